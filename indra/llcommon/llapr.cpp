@@ -759,3 +759,107 @@ bool LLAPRFile::removeDir(const std::string& dirname, LLVolatileAPRPool* pool)
 //end of static components of LLAPRFile
 //*******************************************************************************************************************************
 //
+
+//*******************************************************************************************************************************
+//LLAPRMappedFile
+//
+LLAPRMappedFile::LLAPRMappedFile()
+	: mFile(NULL),
+	  mMap(NULL),
+	  mData(NULL),
+	  mSize(0),
+	  mReadOnly(false)
+{
+}
+
+LLAPRMappedFile::~LLAPRMappedFile()
+{
+	close() ;
+}
+
+bool LLAPRMappedFile::open(const std::string& filename, S64 size, bool readonly)
+{
+	llassert_always(!mFile) ;
+
+	apr_int32_t flags = readonly ? APR_READ|APR_BINARY : APR_READ|APR_WRITE|APR_CREATE|APR_BINARY ;
+	apr_status_t s = apr_file_open(&mFile, filename.c_str(), flags, APR_OS_DEFAULT, mPool.getAPRPool());
+	if (s != APR_SUCCESS || !mFile)
+	{
+		ll_apr_warn_status(s);
+		LL_WARNS("APR") << " Attempting to open filename: " << filename << LL_ENDL;
+		mFile = NULL ;
+		close() ;
+		return false ;
+	}
+
+	apr_finfo_t info ;
+	s = apr_file_info_get(&info, APR_FINFO_SIZE, mFile) ;
+	S64 file_size = (s == APR_SUCCESS) ? (S64)info.size : 0 ;
+	if (readonly)
+	{
+		size = file_size ;
+	}
+	else if (file_size < size)
+	{
+		s = apr_file_trunc(mFile, (apr_off_t)size) ; //grows the file
+		if (s != APR_SUCCESS)
+		{
+			ll_apr_warn_status(s);
+			LL_WARNS("APR") << " Attempting to resize " << filename << " to " << size << " bytes" << LL_ENDL;
+			close() ;
+			return false ;
+		}
+	}
+	else
+	{
+		size = file_size ;
+	}
+
+	if (size <= 0 || (S64)(apr_size_t)size != size)
+	{
+		LL_WARNS("APR") << " Can not map " << size << " bytes of " << filename << LL_ENDL;
+		close() ;
+		return false ;
+	}
+
+	apr_int32_t mmap_flags = readonly ? APR_MMAP_READ : APR_MMAP_READ|APR_MMAP_WRITE ;
+	s = apr_mmap_create(&mMap, mFile, 0, (apr_size_t)size, mmap_flags, mPool.getAPRPool()) ;
+	if (s != APR_SUCCESS || !mMap)
+	{
+		ll_apr_warn_status(s);
+		LL_WARNS("APR") << " Attempting to map " << size << " bytes of " << filename << LL_ENDL;
+		mMap = NULL ;
+		close() ;
+		return false ;
+	}
+
+	mData = (U8*)mMap->mm ;
+	mSize = size ;
+	mReadOnly = readonly ;
+	return true ;
+}
+
+void LLAPRMappedFile::close()
+{
+	if (mMap)
+	{
+		apr_mmap_delete(mMap) ;
+		mMap = NULL ;
+	}
+	if (mFile)
+	{
+		apr_file_close(mFile) ;
+		mFile = NULL ;
+	}
+	if (mPool.getAPRPool())
+	{
+		apr_pool_clear(mPool.getAPRPool()) ;
+	}
+	mData = NULL ;
+	mSize = 0 ;
+	mReadOnly = false ;
+}
+//
+//end of LLAPRMappedFile
+//*******************************************************************************************************************************
+//
@@ -48,6 +48,7 @@
 #include "apr_getopt.h"
 #include "apr_signal.h"
 #include "apr_atomic.h"
+#include "apr_mmap.h"
 #include "llstring.h"
 
 extern LL_COMMON_API apr_thread_mutex_t* gLogMutexp;
@@ -253,6 +254,39 @@ public:
 //*******************************************************************************************************************************
 };
 
+//
+//LLAPRMappedFile
+//a file mapped read/write into memory for as long as it stays open.
+//the file is created or grown to the requested size, never shrunk.
+//writes go to the page cache and reach the disk when the OS flushes them,
+//so a crash of the process does not lose them but a crash of the machine may.
+//
+class LL_COMMON_API LLAPRMappedFile : boost::noncopyable
+{
+public:
+	LLAPRMappedFile() ;
+	~LLAPRMappedFile() ;
+
+	// Maps at least size bytes of filename, or the whole file if it is bigger.
+	// A readonly mapping never creates or grows the file.
+	// Returns false if the file could not be opened or mapped.
+	bool open(const std::string& filename, S64 size, bool readonly = false) ;
+	void close() ;
+
+	bool isOpen() const { return mData != NULL ; }
+	bool isReadOnly() const { return mReadOnly ; }
+	U8*  getData() const { return mData ; }
+	S64  getSize() const { return mSize ; }
+
+private:
+	LLAPRPool   mPool ; //owns the file and the mapping, cleared on close()
+	apr_file_t* mFile ;
+	apr_mmap_t* mMap ;
+	U8*         mData ;
+	S64         mSize ;
+	bool        mReadOnly ;
+};
+
 /**
  * @brief Function which appropriately logs error or remains quiet on
  * APR_SUCCESS.
@@ -0,0 +1,370 @@
+/**
+ * @file llflathashmap.h
+ * @brief Open addressing hash map that keeps its entries in one flat array
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLFLATHASHMAP_H
+#define LL_LLFLATHASHMAP_H
+
+#include <cstring>
+#include <utility>
+
+#include "stdtypes.h"
+#include "lluuid.h"
+
+// Final mix of MurmurHash3, spreads every input bit over the whole result
+inline U32 ll_flat_hash_mix(U32 h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+// Hashes for LLFlatHashMap keys, specialize for new key types
+template <class KEY>
+struct LLFlatHash;
+
+template <>
+struct LLFlatHash<LLUUID>
+{
+	U32 operator()(const LLUUID& id) const	{ return ll_flat_hash_mix(id.getCRC32()); }
+};
+
+// Also (region or host index << 32) | local id
+template <>
+struct LLFlatHash<U64>
+{
+	U32 operator()(U64 key) const	{ return ll_flat_hash_mix((U32)key ^ ll_flat_hash_mix((U32)(key >> 32))); }
+};
+
+template <>
+struct LLFlatHash<U32>
+{
+	U32 operator()(U32 key) const	{ return ll_flat_hash_mix(key); }
+};
+
+// Hash map with the std::map interface most callers use, for lookup heavy
+// tables.  Entries sit in one array and are found by linear probing, with
+// a parallel array of one control byte per slot holding 7 bits of the
+// entry's hash, so most probes never touch a key that doesn't match.
+//
+// Unlike std::map:
+// - iteration order is arbitrary;
+// - insert() and operator[] may rehash, which invalidates all iterators;
+// - erase() never moves other entries, so erasing while iterating is fine,
+//   and the erased iterator can still be incremented;
+// - keys are only compared with ==, and iterators let you write the key,
+//   don't.
+// The table is at most 3/4 full, counting erased slots, and grows to at
+// most half full, so probes stay short.
+template <class KEY, class VALUE, class HASH = LLFlatHash<KEY> >
+class LLFlatHashMap
+{
+public:
+	typedef KEY key_type;
+	typedef VALUE mapped_type;
+	typedef std::pair<KEY, VALUE> value_type;
+	typedef size_t size_type;
+
+	template <class MAP_PTR, class REF, class PTR>
+	class iter_t
+	{
+	public:
+		iter_t() : mMap(NULL), mSlot(0) {}
+		iter_t(MAP_PTR map, U32 slot) : mMap(map), mSlot(slot) {}
+		// iterator to const_iterator
+		template <class M, class R, class P>
+		iter_t(const iter_t<M, R, P>& other) : mMap(other.mMap), mSlot(other.mSlot) {}
+
+		REF operator*() const	{ return mMap->mEntries[mSlot]; }
+		PTR operator->() const	{ return &mMap->mEntries[mSlot]; }
+		iter_t& operator++()	{ mSlot = mMap->nextFull(mSlot + 1); return *this; }
+		iter_t operator++(int)	{ iter_t tmp(*this); ++*this; return tmp; }
+		bool operator==(const iter_t& rhs) const	{ return mSlot == rhs.mSlot; }
+		bool operator!=(const iter_t& rhs) const	{ return mSlot != rhs.mSlot; }
+
+		// Position in the table, for resuming a sweep with fromSlot()
+		U32 getSlot() const		{ return mSlot; }
+
+	private:
+		template <class M, class R, class P> friend class iter_t;
+		MAP_PTR mMap;
+		U32 mSlot;
+	};
+	typedef iter_t<LLFlatHashMap*, value_type&, value_type*> iterator;
+	typedef iter_t<const LLFlatHashMap*, const value_type&, const value_type*> const_iterator;
+
+	LLFlatHashMap()
+	:	mControl(NULL),
+		mEntries(NULL),
+		mCapacity(0),
+		mSize(0),
+		mDeleted(0)
+	{
+	}
+
+	LLFlatHashMap(const LLFlatHashMap& other)
+	:	mControl(NULL),
+		mEntries(NULL),
+		mCapacity(0),
+		mSize(0),
+		mDeleted(0)
+	{
+		*this = other;
+	}
+
+	~LLFlatHashMap()
+	{
+		delete[] mControl;
+		delete[] mEntries;
+	}
+
+	LLFlatHashMap& operator=(const LLFlatHashMap& other)
+	{
+		if (this != &other)
+		{
+			clear();
+			reserve(other.size());
+			for (const_iterator iter = other.begin(); iter != other.end(); ++iter)
+			{
+				insert(*iter);
+			}
+		}
+		return *this;
+	}
+
+	iterator begin()				{ return iterator(this, nextFull(0)); }
+	iterator end()					{ return iterator(this, mCapacity); }
+	const_iterator begin() const	{ return const_iterator(this, nextFull(0)); }
+	const_iterator end() const		{ return const_iterator(this, mCapacity); }
+
+	// First entry at or after slot, for sweeping through the map a few
+	// entries at a time: end() once past the last one.
+	iterator fromSlot(U32 slot)		{ return iterator(this, nextFull(slot)); }
+
+	size_type size() const			{ return mSize; }
+	bool empty() const				{ return mSize == 0; }
+
+	iterator find(const KEY& key)				{ return iterator(this, findSlot(key)); }
+	const_iterator find(const KEY& key) const	{ return const_iterator(this, findSlot(key)); }
+	size_type count(const KEY& key) const		{ return findSlot(key) != mCapacity ? 1 : 0; }
+
+	VALUE& operator[](const KEY& key)
+	{
+		// Not mEntries[insertKey(key).first], insertKey() may reallocate it
+		U32 slot = insertKey(key).first;
+		return mEntries[slot].second;
+	}
+
+	std::pair<iterator, bool> insert(const value_type& entry)
+	{
+		std::pair<U32, bool> result = insertKey(entry.first);
+		if (result.second)
+		{
+			mEntries[result.first].second = entry.second;
+		}
+		return std::make_pair(iterator(this, result.first), result.second);
+	}
+
+	size_type erase(const KEY& key)
+	{
+		U32 slot = findSlot(key);
+		if (slot == mCapacity)
+		{
+			return 0;
+		}
+		eraseSlot(slot);
+		return 1;
+	}
+
+	void erase(iterator iter)
+	{
+		eraseSlot(iter.getSlot());
+	}
+
+	// Keeps the table's memory
+	void clear()
+	{
+		for (U32 slot = 0; slot < mCapacity; slot++)
+		{
+			if (mControl[slot] & FULL)
+			{
+				mEntries[slot] = value_type();
+			}
+			mControl[slot] = EMPTY;
+		}
+		mSize = 0;
+		mDeleted = 0;
+	}
+
+	// Makes room for count entries without rehashing
+	void reserve(size_type count)
+	{
+		if ((count + mDeleted) * 4 > (size_type)mCapacity * 3)
+		{
+			rehash((U32)count);
+		}
+	}
+
+private:
+	enum
+	{
+		EMPTY = 0,
+		DELETED = 1,
+		FULL = 0x80,	// | the top 7 bits of the hash
+		MIN_CAPACITY = 16
+	};
+
+	U32 nextFull(U32 slot) const
+	{
+		while (slot < mCapacity && !(mControl[slot] & FULL))
+		{
+			slot++;
+		}
+		return slot;
+	}
+
+	// mCapacity if not there
+	U32 findSlot(const KEY& key) const
+	{
+		if (!mSize)
+		{
+			return mCapacity;
+		}
+		U32 hash = mHash(key);
+		U8 tag = (U8)(FULL | (hash >> 25));
+		U32 mask = mCapacity - 1;
+		// There's always an empty slot to stop at
+		for (U32 slot = hash & mask; ; slot = (slot + 1) & mask)
+		{
+			U8 control = mControl[slot];
+			if (control == tag && mEntries[slot].first == key)
+			{
+				return slot;
+			}
+			if (control == EMPTY)
+			{
+				return mCapacity;
+			}
+		}
+	}
+
+	// Returns the key's slot, and whether it was just added
+	std::pair<U32, bool> insertKey(const KEY& key)
+	{
+		U32 slot = findSlot(key);
+		if (slot != mCapacity)
+		{
+			return std::make_pair(slot, false);
+		}
+		if ((mSize + mDeleted + 1) * 4 > mCapacity * 3)
+		{
+			rehash(mSize + 1);
+		}
+		U32 hash = mHash(key);
+		slot = freeSlot(hash);
+		if (mControl[slot] == DELETED)
+		{
+			mDeleted--;
+		}
+		mControl[slot] = (U8)(FULL | (hash >> 25));
+		mEntries[slot].first = key;
+		mSize++;
+		return std::make_pair(slot, true);
+	}
+
+	// First slot on the hash's probe sequence that isn't in use
+	U32 freeSlot(U32 hash) const
+	{
+		U32 mask = mCapacity - 1;
+		U32 slot = hash & mask;
+		while (mControl[slot] & FULL)
+		{
+			slot = (slot + 1) & mask;
+		}
+		return slot;
+	}
+
+	void eraseSlot(U32 slot)
+	{
+		mEntries[slot] = value_type();
+		mSize--;
+		// No probe goes on past an empty slot, so if the next one is empty
+		// nothing needs to pass through this one either
+		if (mControl[(slot + 1) & (mCapacity - 1)] == EMPTY)
+		{
+			mControl[slot] = EMPTY;
+		}
+		else
+		{
+			mControl[slot] = DELETED;
+			mDeleted++;
+		}
+	}
+
+	// Rebuilds the table at most half full with room for count entries,
+	// dropping erased slots
+	void rehash(U32 count)
+	{
+		U32 capacity = MIN_CAPACITY;
+		while (capacity < count * 2)
+		{
+			capacity *= 2;
+		}
+
+		U8* old_control = mControl;
+		value_type* old_entries = mEntries;
+		U32 old_capacity = mCapacity;
+
+		mControl = new U8[capacity];
+		memset(mControl, EMPTY, capacity);
+		mEntries = new value_type[capacity];
+		mCapacity = capacity;
+		mDeleted = 0;
+
+		for (U32 i = 0; i < old_capacity; i++)
+		{
+			if (old_control[i] & FULL)
+			{
+				U32 slot = freeSlot(mHash(old_entries[i].first));
+				mControl[slot] = old_control[i];
+				mEntries[slot] = old_entries[i];
+			}
+		}
+		delete[] old_control;
+		delete[] old_entries;
+	}
+
+	U8* mControl;			// EMPTY, DELETED or the tag of the entry there
+	value_type* mEntries;
+	U32 mCapacity;			// 0 or a power of 2
+	U32 mSize;
+	U32 mDeleted;
+	HASH mHash;
+};
+
+#endif // LL_LLFLATHASHMAP_H
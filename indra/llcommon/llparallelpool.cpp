@@ -0,0 +1,202 @@
+/**
+ * @file llparallelpool.cpp
+ * @brief Spreads the independent pieces of one job over the calling thread
+ * and a pool of helper threads
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llparallelpool.h"
+
+#include "llpointer.h"
+#include "llqueuedthread.h"
+#include "llthread.h"
+
+namespace
+{
+	// One run() call.  The calling thread and every pool request it
+	// posted take job indices until none are left.  Whoever finishes the
+	// last index signals done_condition.
+	class LLParallelBatch : public LLThreadSafeRefCount
+	{
+	public:
+		LLParallelBatch(LLParallelPool::Job* job, S32 count, LLCondition* done_condition)
+			: mJob(job), mCount(count), mNext(0), mDone(0), mDoneCondition(done_condition)
+		{
+		}
+
+		void run()
+		{
+			S32 index;
+			while ((index = mNext++) < mCount)
+			{
+				mJob->run(index);
+				if (mDone++ == mCount - 1)
+				{
+					mDoneCondition->lock();
+					mDoneCondition->signal();
+					mDoneCondition->unlock();
+				}
+			}
+		}
+
+		// Blocks until every index has finished
+		void wait()
+		{
+			mDoneCondition->lock();
+			while (mDone < mCount)
+			{
+				mDoneCondition->wait();
+			}
+			mDoneCondition->unlock();
+		}
+
+	private:
+		// Only valid until wait() returns, mJob belongs to the caller
+		LLParallelPool::Job* mJob;
+		S32 mCount;
+		LLAtomicS32 mNext;
+		LLAtomicS32 mDone;
+		LLCondition* mDoneCondition;
+	};
+}
+
+class LLParallelPoolThreads : public LLQueuedThread
+{
+public:
+	class BatchRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		/*virtual*/ ~BatchRequest() {}
+
+	public:
+		BatchRequest(handle_t handle, LLParallelBatch* batch)
+			: LLQueuedThread::QueuedRequest(handle, PRIORITY_NORMAL, FLAG_AUTO_COMPLETE),
+			  mBatch(batch)
+		{
+		}
+
+		/*virtual*/ bool processRequest()
+		{
+			mBatch->run();
+			return true;
+		}
+
+	private:
+		LLPointer<LLParallelBatch> mBatch;
+	};
+
+	LLParallelPoolThreads(const std::string& name, S32 threads)
+		: LLQueuedThread(name, true, false, threads),
+		  mBusy(0)
+	{
+	}
+
+	// FALSE if another run() has the pool
+	bool acquire()
+	{
+		if (mBusy++ != 0)
+		{
+			mBusy--;
+			return false;
+		}
+		return true;
+	}
+
+	void release()
+	{
+		mBusy--;
+	}
+
+	void post(LLParallelBatch* batch, S32 count)
+	{
+		for (S32 i = 0; i < count; i++)
+		{
+			addRequest(new BatchRequest(generateHandle(), batch));
+		}
+	}
+
+private:
+	LLAtomicS32 mBusy;
+};
+
+//----------------------------------------------------------------------------
+
+LLParallelPool::LLParallelPool(const std::string& name, S32 threads)
+	: mThreads(NULL),
+	  mDoneCondition(NULL),
+	  mThreadCount(llclamp(threads, 0, (S32)LLQueuedThread::MAX_POOL_SIZE))
+{
+	if (mThreadCount > 0)
+	{
+		mThreads = new LLParallelPoolThreads(name, mThreadCount);
+		mDoneCondition = new LLCondition(NULL);
+	}
+}
+
+LLParallelPool::~LLParallelPool()
+{
+	// Stops the threads first, the last of them may still be signalling
+	delete mThreads;
+	delete mDoneCondition;
+}
+
+void LLParallelPool::run(Job& job, S32 count)
+{
+	// When another thread's batch is using the helpers this one could
+	// only queue up behind it, so it is no slower to run it here
+	if (!mThreads || count < 2 || !mThreads->acquire())
+	{
+		for (S32 i = 0; i < count; i++)
+		{
+			job.run(i);
+		}
+		return;
+	}
+
+	LLPointer<LLParallelBatch> batch = new LLParallelBatch(&job, count, mDoneCondition);
+	mThreads->post(batch, llmin(count - 1, mThreadCount));
+	batch->run();
+	// Sleep while the pool finishes the last indices.  Only the batch
+	// holding the pool uses mDoneCondition, a stale signal from the one
+	// before just wakes wait() to check again.
+	batch->wait();
+	mThreads->release();
+}
+
+//static
+void LLParallelPool::run(LLParallelPool* pool, Job& job, S32 count)
+{
+	if (pool)
+	{
+		pool->run(job, count);
+	}
+	else
+	{
+		for (S32 i = 0; i < count; i++)
+		{
+			job.run(i);
+		}
+	}
+}
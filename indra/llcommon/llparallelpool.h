@@ -0,0 +1,70 @@
+/**
+ * @file llparallelpool.h
+ * @brief Spreads the independent pieces of one job over the calling thread
+ * and a pool of helper threads
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPARALLELPOOL_H
+#define LL_LLPARALLELPOOL_H
+
+#include <string>
+
+class LLCondition;
+class LLParallelPoolThreads;
+
+// Fork-join helper: run() hands out job indices to the calling thread and
+// up to getThreadCount() pool threads, and returns once all of them are
+// done.  The caller always takes part, so a busy pool only costs
+// parallelism, and a pool of 0 threads runs everything in place.
+// The pool serves one run() at a time.  A run() from another thread, or
+// from inside a job, while it is busy runs its job in place.
+class LL_COMMON_API LLParallelPool
+{
+public:
+	class Job
+	{
+	public:
+		virtual ~Job() {}
+		virtual void run(S32 index) = 0; // any thread
+	};
+
+	LLParallelPool(const std::string& name, S32 threads);
+	~LLParallelPool();
+
+	// Runs job.run(0) .. job.run(count - 1), in no particular order.
+	// Any thread.
+	void run(Job& job, S32 count);
+
+	S32 getThreadCount() const	{ return mThreadCount; }
+
+	// run() on pool, or in place if pool is NULL
+	static void run(LLParallelPool* pool, Job& job, S32 count);
+
+private:
+	LLParallelPoolThreads* mThreads;
+	LLCondition* mDoneCondition;
+	S32 mThreadCount;
+};
+
+#endif // LL_LLPARALLELPOOL_H
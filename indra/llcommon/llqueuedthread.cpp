@@ -26,19 +26,98 @@
 #include "linden_common.h"
 #include "llqueuedthread.h"
 
+#include <algorithm>
+
 #include "llstl.h"
 #include "lltimer.h"	// ms_sleep()
 
 //============================================================================
 
+// One of the pool_size - 1 helper threads of a pooled LLQueuedThread.
+// It only runs requests; everything else stays on the owner's thread.
+class LLQueuedThread::PoolThread : public LLThread
+{
+public:
+	PoolThread(const std::string& name, LLQueuedThread* owner, S32 index) :
+		LLThread(name),
+		mOwner(owner),
+		mIndex(index),
+		mThreadID(0)
+	{
+		mLocalAPRFilePoolp = new LLVolatileAPRPool();
+	}
+
+	U32 getThreadID() const { return mThreadID; }
+
+private:
+	/*virtual*/ bool runCondition()
+	{
+		// mRunCondition must be locked here
+		return !mOwner->isPaused() && mOwner->mQueuedCount > 0;
+	}
+
+	/*virtual*/ void run()
+	{
+		mThreadID = LLThread::currentID();
+		while (1)
+		{
+			checkPause();
+			if (isQuitting() || mOwner->isQuitting())
+			{
+				break;
+			}
+			if (mOwner->processNextPoolRequest(mIndex) > 0)
+			{
+				// Lost a race for the only request left, don't spin on it
+				LLThread::yield();
+			}
+		}
+		llinfos << "LLQueuedThread " << mName << " EXITING." << llendl;
+	}
+
+	LLQueuedThread* mOwner;
+	S32 mIndex;
+	U32 mThreadID;
+};
+
+//============================================================================
+
 // MAIN THREAD
-LLQueuedThread::LLQueuedThread(const std::string& name, bool threaded) :
+LLQueuedThread::LLQueuedThread(const std::string& name, bool threaded, bool concurrent_queue, S32 pool_size) :
 	LLThread(name),
 	mThreaded(threaded),
 	mIdleThread(TRUE),
 	mNextHandle(0),
-	mStarted(FALSE)
+	mStarted(FALSE),
+	mConcurrentQueue(concurrent_queue),
+	mQueuedCount(0),
+	mNextPoolQueue(0),
+	mPoolSteals(0)
 {
+	pool_size = llclamp(pool_size, 1, (S32)MAX_POOL_SIZE);
+	if (mThreaded && pool_size > 1)
+	{
+		if (mConcurrentQueue)
+		{
+			llwarns << "LLQueuedThread " << mName << " uses a pool of " << pool_size
+					<< " threads, ignoring the concurrent queue" << llendl;
+			mConcurrentQueue = false;
+		}
+		for (S32 i = 0; i < pool_size; i++)
+		{
+			PoolQueue* queue = new PoolQueue;
+			queue->mMutex = new LLMutex(NULL);
+			queue->mTopKey = 0;
+			mPoolQueues.push_back(queue);
+		}
+		for (S32 i = 1; i < pool_size; i++)
+		{
+			PoolThread* thread = new PoolThread(llformat("%s %d", mName.c_str(), i), this, i);
+			mPoolThreads.push_back(thread);
+			thread->start();
+		}
+	}
+
 	if (mThreaded)
 	{
 		start();
@@ -53,6 +132,12 @@ LLQueuedThread::~LLQueuedThread()
 		endThread();
 	}
 	shutdown();
+	for (std::vector<PoolQueue*>::iterator iter = mPoolQueues.begin(); iter != mPoolQueues.end(); ++iter)
+	{
+		delete (*iter)->mMutex;
+		delete *iter;
+	}
+	mPoolQueues.clear();
 	// ~LLThread() will be called here
 }
 
@@ -83,6 +168,10 @@ void LLQueuedThread::shutdown()
 		mStatus = STOPPED;
 	}
 
+	// Waits for each helper to leave its current request
+	for_each(mPoolThreads.begin(), mPoolThreads.end(), DeletePointer());
+	mPoolThreads.clear();
+
 	QueuedRequest* req;
 	S32 active_count = 0;
 	while ( (req = (QueuedRequest*)mRequestHash.pop_element()) )
@@ -98,6 +187,17 @@ void LLQueuedThread::shutdown()
 	{
 		llwarns << "~LLQueuedThread() called with active requests: " << active_count << llendl;
 	}
+
+	// Anything left in the inbox was deleted above
+	mInbox.clear();
+	mInboxTaken.clear();
+	mRequestQueue.clear();
+	for (std::vector<PoolQueue*>::iterator iter = mPoolQueues.begin(); iter != mPoolQueues.end(); ++iter)
+	{
+		(*iter)->mQueue.clear();
+		(*iter)->mTopKey = 0;
+	}
+	mQueuedCount = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -130,6 +230,11 @@ S32 LLQueuedThread::updateQueue(U32 max_time_ms)
 		if(pending > 0)
 		{
 		unpause();
+			// Also picks up helpers that slept through a pause
+			for (S32 i = 1; i < (S32)mPoolQueues.size(); i++)
+			{
+				wakePoolThread(i);
+			}
 	}
 	}
 	else
@@ -160,6 +265,11 @@ void LLQueuedThread::incQueue()
 // May be called from any thread
 S32 LLQueuedThread::getPending()
 {
+	if (mConcurrentQueue || !mPoolQueues.empty())
+	{
+		return mQueuedCount;
+	}
+
 	S32 res;
 	lockData();
 	res = mRequestQueue.size();
@@ -189,6 +299,28 @@ void LLQueuedThread::waitOnPending()
 // MAIN thread
 void LLQueuedThread::printQueueStats()
 {
+	if (!mPoolQueues.empty())
+	{
+		S32 pending = mQueuedCount;
+		llinfos << llformat("Pending Requests:%d Pool Threads:%d Steals:%u",
+							pending, getPoolSize(), (U32)mPoolSteals) << llendl;
+		return;
+	}
+	if (mConcurrentQueue)
+	{
+		// The queue itself belongs to the worker
+		S32 pending = mQueuedCount;
+		if (pending)
+		{
+			llinfos << llformat("Pending Requests:%d", pending) << llendl;
+		}
+		else
+		{
+			llinfos << "Queued Thread Idle" << llendl;
+		}
+		return;
+	}
+
 	lockData();
 	if (!mRequestQueue.empty())
 	{
@@ -223,16 +355,35 @@ bool LLQueuedThread::addRequest(QueuedRequest* req)
 		return false;
 	}
 	
+	S32 pool_index = 0;
 	lockData();
 	req->setStatus(STATUS_QUEUED);
-	mRequestQueue.insert(req);
+	if (mConcurrentQueue)
+	{
+		req->mRequestedPriority = req->getPriority();
+		mQueuedCount++;
+		postRequest(req);
+	}
+	else if (!mPoolQueues.empty())
+	{
+		pool_index = mNextPoolQueue++ % mPoolQueues.size();
+		PoolQueue* queue = mPoolQueues[pool_index];
+		mQueuedCount++;
+		queue->mMutex->lock();
+		insertPoolRequest(pool_index, req);
+		queue->mMutex->unlock();
+	}
+	else
+	{
+		mRequestQueue.insert(req);
+	}
 	mRequestHash.insert(req);
 #if _DEBUG
 // 	llinfos << llformat("LLQueuedThread::Added req [%08d]",handle) << llendl;
 #endif
 	unlockData();
 
-	incQueue();
+	wakePoolThread(pool_index);
 
 	return true;
 }
@@ -331,7 +482,33 @@ void LLQueuedThread::setPriority(handle_t handle, U32 priority)
 {
 	lockData();
 	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
-	if (req)
+	if (req && mConcurrentQueue)
+	{
+		// Applied lazily by the worker, see drainInbox()
+		req->mRequestedPriority = priority;
+		if (req->getStatus() == STATUS_QUEUED)
+		{
+			postRequest(req);
+		}
+	}
+	else if (req && !mPoolQueues.empty())
+	{
+		// The status can only leave STATUS_QUEUED under the queue mutex
+		PoolQueue* queue = mPoolQueues[req->mPoolIndex];
+		queue->mMutex->lock();
+		if (req->getStatus() == STATUS_QUEUED)
+		{
+			llverify(queue->mQueue.erase(req) == 1);
+			req->setPriority(priority);
+			insertPoolRequest(req->mPoolIndex, req);
+		}
+		else
+		{
+			req->setPriority(priority);
+		}
+		queue->mMutex->unlock();
+	}
+	else if (req)
 	{
 		if(req->getStatus() == STATUS_INPROGRESS)
 		{
@@ -395,6 +572,15 @@ bool LLQueuedThread::check()
 
 S32 LLQueuedThread::processNextRequest()
 {
+	if (mConcurrentQueue)
+	{
+		return processNextRequestConcurrent();
+	}
+	if (!mPoolQueues.empty())
+	{
+		return processNextPoolRequest(0);
+	}
+
 	QueuedRequest *req;
 	// Get next request from pool
 	lockData();
@@ -469,10 +655,311 @@ S32 LLQueuedThread::processNextRequest()
 	return pending;
 }
 
+//============================================================================
+// Concurrent queue
+//
+// Producers (addRequest() and setPriority(), under the data lock as they
+// also touch mRequestHash) add a request to the inbox at most once,
+// however often it is reprioritized.  The worker takes the whole inbox
+// under the data lock and sorts it into mRequestQueue, which only it
+// touches, without it, so picking the next request never waits on a
+// producer.  The worker takes the data lock to requeue a request and to
+// finish one, and takes it out of the inbox first if it was posted again,
+// so a request is never deleted while the inbox holds it.
+
+// Data lock must be held
+void LLQueuedThread::postRequest(QueuedRequest* req)
+{
+	if (!req->mInInbox)
+	{
+		req->mInInbox = true;
+		mInbox.push_back(req);
+	}
+}
+
+// WORKER THREAD
+void LLQueuedThread::drainInbox()
+{
+	lockData();
+	mInboxTaken.swap(mInbox);
+	for (std::vector<QueuedRequest*>::iterator iter = mInboxTaken.begin(); iter != mInboxTaken.end(); ++iter)
+	{
+		// A change posted after this point adds the request again
+		(*iter)->mInInbox = false;
+	}
+	unlockData();
+
+	// Only this thread finishes, and so deletes, requests
+	for (std::vector<QueuedRequest*>::iterator iter = mInboxTaken.begin(); iter != mInboxTaken.end(); ++iter)
+	{
+		QueuedRequest* req = *iter;
+		if (req->getStatus() != STATUS_QUEUED)
+		{
+			// In progress, the priority is applied if it gets requeued
+			continue;
+		}
+		U32 priority = req->mRequestedPriority;
+		if (req->mInQueue)
+		{
+			if (priority == req->getPriority())
+			{
+				continue;
+			}
+			llverify(mRequestQueue.erase(req) == 1);
+		}
+		req->setPriority(priority);
+		mRequestQueue.insert(req);
+		req->mInQueue = true;
+	}
+	mInboxTaken.clear();
+}
+
+// WORKER THREAD
+void LLQueuedThread::queueRequest(QueuedRequest* req)
+{
+	lockData();
+	req->setPriority(req->mRequestedPriority);
+	req->setStatus(STATUS_QUEUED);
+	mQueuedCount++;
+	unlockData();
+
+	mRequestQueue.insert(req);
+	req->mInQueue = true;
+}
+
+// WORKER THREAD
+void LLQueuedThread::finishDequeued(QueuedRequest* req, status_t status, bool completed)
+{
+	lockData();
+	req->setStatus(status);
+	if (req->mInInbox)
+	{
+		// Posted again by setPriority() after we took it
+		mInbox.erase(std::find(mInbox.begin(), mInbox.end(), req));
+		req->mInInbox = false;
+	}
+	req->finishRequest(completed);
+	if (req->getFlags() & FLAG_AUTO_COMPLETE)
+	{
+		mRequestHash.erase(req);
+		req->deleteRequest();
+	}
+	unlockData();
+}
+
+// WORKER THREAD
+S32 LLQueuedThread::processNextRequestConcurrent()
+{
+	drainInbox();
+
+	QueuedRequest *req = NULL;
+	while (!mRequestQueue.empty())
+	{
+		req = *mRequestQueue.begin();
+		mRequestQueue.erase(mRequestQueue.begin());
+		req->mInQueue = false;
+		mQueuedCount--;
+		if ((req->getFlags() & FLAG_ABORT) || (mStatus == QUITTING))
+		{
+			finishDequeued(req, STATUS_ABORTED, false);
+			req = NULL;
+			continue;
+		}
+		llassert_always(req->getStatus() == STATUS_QUEUED);
+		break;
+	}
+
+	if (req)
+	{
+		U32 start_priority = req->getPriority();
+		req->setStatus(STATUS_INPROGRESS);
+
+		if (req->processRequest())
+		{
+			finishDequeued(req, STATUS_COMPLETE, true);
+		}
+		else
+		{
+			queueRequest(req);
+			if (mThreaded && start_priority < PRIORITY_NORMAL)
+			{
+				ms_sleep(1); // sleep the thread a little
+			}
+		}
+	}
+
+	return mQueuedCount;
+}
+
+//============================================================================
+// Thread pool
+//
+// Lock order is data lock -> pool queue mutex.  A pool thread only takes
+// its queue mutex to pop a request, and the data lock to finish or requeue
+// one, as processNextRequest() does.
+
+// Pool queue mutex must be held
+void LLQueuedThread::insertPoolRequest(S32 index, QueuedRequest* req)
+{
+	PoolQueue* queue = mPoolQueues[index];
+	req->mPoolIndex = index;
+	queue->mQueue.insert(req);
+	queue->mTopKey = (*queue->mQueue.begin())->getPriority() + 1;
+}
+
+// ANY THREAD
+void LLQueuedThread::wakePoolThread(S32 index)
+{
+	if (index == 0)
+	{
+		incQueue();
+	}
+	else if (!isPaused())
+	{
+		mPoolThreads[index - 1]->wake();
+	}
+}
+
+// POOL THREAD
+LLQueuedThread::QueuedRequest* LLQueuedThread::takePoolRequest(S32 index)
+{
+	// Find the queue with the best request at its front, preferring our
+	// own.  The published keys are read without locking; if another thread
+	// beats us to that request we take whatever replaced it, or nothing.
+	S32 count = (S32)mPoolQueues.size();
+	S32 best = index;
+	U32 best_key = mPoolQueues[index]->mTopKey;
+	for (S32 i = 1; i < count; i++)
+	{
+		S32 victim = (index + i) % count;
+		U32 key = mPoolQueues[victim]->mTopKey;
+		if (key > best_key)
+		{
+			best = victim;
+			best_key = key;
+		}
+	}
+	if (best_key == 0)
+	{
+		return NULL;
+	}
+
+	QueuedRequest* req = NULL;
+	PoolQueue* queue = mPoolQueues[best];
+	queue->mMutex->lock();
+	if (!queue->mQueue.empty())
+	{
+		req = *queue->mQueue.begin();
+		queue->mQueue.erase(queue->mQueue.begin());
+		queue->mTopKey = queue->mQueue.empty() ? 0 : (*queue->mQueue.begin())->getPriority() + 1;
+		llassert_always(req->getStatus() == STATUS_QUEUED);
+		req->setStatus(STATUS_INPROGRESS);
+	}
+	queue->mMutex->unlock();
+
+	if (req)
+	{
+		mQueuedCount--;
+		if (best != index)
+		{
+			mPoolSteals++;
+		}
+	}
+	return req;
+}
+
+// POOL THREAD
+S32 LLQueuedThread::processNextPoolRequest(S32 index)
+{
+	QueuedRequest* req;
+	while ((req = takePoolRequest(index)))
+	{
+		if ((req->getFlags() & FLAG_ABORT) || (mStatus == QUITTING))
+		{
+			lockData();
+			req->setStatus(STATUS_ABORTED);
+			req->finishRequest(false);
+			if (req->getFlags() & FLAG_AUTO_COMPLETE)
+			{
+				mRequestHash.erase(req);
+				req->deleteRequest();
+			}
+			unlockData();
+			continue;
+		}
+		break;
+	}
+
+	if (req)
+	{
+		if (mQueuedCount > 0)
+		{
+			// More work than we can take, get the next thread going
+			wakePoolThread((index + 1) % mPoolQueues.size());
+		}
+
+		U32 start_priority = req->getPriority();
+		bool complete = req->processRequest();
+
+		lockData();
+		if (complete)
+		{
+			req->setStatus(STATUS_COMPLETE);
+			req->finishRequest(true);
+			if (req->getFlags() & FLAG_AUTO_COMPLETE)
+			{
+				mRequestHash.erase(req);
+				req->deleteRequest();
+			}
+			unlockData();
+		}
+		else
+		{
+			// Requeue on this thread, it has the request's data warm
+			PoolQueue* queue = mPoolQueues[index];
+			mQueuedCount++;
+			queue->mMutex->lock();
+			req->setStatus(STATUS_QUEUED);
+			insertPoolRequest(index, req);
+			queue->mMutex->unlock();
+			unlockData();
+			if (start_priority < PRIORITY_NORMAL)
+			{
+				ms_sleep(1); // sleep the thread a little
+			}
+		}
+	}
+
+	return mQueuedCount;
+}
+
+// virtual
+LLVolatileAPRPool* LLQueuedThread::getLocalAPRFilePool()
+{
+	if (!mPoolThreads.empty())
+	{
+		U32 id = LLThread::currentID();
+		for (std::vector<PoolThread*>::iterator iter = mPoolThreads.begin(); iter != mPoolThreads.end(); ++iter)
+		{
+			if ((*iter)->getThreadID() == id)
+			{
+				return (*iter)->getLocalAPRFilePool();
+			}
+		}
+	}
+	return mLocalAPRFilePoolp;
+}
+
+//============================================================================
+
 // virtual
 bool LLQueuedThread::runCondition()
 {
 	// mRunCondition must be locked here
+	if (mConcurrentQueue || !mPoolQueues.empty())
+	{
+		return !(mQueuedCount == 0 && mIdleThread);
+	}
 	if (mRequestQueue.empty() && mIdleThread)
 		return false;
 	else
@@ -534,7 +1021,11 @@ LLQueuedThread::QueuedRequest::QueuedRequest(LLQueuedThread::handle_t handle, U3
 	LLSimpleHashEntry<LLQueuedThread::handle_t>(handle),
 	mStatus(STATUS_UNKNOWN),
 	mPriority(priority),
-	mFlags(flags)
+	mFlags(flags),
+	mInInbox(false),
+	mRequestedPriority(priority),
+	mInQueue(false),
+	mPoolIndex(0)
 {
 }
 
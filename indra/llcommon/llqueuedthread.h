@@ -31,6 +31,7 @@
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
 
 #include "llapr.h"
 
@@ -73,6 +74,7 @@ public:
 	
 	//------------------------------------------------------------------------
 public:
+	class QueuedRequest;
 
 	class LL_COMMON_API QueuedRequest : public LLSimpleHashEntry<handle_t>
 	{
@@ -131,6 +133,17 @@ public:
 		LLAtomic32<status_t> mStatus;
 		U32 mPriority;
 		U32 mFlags;
+
+		// Concurrent queue only.  mPriority belongs to the worker there,
+		// setPriority() posts mRequestedPriority and the worker applies it
+		// the next time it drains the inbox or requeues the request.
+		bool mInInbox;	// in mInbox, data lock
+		LLAtomicU32 mRequestedPriority;
+		bool mInQueue;	// in mRequestQueue, worker side
+
+		// Thread pool only, the pool queue this request is (or was last) in.
+		// Changed with the data lock and that queue's mutex held.
+		S32 mPoolIndex;
 	};
 
 protected:
@@ -149,15 +162,34 @@ public:
 	static handle_t nullHandle() { return handle_t(0); }
 	
 public:
-	LLQueuedThread(const std::string& name, bool threaded = true);
+	// With concurrent_queue, producers hand requests and priority changes to
+	// the worker through an inbox and the worker keeps the priority queue to
+	// itself, so neither side holds the data lock while the queue is sorted.
+	// The inbox is a plain list under the data lock, which producers hold
+	// anyway for the request hash.
+	//
+	// With pool_size > 1 (threaded only) requests are processed by that many
+	// OS threads, this one and pool_size - 1 helpers.  Each thread has its
+	// own priority queue; new requests are dealt out round robin and a thread
+	// takes the highest priority request at the front of any queue, its own
+	// on a tie, so idle threads steal work and priority order is kept.  A
+	// request is only ever processed by one thread at a time.  startThread(),
+	// endThread() and threadedUpdate() only run on this thread.  The pool
+	// replaces the concurrent queue if both are asked for.
+	LLQueuedThread(const std::string& name, bool threaded = true, bool concurrent_queue = false, S32 pool_size = 1);
 	virtual ~LLQueuedThread();	
 	virtual void shutdown();
+
+	enum { MAX_POOL_SIZE = 16 };
 	
 private:
 	// No copy constructor or copy assignment
 	LLQueuedThread(const LLQueuedThread&);
 	LLQueuedThread& operator=(const LLQueuedThread&);
 
+	class PoolThread;
+	friend class PoolThread;
+
 	virtual bool runCondition(void);
 	virtual void run(void);
 	virtual void startThread(void);
@@ -170,6 +202,19 @@ protected:
 	S32  processNextRequest(void);
 	void incQueue();
 
+	// Concurrent queue
+	S32  processNextRequestConcurrent();
+	void postRequest(QueuedRequest* req);	// data lock must be held
+	void drainInbox();						// worker only, takes the data lock
+	void queueRequest(QueuedRequest* req);	// worker only
+	void finishDequeued(QueuedRequest* req, status_t status, bool completed);	// worker only, takes the data lock
+
+	// Thread pool
+	S32  processNextPoolRequest(S32 index);
+	QueuedRequest* takePoolRequest(S32 index);
+	void insertPoolRequest(S32 index, QueuedRequest* req);	// that queue's mutex must be held
+	void wakePoolThread(S32 index);
+
 public:
 	bool waitForResult(handle_t handle, bool auto_complete = true);
 
@@ -181,6 +226,11 @@ public:
 
 	S32 getPending();
 	bool getThreaded() { return mThreaded ? true : false; }
+	bool getConcurrentQueue() const { return mConcurrentQueue; }
+	S32 getPoolSize() const { return mPoolQueues.empty() ? 1 : (S32)mPoolQueues.size(); }
+
+	// Pool threads each have their own, APR pools are not thread safe.
+	/*virtual*/ LLVolatileAPRPool* getLocalAPRFilePool();
 
 	// Request accessors
 	status_t getRequestStatus(handle_t handle);
@@ -208,6 +258,22 @@ protected:
 	request_hash_t mRequestHash;
 
 	handle_t mNextHandle;
+
+	bool mConcurrentQueue;
+	std::vector<QueuedRequest*> mInbox;		// data lock
+	std::vector<QueuedRequest*> mInboxTaken;	// worker only, what drainInbox() took
+	LLAtomicS32 mQueuedCount;		// requests in STATUS_QUEUED, concurrent queue and pool only
+
+	struct PoolQueue
+	{
+		LLMutex* mMutex;
+		request_queue_t mQueue;
+		LLAtomicU32 mTopKey;	// priority of the front request + 1, 0 when empty
+	};
+	std::vector<PoolQueue*> mPoolQueues;	// [0] belongs to this thread
+	std::vector<PoolThread*> mPoolThreads;	// [i] serves mPoolQueues[i + 1]
+	U32 mNextPoolQueue;						// data lock
+	LLAtomicU32 mPoolSteals;
 };
 
 #endif // LL_LLQUEUEDTHREAD_H
@@ -521,6 +521,23 @@ LLCPUInfo::LLCPUInfo()
 		out << " (" << mCPUMHz << " MHz)";
 	}
 	mCPUString = out.str();
+
+#if LL_WINDOWS
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	mCPUCount = (S32)info.dwNumberOfProcessors;
+#elif LL_DARWIN
+	int count = 0;
+	size_t size = sizeof(count);
+	if (sysctlbyname("hw.ncpu", &count, &size, NULL, 0) != 0)
+	{
+		count = 1;
+	}
+	mCPUCount = count;
+#else
+	mCPUCount = (S32)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	mCPUCount = llmax(mCPUCount, 1);
 }
 
 bool LLCPUInfo::hasAltivec() const
@@ -76,6 +76,8 @@ public:
 	bool hasSSE() const;
 	bool hasSSE2() const;
 	F64 getMHz() const;
+	// Logical processors the OS reports online, at least 1
+	S32 getCPUCount() const { return mCPUCount; }
 
 	// Family is "AMD Duron" or "Intel Pentium Pro"
 	const std::string& getFamily() const { return mFamily; }
@@ -85,6 +87,7 @@ private:
 	bool mHasSSE2;
 	bool mHasAltivec;
 	F64 mCPUMHz;
+	S32 mCPUCount;
 	std::string mFamily;
 	std::string mCPUString;
 };
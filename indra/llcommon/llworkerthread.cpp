@@ -34,8 +34,8 @@
 //============================================================================
 // Run on MAIN thread
 
-LLWorkerThread::LLWorkerThread(const std::string& name, bool threaded) :
-	LLQueuedThread(name, threaded)
+LLWorkerThread::LLWorkerThread(const std::string& name, bool threaded, bool concurrent_queue, S32 pool_size) :
+	LLQueuedThread(name, threaded, concurrent_queue, pool_size)
 {
 	mDeleteMutex = new LLMutex(NULL);
 
@@ -281,7 +281,11 @@ void LLWorkerClass::setWorking(bool working)
 bool LLWorkerClass::yield()
 {
 	LLThread::yield();
-	mWorkerThread->checkPause();
+	if (mWorkerThread->getPoolSize() == 1)
+	{
+		// Pool helpers would wait on the owner's condition, let them run on
+		mWorkerThread->checkPause();
+	}
 	bool res;
 	mMutex.lock();
 	res = (getFlags() & WCF_ABORT_REQUESTED) ? true : false;
@@ -0,0 +1,259 @@
+/**
+ * @file llflathashmap_test.cpp
+ * @brief Tests for LLFlatHashMap, and a lookup benchmark against std::map
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <map>
+#include <vector>
+#include <iostream>
+
+#include "../llflathashmap.h"
+#include "../lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	const S32 BENCH_ENTRIES = 100000;
+	const S32 BENCH_PASSES = 10;
+
+	// Repeatable pseudo random numbers, LLUUID::generate() isn't
+	U32 sSeed = 1;
+	U32 next_random()
+	{
+		sSeed = sSeed * 1664525 + 1013904223;
+		return sSeed;
+	}
+
+	LLUUID random_uuid()
+	{
+		LLUUID id;
+		for (S32 i = 0; i < UUID_BYTES; i += 2)
+		{
+			U32 r = next_random();
+			id.mData[i] = (U8)(r >> 24);
+			id.mData[i + 1] = (U8)(r >> 16);
+		}
+		return id;
+	}
+
+	// (host index << 32) | local id, as LLViewerObjectList builds them
+	U64 object_index(U32 host, U32 local_id)
+	{
+		return ((U64)host << 32) | local_id;
+	}
+
+	// Looks up every key BENCH_PASSES times, returns lookups/sec
+	template <class MAP, class KEY>
+	F64 time_lookups(const MAP& map, const std::vector<KEY>& keys, S32& found)
+	{
+		found = 0;
+		LLTimer timer;
+		for (S32 pass = 0; pass < BENCH_PASSES; pass++)
+		{
+			for (typename std::vector<KEY>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+			{
+				if (map.find(*iter) != map.end())
+				{
+					found++;
+				}
+			}
+		}
+		return (F64)keys.size() * BENCH_PASSES / llmax(timer.getElapsedTimeF64(), 0.000001);
+	}
+
+	template <class KEY>
+	void bench(const char* name, const std::vector<KEY>& keys, const std::vector<KEY>& misses)
+	{
+		std::map<KEY, S32> tree;
+		LLFlatHashMap<KEY, S32> flat;
+		for (S32 i = 0; i < (S32)keys.size(); i++)
+		{
+			tree[keys[i]] = i;
+			flat[keys[i]] = i;
+		}
+
+		S32 tree_found;
+		S32 flat_found;
+		F64 tree_hits = time_lookups(tree, keys, tree_found);
+		F64 flat_hits = time_lookups(flat, keys, flat_found);
+		tut::ensure_equals(llformat("%s hits", name), flat_found, tree_found);
+		F64 tree_misses = time_lookups(tree, misses, tree_found);
+		F64 flat_misses = time_lookups(flat, misses, flat_found);
+		tut::ensure_equals(llformat("%s misses", name), flat_found, tree_found);
+
+		std::cout << llformat("\n%-16s std::map %10.0f hits/sec %10.0f misses/sec", name, tree_hits, tree_misses)
+				  << llformat("\n%-16s flat     %10.0f hits/sec %10.0f misses/sec (%.1fx, %.1fx)", "",
+							  flat_hits, flat_misses, flat_hits / tree_hits, flat_misses / tree_misses);
+	}
+}
+
+namespace tut
+{
+	struct llflathashmap_data
+	{
+	};
+	typedef test_group<llflathashmap_data> llflathashmap_t;
+	typedef llflathashmap_t::object llflathashmap_object_t;
+	tut::llflathashmap_t tut_llflathashmap("llflathashmap");
+
+	template<> template<>
+	void llflathashmap_object_t::test<1>()
+	{
+		set_test_name("map interface");
+		LLFlatHashMap<LLUUID, S32> map;
+		ensure("starts empty", map.empty());
+		ensure("begin is end", map.begin() == map.end());
+		ensure("null not found", map.find(LLUUID::null) == map.end());
+
+		LLUUID a = random_uuid();
+		LLUUID b = random_uuid();
+		map[a] = 1;
+		ensure_equals("insert new", map.insert(std::make_pair(b, 2)).second, true);
+		ensure_equals("insert existing", map.insert(std::make_pair(b, 3)).second, false);
+		ensure_equals("insert keeps value", map[b], 2);
+		ensure_equals("size", (S32)map.size(), 2);
+		ensure_equals("count", (S32)map.count(a), 1);
+		ensure("null still not found", map.find(LLUUID::null) == map.end());
+
+		map[LLUUID::null] = 7;
+		ensure_equals("null is a key like any other", map.find(LLUUID::null)->second, 7);
+
+		ensure_equals("erase", (S32)map.erase(a), 1);
+		ensure_equals("erase again", (S32)map.erase(a), 0);
+		ensure("erased", map.find(a) == map.end());
+		ensure_equals("size after erase", (S32)map.size(), 2);
+
+		LLFlatHashMap<LLUUID, S32> copy(map);
+		map.clear();
+		ensure("cleared", map.empty() && map.begin() == map.end());
+		ensure_equals("copy", copy[b], 2);
+		ensure_equals("copy size", (S32)copy.size(), 2);
+	}
+
+	template<> template<>
+	void llflathashmap_object_t::test<2>()
+	{
+		set_test_name("matches std::map under random inserts and erases");
+		std::map<U64, S32> tree;
+		LLFlatHashMap<U64, S32> flat;
+		for (S32 op = 0; op < 200000; op++)
+		{
+			// Few hosts and local ids, so keys repeat and collide
+			U64 key = object_index(next_random() % 4, next_random() % 5000);
+			if (next_random() % 3)
+			{
+				tree[key] = op;
+				flat[key] = op;
+			}
+			else
+			{
+				ensure_equals("erase", flat.erase(key), tree.erase(key));
+			}
+		}
+		ensure_equals("size", flat.size(), tree.size());
+		for (std::map<U64, S32>::iterator iter = tree.begin(); iter != tree.end(); ++iter)
+		{
+			LLFlatHashMap<U64, S32>::iterator found = flat.find(iter->first);
+			ensure("found", found != flat.end());
+			ensure_equals("value", found->second, iter->second);
+		}
+		S32 iterated = 0;
+		for (LLFlatHashMap<U64, S32>::const_iterator iter = flat.begin(); iter != flat.end(); ++iter)
+		{
+			ensure("iterated key is in std::map", tree.count(iter->first) == 1);
+			iterated++;
+		}
+		ensure_equals("iterated", iterated, (S32)tree.size());
+	}
+
+	template<> template<>
+	void llflathashmap_object_t::test<3>()
+	{
+		set_test_name("erase while iterating, and sweeps by slot");
+		LLFlatHashMap<U32, S32> map;
+		for (U32 i = 0; i < 1000; i++)
+		{
+			map[i] = i;
+		}
+		S32 visited = 0;
+		for (LLFlatHashMap<U32, S32>::iterator iter = map.begin(); iter != map.end(); )
+		{
+			LLFlatHashMap<U32, S32>::iterator here = iter++;
+			if (here->first % 2)
+			{
+				map.erase(here);
+			}
+			visited++;
+		}
+		ensure_equals("visited every entry once", visited, 1000);
+		ensure_equals("odd ones gone", (S32)map.size(), 500);
+
+		// A few at a time, wrapping around, like LLViewerTextureList does
+		std::vector<S32> seen(1000, 0);
+		U32 slot = 0;
+		for (S32 i = 0; i < 500; i++)
+		{
+			LLFlatHashMap<U32, S32>::iterator iter = map.fromSlot(slot);
+			if (iter == map.end())
+			{
+				iter = map.begin();
+			}
+			seen[iter->first]++;
+			slot = iter.getSlot() + 1;
+		}
+		for (U32 i = 0; i < 1000; i++)
+		{
+			ensure_equals(llformat("sweep saw %d", i), seen[i], (i % 2) ? 0 : 1);
+		}
+	}
+
+	template<> template<>
+	void llflathashmap_object_t::test<4>()
+	{
+		set_test_name("lookup throughput at 100k entries");
+		if (!run_benchmarks())
+		{
+			return;
+		}
+		std::vector<LLUUID> ids;
+		std::vector<LLUUID> missing_ids;
+		std::vector<U64> indices;
+		std::vector<U64> missing_indices;
+		for (S32 i = 0; i < BENCH_ENTRIES; i++)
+		{
+			ids.push_back(random_uuid());
+			missing_ids.push_back(random_uuid());
+			// A dozen sims' worth of sequential local ids
+			indices.push_back(object_index(i % 12, 1000 + i));
+			missing_indices.push_back(object_index(i % 12 + 12, 1000 + i));
+		}
+		std::cout << "\n" << BENCH_ENTRIES << " entries, " << BENCH_PASSES << " passes of lookups in insertion order:";
+		bench("LLUUID", ids, missing_ids);
+		bench("host, local id", indices, missing_indices);
+		std::cout << std::endl;
+	}
+}
@@ -0,0 +1,157 @@
+/**
+ * @file llparallelpool_test.cpp
+ * @brief Tests for LLParallelPool
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "../llparallelpool.h"
+#include "../llapr.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	// Counts how often each index ran
+	class CountJob : public LLParallelPool::Job
+	{
+	public:
+		CountJob(S32 count) : mRuns(count, 0) {}
+
+		/*virtual*/ void run(S32 index)
+		{
+			volatile S32 sink = 0;
+			for (S32 i = 0; i < 10000; i++)
+			{
+				sink += i;
+			}
+			apr_atomic_inc32(&mRuns[index]);
+		}
+
+		std::vector<apr_uint32_t> mRuns;
+	};
+
+	// Each index runs a whole CountJob on the same pool, so run() is
+	// entered from the pool threads and the caller at the same time
+	class NestedJob : public LLParallelPool::Job
+	{
+	public:
+		NestedJob(LLParallelPool& pool, S32 count, S32 inner_count)
+			: mPool(pool)
+		{
+			for (S32 i = 0; i < count; i++)
+			{
+				mInner.push_back(new CountJob(inner_count));
+			}
+		}
+
+		~NestedJob()
+		{
+			for (U32 i = 0; i < mInner.size(); i++)
+			{
+				delete mInner[i];
+			}
+		}
+
+		/*virtual*/ void run(S32 index)
+		{
+			CountJob* job = mInner[index];
+			mPool.run(*job, (S32)job->mRuns.size());
+		}
+
+		LLParallelPool& mPool;
+		std::vector<CountJob*> mInner;
+	};
+
+	void ensure_each_ran_once(const CountJob& job)
+	{
+		for (U32 i = 0; i < job.mRuns.size(); i++)
+		{
+			tut::ensure_equals(llformat("runs of index %d", i), (U32)job.mRuns[i], 1U);
+		}
+	}
+}
+
+namespace tut
+{
+	struct llparallelpool_data
+	{
+	};
+	typedef test_group<llparallelpool_data> llparallelpool_t;
+	typedef llparallelpool_t::object llparallelpool_object_t;
+	tut::llparallelpool_t tut_llparallelpool("llparallelpool");
+
+	template<> template<>
+	void llparallelpool_object_t::test<1>()
+	{
+		set_test_name("no pool runs every index in place");
+		CountJob job(37);
+		LLParallelPool::run(NULL, job, 37);
+		ensure_each_ran_once(job);
+
+		LLParallelPool pool("test", 0);
+		ensure_equals("no threads", pool.getThreadCount(), 0);
+		CountJob job2(5);
+		pool.run(job2, 5);
+		ensure_each_ran_once(job2);
+	}
+
+	template<> template<>
+	void llparallelpool_object_t::test<2>()
+	{
+		set_test_name("pool runs every index exactly once");
+		LLParallelPool pool("test", 3);
+		ensure_equals("threads", pool.getThreadCount(), 3);
+		// Fewer indices than threads, then many more, and repeatedly so
+		// requests from one run() still in the queue meet the next one
+		const S32 counts[] = { 0, 1, 2, 500, 7, 1000 };
+		for (S32 pass = 0; pass < 20; pass++)
+		{
+			for (U32 c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+			{
+				CountJob job(counts[c]);
+				pool.run(job, counts[c]);
+				ensure_each_ran_once(job);
+			}
+		}
+	}
+
+	template<> template<>
+	void llparallelpool_object_t::test<3>()
+	{
+		set_test_name("run() from several threads at once");
+		LLParallelPool pool("test", 3);
+		for (S32 pass = 0; pass < 20; pass++)
+		{
+			NestedJob job(pool, 8, 200);
+			pool.run(job, 8);
+			for (U32 i = 0; i < job.mInner.size(); i++)
+			{
+				ensure_each_ran_once(*job.mInner[i]);
+			}
+		}
+	}
+}
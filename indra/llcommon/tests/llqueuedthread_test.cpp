@@ -0,0 +1,305 @@
+/**
+ * @file llqueuedthread_test.cpp
+ * @brief Tests and contention benchmark for LLQueuedThread request queues
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+#include <iostream>
+
+#include "../llqueuedthread.h"
+#include "../lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	const S32 BENCH_REQUEST_COUNT = 20000;
+	const S32 BENCH_WORK = 2000;
+
+	class LLTestQueuedThread : public LLQueuedThread
+	{
+	public:
+		class TestRequest : public QueuedRequest
+		{
+		public:
+			TestRequest(handle_t handle, U32 priority, U32 flags, LLTestQueuedThread* thread, S32 id, S32 passes)
+			:	QueuedRequest(handle, priority, flags),
+				mThread(thread),
+				mID(id),
+				mPasses(passes)
+			{
+			}
+
+			/*virtual*/ bool processRequest()
+			{
+				volatile S32 sink = 0;
+				for (S32 i = 0; i < mThread->mWork; i++)
+				{
+					sink += i;
+				}
+				if (--mPasses > 0)
+				{
+					return false;
+				}
+				mThread->mProcessedMutex.lock();
+				mThread->mProcessed.push_back(mID);
+				mThread->mProcessedMutex.unlock();
+				mThread->mProcessedCount++;
+				return true;
+			}
+
+		private:
+			LLTestQueuedThread* mThread;
+			S32 mID;
+			S32 mPasses;
+		};
+
+		LLTestQueuedThread(bool threaded, bool concurrent_queue, S32 work = 0, S32 pool_size = 1)
+		:	LLQueuedThread("test", threaded, concurrent_queue, pool_size),
+			mWork(work),
+			mProcessedMutex(NULL),
+			mProcessedCount(0)
+		{
+		}
+
+		handle_t add(U32 priority, S32 id, U32 flags = FLAG_AUTO_COMPLETE, S32 passes = 1)
+		{
+			handle_t handle = generateHandle();
+			addRequest(new TestRequest(handle, priority, flags, this, id, passes));
+			return handle;
+		}
+
+		S32 mWork;
+		std::vector<S32> mProcessed;	// worker side
+		LLMutex mProcessedMutex;
+		LLAtomicS32 mProcessedCount;
+	};
+
+	// Main thread cost of feeding a busy worker: adds, reprioritizations
+	// and status polls like LLTextureFetch does during a teleport.
+	struct LLQueueBenchResult
+	{
+		F64 mTotalMainSeconds;
+		F64 mMaxCallSeconds;
+		F64 mElapsedSeconds;
+	};
+
+	LLQueueBenchResult bench_queue(bool concurrent_queue)
+	{
+		LLQueueBenchResult result;
+		result.mTotalMainSeconds = 0.0;
+		result.mMaxCallSeconds = 0.0;
+
+		LLTestQueuedThread* thread = new LLTestQueuedThread(true, concurrent_queue, BENCH_WORK);
+		std::vector<LLQueuedThread::handle_t> handles;
+		handles.reserve(BENCH_REQUEST_COUNT);
+
+		U32 r = 12345;
+		LLTimer elapsed;
+		LLTimer call;
+		for (S32 i = 0; i < BENCH_REQUEST_COUNT; i++)
+		{
+			r = r * 1103515245 + 12345;
+			U32 priority = LLQueuedThread::PRIORITY_NORMAL | ((r >> 4) & LLQueuedThread::PRIORITY_LOWBITS);
+
+			call.reset();
+			handles.push_back(thread->add(priority, i));
+			LLQueuedThread::handle_t other = handles[(r >> 8) % handles.size()];
+			thread->setPriority(other, priority ^ 0x00ffff00);
+			thread->getRequestStatus(handles[(r >> 16) % handles.size()]);
+			F64 t = call.getElapsedTimeF64();
+
+			result.mTotalMainSeconds += t;
+			result.mMaxCallSeconds = llmax(result.mMaxCallSeconds, t);
+		}
+
+		while (thread->mProcessedCount < BENCH_REQUEST_COUNT)
+		{
+			ms_sleep(1);
+		}
+		result.mElapsedSeconds = elapsed.getElapsedTimeF64();
+
+		delete thread;
+		return result;
+	}
+
+	// Wall clock time for a pool to get through a batch of CPU bound requests
+	F64 bench_pool(S32 pool_size, S32 count, S32 work)
+	{
+		LLTestQueuedThread* thread = new LLTestQueuedThread(true, false, work, pool_size);
+		LLTimer elapsed;
+		for (S32 i = 0; i < count; i++)
+		{
+			thread->add(LLQueuedThread::PRIORITY_NORMAL | (i & LLQueuedThread::PRIORITY_LOWBITS), i);
+		}
+		while (thread->mProcessedCount < count)
+		{
+			ms_sleep(1);
+		}
+		F64 res = elapsed.getElapsedTimeF64();
+		delete thread;
+		return res;
+	}
+}
+
+namespace tut
+{
+	struct queuedthread_test
+	{
+	};
+	typedef test_group<queuedthread_test> queuedthread_group_t;
+	typedef queuedthread_group_t::object queuedthread_object_t;
+	tut::queuedthread_group_t queuedthread_instance("LLQueuedThread");
+
+	template<> template<>
+	void queuedthread_object_t::test<1>()
+		// requests run in priority order, including after setPriority
+	{
+		for (S32 concurrent = 0; concurrent < 2; concurrent++)
+		{
+			LLTestQueuedThread thread(false, concurrent != 0);
+			thread.add(LLQueuedThread::PRIORITY_NORMAL + 1, 0);
+			thread.add(LLQueuedThread::PRIORITY_HIGH, 1);
+			LLQueuedThread::handle_t low = thread.add(LLQueuedThread::PRIORITY_LOW, 2);
+			thread.add(LLQueuedThread::PRIORITY_NORMAL + 5, 3);
+			thread.add(LLQueuedThread::PRIORITY_URGENT, 4);
+			thread.setPriority(low, LLQueuedThread::PRIORITY_IMMEDIATE);
+			ensure_equals("pending", thread.getPending(), 5);
+
+			thread.update(0);
+
+			ensure_equals("all processed", (S32)thread.mProcessed.size(), 5);
+			ensure_equals("reprioritized first", thread.mProcessed[0], 2);
+			ensure_equals("urgent", thread.mProcessed[1], 4);
+			ensure_equals("high", thread.mProcessed[2], 1);
+			ensure_equals("normal + 5", thread.mProcessed[3], 3);
+			ensure_equals("normal + 1", thread.mProcessed[4], 0);
+			ensure_equals("nothing pending", thread.getPending(), 0);
+		}
+	}
+
+	template<> template<>
+	void queuedthread_object_t::test<2>()
+		// requeued, aborted and completed requests
+	{
+		for (S32 concurrent = 0; concurrent < 2; concurrent++)
+		{
+			LLTestQueuedThread thread(false, concurrent != 0);
+			LLQueuedThread::handle_t requeued = thread.add(LLQueuedThread::PRIORITY_NORMAL, 0, 0, 3);
+			LLQueuedThread::handle_t aborted = thread.add(LLQueuedThread::PRIORITY_LOW, 1, 0);
+			thread.abortRequest(aborted, false);
+
+			ensure("requeued request completes", thread.waitForResult(requeued));
+			ensure_equals("requeued request expired", thread.getRequestStatus(requeued), LLQueuedThread::STATUS_EXPIRED);
+			ensure_equals("aborted", thread.getRequestStatus(aborted), LLQueuedThread::STATUS_ABORTED);
+			ensure("complete aborted", thread.completeRequest(aborted));
+			ensure_equals("only one processed", (S32)thread.mProcessedCount, 1);
+		}
+	}
+
+	template<> template<>
+	void queuedthread_object_t::test<3>()
+		// a threaded worker gets through every request while the main thread
+		// keeps reprioritizing, and with LL_BENCHMARKS the contention
+		// benchmark: locked vs concurrent queue
+	{
+		LLQueueBenchResult locked = bench_queue(false);
+		LLQueueBenchResult concurrent = bench_queue(true);
+
+		if (run_benchmarks())
+		{
+			std::cout << "\n" << BENCH_REQUEST_COUNT << " requests, main thread add + setPriority + getRequestStatus:"
+					  << llformat("\nlocked queue:     %.1f ms total, %.3f ms worst call, %.1f ms elapsed",
+								  locked.mTotalMainSeconds * 1000.0, locked.mMaxCallSeconds * 1000.0, locked.mElapsedSeconds * 1000.0)
+					  << llformat("\nconcurrent queue: %.1f ms total, %.3f ms worst call, %.1f ms elapsed",
+								  concurrent.mTotalMainSeconds * 1000.0, concurrent.mMaxCallSeconds * 1000.0, concurrent.mElapsedSeconds * 1000.0)
+					  << std::endl;
+		}
+	}
+
+	template<> template<>
+	void queuedthread_object_t::test<4>()
+		// thread pool runs every request exactly once, including requeued,
+		// reprioritized and aborted ones
+	{
+		const S32 COUNT = 2000;
+		LLTestQueuedThread thread(true, false, 500, 4);
+		ensure_equals("pool size", thread.getPoolSize(), 4);
+
+		std::vector<LLQueuedThread::handle_t> handles;
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			U32 priority = (i % 3 == 0 ? LLQueuedThread::PRIORITY_HIGH : LLQueuedThread::PRIORITY_NORMAL) + i;
+			handles.push_back(thread.add(priority, i, LLQueuedThread::FLAG_AUTO_COMPLETE, 1 + i % 4));
+			if (i > 0)
+			{
+				thread.setPriority(handles[i / 2], LLQueuedThread::PRIORITY_URGENT + i);
+			}
+		}
+		LLQueuedThread::handle_t aborted = thread.add(LLQueuedThread::PRIORITY_LOW, COUNT, 0, 1000);
+		thread.abortRequest(aborted, true);
+
+		while (thread.mProcessedCount < COUNT || thread.getRequestStatus(aborted) != LLQueuedThread::STATUS_EXPIRED)
+		{
+			thread.update(0);
+			ms_sleep(1);
+		}
+
+		std::vector<S32> seen(COUNT + 1, 0);
+		for (std::vector<S32>::iterator iter = thread.mProcessed.begin(); iter != thread.mProcessed.end(); ++iter)
+		{
+			seen[*iter]++;
+		}
+		for (S32 i = 0; i < COUNT; i++)
+		{
+			ensure_equals(llformat("request %d processed once", i), seen[i], 1);
+		}
+		ensure_equals("aborted request not processed", seen[COUNT], 0);
+		ensure_equals("nothing pending", thread.getPending(), 0);
+		thread.printQueueStats();
+	}
+
+	template<> template<>
+	void queuedthread_object_t::test<5>()
+		// pool scaling benchmark, with LL_BENCHMARKS only
+	{
+		if (!run_benchmarks())
+		{
+			// test<4> covers what the pool does, this only times it
+			return;
+		}
+		const S32 COUNT = 4000;
+		const S32 WORK = 50000;
+		F64 single = bench_pool(1, COUNT, WORK);
+		std::cout << "\n" << COUNT << " requests:";
+		for (S32 pool_size = 1; pool_size <= 8; pool_size *= 2)
+		{
+			F64 elapsed = pool_size == 1 ? single : bench_pool(pool_size, COUNT, WORK);
+			std::cout << llformat("\npool of %d: %.1f ms, %.2fx", pool_size, elapsed * 1000.0, single / elapsed);
+		}
+		std::cout << std::endl;
+	}
+}
@@ -31,6 +31,7 @@
 #include "llmath.h"
 #include "v4coloru.h"
 #include "llmemtype.h"
+#include "llprocessor.h"
 
 #include "llimagebmp.h"
 #include "llimagetga.h"
@@ -47,12 +48,15 @@
 //static
 std::string LLImage::sLastErrorMessage;
 LLMutex* LLImage::sMutex = NULL;
+bool LLImage::sUseSSE2 = false;
 
 //static
 void LLImage::initClass()
 {
 	sMutex = new LLMutex(NULL);
 	LLImageJ2C::openDSO();
+	setUseSSE2(true);
+	llinfos << "SSE2 image kernels " << (sUseSSE2 ? "enabled" : "disabled") << llendl;
 }
 
 //static
@@ -63,6 +67,12 @@ void LLImage::cleanupClass()
 	sMutex = NULL;
 }
 
+//static
+void LLImage::setUseSSE2(bool use_sse2)
+{
+	sUseSSE2 = use_sse2 && isSSE2Compiled() && LLProcessorInfo().hasSSE2();
+}
+
 //static
 const std::string& LLImage::getLastError()
 {
@@ -516,13 +526,6 @@ void LLImageRaw::biasedScaleToPowerOfTwo(S32 max_dim)
 
 
 // Calculates (U8)(255*(a/255.f)*(b/255.f) + 0.5f).  Thanks, Jim Blinn!
-inline U8 LLImageRaw::fastFractionalMult( U8 a, U8 b )
-{
-	U32 i = a * b + 128;
-	return U8((i + (i>>8)) >> 8);
-}
-
-
 void LLImageRaw::composite( LLImageRaw* src )
 {
 	LLImageRaw* dst = this;  // Just for clarity.
@@ -573,10 +576,7 @@ void LLImageRaw::compositeScaled4onto3(LLImageRaw* src)
 	std::vector<U8> temp_buffer(temp_data_size);
 
 	// Vertical: scale but no composite
-	for( S32 col = 0; col < src->getWidth(); col++ )
-	{
-		copyLineScaled( src->getData() + (src->getComponents() * col), &temp_buffer[0] + (src->getComponents() * col), src->getHeight(), dst->getHeight(), src->getWidth(), src->getWidth() );
-	}
+	copyRowsScaled( src->getData(), &temp_buffer[0], src->getComponents() * src->getWidth(), src->getHeight(), dst->getHeight() );
 
 	// Horizontal: scale and composite
 	for( S32 row = 0; row < dst->getHeight(); row++ )
@@ -609,6 +609,11 @@ void LLImageRaw::compositeUnscaled4onto3( LLImageRaw* src )
 	llassert( (3 == src->getComponents()) || (4 == src->getComponents()) );
 	llassert( (src->getWidth() == dst->getWidth()) && (src->getHeight() == dst->getHeight()) );
 
+	if (LLImage::getUseSSE2())
+	{
+		compositeUnscaled4onto3SSE2( src );
+		return;
+	}
 
 	U8* src_data = src->getData();
 	U8* dst_data = dst->getData();
@@ -820,10 +825,7 @@ void LLImageRaw::copyScaled( LLImageRaw* src )
 	std::vector<U8> temp_buffer(temp_data_size);
 
 	// Vertical
-	for( S32 col = 0; col < src->getWidth(); col++ )
-	{
-		copyLineScaled( src->getData() + (getComponents() * col), &temp_buffer[0] + (getComponents() * col), src->getHeight(), dst->getHeight(), src->getWidth(), src->getWidth() );
-	}
+	copyRowsScaled( src->getData(), &temp_buffer[0], getComponents() * src->getWidth(), src->getHeight(), dst->getHeight() );
 
 	// Horizontal
 	for( S32 row = 0; row < dst->getHeight(); row++ )
@@ -900,10 +902,7 @@ BOOL LLImageRaw::scale( S32 new_width, S32 new_height, BOOL scale_image_data )
 		std::vector<U8> temp_buffer(temp_data_size);
 
 		// Vertical
-		for( S32 col = 0; col < old_width; col++ )
-		{
-			copyLineScaled( getData() + (getComponents() * col), &temp_buffer[0] + (getComponents() * col), old_height, new_height, old_width, old_width );
-		}
+		copyRowsScaled( getData(), &temp_buffer[0], getComponents() * old_width, old_height, new_height );
 
 		deleteData();
 
@@ -952,6 +951,12 @@ void LLImageRaw::copyLineScaled( U8* in, U8* out, S32 in_pixel_len, S32 out_pixe
 	const S32 components = getComponents();
 	llassert( components >= 1 && components <= 4 );
 
+	if (LLImage::getUseSSE2() && components >= 3 && in_pixel_step == 1 && out_pixel_step == 1)
+	{
+		copyLineScaledSSE2( in, out, in_pixel_len, out_pixel_len );
+		return;
+	}
+
 	const F32 ratio = F32(in_pixel_len) / out_pixel_len; // ratio of old to new
 	const F32 norm_factor = 1.f / ratio;
 
@@ -1062,10 +1067,68 @@ void LLImageRaw::copyLineScaled( U8* in, U8* out, S32 in_pixel_len, S32 out_pixe
 	}
 }
 
+void LLImageRaw::copyRowsScaled( const U8* in, U8* out, S32 row_bytes, S32 in_rows, S32 out_rows )
+{
+	if (LLImage::getUseSSE2())
+	{
+		copyRowsScaledSSE2( in, out, row_bytes, in_rows, out_rows );
+		return;
+	}
+
+	// Every byte of a row is filtered on its own, with the arithmetic of
+	// copyLineScaled(), so this gives the same result as scaling each column
+	// but walks memory row by row.
+	const F32 ratio = F32(in_rows) / out_rows; // ratio of old to new
+	const F32 norm_factor = 1.f / ratio;
+
+	for( S32 y = 0; y < out_rows; y++ )
+	{
+		const F32 sample0 = y * ratio;
+		const F32 sample1 = (y+1) * ratio;
+		const S32 index0 = llfloor(sample0);			// top integer (floor)
+		const S32 index1 = llfloor(sample1);			// bottom integer (floor)
+		const F32 fract0 = 1.f - (sample0 - F32(index0));	// spill over on top
+		const F32 fract1 = sample1 - F32(index1);			// spill-over on bottom
+
+		U8* outp = out + y * row_bytes;
+		const U8* in0 = in + index0 * row_bytes;
+		if( index0 == index1 )
+		{
+			// Interval is embedded in one input row
+			memcpy(outp, in0, row_bytes);	/* Flawfinder: ignore */
+			continue;
+		}
+
+		// Watch out for reading off of end of input array.
+		const U8* in1 = (fract1 && index1 < in_rows) ? in + index1 * row_bytes : NULL;
+		for( S32 i = 0; i < row_bytes; i++ )
+		{
+			F32 v = in0[i] * fract0;
+			for( S32 u = index0 + 1; u < index1; u++ )
+			{
+				v += in[u * row_bytes + i];
+			}
+			if (in1)
+			{
+				U8 last = in1[i];
+				v += last * fract1;
+			}
+			v *= norm_factor;
+			outp[i] = U8(llround(v));
+		}
+	}
+}
+
 void LLImageRaw::compositeRowScaled4onto3( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len )
 {
 	llassert( getComponents() == 3 );
 
+	if (LLImage::getUseSSE2())
+	{
+		compositeRowScaled4onto3SSE2( in, out, in_pixel_len, out_pixel_len );
+		return;
+	}
+
 	const S32 IN_COMPONENTS = 4;
 	const S32 OUT_COMPONENTS = 3;
 
@@ -1093,9 +1156,9 @@ void LLImageRaw::compositeRowScaled4onto3( U8* in, U8* out, S32 in_pixel_len, S3
 			// Interval is embedded in one input pixel
 			S32 t1 = index0 * IN_COMPONENTS;
 			in_scaled_r = in[t1 + 0];
-			in_scaled_g = in[t1 + 0];
-			in_scaled_b = in[t1 + 0];
-			in_scaled_a = in[t1 + 0];
+			in_scaled_g = in[t1 + 1];
+			in_scaled_b = in[t1 + 2];
+			in_scaled_a = in[t1 + 3];
 		}
 		else
 		{
@@ -1479,6 +1542,7 @@ U8* LLImageFormatted::allocateData(S32 size)
 // virtual
 U8* LLImageFormatted::reallocateData(S32 size)
 {
+	releaseDecodeState();
 	sGlobalFormattedMemory -= getDataSize();
 	U8* res = LLImageBase::reallocateData(size);
 	sGlobalFormattedMemory += getDataSize();
@@ -1488,6 +1552,7 @@ U8* LLImageFormatted::reallocateData(S32 size)
 // virtual
 void LLImageFormatted::deleteData()
 {
+	releaseDecodeState();
 	sGlobalFormattedMemory -= getDataSize();
 	LLImageBase::deleteData();
 }
@@ -1647,6 +1712,11 @@ static void avg4_colors2(const U8* a, const U8* b, const U8* c, const U8* d, U8*
 void LLImageBase::generateMip(const U8* indata, U8* mipdata, S32 width, S32 height, S32 nchannels)
 {
 	llassert(width > 0 && height > 0);
+	if (LLImage::getUseSSE2())
+	{
+		generateMipSSE2(indata, mipdata, width, height, nchannels);
+		return;
+	}
 	U8* data = mipdata;
 	S32 in_width = width*2;
 	for (S32 h=0; h<height; h++)
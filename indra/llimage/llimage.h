@@ -81,10 +81,18 @@ public:
 
 	static const std::string& getLastError();
 	static void setLastError(const std::string& message);
+
+	// SSE2 versions of the scaling, compositing and mip generation kernels.
+	// initClass() turns them on when the CPU supports SSE2.  Their output
+	// matches the scalar code, see llimage_sse2.cpp.
+	static void setUseSSE2(bool use_sse2);
+	static bool getUseSSE2() { return sUseSSE2; }
+	static bool isSSE2Compiled(); // defined in llimage_sse2.cpp
 	
 protected:
 	static LLMutex* sMutex;
 	static std::string sLastErrorMessage;
+	static bool sUseSSE2;
 };
 
 //============================================================================
@@ -131,6 +139,7 @@ protected:
 	
 public:
 	static void generateMip(const U8 *indata, U8* mipdata, int width, int height, S32 nchannels);
+	static void generateMipSSE2(const U8 *indata, U8* mipdata, int width, int height, S32 nchannels);
 	
 	// Function for calculating the download priority for textures
 	// <= 0 priority means that there's no need for more data.
@@ -230,6 +239,15 @@ protected:
 
 	void copyLineScaled( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len, S32 in_pixel_step, S32 out_pixel_step );
 	void compositeRowScaled4onto3( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len );
+	// Vertical pass of the scalers: same filter as copyLineScaled(), applied
+	// to whole rows of row_bytes bytes at once.
+	void copyRowsScaled( const U8* in, U8* out, S32 row_bytes, S32 in_rows, S32 out_rows );
+
+	// SSE2 kernels, see llimage_sse2.cpp.  Only called when LLImage::getUseSSE2().
+	void copyLineScaledSSE2( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len );
+	void compositeRowScaled4onto3SSE2( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len );
+	void copyRowsScaledSSE2( const U8* in, U8* out, S32 row_bytes, S32 in_rows, S32 out_rows );
+	void compositeUnscaled4onto3SSE2( LLImageRaw* src );
 
 	U8	fastFractionalMult(U8 a,U8 b);
 
@@ -240,6 +258,13 @@ public:
 	static S32 sRawImageCount;
 };
 
+// (a * b) / 255 rounded, without a divide
+inline U8 LLImageRaw::fastFractionalMult( U8 a, U8 b )
+{
+	U32 i = a * b + 128;
+	return U8((i + (i>>8)) >> 8);
+}
+
 // Compressed representation of image.
 // Subclass from this class for the different representations (J2C, bmp)
 class LLImageFormatted : public LLImageBase
@@ -286,6 +311,10 @@ public:
 	virtual BOOL decode(LLImageRaw* raw_image, F32 decode_time) = 0;  
 	// Subclasses that can handle more than 4 channels should override this function.
 	virtual BOOL decodeChannels(LLImageRaw* raw_image, F32 decode_time, S32 first_channel, S32 max_channel);
+	// No more channels will be decoded from the current data, drop any
+	// decoder state kept between decodeChannels() calls.  Also called
+	// whenever the data is deleted or reallocated.
+	virtual void releaseDecodeState() {}
 
 	virtual BOOL encode(const LLImageRaw* raw_image, F32 encode_time) = 0;
 
@@ -0,0 +1,506 @@
+/**
+ * @file llimage_sse2.cpp
+ * @brief SSE2 versions of the LLImageRaw scaling and compositing kernels
+ * and of LLImageBase::generateMip().
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+// Code Generation: SSE2
+//
+// This file is built with SSE2 code generation (see CMakeLists.txt) and
+// must only be entered when LLImage::getUseSSE2() is true, which checks
+// LLProcessorInfo at runtime.
+//
+// Precision: the integer kernels (compositeUnscaled4onto3, generateMip) are
+// bit-exact.  The box filters do the same float operations in the same
+// order as the scalar code, one channel per lane, so they are bit-exact
+// against a scalar build that uses SSE float math (all x86_64 builds and
+// -mfpmath=sse).  Against x87 scalar math a channel may differ by 1 when
+// the filtered value is within float rounding of a .5 boundary.
+
+#include "linden_common.h"
+
+#include "llimage.h"
+
+#include "llmath.h"
+
+// MSVC accepts SSE2 intrinsics without /arch:SSE2, gcc needs -msse2.
+#if defined(__SSE2__) || (LL_MSVC && (defined(_M_X64) || defined(_M_IX86)))
+#define LL_IMAGE_SSE2 1
+#endif
+
+#if LL_IMAGE_SSE2
+
+#include <emmintrin.h>
+
+//static
+bool LLImage::isSSE2Compiled()
+{
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Helpers
+
+// One 3 or 4 component pixel, one channel per float lane
+inline __m128 load_pixel(const U8* in, S32 components)
+{
+	U32 v = in[0] | (in[1] << 8) | (in[2] << 16);
+	if (components == 4)
+	{
+		v |= in[3] << 24;
+	}
+	__m128i zero = _mm_setzero_si128();
+	__m128i i = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero);
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(i, zero));
+}
+
+// U8(llround(v)) per lane.  v is never negative so truncating v + 0.5
+// is the same as floor(v + 0.5).
+inline U32 round_pixel(__m128 v)
+{
+	__m128i i = _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+	i = _mm_packs_epi32(i, i);
+	i = _mm_packus_epi16(i, i);
+	return (U32)_mm_cvtsi128_si32(i);
+}
+
+inline void store_pixel(U8* out, U32 v, S32 components)
+{
+	out[0] = U8(v);
+	out[1] = U8(v >> 8);
+	out[2] = U8(v >> 16);
+	if (components == 4)
+	{
+		out[3] = U8(v >> 24);
+	}
+}
+
+// Box filter of in[index0..index1] along a line of 3 or 4 component
+// pixels, same arithmetic as LLImageRaw::copyLineScaled()
+inline __m128 filter_pixel(const U8* in, S32 components, S32 in_pixel_len,
+						   S32 index0, S32 index1, F32 fract0, F32 fract1, F32 norm_factor)
+{
+	const U8* inp = in + index0 * components;
+	__m128 sum = _mm_mul_ps(load_pixel(inp, components), _mm_set1_ps(fract0));
+	for (S32 u = index0 + 1; u < index1; u++)
+	{
+		inp += components;
+		sum = _mm_add_ps(sum, load_pixel(inp, components));
+	}
+	// Watch out for reading off of end of input array.
+	if (fract1 && index1 < in_pixel_len)
+	{
+		sum = _mm_add_ps(sum, _mm_mul_ps(load_pixel(in + index1 * components, components), _mm_set1_ps(fract1)));
+	}
+	return _mm_mul_ps(sum, _mm_set1_ps(norm_factor));
+}
+
+//----------------------------------------------------------------------------
+// LLImageRaw
+
+void LLImageRaw::copyLineScaledSSE2( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len )
+{
+	const S32 components = getComponents();
+	llassert( components == 3 || components == 4 );
+
+	const F32 ratio = F32(in_pixel_len) / out_pixel_len; // ratio of old to new
+	const F32 norm_factor = 1.f / ratio;
+
+	for( S32 x = 0; x < out_pixel_len; x++ )
+	{
+		const F32 sample0 = x * ratio;
+		const F32 sample1 = (x+1) * ratio;
+		const S32 index0 = llfloor(sample0);			// left integer (floor)
+		const S32 index1 = llfloor(sample1);			// right integer (floor)
+		const F32 fract0 = 1.f - (sample0 - F32(index0));	// spill over on left
+		const F32 fract1 = sample1 - F32(index1);			// spill-over on right
+
+		U8* outp = out + x * components;
+		if( index0 == index1 )
+		{
+			// Interval is embedded in one input pixel
+			memcpy(outp, in + index0 * components, components);	/* Flawfinder: ignore */
+		}
+		else
+		{
+			__m128 v = filter_pixel(in, components, in_pixel_len, index0, index1, fract0, fract1, norm_factor);
+			store_pixel(outp, round_pixel(v), components);
+		}
+	}
+}
+
+void LLImageRaw::compositeRowScaled4onto3SSE2( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len )
+{
+	llassert( getComponents() == 3 );
+
+	const S32 IN_COMPONENTS = 4;
+	const S32 OUT_COMPONENTS = 3;
+
+	const F32 ratio = F32(in_pixel_len) / out_pixel_len; // ratio of old to new
+	const F32 norm_factor = 1.f / ratio;
+
+	for( S32 x = 0; x < out_pixel_len; x++ )
+	{
+		const F32 sample0 = x * ratio;
+		const F32 sample1 = (x+1) * ratio;
+		const S32 index0 = S32(sample0);			// left integer (floor)
+		const S32 index1 = S32(sample1);			// right integer (floor)
+		const F32 fract0 = 1.f - (sample0 - F32(index0));	// spill over on left
+		const F32 fract1 = sample1 - F32(index1);			// spill-over on right
+
+		U8 in_scaled[4];
+		if( index0 == index1 )
+		{
+			// Interval is embedded in one input pixel
+			memcpy(in_scaled, in + index0 * IN_COMPONENTS, IN_COMPONENTS);	/* Flawfinder: ignore */
+		}
+		else
+		{
+			__m128 v = filter_pixel(in, IN_COMPONENTS, in_pixel_len, index0, index1, fract0, fract1, norm_factor);
+			store_pixel(in_scaled, round_pixel(v), IN_COMPONENTS);
+		}
+
+		const U8 alpha = in_scaled[3];
+		if( alpha )
+		{
+			if( 255 == alpha )
+			{
+				out[0] = in_scaled[0];
+				out[1] = in_scaled[1];
+				out[2] = in_scaled[2];
+			}
+			else
+			{
+				U8 transparency = 255 - alpha;
+				out[0] = fastFractionalMult( out[0], transparency ) + fastFractionalMult( in_scaled[0], alpha );
+				out[1] = fastFractionalMult( out[1], transparency ) + fastFractionalMult( in_scaled[1], alpha );
+				out[2] = fastFractionalMult( out[2], transparency ) + fastFractionalMult( in_scaled[2], alpha );
+			}
+		}
+		out += OUT_COMPONENTS;
+	}
+}
+
+void LLImageRaw::copyRowsScaledSSE2( const U8* in, U8* out, S32 row_bytes, S32 in_rows, S32 out_rows )
+{
+	const F32 ratio = F32(in_rows) / out_rows; // ratio of old to new
+	const F32 norm_factor = 1.f / ratio;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 norm = _mm_set1_ps(norm_factor);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	for( S32 y = 0; y < out_rows; y++ )
+	{
+		const F32 sample0 = y * ratio;
+		const F32 sample1 = (y+1) * ratio;
+		const S32 index0 = llfloor(sample0);			// top integer (floor)
+		const S32 index1 = llfloor(sample1);			// bottom integer (floor)
+		const F32 fract0 = 1.f - (sample0 - F32(index0));	// spill over on top
+		const F32 fract1 = sample1 - F32(index1);			// spill-over on bottom
+
+		U8* outp = out + y * row_bytes;
+		const U8* in0 = in + index0 * row_bytes;
+		if( index0 == index1 )
+		{
+			// Interval is embedded in one input row
+			memcpy(outp, in0, row_bytes);	/* Flawfinder: ignore */
+			continue;
+		}
+
+		// Watch out for reading off of end of input array.
+		const U8* in1 = (fract1 && index1 < in_rows) ? in + index1 * row_bytes : NULL;
+		const __m128 f0 = _mm_set1_ps(fract0);
+		const __m128 f1 = _mm_set1_ps(fract1);
+
+		// 16 bytes of the row at a time, 4 floats per register
+		S32 i = 0;
+		for( ; i + 16 <= row_bytes; i += 16 )
+		{
+			__m128 acc[4];
+			__m128i b = _mm_loadu_si128((const __m128i*)(in0 + i));
+			__m128i lo = _mm_unpacklo_epi8(b, zero);
+			__m128i hi = _mm_unpackhi_epi8(b, zero);
+			acc[0] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), f0);
+			acc[1] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), f0);
+			acc[2] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), f0);
+			acc[3] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), f0);
+
+			for( S32 u = index0 + 1; u < index1; u++ )
+			{
+				b = _mm_loadu_si128((const __m128i*)(in + u * row_bytes + i));
+				lo = _mm_unpacklo_epi8(b, zero);
+				hi = _mm_unpackhi_epi8(b, zero);
+				acc[0] = _mm_add_ps(acc[0], _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+				acc[1] = _mm_add_ps(acc[1], _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+				acc[2] = _mm_add_ps(acc[2], _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+				acc[3] = _mm_add_ps(acc[3], _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+			}
+
+			if (in1)
+			{
+				b = _mm_loadu_si128((const __m128i*)(in1 + i));
+				lo = _mm_unpacklo_epi8(b, zero);
+				hi = _mm_unpackhi_epi8(b, zero);
+				acc[0] = _mm_add_ps(acc[0], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), f1));
+				acc[1] = _mm_add_ps(acc[1], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), f1));
+				acc[2] = _mm_add_ps(acc[2], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), f1));
+				acc[3] = _mm_add_ps(acc[3], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), f1));
+			}
+
+			__m128i r0 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(acc[0], norm), half));
+			__m128i r1 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(acc[1], norm), half));
+			__m128i r2 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(acc[2], norm), half));
+			__m128i r3 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(acc[3], norm), half));
+			_mm_storeu_si128((__m128i*)(outp + i),
+							 _mm_packus_epi16(_mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3)));
+		}
+
+		// Tail of the row
+		for( ; i < row_bytes; i++ )
+		{
+			F32 v = in0[i] * fract0;
+			for( S32 u = index0 + 1; u < index1; u++ )
+			{
+				v += in[u * row_bytes + i];
+			}
+			if (in1)
+			{
+				U8 last = in1[i];
+				v += last * fract1;
+			}
+			v *= norm_factor;
+			outp[i] = U8(llround(v));
+		}
+	}
+}
+
+// Src and dst are same size.  Src has 4 components.  Dst has 3 components.
+void LLImageRaw::compositeUnscaled4onto3SSE2( LLImageRaw* src )
+{
+	// dst * (255 - alpha) / 255 + src * alpha / 255 with fastFractionalMult()
+	// rounding in 16 bit lanes, 4 pixels at a time.  alpha == 0 and 255 need
+	// no special case: the blend leaves dst, or copies src, exactly.
+	U8* src_data = src->getData();
+	U8* dst_data = getData();
+	S32 pixels = getWidth() * getHeight();
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i m0 = _mm_setr_epi32(0x00ffffff, 0, 0, 0);
+	const __m128i m1 = _mm_setr_epi32(0, 0x00ffffff, 0, 0);
+	const __m128i m2 = _mm_setr_epi32(0, 0, 0x00ffffff, 0);
+	const __m128i m3 = _mm_setr_epi32(0, 0, 0, 0x00ffffff);
+	const __m128i n1 = _mm_srli_si128(m1, 1);
+	const __m128i n2 = _mm_srli_si128(m2, 2);
+	const __m128i n3 = _mm_srli_si128(m3, 3);
+
+	// The 16 byte load of 4 dst pixels reads 4 bytes ahead, stay 6 pixels
+	// away from the end of the buffer.
+	while( pixels >= 6 )
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)src_data);
+		__m128i d = _mm_loadu_si128((const __m128i*)dst_data);
+		// RGB RGB RGB RGB -> RGB0 RGB0 RGB0 RGB0
+		d = _mm_or_si128(_mm_or_si128(_mm_and_si128(d, m0), _mm_and_si128(_mm_slli_si128(d, 1), m1)),
+						 _mm_or_si128(_mm_and_si128(_mm_slli_si128(d, 2), m2), _mm_and_si128(_mm_slli_si128(d, 3), m3)));
+
+		__m128i res[2];
+		for (S32 half = 0; half < 2; half++)
+		{
+			__m128i s16 = half ? _mm_unpackhi_epi8(s, zero) : _mm_unpacklo_epi8(s, zero);
+			__m128i d16 = half ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+			__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+			__m128i t = _mm_sub_epi16(c255, a);
+
+			__m128i x = _mm_add_epi16(_mm_mullo_epi16(d16, t), c128);
+			x = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+			__m128i y = _mm_add_epi16(_mm_mullo_epi16(s16, a), c128);
+			y = _mm_srli_epi16(_mm_add_epi16(y, _mm_srli_epi16(y, 8)), 8);
+			res[half] = _mm_add_epi16(x, y);
+		}
+		__m128i r = _mm_packus_epi16(res[0], res[1]);
+		// RGBx RGBx RGBx RGBx -> RGB RGB RGB RGB
+		r = _mm_or_si128(_mm_or_si128(_mm_and_si128(r, m0), _mm_and_si128(_mm_srli_si128(r, 1), n1)),
+						 _mm_or_si128(_mm_and_si128(_mm_srli_si128(r, 2), n2), _mm_and_si128(_mm_srli_si128(r, 3), n3)));
+		_mm_storel_epi64((__m128i*)dst_data, r);
+		U32 last = (U32)_mm_cvtsi128_si32(_mm_srli_si128(r, 8));
+		memcpy(dst_data + 8, &last, 4);	/* Flawfinder: ignore */
+
+		src_data += 16;
+		dst_data += 12;
+		pixels -= 4;
+	}
+
+	while( pixels-- )
+	{
+		U8 alpha = src_data[3];
+		U8 transparency = 255 - alpha;
+		dst_data[0] = fastFractionalMult( dst_data[0], transparency ) + fastFractionalMult( src_data[0], alpha );
+		dst_data[1] = fastFractionalMult( dst_data[1], transparency ) + fastFractionalMult( src_data[1], alpha );
+		dst_data[2] = fastFractionalMult( dst_data[2], transparency ) + fastFractionalMult( src_data[2], alpha );
+		src_data += 4;
+		dst_data += 3;
+	}
+}
+
+//----------------------------------------------------------------------------
+// LLImageBase
+
+// Vertical sum of two rows of 16 bytes, as 2 x 8 16 bit lanes
+inline void sum_rows(const U8* row0, const U8* row1, __m128i& lo, __m128i& hi)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_loadu_si128((const __m128i*)row0);
+	__m128i b = _mm_loadu_si128((const __m128i*)row1);
+	lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+	hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+}
+
+// Adds horizontally adjacent pixels of a 16 byte block of both rows,
+// giving 8 lanes of 4 pixel sums.
+inline __m128i sum_block(const U8* row0, const U8* row1, S32 nchannels)
+{
+	__m128i lo, hi;
+	if (nchannels == 1)
+	{
+		const __m128i mask = _mm_set1_epi16(0x00ff);
+		__m128i a = _mm_loadu_si128((const __m128i*)row0);
+		__m128i b = _mm_loadu_si128((const __m128i*)row1);
+		lo = _mm_add_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+		hi = _mm_add_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+		return _mm_add_epi16(lo, hi);
+	}
+
+	sum_rows(row0, row1, lo, hi);
+	if (nchannels == 2)
+	{
+		// 32 bits per pixel: add even and odd pixels
+		__m128 flo = _mm_castsi128_ps(lo);
+		__m128 fhi = _mm_castsi128_ps(hi);
+		return _mm_add_epi16(_mm_castps_si128(_mm_shuffle_ps(flo, fhi, _MM_SHUFFLE(2,0,2,0))),
+							 _mm_castps_si128(_mm_shuffle_ps(flo, fhi, _MM_SHUFFLE(3,1,3,1))));
+	}
+	// 64 bits per pixel
+	return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+//static
+void LLImageBase::generateMipSSE2(const U8* indata, U8* mipdata, S32 width, S32 height, S32 nchannels)
+{
+	llassert(width > 0 && height > 0);
+	if (nchannels < 1 || nchannels > 4)
+	{
+		llerrs << "generateMmip called with bad num channels" << llendl;
+	}
+
+	const S32 in_row = width * 2 * nchannels;
+	const S32 out_row = width * nchannels;
+	const __m128i mask3 = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+	for (S32 h = 0; h < height; h++)
+	{
+		const U8* row0 = indata + h * 2 * in_row;
+		const U8* row1 = row0 + in_row;
+		U8* data = mipdata + h * out_row;
+
+		// Bytes of output done with SSE2.  Loads never go past the end of row1.
+		S32 done = 0;
+		if (nchannels == 3)
+		{
+			// 2 output pixels from 12 bytes of each row, loaded as 16
+			for (S32 w = 0; w + 3 <= width; w += 2)
+			{
+				__m128i lo, hi;
+				sum_rows(row0 + w * 6, row1 + w * 6, lo, hi);
+				__m128i p0 = _mm_add_epi16(lo, _mm_srli_si128(lo, 6));
+				__m128i x = _mm_or_si128(_mm_srli_si128(lo, 12), _mm_slli_si128(hi, 4));
+				__m128i p1 = _mm_add_epi16(x, _mm_srli_si128(x, 6));
+				__m128i r = _mm_or_si128(_mm_and_si128(p0, mask3), _mm_slli_si128(_mm_and_si128(p1, mask3), 6));
+				r = _mm_packus_epi16(_mm_srli_epi16(r, 2), _mm_setzero_si128());
+				U8 tmp[8];
+				_mm_storel_epi64((__m128i*)tmp, r);
+				memcpy(data + w * 3, tmp, 6);	/* Flawfinder: ignore */
+				done = (w + 2) * 3;
+			}
+		}
+		else
+		{
+			// 16 bytes of output from 32 bytes of each row
+			for ( ; done + 16 <= out_row; done += 16)
+			{
+				__m128i q0 = sum_block(row0 + done * 2, row1 + done * 2, nchannels);
+				__m128i q1 = sum_block(row0 + done * 2 + 16, row1 + done * 2 + 16, nchannels);
+				_mm_storeu_si128((__m128i*)(data + done),
+								 _mm_packus_epi16(_mm_srli_epi16(q0, 2), _mm_srli_epi16(q1, 2)));
+			}
+		}
+
+		// Tail of the row
+		for (S32 i = done; i < out_row; i++)
+		{
+			S32 in0 = (i / nchannels) * 2 * nchannels + (i % nchannels);
+			S32 in1 = in0 + nchannels;
+			data[i] = (U8)(((U32)(row0[in0]) + row0[in1] + row1[in0] + row1[in1])>>2);
+		}
+	}
+}
+
+#else // LL_IMAGE_SSE2
+
+// Not built with SSE2, LLImage::setUseSSE2() never enables these.
+
+//static
+bool LLImage::isSSE2Compiled()
+{
+	return false;
+}
+
+void LLImageRaw::copyLineScaledSSE2( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len )
+{
+	llerrs << "SSE2 image kernels not compiled in" << llendl;
+}
+
+void LLImageRaw::compositeRowScaled4onto3SSE2( U8* in, U8* out, S32 in_pixel_len, S32 out_pixel_len )
+{
+	llerrs << "SSE2 image kernels not compiled in" << llendl;
+}
+
+void LLImageRaw::copyRowsScaledSSE2( const U8* in, U8* out, S32 row_bytes, S32 in_rows, S32 out_rows )
+{
+	llerrs << "SSE2 image kernels not compiled in" << llendl;
+}
+
+void LLImageRaw::compositeUnscaled4onto3SSE2( LLImageRaw* src )
+{
+	llerrs << "SSE2 image kernels not compiled in" << llendl;
+}
+
+//static
+void LLImageBase::generateMipSSE2(const U8* indata, U8* mipdata, S32 width, S32 height, S32 nchannels)
+{
+	llerrs << "SSE2 image kernels not compiled in" << llendl;
+}
+
+#endif // LL_IMAGE_SSE2
@@ -403,6 +403,84 @@ BOOL LLImageDXT::encode(const LLImageRaw* raw_image, F32 time)
 	return encodeDXT(raw_image, time, false);
 }
 
+BOOL LLImageDXT::encodeCompressed(const LLImageRaw* raw_image)
+{
+	llassert_always(raw_image);
+	resetLastError();
+
+	S32 ncomponents = raw_image->getComponents();
+	EFileFormat format;
+	switch (ncomponents)
+	{
+	  case 3:
+		format = FORMAT_DXR1;
+		break;
+	  case 4:
+		format = FORMAT_DXR5;
+		break;
+	  default:
+		setLastError("LLImageDXT::encodeCompressed: unhandled number of components");
+		return FALSE;
+	}
+
+	S32 width = raw_image->getWidth();
+	S32 height = raw_image->getHeight();
+	if (width < 1 || height < 1 || (width & (width - 1)) || (height & (height - 1)))
+	{
+		setLastError("LLImageDXT::encodeCompressed: dimensions must be powers of two");
+		return FALSE;
+	}
+
+	setSize(width, height, ncomponents);
+	mHeaderSize = sizeof(dxtfile_header_t);
+	mFileFormat = format;
+
+	S32 nmips = calcNumMips(width, height);
+	S32 w = width;
+	S32 h = height;
+
+	S32 totbytes = mHeaderSize;
+	for (S32 mip=0; mip<nmips; mip++)
+	{
+		totbytes += formatBytes(format,w,h);
+		w >>= 1;
+		h >>= 1;
+	}
+
+	allocateData(totbytes);
+
+	U8* data = getData();
+	dxtfile_header_t* header = (dxtfile_header_t*)data;
+	memset(header, 0, mHeaderSize);
+	header->fourcc = 0x20534444;
+	header->pixel_fmt.fourcc = getFourCC(format);
+	header->num_mips = nmips;
+	header->maxwidth = width;
+	header->maxheight = height;
+
+	// Uncompressed mips are generated one level at a time, only two are
+	// alive at once
+	U8* prev_mipdata = NULL;
+	w = width, h = height;
+	for (S32 mip=0; mip<nmips; mip++)
+	{
+		U8* cur_mipdata = NULL;
+		if (mip > 0)
+		{
+			cur_mipdata = new U8[w * h * ncomponents];
+			generateMip(prev_mipdata ? prev_mipdata : raw_image->getData(), cur_mipdata, w, h, ncomponents);
+			delete[] prev_mipdata;
+			prev_mipdata = cur_mipdata;
+		}
+		compressMip(cur_mipdata ? cur_mipdata : raw_image->getData(), data + getMipOffset(mip), w, h, ncomponents);
+		w >>= 1;
+		h >>= 1;
+	}
+	delete[] prev_mipdata;
+	
+	return TRUE;
+}
+
 // virtual
 bool LLImageDXT::convertToDXR()
 {
@@ -503,3 +581,211 @@ void LLImageDXT::extractMip(const U8 *indata, U8* mipdata, int width, int height
 }
 
 //============================================================================
+// BC1/BC3 block compression
+//
+// Bounding box endpoints with the box diagonal picked from the sign of the
+// color covariance, inset by 1/16 of the range (see J.M.P. van Waveren,
+// "Real-Time DXT Compression"). Not as good as a PCA or cluster fit
+// encoder, but fast enough to run on every decoded texture.
+
+namespace
+{
+	// Fetches a 4x4 block as RGBA, replicating edge pixels for mips smaller than a block
+	void get_block(const U8* indata, S32 width, S32 height, S32 ncomponents, S32 bx, S32 by, U8* block)
+	{
+		for (S32 y = 0; y < 4; y++)
+		{
+			const U8* row = indata + llmin(by + y, height - 1) * width * ncomponents;
+			for (S32 x = 0; x < 4; x++)
+			{
+				const U8* pixel = row + llmin(bx + x, width - 1) * ncomponents;
+				U8* out = block + (y * 4 + x) * 4;
+				out[0] = pixel[0];
+				out[1] = pixel[1];
+				out[2] = pixel[2];
+				out[3] = (ncomponents == 4) ? pixel[3] : 255;
+			}
+		}
+	}
+
+	U16 pack_565(const S32* color)
+	{
+		return (U16)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+	}
+
+	void unpack_565(U16 packed, S32* color)
+	{
+		S32 r = (packed >> 11) & 0x1f;
+		S32 g = (packed >> 5) & 0x3f;
+		S32 b = packed & 0x1f;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	void compress_color_block(const U8* block, U8* out)
+	{
+		S32 mincolor[3] = { 255, 255, 255 };
+		S32 maxcolor[3] = { 0, 0, 0 };
+		S32 sum[3] = { 0, 0, 0 };
+		for (S32 i = 0; i < 16; i++)
+		{
+			for (S32 c = 0; c < 3; c++)
+			{
+				S32 v = block[i * 4 + c];
+				mincolor[c] = llmin(mincolor[c], v);
+				maxcolor[c] = llmax(maxcolor[c], v);
+				sum[c] += v;
+			}
+		}
+
+		// Flip the green and blue extents when they run against red
+		S32 cov_rg = 0, cov_rb = 0;
+		for (S32 i = 0; i < 16; i++)
+		{
+			S32 dr = block[i * 4 + 0] * 16 - sum[0];
+			cov_rg += dr * (block[i * 4 + 1] * 16 - sum[1]);
+			cov_rb += dr * (block[i * 4 + 2] * 16 - sum[2]);
+		}
+		if (cov_rg < 0)
+		{
+			std::swap(mincolor[1], maxcolor[1]);
+		}
+		if (cov_rb < 0)
+		{
+			std::swap(mincolor[2], maxcolor[2]);
+		}
+
+		for (S32 c = 0; c < 3; c++)
+		{
+			S32 inset = (maxcolor[c] - mincolor[c]) >> 4;
+			mincolor[c] += inset;
+			maxcolor[c] -= inset;
+		}
+
+		U16 c0 = pack_565(maxcolor);
+		U16 c1 = pack_565(mincolor);
+		if (c0 < c1)
+		{
+			// c0 > c1 selects the four color mode
+			std::swap(c0, c1);
+		}
+
+		U32 indices = 0;
+		if (c0 != c1)
+		{
+			S32 palette[4][3];
+			unpack_565(c0, palette[0]);
+			unpack_565(c1, palette[1]);
+			for (S32 c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (S32 i = 0; i < 16; i++)
+			{
+				S32 best = 0;
+				S32 best_dist = S32_MAX;
+				for (S32 p = 0; p < 4; p++)
+				{
+					S32 dr = block[i * 4 + 0] - palette[p][0];
+					S32 dg = block[i * 4 + 1] - palette[p][1];
+					S32 db = block[i * 4 + 2] - palette[p][2];
+					S32 dist = dr * dr + dg * dg + db * db;
+					if (dist < best_dist)
+					{
+						best_dist = dist;
+						best = p;
+					}
+				}
+				indices |= (U32)best << (i * 2);
+			}
+		}
+		// else all indices select c0
+
+		out[0] = (U8)(c0 & 0xff);
+		out[1] = (U8)(c0 >> 8);
+		out[2] = (U8)(c1 & 0xff);
+		out[3] = (U8)(c1 >> 8);
+		out[4] = (U8)(indices & 0xff);
+		out[5] = (U8)((indices >> 8) & 0xff);
+		out[6] = (U8)((indices >> 16) & 0xff);
+		out[7] = (U8)(indices >> 24);
+	}
+
+	void compress_alpha_block(const U8* block, U8* out)
+	{
+		S32 mina = 255, maxa = 0;
+		for (S32 i = 0; i < 16; i++)
+		{
+			mina = llmin(mina, (S32)block[i * 4 + 3]);
+			maxa = llmax(maxa, (S32)block[i * 4 + 3]);
+		}
+		// Keep fully opaque and fully transparent exact, they are common
+		// and the alpha mask test depends on them
+		if (mina > 0 && maxa < 255)
+		{
+			S32 inset = (maxa - mina) >> 5;
+			mina += inset;
+			maxa -= inset;
+		}
+
+		U64 indices = 0;
+		if (maxa != mina)
+		{
+			// a0 > a1 selects the eight value mode
+			S32 palette[8];
+			palette[0] = maxa;
+			palette[1] = mina;
+			for (S32 p = 1; p < 7; p++)
+			{
+				palette[p + 1] = ((7 - p) * maxa + p * mina) / 7;
+			}
+			for (S32 i = 0; i < 16; i++)
+			{
+				S32 a = block[i * 4 + 3];
+				S32 best = 0;
+				S32 best_dist = S32_MAX;
+				for (S32 p = 0; p < 8; p++)
+				{
+					S32 dist = llabs(a - palette[p]);
+					if (dist < best_dist)
+					{
+						best_dist = dist;
+						best = p;
+					}
+				}
+				indices |= (U64)best << (i * 3);
+			}
+		}
+
+		out[0] = (U8)maxa;
+		out[1] = (U8)mina;
+		for (S32 i = 0; i < 6; i++)
+		{
+			out[2 + i] = (U8)((indices >> (i * 8)) & 0xff);
+		}
+	}
+}
+
+//static
+void LLImageDXT::compressMip(const U8* indata, U8* mipdata, S32 width, S32 height, S32 ncomponents)
+{
+	U8 block[64];
+	for (S32 by = 0; by < height; by += 4)
+	{
+		for (S32 bx = 0; bx < width; bx += 4)
+		{
+			get_block(indata, width, height, ncomponents, bx, by, block);
+			if (ncomponents == 4)
+			{
+				compress_alpha_block(block, mipdata);
+				mipdata += 8;
+			}
+			compress_color_block(block, mipdata);
+			mipdata += 8;
+		}
+	}
+}
+
+//============================================================================
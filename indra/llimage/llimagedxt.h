@@ -108,6 +108,10 @@ public:
 	/*virtual*/ S32 calcDataSize(S32 discard_level = 0);
 
 	BOOL getMipData(LLPointer<LLImageRaw>& raw, S32 discard=-1);
+
+	// Block compresses raw_image, with a full mip chain, to DXR1 (BC1, 3 components)
+	// or DXR5 (BC3, 4 components). Dimensions must be powers of two.
+	BOOL encodeCompressed(const LLImageRaw* raw_image);
 	
 	void setFormat();
 	S32 getMipOffset(S32 discard);
@@ -132,6 +136,7 @@ public:
 private:
 	static void extractMip(const U8 *indata, U8* mipdata, int width, int height,
 						   int mip_width, int mip_height, EFileFormat format);
+	static void compressMip(const U8* indata, U8* mipdata, S32 width, S32 height, S32 ncomponents);
 	
 private:
 	EFileFormat mFileFormat;
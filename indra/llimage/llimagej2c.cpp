@@ -30,6 +30,7 @@
 #include "lldir.h"
 #include "llimagej2c.h"
 #include "llmemtype.h"
+#include "lltimer.h"
 
 typedef LLImageJ2CImpl* (*CreateLLImageJ2CFunction)();
 typedef void (*DestroyLLImageJ2CFunction)(LLImageJ2CImpl*);
@@ -173,6 +174,7 @@ LLImageJ2C::LLImageJ2C() : 	LLImageFormatted(IMG_CODEC_J2C),
 							mRawDiscardLevel(-1),
 							mRate(0.0f),
 							mReversible(FALSE),
+							mDecodeTime(0.f),
 							mAreaUsedForDataSizeCalcs(0)
 {
 	//We assume here that if we wanted to create via
@@ -297,7 +299,15 @@ BOOL LLImageJ2C::decodeChannels(LLImageRaw *raw_imagep, F32 decode_time, S32 fir
 		// Update the raw discard level
 		updateRawDiscardLevel();
 		mDecoding = TRUE;
+		LLTimer decode_timer;
 		res = mImpl->decodeImpl(*this, *raw_imagep, decode_time, first_channel, max_channel_count);
+		mDecodeTime += decode_timer.getElapsedTimeF32();
+		if (res)
+		{
+			LL_DEBUGS("Texture") << "Decoded " << getWidth() << "x" << getHeight()
+								 << " discard " << (S32)mRawDiscardLevel << " in "
+								 << mDecodeTime * 1000.f << " ms" << LL_ENDL;
+		}
 	}
 	
 	if (res)
@@ -322,6 +332,15 @@ BOOL LLImageJ2C::decodeChannels(LLImageRaw *raw_imagep, F32 decode_time, S32 fir
 }
 
 
+// virtual
+void LLImageJ2C::releaseDecodeState()
+{
+	if (mImpl)
+	{
+		mImpl->releaseDecodeState();
+	}
+}
+
 BOOL LLImageJ2C::encode(const LLImageRaw *raw_imagep, F32 encode_time)
 {
 	return encode(raw_imagep, NULL, encode_time);
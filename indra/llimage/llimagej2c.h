@@ -44,6 +44,7 @@ public:
 	/*virtual*/ BOOL updateData();
 	/*virtual*/ BOOL decode(LLImageRaw *raw_imagep, F32 decode_time);
 	/*virtual*/ BOOL decodeChannels(LLImageRaw *raw_imagep, F32 decode_time, S32 first_channel, S32 max_channel_count);
+	/*virtual*/ void releaseDecodeState();
 	/*virtual*/ BOOL encode(const LLImageRaw *raw_imagep, F32 encode_time);
 	/*virtual*/ S32 calcHeaderSize();
 	/*virtual*/ S32 calcDataSize(S32 discard_level = 0);
@@ -72,6 +73,9 @@ public:
 	static void openDSO();
 	static void closeDSO();
 	static std::string getEngineInfo();
+
+	// Seconds spent in decodeChannels() on this image so far
+	F32 getDecodeTime() const { return mDecodeTime; }
 	
 protected:
 	friend class LLImageJ2CImpl;
@@ -88,6 +92,7 @@ protected:
 	S8  mRawDiscardLevel;
 	F32 mRate;
 	BOOL mReversible;
+	F32 mDecodeTime;
 	LLImageJ2CImpl *mImpl;
 	std::string mLastError;
 };
@@ -112,6 +117,9 @@ protected:
 	virtual BOOL decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decode_time, S32 first_channel, S32 max_channel_count) = 0;
 	virtual BOOL encodeImpl(LLImageJ2C &base, const LLImageRaw &raw_image, const char* comment_text, F32 encode_time=0.0,
 							BOOL reversible=FALSE) = 0;
+	// Free anything kept from the last decodeImpl() for decoding more
+	// channels of the same data.
+	virtual void releaseDecodeState() {}
 
 	friend class LLImageJ2C;
 };
@@ -28,12 +28,16 @@
 
 #include "llimageworker.h"
 #include "llimagedxt.h"
+#include "lltimer.h"
 
 //----------------------------------------------------------------------------
 
+LLAtomicU32 LLImageDecodeThread::sDecodeMicroseconds;
+LLAtomicU32 LLImageDecodeThread::sDecodeCount;
+
 // MAIN THREAD
-LLImageDecodeThread::LLImageDecodeThread(bool threaded)
-	: LLQueuedThread("imagedecode", threaded)
+LLImageDecodeThread::LLImageDecodeThread(bool threaded, bool concurrent_queue, S32 pool_size)
+	: LLQueuedThread("imagedecode", threaded, concurrent_queue, pool_size)
 {
 	mCreationMutex = new LLMutex(getAPRPool());
 }
@@ -113,6 +117,7 @@ LLImageDecodeThread::ImageRequest::~ImageRequest()
 bool LLImageDecodeThread::ImageRequest::processRequest()
 {
 	const F32 decode_time_slice = .1f;
+	const U64 start_time = LLTimer::getTotalTime();
 	bool done = true;
 	if (!mDecodedRaw && mFormattedImage.notNull())
 	{
@@ -151,6 +156,15 @@ bool LLImageDecodeThread::ImageRequest::processRequest()
 		done = mFormattedImage->decodeChannels(mDecodedImageAux, decode_time_slice, 4, 4); // 1ms
 		mDecodedAux = done;
 	}
+	if (done && mFormattedImage.notNull())
+	{
+		mFormattedImage->releaseDecodeState();
+	}
+	sDecodeMicroseconds += (U32)(LLTimer::getTotalTime() - start_time);
+	if (done)
+	{
+		sDecodeCount++;
+	}
 
 	return done;
 }
@@ -72,7 +72,7 @@ public:
 	};
 	
 public:
-	LLImageDecodeThread(bool threaded = true);
+	LLImageDecodeThread(bool threaded = true, bool concurrent_queue = false, S32 pool_size = 1);
 	handle_t decodeImage(LLImageFormatted* image,
 						 U32 priority, S32 discard, BOOL needs_aux,
 						 Responder* responder);
@@ -80,8 +80,17 @@ public:
 
 	// Used by unit tests to check the consistency of the thread instance
 	S32 tut_size();
+
+	// Time spent decoding by all decode threads, in microseconds, and the
+	// number of images decoded. The time wraps after about 71 minutes, so
+	// only look at differences.
+	static U32 getDecodeMicroseconds() { return sDecodeMicroseconds; }
+	static U32 getDecodeCount() { return sDecodeCount; }
 	
 private:
+	static LLAtomicU32 sDecodeMicroseconds;
+	static LLAtomicU32 sDecodeCount;
+
 	struct creation_info
 	{
 		handle_t handle;
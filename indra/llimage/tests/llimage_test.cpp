@@ -0,0 +1,405 @@
+/**
+ * @file llimage_test.cpp
+ * @brief Scalar vs SSE2 checks and throughput benchmark for the LLImageRaw
+ * scaling and compositing kernels and LLImageBase::generateMip(), and
+ * round trip checks for the LLImageDXT block compressor
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+#include <iostream>
+
+#include "../llimage.h"
+#include "../llimagedxt.h"
+#include "llpointer.h"
+#include "lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	U32 sSeed = 1;
+
+	// Random image, with alpha pushed towards 0 and 255 so the composite
+	// special cases get hit.
+	LLImageRaw* make_image(S32 width, S32 height, S32 components)
+	{
+		LLImageRaw* image = new LLImageRaw(width, height, components);
+		U8* data = image->getData();
+		for (S32 i = 0; i < width * height * components; i++)
+		{
+			sSeed = sSeed * 1103515245 + 12345;
+			U8 v = U8(sSeed >> 16);
+			if (components == 4 && i % 4 == 3)
+			{
+				v = (v < 64) ? 0 : ((v > 192) ? 255 : v);
+			}
+			data[i] = v;
+		}
+		return image;
+	}
+
+	LLImageRaw* copy_image(LLImageRaw* src)
+	{
+		LLImageRaw* image = new LLImageRaw(src->getWidth(), src->getHeight(), src->getComponents());
+		memcpy(image->getData(), src->getData(), src->getDataSize());
+		return image;
+	}
+
+	bool same_image(LLImageRaw* a, LLImageRaw* b)
+	{
+		return a->getWidth() == b->getWidth()
+			&& a->getHeight() == b->getHeight()
+			&& a->getComponents() == b->getComponents()
+			&& !memcmp(a->getData(), b->getData(), a->getDataSize());
+	}
+
+	enum EKernel
+	{
+		KERNEL_SCALE,
+		KERNEL_COPY_SCALED,
+		KERNEL_COMPOSITE_SCALED,
+		KERNEL_COMPOSITE_UNSCALED,
+		KERNEL_MIP
+	};
+
+	// Runs one kernel on copies of src (and dst), returns the result
+	LLImageRaw* run_kernel(EKernel kernel, LLImageRaw* src, LLImageRaw* dst, S32 width, S32 height)
+	{
+		LLImageRaw* res = NULL;
+		switch (kernel)
+		{
+		case KERNEL_SCALE:
+			res = copy_image(src);
+			res->scale(width, height);
+			break;
+		case KERNEL_COPY_SCALED:
+			res = new LLImageRaw(width, height, src->getComponents());
+			res->copyScaled(src);
+			break;
+		case KERNEL_COMPOSITE_SCALED:
+			res = copy_image(dst);
+			res->compositeScaled4onto3(src);
+			break;
+		case KERNEL_COMPOSITE_UNSCALED:
+			res = copy_image(dst);
+			res->compositeUnscaled4onto3(src);
+			break;
+		case KERNEL_MIP:
+			res = new LLImageRaw(src->getWidth() / 2, src->getHeight() / 2, src->getComponents());
+			LLImageBase::generateMip(src->getData(), res->getData(), res->getWidth(), res->getHeight(), res->getComponents());
+			break;
+		}
+		return res;
+	}
+
+	// Scalar and SSE2 results of a kernel must match byte for byte
+	bool check_kernel(EKernel kernel, S32 src_width, S32 src_height, S32 components, S32 width, S32 height)
+	{
+		LLPointer<LLImageRaw> src = make_image(src_width, src_height, components);
+		LLPointer<LLImageRaw> dst = make_image(width, height, 3);
+
+		LLImage::setUseSSE2(false);
+		LLPointer<LLImageRaw> scalar = run_kernel(kernel, src, dst, width, height);
+		LLImage::setUseSSE2(true);
+		LLPointer<LLImageRaw> sse2 = run_kernel(kernel, src, dst, width, height);
+		return same_image(scalar, sse2);
+	}
+
+	// Source MPixels per second for one kernel
+	F64 bench_kernel(EKernel kernel, bool use_sse2, S32 components, S32 width, S32 height)
+	{
+		const S32 SRC_SIZE = 1024;
+		const S32 PASSES = 10;
+		LLPointer<LLImageRaw> src = make_image(SRC_SIZE, SRC_SIZE, components);
+		LLPointer<LLImageRaw> dst = make_image(width, height, 3);
+
+		LLImage::setUseSSE2(use_sse2);
+		LLTimer timer;
+		for (S32 i = 0; i < PASSES; i++)
+		{
+			LLPointer<LLImageRaw> res = run_kernel(kernel, src, dst, width, height);
+		}
+		F64 elapsed = timer.getElapsedTimeF64();
+		return (F64)SRC_SIZE * SRC_SIZE * PASSES / 1000000.0 / elapsed;
+	}
+
+	// Reference BC1/BC3 block decoder, RGBA out
+	void decode_bc_block(const U8* in, bool has_alpha, U8* out)
+	{
+		if (has_alpha)
+		{
+			S32 a[8];
+			a[0] = in[0];
+			a[1] = in[1];
+			for (S32 i = 1; i < 7; i++)
+			{
+				a[i + 1] = (a[0] > a[1]) ? ((7 - i) * a[0] + i * a[1]) / 7 : (i < 5 ? ((5 - i) * a[0] + i * a[1]) / 5 : (i == 5 ? 0 : 255));
+			}
+			U64 bits = 0;
+			for (S32 i = 0; i < 6; i++)
+			{
+				bits |= (U64)in[2 + i] << (i * 8);
+			}
+			for (S32 i = 0; i < 16; i++)
+			{
+				out[i * 4 + 3] = (U8)a[(bits >> (i * 3)) & 7];
+			}
+			in += 8;
+		}
+		U16 c0 = in[0] | (in[1] << 8);
+		U16 c1 = in[2] | (in[3] << 8);
+		S32 c[4][3];
+		for (S32 e = 0; e < 2; e++)
+		{
+			U16 v = e ? c1 : c0;
+			c[e][0] = ((v >> 11) << 3) | ((v >> 11) >> 2);
+			c[e][1] = (((v >> 5) & 0x3f) << 2) | (((v >> 5) & 0x3f) >> 4);
+			c[e][2] = ((v & 0x1f) << 3) | ((v & 0x1f) >> 2);
+		}
+		for (S32 k = 0; k < 3; k++)
+		{
+			c[2][k] = (c0 > c1) ? (2 * c[0][k] + c[1][k]) / 3 : (c[0][k] + c[1][k]) / 2;
+			c[3][k] = (c0 > c1) ? (c[0][k] + 2 * c[1][k]) / 3 : 0;
+		}
+		U32 bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((U32)in[7] << 24);
+		for (S32 i = 0; i < 16; i++)
+		{
+			S32 idx = (bits >> (i * 2)) & 3;
+			out[i * 4 + 0] = (U8)c[idx][0];
+			out[i * 4 + 1] = (U8)c[idx][1];
+			out[i * 4 + 2] = (U8)c[idx][2];
+		}
+	}
+
+	// RMS error of the color channels of the largest mip, alpha mismatches
+	// on fully opaque or transparent pixels are counted in alpha_extreme_errors
+	F64 bc_round_trip_error(LLImageRaw* raw, LLImageDXT* dxt, S32& alpha_extreme_errors)
+	{
+		S32 width = raw->getWidth();
+		S32 height = raw->getHeight();
+		S32 nc = raw->getComponents();
+		const U8* src = raw->getData();
+		const U8* block = dxt->getData() + dxt->getMipOffset(0);
+		F64 sq_err = 0.0;
+		alpha_extreme_errors = 0;
+		for (S32 by = 0; by < height; by += 4)
+		{
+			for (S32 bx = 0; bx < width; bx += 4)
+			{
+				U8 out[64];
+				decode_bc_block(block, nc == 4, out);
+				block += (nc == 4) ? 16 : 8;
+				for (S32 i = 0; i < 16; i++)
+				{
+					const U8* pixel = src + ((by + i / 4) * width + bx + i % 4) * nc;
+					for (S32 k = 0; k < 3; k++)
+					{
+						F64 d = (F64)out[i * 4 + k] - pixel[k];
+						sq_err += d * d;
+					}
+					if (nc == 4 && (pixel[3] == 0 || pixel[3] == 255) && out[i * 4 + 3] != pixel[3])
+					{
+						alpha_extreme_errors++;
+					}
+				}
+			}
+		}
+		return sqrt(sq_err / (width * height * 3));
+	}
+
+	// Smooth gradients with some noise, what textures mostly look like
+	LLImageRaw* make_gradient_image(S32 width, S32 height, S32 components)
+	{
+		LLImageRaw* image = new LLImageRaw(width, height, components);
+		U8* data = image->getData();
+		for (S32 y = 0; y < height; y++)
+		{
+			for (S32 x = 0; x < width; x++)
+			{
+				sSeed = sSeed * 1103515245 + 12345;
+				U8* pixel = data + (y * width + x) * components;
+				pixel[0] = (U8)llmin(255, x * 255 / width + (S32)((sSeed >> 16) & 7));
+				pixel[1] = (U8)(y * 255 / height);
+				pixel[2] = (U8)((x * y * 255) / (width * height));
+				if (components == 4)
+				{
+					pixel[3] = (x < width / 2) ? 255 : ((y < height / 4) ? 0 : (U8)(y * 255 / height));
+				}
+			}
+		}
+		return image;
+	}
+}
+
+namespace tut
+{
+	struct image_test
+	{
+		image_test()
+		{
+			LLImage::initClass();
+		}
+		~image_test()
+		{
+			LLImage::cleanupClass();
+		}
+	};
+	typedef test_group<image_test> image_group_t;
+	typedef image_group_t::object image_object_t;
+	tut::image_group_t image_instance("LLImage");
+
+	template<> template<>
+	void image_object_t::test<1>()
+		// SSE2 kernels match the scalar ones
+	{
+		LLImage::setUseSSE2(true);
+		if (!LLImage::getUseSSE2())
+		{
+			std::cout << "\nSSE2 image kernels not available, skipped" << std::endl;
+			return;
+		}
+
+		// odd sizes to exercise the scalar tails, up and down scaling
+		const S32 sizes[][4] = {
+			{ 64, 64, 32, 32 },
+			{ 100, 37, 33, 70 },
+			{ 256, 128, 512, 96 },
+			{ 17, 5, 40, 9 },
+			{ 333, 211, 97, 211 },
+		};
+		const S32 NUM_SIZES = sizeof(sizes) / sizeof(sizes[0]);
+		for (S32 s = 0; s < NUM_SIZES; s++)
+		{
+			S32 sw = sizes[s][0], sh = sizes[s][1], dw = sizes[s][2], dh = sizes[s][3];
+			for (S32 c = 1; c <= 4; c++)
+			{
+				if (c == 2)
+				{
+					continue;	// scale() and copyScaled() take 1, 3 or 4
+				}
+				ensure(llformat("scale %dx%dx%d to %dx%d", sw, sh, c, dw, dh), check_kernel(KERNEL_SCALE, sw, sh, c, dw, dh));
+				ensure(llformat("copyScaled %dx%dx%d to %dx%d", sw, sh, c, dw, dh), check_kernel(KERNEL_COPY_SCALED, sw, sh, c, dw, dh));
+			}
+			ensure(llformat("compositeScaled4onto3 %dx%d to %dx%d", sw, sh, dw, dh), check_kernel(KERNEL_COMPOSITE_SCALED, sw, sh, 4, dw, dh));
+			ensure(llformat("compositeUnscaled4onto3 %dx%d", sw, sh), check_kernel(KERNEL_COMPOSITE_UNSCALED, sw, sh, 4, sw, sh));
+			for (S32 c = 1; c <= 4; c++)
+			{
+				ensure(llformat("generateMip %dx%dx%d", sw, sh, c), check_kernel(KERNEL_MIP, sw & ~1, sh & ~1, c, sw / 2, sh / 2));
+			}
+		}
+	}
+
+	template<> template<>
+	void image_object_t::test<2>()
+		// throughput benchmark, source MPixels/s, with LL_BENCHMARKS only
+	{
+		if (!run_benchmarks())
+		{
+			return;
+		}
+		LLImage::setUseSSE2(true);
+		bool have_sse2 = LLImage::getUseSSE2();
+
+		struct
+		{
+			const char* mName;
+			EKernel mKernel;
+			S32 mComponents;
+			S32 mWidth;
+			S32 mHeight;
+		} benches[] = {
+			{ "scale 1024 -> 512, RGB", KERNEL_SCALE, 3, 512, 512 },
+			{ "scale 1024 -> 512, RGBA", KERNEL_SCALE, 4, 512, 512 },
+			{ "scale 1024 -> 1536x768, RGBA", KERNEL_SCALE, 4, 1536, 768 },
+			{ "compositeScaled4onto3 -> 512", KERNEL_COMPOSITE_SCALED, 4, 512, 512 },
+			{ "compositeUnscaled4onto3", KERNEL_COMPOSITE_UNSCALED, 4, 1024, 1024 },
+			{ "generateMip, L", KERNEL_MIP, 1, 512, 512 },
+			{ "generateMip, RGB", KERNEL_MIP, 3, 512, 512 },
+			{ "generateMip, RGBA", KERNEL_MIP, 4, 512, 512 },
+		};
+
+		std::cout << "\n" << llformat("%-32s %10s %10s", "MPixels/s", "scalar", "SSE2");
+		for (S32 i = 0; i < (S32)(sizeof(benches) / sizeof(benches[0])); i++)
+		{
+			F64 scalar = bench_kernel(benches[i].mKernel, false, benches[i].mComponents, benches[i].mWidth, benches[i].mHeight);
+			if (have_sse2)
+			{
+				F64 sse2 = bench_kernel(benches[i].mKernel, true, benches[i].mComponents, benches[i].mWidth, benches[i].mHeight);
+				std::cout << llformat("\n%-32s %10.1f %10.1f  %.2fx", benches[i].mName, scalar, sse2, sse2 / scalar);
+			}
+			else
+			{
+				std::cout << llformat("\n%-32s %10.1f %10s", benches[i].mName, scalar, "n/a");
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	template<> template<>
+	void image_object_t::test<3>()
+		// BC1/BC3 compression: layout, mips and round trip error
+	{
+		const S32 sizes[][2] = { { 256, 256 }, { 128, 32 }, { 16, 64 }, { 4, 4 } };
+		for (S32 s = 0; s < (S32)(sizeof(sizes) / sizeof(sizes[0])); s++)
+		{
+			S32 width = sizes[s][0], height = sizes[s][1];
+			for (S32 c = 3; c <= 4; c++)
+			{
+				LLPointer<LLImageRaw> raw = make_gradient_image(width, height, c);
+				LLPointer<LLImageDXT> dxt = new LLImageDXT();
+				std::string name = llformat("%dx%dx%d", width, height, c);
+				ensure(name + " encodes", dxt->encodeCompressed(raw));
+				ensure_equals(name + " format", dxt->getFileFormat(), c == 3 ? LLImageDXT::FORMAT_DXR1 : LLImageDXT::FORMAT_DXR5);
+
+				// reparse the header like a cache read does
+				LLPointer<LLImageDXT> read = new LLImageDXT();
+				U8* copy = new U8[dxt->getDataSize()];
+				memcpy(copy, dxt->getData(), dxt->getDataSize());
+				read->setData(copy, dxt->getDataSize());
+				ensure(name + " header", read->updateData());
+				ensure_equals(name + " width", read->getWidth(), width);
+				ensure_equals(name + " height", read->getHeight(), height);
+				ensure_equals(name + " components", (S32)read->getComponents(), c);
+				ensure_equals(name + " discard", (S32)read->getDiscardLevel(), 0);
+				S32 block_bytes = (c == 3) ? 8 : 16;
+				ensure_equals(name + " largest mip size", dxt->getDataSize() - dxt->getMipOffset(0),
+							  (width / 4) * (height / 4) * block_bytes);
+
+				S32 alpha_errors = 0;
+				F64 rms = bc_round_trip_error(raw, dxt, alpha_errors);
+				ensure(llformat("%s rms error %.2f", name.c_str(), rms), rms < 6.0);
+				ensure_equals(name + " opaque/transparent alpha kept", alpha_errors, 0);
+			}
+		}
+
+		// unsupported input is refused
+		LLPointer<LLImageRaw> lum = make_image(64, 64, 1);
+		LLPointer<LLImageRaw> npot = make_image(48, 64, 3);
+		LLPointer<LLImageDXT> dxt = new LLImageDXT();
+		ensure("one component refused", !dxt->encodeCompressed(lum));
+		ensure("non power of two refused", !dxt->encodeCompressed(npot));
+	}
+}
@@ -91,71 +91,111 @@ void info_callback(const char* msg, void*)
 }
 
 
-LLImageJ2COJ::LLImageJ2COJ()
-	: LLImageJ2CImpl()
+namespace
 {
-}
+	opj_image_t* decode_codestream(U8* data, S32 size, S32 reduce)
+	{
+		opj_dparameters_t parameters;	/* decompression parameters */
+		opj_event_mgr_t event_mgr;		/* event manager */
 
+		/* configure the event callbacks (not required) */
+		memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
+		event_mgr.error_handler = error_callback;
+		event_mgr.warning_handler = warning_callback;
+		event_mgr.info_handler = info_callback;
 
-LLImageJ2COJ::~LLImageJ2COJ()
-{
-}
+		/* set decoding parameters to default values */
+		opj_set_default_decoder_parameters(&parameters);
 
+		parameters.cp_reduce = reduce;
 
-BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decode_time, S32 first_channel, S32 max_channel_count)
-{
-	//
-	// FIXME: Get the comment field out of the texture
-	//
+		/* get a decoder handle */
+		opj_dinfo_t* dinfo = opj_create_decompress(CODEC_J2K);
 
-	LLTimer decode_timer;
+		/* catch events using our callbacks and give a local context */
+		opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);			
 
-	opj_dparameters_t parameters;	/* decompression parameters */
-	opj_event_mgr_t event_mgr;		/* event manager */
-	opj_image_t *image = NULL;
+		/* setup the decoder decoding parameters using user parameters */
+		opj_setup_decoder(dinfo, &parameters);
 
-	opj_dinfo_t* dinfo = NULL;	/* handle to a decompressor */
-	opj_cio_t *cio = NULL;
+		/* open a byte stream */
+		opj_cio_t* cio = opj_cio_open((opj_common_ptr)dinfo, data, size);
 
+		/* decode the stream and fill the image structure */
+		opj_image_t* image = opj_decode(dinfo, cio);
 
-	/* configure the event callbacks (not required) */
-	memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
-	event_mgr.error_handler = error_callback;
-	event_mgr.warning_handler = warning_callback;
-	event_mgr.info_handler = info_callback;
+		/* close the byte stream */
+		opj_cio_close(cio);
 
-	/* set decoding parameters to default values */
-	opj_set_default_decoder_parameters(&parameters);
+		/* free remaining structures */
+		if(dinfo)
+		{
+			opj_destroy_decompress(dinfo);
+		}
+		return image;
+	}
+}
 
-	parameters.cp_reduce = base.getRawDiscardLevel();
+//----------------------------------------------------------------------------
 
-	/* decode the code-stream */
-	/* ---------------------- */
+LLImageJ2COJ::LLImageJ2COJ()
+	: LLImageJ2CImpl(),
+	  mDecodedImage(NULL),
+	  mDecodedDataSize(0),
+	  mDecodedDiscard(-1)
+{
+}
 
-	/* JPEG-2000 codestream */
 
-	/* get a decoder handle */
-	dinfo = opj_create_decompress(CODEC_J2K);
+LLImageJ2COJ::~LLImageJ2COJ()
+{
+	releaseDecodeState();
+}
 
-	/* catch events using our callbacks and give a local context */
-	opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);			
+// virtual
+void LLImageJ2COJ::releaseDecodeState()
+{
+	if (mDecodedImage)
+	{
+		opj_image_destroy(mDecodedImage);
+		mDecodedImage = NULL;
+	}
+	mDecodedDataSize = 0;
+	mDecodedDiscard = -1;
+}
 
-	/* setup the decoder decoding parameters using user parameters */
-	opj_setup_decoder(dinfo, &parameters);
+opj_image_t* LLImageJ2COJ::takeDecodedImage(LLImageJ2C &base)
+{
+	opj_image_t* image = NULL;
+	// base owns this impl and drops the kept image whenever its data is
+	// deleted or reallocated, so only the discard level can have changed.
+	// The size check is a guard against data rewritten in place.
+	if (mDecodedImage
+		&& mDecodedDataSize == base.getDataSize()
+		&& mDecodedDiscard == base.getRawDiscardLevel())
+	{
+		image = mDecodedImage;
+		mDecodedImage = NULL;
+	}
+	releaseDecodeState();
+	return image;
+}
 
-	/* open a byte stream */
-	cio = opj_cio_open((opj_common_ptr)dinfo, base.getData(), base.getDataSize());
 
-	/* decode the stream and fill the image structure */
-	image = opj_decode(dinfo, cio);
+BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decode_time, S32 first_channel, S32 max_channel_count)
+{
+	//
+	// FIXME: Get the comment field out of the texture
+	//
 
-	/* close the byte stream */
-	opj_cio_close(cio);
+	/* decode the code-stream */
+	/* ---------------------- */
 
-	/* free remaining structures */
-	if(dinfo)
+	/* JPEG-2000 codestream */
+	opj_image_t *image = takeDecodedImage(base);
+	if (!image)
 	{
-		opj_destroy_decompress(dinfo);
+		image = decode_codestream(base.getData(), base.getDataSize(), base.getRawDiscardLevel());
 	}
 
 	// The image decode failed if the return was NULL or the component
@@ -243,8 +283,18 @@ BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decod
 		}
 	}
 
-	/* free image data structure */
-	opj_image_destroy(image);
+	if (img_components > first_channel + channels)
+	{
+		// Keep the rest for the next decodeChannels()
+		mDecodedImage = image;
+		mDecodedDataSize = base.getDataSize();
+		mDecodedDiscard = base.getRawDiscardLevel();
+	}
+	else
+	{
+		/* free image data structure */
+		opj_image_destroy(image);
+	}
 
 	return TRUE; // done
 }
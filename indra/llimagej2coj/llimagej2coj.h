@@ -29,6 +29,8 @@
 
 #include "llimagej2c.h"
 
+struct opj_image;
+
 class LLImageJ2COJ : public LLImageJ2CImpl
 {	
 public:
@@ -40,11 +42,27 @@ protected:
 	/*virtual*/ BOOL decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decode_time, S32 first_channel, S32 max_channel_count);
 	/*virtual*/ BOOL encodeImpl(LLImageJ2C &base, const LLImageRaw &raw_image, const char* comment_text, F32 encode_time=0.0,
 								BOOL reversible = FALSE);
+	/*virtual*/ void releaseDecodeState();
+	// The decoded image kept from the last decodeImpl() of base's current
+	// data at the same discard level, or NULL.  The caller owns it.
+	struct opj_image* takeDecodedImage(LLImageJ2C &base);
 	int ceildivpow2(int a, int b)
 	{
 		// Divide a by b to the power of 2 and round upwards.
 		return (a + (1 << b) - 1) >> b;
 	}
+
+private:
+	// OpenJPEG decodes every component at once.  When a decode leaves
+	// components unused (the aux channel is decoded by a second
+	// decodeChannels() call) the result is kept here for that call
+	// instead of decoding the whole codestream again.  The owning
+	// LLImageJ2C releases it when its data changes.  This is not
+	// progressive decoding: OpenJPEG 1.x can't resume a decode, so more
+	// data or a lower discard level is always decoded from the start.
+	struct opj_image* mDecodedImage;
+	S32 mDecodedDataSize;
+	S32 mDecodedDiscard;
 };
 
 #endif
@@ -761,3 +761,85 @@ void LLCamera::calculateWorldFrustumPlanes()
 // 						  -1.f,  0.f,  0.f,  0.f,   // -X becomes Y
 //  					   0.f,  1.f,  0.f,  0.f,   //  Y becomes Z
 // 						   0.f,  0.f,  0.f,  1.f };
+
+// ---------------- LLCullPlanes ----------------
+
+LLCullPlanes::LLCullPlanes()
+:	mNumGroups(0)
+{
+	memset(mPlanes, 0, sizeof(mPlanes));
+}
+
+void LLCullPlanes::set(LLCamera& camera, BOOL far_clip)
+{
+	memset(mPlanes, 0, sizeof(mPlanes));
+	U32 count = 0;
+	for (U32 i = 0; i < camera.getAgentPlaneCount(); i++)
+	{
+		if ((i == LLCamera::AGENT_PLANE_FAR && !far_clip) ||
+			camera.isAgentPlaneIgnored(i))
+		{
+			continue;
+		}
+		LLPlane plane = camera.getAgentPlane(i);
+		F32 (*p)[4] = mPlanes[count / 4];
+		U32 j = count % 4;
+		p[NX][j] = plane.mV[VX];
+		p[NY][j] = plane.mV[VY];
+		p[NZ][j] = plane.mV[VZ];
+		p[D][j] = plane.mV[VW];
+		p[AX][j] = fabsf(plane.mV[VX]);
+		p[AY][j] = fabsf(plane.mV[VY]);
+		p[AZ][j] = fabsf(plane.mV[VZ]);
+		count++;
+	}
+	mNumGroups = (count + 3) / 4;
+}
+
+void LLCullPlanes::AABBInFrustum(const F32* const center[3], const F32* const radius[3], U32 count, S8* results) const
+{
+	llassert(count % 4 == 0);
+#if LL_VECTORIZE
+	const __m128 zero = _mm_setzero_ps();
+	for (U32 i = 0; i < count; i += 4)
+	{
+		// Four boxes against one plane at a time
+		const __m128 cx = _mm_loadu_ps(center[VX] + i);
+		const __m128 cy = _mm_loadu_ps(center[VY] + i);
+		const __m128 cz = _mm_loadu_ps(center[VZ] + i);
+		const __m128 rx = _mm_loadu_ps(radius[VX] + i);
+		const __m128 ry = _mm_loadu_ps(radius[VY] + i);
+		const __m128 rz = _mm_loadu_ps(radius[VZ] + i);
+		__m128 outside = zero;
+		__m128 partial = zero;
+		for (U32 g = 0; g < mNumGroups; g++)
+		{
+			const F32 (*p)[4] = mPlanes[g];
+			for (U32 j = 0; j < 4; j++)
+			{
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[NX][j]), cx),
+													_mm_mul_ps(_mm_set1_ps(p[NY][j]), cy)),
+										 _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[NZ][j]), cz),
+													_mm_set1_ps(p[D][j])));
+				__m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[AX][j]), rx),
+													  _mm_mul_ps(_mm_set1_ps(p[AY][j]), ry)),
+										   _mm_mul_ps(_mm_set1_ps(p[AZ][j]), rz));
+				outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_sub_ps(dist, extent), zero));
+				partial = _mm_or_ps(partial, _mm_cmpgt_ps(_mm_add_ps(dist, extent), zero));
+			}
+		}
+		S32 out_mask = _mm_movemask_ps(outside);
+		S32 partial_mask = _mm_movemask_ps(partial);
+		for (U32 k = 0; k < 4; k++)
+		{
+			results[i + k] = (out_mask & (1 << k)) ? 0 : ((partial_mask & (1 << k)) ? 1 : 2);
+		}
+	}
+#else
+	for (U32 i = 0; i < count; i++)
+	{
+		results[i] = AABBInFrustum(LLVector3(center[VX][i], center[VY][i], center[VZ][i]),
+								   LLVector3(radius[VX][i], radius[VY][i], radius[VZ][i]));
+	}
+#endif
+}
@@ -31,6 +31,7 @@
 #include "llmath.h"
 #include "llcoordframe.h"
 #include "llplane.h"
+#include "llv4math.h"
 
 const F32 DEFAULT_FIELD_OF_VIEW 	= 60.f * DEG_TO_RAD;
 const F32 DEFAULT_ASPECT_RATIO 		= 640.f / 480.f;
@@ -138,6 +139,8 @@ public:
 	LLVector3 mAgentFrustum[8];  //8 corners of 6-plane frustum
 	F32	mFrustumCornerDist;		//distance to corner of frustum against far clip plane
 	LLPlane getAgentPlane(U32 idx) { return mAgentPlanes[idx].p; }
+	U32 getAgentPlaneCount() const { return mPlaneCount; }
+	BOOL isAgentPlaneIgnored(U32 idx) const { return mAgentPlanes[idx].mask == 0xff; }
 
 public:
 	LLCamera();
@@ -217,6 +220,92 @@ protected:
 	void calculateWorldFrustumPlanes();
 };
 
+// A camera's agent frustum planes, four to a SIMD register, for testing
+// lots of boxes against the same frustum.  Only read once set(), so any
+// number of threads can test against one.
+class LLCullPlanes
+{
+public:
+	LLCullPlanes();
+
+	// Takes camera's planes, leaving out the far clip plane unless far_clip
+	void set(LLCamera& camera, BOOL far_clip);
+
+	// 0 outside, 1 partly in, 2 fully in, as LLCamera::AABBInFrustum() or
+	// AABBInFrustumNoFarClip() would say, up to rounding on the planes
+	inline S32 AABBInFrustum(const LLVector3& center, const LLVector3& radius) const;
+
+	// The same for count boxes, a multiple of 4, given as one array per
+	// coordinate of their centers and radii
+	void AABBInFrustum(const F32* const center[3], const F32* const radius[3], U32 count, S8* results) const;
+
+private:
+	enum
+	{
+		NUM_GROUPS = 2,	// of 4 planes, enough for all 7
+		NX = 0, NY, NZ, D, AX, AY, AZ, NUM_ROWS	// n, d and |n| of each plane
+	};
+	// Unused planes are all 0, they never say outside or partly in
+	F32 mPlanes[NUM_GROUPS][NUM_ROWS][4];
+	U32 mNumGroups;
+};
+
+// A box is outside a plane if even its corner furthest into the frustum
+// is on the outside, n.c + d - |n|.r > 0, and partly in if its corner
+// furthest out is, n.c + d + |n|.r > 0.
+inline S32 LLCullPlanes::AABBInFrustum(const LLVector3& center, const LLVector3& radius) const
+{
+#if LL_VECTORIZE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 cx = _mm_set1_ps(center.mV[VX]);
+	const __m128 cy = _mm_set1_ps(center.mV[VY]);
+	const __m128 cz = _mm_set1_ps(center.mV[VZ]);
+	const __m128 rx = _mm_set1_ps(radius.mV[VX]);
+	const __m128 ry = _mm_set1_ps(radius.mV[VY]);
+	const __m128 rz = _mm_set1_ps(radius.mV[VZ]);
+	__m128 outside = zero;
+	__m128 partial = zero;
+	for (U32 i = 0; i < mNumGroups; i++)
+	{
+		const F32 (*p)[4] = mPlanes[i];
+		__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p[NX]), cx),
+											_mm_mul_ps(_mm_loadu_ps(p[NY]), cy)),
+								 _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p[NZ]), cz),
+											_mm_loadu_ps(p[D])));
+		__m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p[AX]), rx),
+											  _mm_mul_ps(_mm_loadu_ps(p[AY]), ry)),
+								   _mm_mul_ps(_mm_loadu_ps(p[AZ]), rz));
+		outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_sub_ps(dist, extent), zero));
+		partial = _mm_or_ps(partial, _mm_cmpgt_ps(_mm_add_ps(dist, extent), zero));
+	}
+	if (_mm_movemask_ps(outside))
+	{
+		return 0;
+	}
+	return _mm_movemask_ps(partial) ? 1 : 2;
+#else
+	S32 result = 2;
+	for (U32 i = 0; i < mNumGroups; i++)
+	{
+		const F32 (*p)[4] = mPlanes[i];
+		for (U32 j = 0; j < 4; j++)
+		{
+			F32 dist = p[NX][j] * center.mV[VX] + p[NY][j] * center.mV[VY] + p[NZ][j] * center.mV[VZ] + p[D][j];
+			F32 extent = p[AX][j] * radius.mV[VX] + p[AY][j] * radius.mV[VY] + p[AZ][j] * radius.mV[VZ];
+			if (dist - extent > 0.f)
+			{
+				return 0;
+			}
+			if (dist + extent > 0.f)
+			{
+				result = 1;
+			}
+		}
+	}
+	return result;
+#endif
+}
+
 
 #endif
 
@@ -0,0 +1,203 @@
+/**
+ * @file llcullbounds.cpp
+ * @brief Bounding boxes kept as a structure of arrays for culling many at
+ * once
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llcullbounds.h"
+
+#include "llcamera.h"
+#include "llv4math.h"
+
+LLCullBoundsTable::LLCullBoundsTable()
+:	mHasDistances(FALSE),
+	mNumSlots(0),
+	mCapacity(0)
+{
+}
+
+S32 LLCullBoundsTable::alloc()
+{
+	if (!mFreeSlots.empty())
+	{
+		S32 slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		return slot;
+	}
+
+	if (mNumSlots == mCapacity)
+	{
+		mCapacity = llmax(mCapacity * 2, (U32)16);
+		for (U32 i = 0; i < NUM_BOXES * NUM_BOX_FIELDS; i++)
+		{
+			mFields[i].resize(mCapacity, 0.f);
+		}
+		for (U32 i = 0; i < NUM_BOXES; i++)
+		{
+			mResults[i].resize(mCapacity, 0);
+		}
+		mDistances.resize(mCapacity, 0.f);
+	}
+	return mNumSlots++;
+}
+
+void LLCullBoundsTable::free(S32 slot)
+{
+	llassert(slot >= 0 && (U32)slot < mNumSlots);
+	mFreeSlots.push_back(slot);
+}
+
+void LLCullBoundsTable::set(S32 slot, U32 box, const LLVector3* bounds, const LLVector3* extents)
+{
+	for (U32 i = 0; i < 3; i++)
+	{
+		getField(box, CX + i)[slot] = bounds[0].mV[i];
+		getField(box, RX + i)[slot] = bounds[1].mV[i];
+		getField(box, MIN_X + i)[slot] = extents[0].mV[i];
+		getField(box, MAX_X + i)[slot] = extents[1].mV[i];
+	}
+
+	if (box == OBJECT_BOUNDS && mHasDistances)
+	{
+		mDistances[slot] = (bounds[0] - mDistanceOrigin).magVec();
+	}
+}
+
+void LLCullBoundsTable::cull(const LLCullPlanes& planes, const LLVector3& origin, F32 radius)
+{
+	if (!mCapacity)
+	{
+		return;
+	}
+
+	for (U32 box = 0; box < NUM_BOXES; box++)
+	{
+		const F32* const center[] = { getField(box, CX), getField(box, CY), getField(box, CZ) };
+		const F32* const rad[] = { getField(box, RX), getField(box, RY), getField(box, RZ) };
+		S8* results = &mResults[box][0];
+		planes.AABBInFrustum(center, rad, mCapacity, results);
+
+		if (radius <= 0.f)
+		{
+			continue;
+		}
+
+		// AABBSphereIntersectR2(), four boxes at a time
+		const F32* min[] = { getField(box, MIN_X), getField(box, MIN_Y), getField(box, MIN_Z) };
+		const F32* max[] = { getField(box, MAX_X), getField(box, MAX_Y), getField(box, MAX_Z) };
+		const F32 r2 = radius * radius;
+#if LL_VECTORIZE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 vr2 = _mm_set1_ps(r2);
+		const __m128 o[] = { _mm_set1_ps(origin.mV[VX]), _mm_set1_ps(origin.mV[VY]), _mm_set1_ps(origin.mV[VZ]) };
+		for (U32 i = 0; i < mCapacity; i += 4)
+		{
+			__m128 min_dist = zero;		// squared distance to the min corner
+			__m128 max_dist = zero;		// and to the max corner
+			__m128 box_dist = zero;		// and to the nearest point of the box
+			for (U32 j = 0; j < 3; j++)
+			{
+				__m128 lo = _mm_sub_ps(_mm_loadu_ps(min[j] + i), o[j]);
+				__m128 hi = _mm_sub_ps(o[j], _mm_loadu_ps(max[j] + i));
+				min_dist = _mm_add_ps(min_dist, _mm_mul_ps(lo, lo));
+				max_dist = _mm_add_ps(max_dist, _mm_mul_ps(hi, hi));
+				// Below min if lo > 0, else above max if hi > 0
+				__m128 below = _mm_cmpgt_ps(lo, zero);
+				__m128 t = _mm_or_ps(_mm_and_ps(below, lo), _mm_andnot_ps(below, _mm_max_ps(hi, zero)));
+				box_dist = _mm_add_ps(box_dist, _mm_mul_ps(t, t));
+			}
+			S32 inside = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(min_dist, vr2), _mm_cmplt_ps(max_dist, vr2)));
+			S32 outside = _mm_movemask_ps(_mm_cmpgt_ps(box_dist, vr2));
+			for (U32 k = 0; k < 4; k++)
+			{
+				S8 res = (inside & (1 << k)) ? 2 : ((outside & (1 << k)) ? 0 : 1);
+				results[i + k] = llmin(results[i + k], res);
+			}
+		}
+#else
+		for (U32 i = 0; i < mCapacity; i++)
+		{
+			F32 min_dist = 0.f;
+			F32 max_dist = 0.f;
+			F32 box_dist = 0.f;
+			for (U32 j = 0; j < 3; j++)
+			{
+				F32 lo = min[j][i] - origin.mV[j];
+				F32 hi = origin.mV[j] - max[j][i];
+				min_dist += lo * lo;
+				max_dist += hi * hi;
+				F32 t = lo > 0.f ? lo : llmax(hi, 0.f);
+				box_dist += t * t;
+			}
+			S8 res = (min_dist < r2 && max_dist < r2) ? 2 : (box_dist > r2 ? 0 : 1);
+			results[i] = llmin(results[i], res);
+		}
+#endif
+	}
+}
+
+void LLCullBoundsTable::calcDistances(const LLVector3& origin)
+{
+	mDistanceOrigin = origin;
+	mHasDistances = TRUE;
+	if (!mCapacity)
+	{
+		return;
+	}
+
+	const F32* center[] = { getField(OBJECT_BOUNDS, CX), getField(OBJECT_BOUNDS, CY), getField(OBJECT_BOUNDS, CZ) };
+#if LL_VECTORIZE
+	const __m128 o[] = { _mm_set1_ps(origin.mV[VX]), _mm_set1_ps(origin.mV[VY]), _mm_set1_ps(origin.mV[VZ]) };
+	for (U32 i = 0; i < mCapacity; i += 4)
+	{
+		__m128 d2 = _mm_setzero_ps();
+		for (U32 j = 0; j < 3; j++)
+		{
+			__m128 d = _mm_sub_ps(_mm_loadu_ps(center[j] + i), o[j]);
+			d2 = _mm_add_ps(d2, _mm_mul_ps(d, d));
+		}
+		_mm_storeu_ps(&mDistances[i], _mm_sqrt_ps(d2));
+	}
+#else
+	for (U32 i = 0; i < mCapacity; i++)
+	{
+		mDistances[i] = LLVector3(center[VX][i] - origin.mV[VX],
+								  center[VY][i] - origin.mV[VY],
+								  center[VZ][i] - origin.mV[VZ]).magVec();
+	}
+#endif
+}
+
+F32 LLCullBoundsTable::getDistance(S32 slot, const LLVector3& origin) const
+{
+	if (mHasDistances && origin == mDistanceOrigin)
+	{
+		return mDistances[slot];
+	}
+	return LLVector3(getField(OBJECT_BOUNDS, CX)[slot] - origin.mV[VX],
+					 getField(OBJECT_BOUNDS, CY)[slot] - origin.mV[VY],
+					 getField(OBJECT_BOUNDS, CZ)[slot] - origin.mV[VZ]).magVec();
+}
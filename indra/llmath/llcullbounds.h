@@ -0,0 +1,99 @@
+/**
+ * @file llcullbounds.h
+ * @brief Bounding boxes kept as a structure of arrays for culling many at
+ * once
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLCULLBOUNDS_H
+#define LL_LLCULLBOUNDS_H
+
+#include <vector>
+
+#include "v3math.h"
+
+class LLCullPlanes;
+
+// Slots of two boxes each, stored one array per coordinate, so cull() and
+// calcDistances() go through them four at a time in SSE registers instead
+// of chasing a pointer per box.  Each box is kept both as center and
+// radius and as min and max corners, as LLSpatialGroup keeps its bounds.
+// A slot keeps its index until free()d, and alloc() reuses freed slots.
+class LLCullBoundsTable
+{
+public:
+	enum
+	{
+		BOUNDS = 0,		// of a node and its children
+		OBJECT_BOUNDS,	// of a node's own objects
+		NUM_BOXES
+	};
+
+	LLCullBoundsTable();
+
+	S32 alloc();
+	void free(S32 slot);
+
+	// bounds are center and radius, extents min and max
+	void set(S32 slot, U32 box, const LLVector3* bounds, const LLVector3* extents);
+
+	// Checks both boxes of every slot against planes, and if radius > 0
+	// against the sphere around origin too, as AABBSphereIntersect() does,
+	// keeping the worse of the two.
+	void cull(const LLCullPlanes& planes, const LLVector3& origin, F32 radius);
+
+	// As of the last cull(), 0 outside, 1 partly in, 2 fully in
+	S32 getCullResult(S32 slot, U32 box) const	{ return mResults[box][slot]; }
+
+	// Distances from origin to the center of every slot's OBJECT_BOUNDS
+	void calcDistances(const LLVector3& origin);
+
+	// As of the last calcDistances(), if it was from origin
+	F32 getDistance(S32 slot, const LLVector3& origin) const;
+
+	// Including free ones
+	U32 getNumSlots() const		{ return mNumSlots; }
+
+private:
+	enum
+	{
+		CX = 0, CY, CZ, RX, RY, RZ, MIN_X, MIN_Y, MIN_Z, MAX_X, MAX_Y, MAX_Z,
+		NUM_BOX_FIELDS
+	};
+
+	F32* getField(U32 box, U32 field)	{ return &mFields[box * NUM_BOX_FIELDS + field][0]; }
+	const F32* getField(U32 box, U32 field) const	{ return &mFields[box * NUM_BOX_FIELDS + field][0]; }
+
+	// Arrays are mCapacity long, a multiple of 4, and the slots past
+	// mNumSlots are empty boxes at the origin
+	std::vector<F32> mFields[NUM_BOXES * NUM_BOX_FIELDS];
+	std::vector<S8> mResults[NUM_BOXES];
+	std::vector<F32> mDistances;
+	LLVector3 mDistanceOrigin;
+	BOOL mHasDistances;
+	std::vector<S32> mFreeSlots;
+	U32 mNumSlots;
+	U32 mCapacity;
+};
+
+#endif // LL_LLCULLBOUNDS_H
@@ -1658,7 +1658,7 @@ LLProfile::~LLProfile()
 }
 
 
-S32 LLVolume::sNumMeshPoints = 0;
+LLAtomicS32 LLVolume::sNumMeshPoints;
 
 LLVolume::LLVolume(const LLVolumeParams &params, const F32 detail, const BOOL generate_single_face, const BOOL is_unique)
 	: mParams(params)
@@ -48,6 +48,7 @@ class LLVolume;
 #include "v4coloru.h"
 #include "llrefcount.h"
 #include "llfile.h"
+#include "llapr.h"
 
 //============================================================================
 
@@ -931,7 +932,7 @@ public:
 	LLFaceID generateFaceMask();
 
 	BOOL isFaceMaskValid(LLFaceID face_mask);
-	static S32 sNumMeshPoints;
+	static LLAtomicS32 sNumMeshPoints;	// volumes may be built on the volume build thread
 
 	friend std::ostream& operator<<(std::ostream &s, const LLVolume &volume);
 	friend std::ostream& operator<<(std::ostream &s, const LLVolume *volumep);		// HACK to bypass Windoze confusion over 
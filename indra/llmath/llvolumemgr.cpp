@@ -42,10 +42,60 @@ F32 LLVolumeLODGroup::mDetailThresholds[NUM_LODS] = {BASE_THRESHOLD,
 F32 LLVolumeLODGroup::mDetailScales[NUM_LODS] = {1.f, 1.5f, 2.5f, 4.f};
 
 
+//============================================================================
+
+// Builds LLVolumes from a copy of their params, so the volume has a single
+// owner until the main thread takes it from a completed request.
+class LLVolumeBuildThread : public LLQueuedThread
+{
+public:
+	class BuildRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		/*virtual*/ ~BuildRequest() {}
+
+	public:
+		BuildRequest(handle_t handle, U32 priority, const LLVolumeParams& volume_params, S32 detail)
+			: LLQueuedThread::QueuedRequest(handle, priority),
+			  mVolumeParams(volume_params),
+			  mDetail(detail)
+		{
+		}
+
+		/*virtual*/ bool processRequest()
+		{
+			mVolumep = new LLVolume(mVolumeParams, LLVolumeLODGroup::getVolumeScaleFromDetail(mDetail));
+			return true;
+		}
+
+		const LLVolumeParams& getVolumeParams() const { return mVolumeParams; }
+		S32 getDetail() const { return mDetail; }
+		LLVolume* getVolume() const { return mVolumep; }
+
+	private:
+		LLVolumeParams mVolumeParams;
+		S32 mDetail;
+		LLPointer<LLVolume> mVolumep;
+	};
+
+	LLVolumeBuildThread(S32 threads)
+		: LLQueuedThread("volumebuild", true, false, threads)
+	{
+	}
+
+	handle_t build(const LLVolumeParams& volume_params, S32 detail, U32 priority)
+	{
+		handle_t handle = generateHandle();
+		addRequest(new BuildRequest(handle, priority, volume_params, detail));
+		return handle;
+	}
+};
+
 //============================================================================
 
 LLVolumeMgr::LLVolumeMgr()
-:	mDataMutex(NULL)
+:	mDataMutex(NULL),
+	mBuildThread(NULL)
 {
 	// the LLMutex magic interferes with easy unit testing,
 	// so you now must manually call useMutex() to use it
@@ -54,6 +104,12 @@ LLVolumeMgr::LLVolumeMgr()
 
 LLVolumeMgr::~LLVolumeMgr()
 {
+	if (mBuildThread)
+	{
+		mBuildThread->shutdown();
+		delete mBuildThread;
+		mBuildThread = NULL;
+	}
 	cleanup();
 
 	delete mDataMutex;
@@ -220,6 +276,83 @@ void LLVolumeMgr::useMutex()
 	}
 }
 
+void LLVolumeMgr::startBuildThread(S32 threads)
+{
+	if (!mBuildThread && threads > 0)
+	{
+		mBuildThread = new LLVolumeBuildThread(llmin(threads, (S32)LLQueuedThread::MAX_POOL_SIZE));
+	}
+}
+
+BOOL LLVolumeMgr::requestLOD(const LLVolumeParams& volume_params, const S32 detail, BOOL prefetch)
+{
+	llassert(detail >= 0 && detail < LLVolumeLODGroup::NUM_LODS);
+	if (!mBuildThread)
+	{
+		return TRUE;
+	}
+	LLVolumeLODGroup* volgroupp = getGroup(volume_params);
+	if (!volgroupp || volgroupp->isLODBuilt(detail))
+	{
+		return TRUE;
+	}
+
+	U32 priority = prefetch ? LLQueuedThread::PRIORITY_LOW : LLQueuedThread::PRIORITY_HIGH;
+	LLQueuedThread::handle_t& handle = volgroupp->mBuildHandles[detail];
+	if (handle == LLQueuedThread::nullHandle())
+	{
+		handle = mBuildThread->build(volume_params, detail, priority);
+		mPendingBuilds.push_back(handle);
+	}
+	else if (!prefetch)
+	{
+		// A prefetch that's needed now
+		mBuildThread->setPriority(handle, priority);
+	}
+	return FALSE;
+}
+
+void LLVolumeMgr::updateBuilds()
+{
+	if (!mBuildThread)
+	{
+		return;
+	}
+	mBuildThread->update(0);
+
+	for (U32 i = 0; i < mPendingBuilds.size(); )
+	{
+		LLQueuedThread::handle_t handle = mPendingBuilds[i];
+		if (mBuildThread->getRequestStatus(handle) != LLQueuedThread::STATUS_COMPLETE)
+		{
+			i++;
+			continue;
+		}
+
+		// The group that asked may be gone by now, and another one with
+		// the same params may have asked for it again or built it itself
+		LLVolumeBuildThread::BuildRequest* req = (LLVolumeBuildThread::BuildRequest*)mBuildThread->getRequest(handle);
+		LLVolumeLODGroup* volgroupp = getGroup(req->getVolumeParams());
+		if (volgroupp)
+		{
+			S32 detail = req->getDetail();
+			if (volgroupp->mBuildHandles[detail] == handle)
+			{
+				volgroupp->mBuildHandles[detail] = LLQueuedThread::nullHandle();
+			}
+			// A prefetch whose neighbour has gone out of use since is dropped
+			if (!volgroupp->isLODBuilt(detail) && volgroupp->isLODNeeded(detail))
+			{
+				volgroupp->mVolumeLODs[detail] = req->getVolume();
+			}
+		}
+		mBuildThread->completeRequest(handle);
+
+		mPendingBuilds[i] = mPendingBuilds.back();
+		mPendingBuilds.pop_back();
+	}
+}
+
 std::ostream& operator<<(std::ostream& s, const LLVolumeMgr& volume_mgr)
 {
 	s << "{ numLODgroups=" << volume_mgr.mVolumeLODGroups.size() << ", ";
@@ -255,6 +388,7 @@ LLVolumeLODGroup::LLVolumeLODGroup(const LLVolumeParams &params)
 	{
 		mLODRefs[i] = 0;
 		mAccessCount[i] = 0;
+		mBuildHandles[i] = LLQueuedThread::nullHandle();
 	}
 }
 
@@ -318,6 +452,8 @@ BOOL LLVolumeLODGroup::derefLOD(LLVolume *volumep)
 			if (!mLODRefs[i])
 			{
 				mVolumeLODs[i] = NULL;
+				// Prefetches next to this one may have lost their reason
+				dropUnneededLODs();
 			}
 #endif
 			return TRUE;
@@ -327,6 +463,24 @@ BOOL LLVolumeLODGroup::derefLOD(LLVolume *volumep)
 	return FALSE;
 }
 
+BOOL LLVolumeLODGroup::isLODNeeded(const S32 detail) const
+{
+	return mLODRefs[detail] > 0 ||
+		(detail > 0 && mLODRefs[detail - 1] > 0) ||
+		(detail < NUM_LODS - 1 && mLODRefs[detail + 1] > 0);
+}
+
+void LLVolumeLODGroup::dropUnneededLODs()
+{
+	for (S32 i = 0; i < NUM_LODS; i++)
+	{
+		if (!isLODNeeded(i))
+		{
+			mVolumeLODs[i] = NULL;
+		}
+	}
+}
+
 S32 LLVolumeLODGroup::getDetailFromTan(const F32 tan_angle)
 {
 	S32 i = 0;
@@ -28,13 +28,16 @@
 #define LL_LLVOLUMEMGR_H
 
 #include <map>
+#include <vector>
 
 #include "llvolume.h"
 #include "llpointer.h"
 #include "llthread.h"
+#include "llqueuedthread.h"
 
 class LLVolumeParams;
 class LLVolumeLODGroup;
+class LLVolumeBuildThread;
 
 class LLVolumeLODGroup
 {
@@ -57,6 +60,10 @@ public:
 	LLVolume* refLOD(const S32 detail);
 	BOOL derefLOD(LLVolume *volumep);
 	S32 getNumRefs() const { return mRefs; }
+	// refLOD() won't have to build it
+	BOOL isLODBuilt(const S32 detail) const { return mVolumeLODs[detail].notNull(); }
+	// An unreferenced LOD is only kept, as a prefetch, next to one in use
+	BOOL isLODNeeded(const S32 detail) const;
 	
 	const LLVolumeParams* getVolumeParams() const { return &mVolumeParams; };
 
@@ -64,6 +71,11 @@ public:
 	friend std::ostream& operator<<(std::ostream& s, const LLVolumeLODGroup& volgroup);
 
 protected:
+	friend class LLVolumeMgr;
+
+	// Frees the unreferenced LODs isLODNeeded() no longer wants
+	void dropUnneededLODs();
+
 	LLVolumeParams mVolumeParams;
 
 	S32 mRefs;
@@ -72,6 +84,7 @@ protected:
 	static F32 mDetailThresholds[NUM_LODS];
 	static F32 mDetailScales[NUM_LODS];
 	S32		mAccessCount[NUM_LODS];
+	LLQueuedThread::handle_t mBuildHandles[NUM_LODS];	// builds on the build thread, or 0
 };
 
 class LLVolumeMgr
@@ -94,6 +107,20 @@ public:
 	// manually call this for mutex magic
 	void useMutex();
 
+	// Lets requestLOD() build volumes ahead on that many threads
+	void startBuildThread(S32 threads);
+	// TRUE if refVolume() would not have to build the detail LOD of
+	// volume_params.  Otherwise queues a build for it on the build thread,
+	// once per LOD of each set of params, and returns FALSE.  Prefetches
+	// run after builds that are needed now.  Always TRUE without a build
+	// thread, or for params nothing references.  Only LOD changes go
+	// through here; a change of params still builds in refVolume(), see
+	// LLVOVolume::setVolume().
+	BOOL requestLOD(const LLVolumeParams& volume_params, const S32 detail, BOOL prefetch = FALSE);
+	// Hands finished builds to their groups, main thread only
+	void updateBuilds();
+	S32 getNumPendingBuilds() const { return (S32)mPendingBuilds.size(); }
+
 	friend std::ostream& operator<<(std::ostream& s, const LLVolumeMgr& volume_mgr);
 
 protected:
@@ -106,6 +133,9 @@ protected:
 	volume_lod_group_map_t mVolumeLODGroups;
 
 	LLMutex* mDataMutex;
+
+	LLVolumeBuildThread* mBuildThread;
+	std::vector<LLQueuedThread::handle_t> mPendingBuilds;
 };
 
 #endif // LL_LLVOLUMEMGR_H
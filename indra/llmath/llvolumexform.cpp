@@ -0,0 +1,208 @@
+/**
+ * @file llvolumexform.cpp
+ * @brief Transforms of volume face vertices in batches, four at a time
+ * where SSE is available
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llvolumexform.h"
+
+#include "m3math.h"
+#include "m4math.h"
+#include "v4math.h"
+#include "llv4math.h"
+#include "llv4matrix4.h"
+
+namespace
+{
+	typedef LLVolumeXform::VertexData VertexData;
+
+#if LL_VECTORIZE
+	// Loads one LLVector3 field of four vertices, one coordinate per
+	// register.  Reads a float past the field, which is safe as long as the
+	// field is not the last one in VertexData.
+	inline void load_fields(const LLVector3* a, const LLVector3* b, const LLVector3* c, const LLVector3* d,
+							__m128& x, __m128& y, __m128& z)
+	{
+		__m128 r0 = _mm_loadu_ps(a->mV);
+		__m128 r1 = _mm_loadu_ps(b->mV);
+		__m128 r2 = _mm_loadu_ps(c->mV);
+		__m128 r3 = _mm_loadu_ps(d->mV);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		x = r0;
+		y = r1;
+		z = r2;
+	}
+
+	// Stores four vectors from the registers load_fields() fills, touching
+	// only their own 12 bytes in dst
+	inline void store_vectors(__m128 x, __m128 y, __m128 z, LLStrider<LLVector3>& dst)
+	{
+		__m128 w = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		const __m128 rows[] = { x, y, z, w };
+		for (U32 k = 0; k < 4; k++)
+		{
+			F32* out = (dst++)->mV;
+			_mm_storel_pi((__m64*) out, rows[k]);
+			_mm_store_ss(out + 2, _mm_movehl_ps(rows[k], rows[k]));
+		}
+	}
+
+	// As LLVector3::normVec() on four vectors
+	inline void normalize(__m128& x, __m128& y, __m128& z)
+	{
+		__m128 mag = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+		__m128 valid = _mm_cmpgt_ps(mag, _mm_set1_ps(FP_MAG_THRESHOLD));
+		__m128 oomag = _mm_div_ps(_mm_set1_ps(1.f), mag);
+		x = _mm_and_ps(_mm_mul_ps(x, oomag), valid);
+		y = _mm_and_ps(_mm_mul_ps(y, oomag), valid);
+		z = _mm_and_ps(_mm_mul_ps(z, oomag), valid);
+	}
+#endif
+
+	// LLVector3 * LLMatrix3 on the field of every vertex, then normalized
+	void transform_normals(const VertexData* src, S32 count, const LLMatrix3& mat,
+						   LLVector3 VertexData::* field, LLStrider<LLVector3>& dst)
+	{
+		S32 i = 0;
+#if LL_VECTORIZE
+		__m128 m[3][3];
+		for (U32 r = 0; r < 3; r++)
+		{
+			for (U32 c = 0; c < 3; c++)
+			{
+				m[r][c] = _mm_set1_ps(mat.mMatrix[r][c]);
+			}
+		}
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x, y, z;
+			load_fields(&(src[i].*field), &(src[i + 1].*field), &(src[i + 2].*field), &(src[i + 3].*field), x, y, z);
+			__m128 o[3];
+			for (U32 c = 0; c < 3; c++)
+			{
+				o[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m[VX][c]), _mm_mul_ps(y, m[VY][c])), _mm_mul_ps(z, m[VZ][c]));
+			}
+			normalize(o[VX], o[VY], o[VZ]);
+			store_vectors(o[VX], o[VY], o[VZ], dst);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			LLVector3 normal = src[i].*field * mat;
+			normal.normVec();
+			*dst++ = normal;
+		}
+	}
+}
+
+void LLVolumeXform::transformPositions(const VertexData* src, S32 count, const LLMatrix4& mat, LLStrider<LLVector3> dst)
+{
+#if LL_VECTORIZE
+	// One vertex at a time is enough here, there is no normalize to share
+	LLV4Matrix4 m;
+	m = mat;
+	for (S32 i = 0; i < count; i++)
+	{
+		const F32* p = src[i].mPosition.mV;
+		__m128 o = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[VX]), m.mV[VX]),
+													_mm_mul_ps(_mm_set1_ps(p[VY]), m.mV[VY])),
+										 _mm_mul_ps(_mm_set1_ps(p[VZ]), m.mV[VZ])),
+							  m.mV[VW]);
+		F32* out = (dst++)->mV;
+		_mm_storel_pi((__m64*) out, o);
+		_mm_store_ss(out + 2, _mm_movehl_ps(o, o));
+	}
+#else
+	for (S32 i = 0; i < count; i++)
+	{
+		*dst++ = src[i].mPosition * mat;
+	}
+#endif
+}
+
+void LLVolumeXform::transformNormals(const VertexData* src, S32 count, const LLMatrix3& mat, LLStrider<LLVector3> dst)
+{
+	transform_normals(src, count, mat, &VertexData::mNormal, dst);
+}
+
+void LLVolumeXform::transformBinormals(const VertexData* src, S32 count, const LLMatrix3& mat, LLStrider<LLVector3> dst)
+{
+	transform_normals(src, count, mat, &VertexData::mBinormal, dst);
+}
+
+void LLVolumeXform::transformTexCoords(const VertexData* src, S32 count,
+									   F32 cos_ang, F32 sin_ang,
+									   F32 off_s, F32 off_t,
+									   F32 mag_s, F32 mag_t,
+									   LLStrider<LLVector2> dst)
+{
+	// Added after scaling, back from the center of the face
+	const F32 end_s = off_s + 0.5f;
+	const F32 end_t = off_t + 0.5f;
+
+	S32 i = 0;
+#if LL_VECTORIZE
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 vcos = _mm_set1_ps(cos_ang);
+	const __m128 vsin = _mm_set1_ps(sin_ang);
+	const __m128 vmag_s = _mm_set1_ps(mag_s);
+	const __m128 vmag_t = _mm_set1_ps(mag_t);
+	const __m128 vend_s = _mm_set1_ps(end_s);
+	const __m128 vend_t = _mm_set1_ps(end_t);
+	for (; i + 4 <= count; i += 4)
+	{
+		// mTexCoord is the last field, so no reading past it
+		__m128 s = _mm_setr_ps(src[i].mTexCoord.mV[VX], src[i + 1].mTexCoord.mV[VX],
+							   src[i + 2].mTexCoord.mV[VX], src[i + 3].mTexCoord.mV[VX]);
+		__m128 t = _mm_setr_ps(src[i].mTexCoord.mV[VY], src[i + 1].mTexCoord.mV[VY],
+							   src[i + 2].mTexCoord.mV[VY], src[i + 3].mTexCoord.mV[VY]);
+		s = _mm_sub_ps(s, half);
+		t = _mm_sub_ps(t, half);
+		__m128 rs = _mm_add_ps(_mm_mul_ps(s, vcos), _mm_mul_ps(t, vsin));
+		__m128 rt = _mm_sub_ps(_mm_mul_ps(t, vcos), _mm_mul_ps(s, vsin));
+		rs = _mm_add_ps(_mm_mul_ps(rs, vmag_s), vend_s);
+		rt = _mm_add_ps(_mm_mul_ps(rt, vmag_t), vend_t);
+
+		__m128 lo = _mm_unpacklo_ps(rs, rt);	// s0 t0 s1 t1
+		__m128 hi = _mm_unpackhi_ps(rs, rt);	// s2 t2 s3 t3
+		_mm_storel_pi((__m64*) (dst++)->mV, lo);
+		_mm_storeh_pi((__m64*) (dst++)->mV, lo);
+		_mm_storel_pi((__m64*) (dst++)->mV, hi);
+		_mm_storeh_pi((__m64*) (dst++)->mV, hi);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		F32 s = src[i].mTexCoord.mV[VX] - 0.5f;
+		F32 t = src[i].mTexCoord.mV[VY] - 0.5f;
+		F32 rs = s * cos_ang + t * sin_ang;
+		F32 rt = t * cos_ang - s * sin_ang;
+		LLVector2& tc = *dst++;
+		tc.mV[VX] = rs * mag_s + end_s;
+		tc.mV[VY] = rt * mag_t + end_t;
+	}
+}
@@ -0,0 +1,64 @@
+/**
+ * @file llvolumexform.h
+ * @brief Transforms of volume face vertices in batches, four at a time
+ * where SSE is available
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLVOLUMEXFORM_H
+#define LL_LLVOLUMEXFORM_H
+
+#include "llstrider.h"
+#include "llvolume.h"
+
+// What LLFace::getGeometryVolume() does to every vertex of a volume face,
+// over a whole run of vertices at once.  With LL_VECTORIZE four vertices
+// are loaded, transposed so each SSE register holds one coordinate of all
+// four, transformed, and transposed back, so the normalize of normals and
+// binormals is one sqrt and one divide per four vertices.  The results
+// are the same as the scalar LLMatrix4, LLMatrix3 and LLVector3::normVec()
+// math, operation for operation.  dst may be interleaved with other data.
+namespace LLVolumeXform
+{
+	typedef LLVolumeFace::VertexData VertexData;
+
+	// dst[i] = src[i].mPosition * mat
+	void transformPositions(const VertexData* src, S32 count, const LLMatrix4& mat, LLStrider<LLVector3> dst);
+
+	// dst[i] = src[i].mNormal * mat, normalized
+	void transformNormals(const VertexData* src, S32 count, const LLMatrix3& mat, LLStrider<LLVector3> dst);
+
+	// dst[i] = src[i].mBinormal * mat, normalized
+	void transformBinormals(const VertexData* src, S32 count, const LLMatrix3& mat, LLStrider<LLVector3> dst);
+
+	// dst[i] = src[i].mTexCoord rotated about the center of the face, then
+	// scaled and offset, as a texture entry's rotation, scale and offset are
+	// applied.  off_s and off_t do not include the 0.5 back to the center.
+	void transformTexCoords(const VertexData* src, S32 count,
+							F32 cos_ang, F32 sin_ang,
+							F32 off_s, F32 off_t,
+							F32 mag_s, F32 mag_t,
+							LLStrider<LLVector2> dst);
+}
+
+#endif // LL_LLVOLUMEXFORM_H
@@ -0,0 +1,128 @@
+/**
+ * @file llcamera_test.cpp
+ * @brief Tests for LLCullPlanes against LLCamera's own frustum checks
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "../llcamera.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	// Repeatable pseudo random numbers in [lo, hi)
+	U32 sSeed = 1;
+	F32 random_range(F32 lo, F32 hi)
+	{
+		sSeed = sSeed * 1664525 + 1013904223;
+		return lo + (hi - lo) * (F32)(sSeed >> 8) / (F32)(1 << 24);
+	}
+
+	// Looking down +X from the origin, 90 degrees wide and high, the
+	// corners in the order LLViewerCamera::updateFrustumPlanes() makes them
+	void make_camera(LLCamera& camera, F32 near_dist, F32 far_dist)
+	{
+		LLVector3 frust[8];
+		const F32 dist[] = { near_dist, far_dist };
+		for (U32 i = 0; i < 2; i++)
+		{
+			F32 d = dist[i];
+			frust[i * 4 + 0].setVec(d,  d, -d);	// bottom left
+			frust[i * 4 + 1].setVec(d, -d, -d);	// bottom right
+			frust[i * 4 + 2].setVec(d, -d,  d);	// top right
+			frust[i * 4 + 3].setVec(d,  d,  d);	// top left
+		}
+		camera.calcAgentFrustumPlanes(frust);
+	}
+
+	// Checks random boxes, most of them straddling some plane, against
+	// both, and that every answer came up
+	void compare(LLCamera& camera, BOOL far_clip)
+	{
+		LLCullPlanes planes;
+		planes.set(camera, far_clip);
+
+		S32 seen[3] = { 0, 0, 0 };
+		for (S32 i = 0; i < 20000; i++)
+		{
+			LLVector3 center(random_range(-50.f, 250.f), random_range(-250.f, 250.f), random_range(-250.f, 250.f));
+			F32 size = random_range(0.f, 1.f);
+			size = size * size * 100.f;
+			LLVector3 radius(random_range(0.f, size), random_range(0.f, size), random_range(0.f, size));
+
+			S32 expected = far_clip ? camera.AABBInFrustum(center, radius) : camera.AABBInFrustumNoFarClip(center, radius);
+			S32 actual = planes.AABBInFrustum(center, radius);
+			if (actual != expected)
+			{
+				// Only allowed on a plane, where rounding may go either way
+				LLVector3 near_radius = radius * 1.0001f + LLVector3(0.001f, 0.001f, 0.001f);
+				LLVector3 far_radius = radius * 0.9999f;
+				S32 grown = far_clip ? camera.AABBInFrustum(center, near_radius) : camera.AABBInFrustumNoFarClip(center, near_radius);
+				S32 shrunk = far_clip ? camera.AABBInFrustum(center, far_radius) : camera.AABBInFrustumNoFarClip(center, far_radius);
+				tut::ensure(llformat("box %d: %d, LLCamera says %d", i, actual, expected), grown != shrunk);
+			}
+			seen[expected]++;
+		}
+		tut::ensure("some boxes outside", seen[0] > 0);
+		tut::ensure("some boxes partly in", seen[1] > 0);
+		tut::ensure("some boxes fully in", seen[2] > 0);
+	}
+}
+
+namespace tut
+{
+	struct llcamera_data
+	{
+	};
+	typedef test_group<llcamera_data> llcamera_t;
+	typedef llcamera_t::object llcamera_object_t;
+	tut::llcamera_t tut_llcamera("llcamera");
+
+	template<> template<>
+	void llcamera_object_t::test<1>()
+	{
+		set_test_name("LLCullPlanes matches AABBInFrustum and AABBInFrustumNoFarClip");
+		LLCamera camera;
+		make_camera(camera, 1.f, 200.f);
+		compare(camera, TRUE);
+		compare(camera, FALSE);
+	}
+
+	template<> template<>
+	void llcamera_object_t::test<2>()
+	{
+		set_test_name("LLCullPlanes with a user clip plane and an ignored plane");
+		LLCamera camera;
+		// Water at z = 20, keeping what is above it, as LLPipeline::updateCull() does
+		camera.setUserClipPlane(LLPlane(LLVector3(0.f, 0.f, 20.f), LLVector3(0.f, 0.f, -1.f)));
+		make_camera(camera, 1.f, 200.f);
+		compare(camera, TRUE);
+		compare(camera, FALSE);
+
+		camera.ignoreAgentFrustumPlane(LLCamera::AGENT_PLANE_NEAR);
+		compare(camera, TRUE);
+		compare(camera, FALSE);
+	}
+}
@@ -0,0 +1,327 @@
+/**
+ * @file llcullbounds_test.cpp
+ * @brief Tests for LLCullBoundsTable, and a cull benchmark against boxes
+ * checked one at a time
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+#include <iostream>
+
+#include "../llcullbounds.h"
+#include "../llcamera.h"
+#include "lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	const S32 BENCH_GROUPS = 20000;
+	const S32 BENCH_PASSES = 50;
+
+	// Repeatable pseudo random numbers in [lo, hi)
+	U32 sSeed = 1;
+	F32 random_range(F32 lo, F32 hi)
+	{
+		sSeed = sSeed * 1664525 + 1013904223;
+		return lo + (hi - lo) * (F32)(sSeed >> 8) / (F32)(1 << 24);
+	}
+
+	// Stands in for an LLSpatialGroup, bounds in the middle of a heap block
+	struct TestGroup
+	{
+		TestGroup()
+		{
+			LLVector3 center(random_range(-50.f, 250.f), random_range(-250.f, 250.f), random_range(-250.f, 250.f));
+			F32 size = random_range(0.f, 1.f);
+			size = size * size * 60.f;
+			for (U32 i = 0; i < LLCullBoundsTable::NUM_BOXES; i++)
+			{
+				LLVector3 radius(random_range(0.f, size), random_range(0.f, size), random_range(0.f, size));
+				mBounds[i][0] = center;
+				mBounds[i][1] = radius;
+				mExtents[i][0] = center - radius;
+				mExtents[i][1] = center + radius;
+				size *= 0.5f;
+			}
+		}
+
+		U8 mBefore[256];
+		LLVector3 mBounds[LLCullBoundsTable::NUM_BOXES][2];
+		LLVector3 mExtents[LLCullBoundsTable::NUM_BOXES][2];
+		U8 mAfter[256];
+	};
+
+	// As AABBSphereIntersectR2() in the viewer
+	S32 sphere_check(const LLVector3& min, const LLVector3& max, const LLVector3& origin, F32 r)
+	{
+		r *= r;
+		if ((min - origin).magVecSquared() < r &&
+			(max - origin).magVecSquared() < r)
+		{
+			return 2;
+		}
+		F32 d = 0.f;
+		for (U32 i = 0; i < 3; i++)
+		{
+			F32 t = 0.f;
+			if (origin.mV[i] < min.mV[i])
+			{
+				t = min.mV[i] - origin.mV[i];
+			}
+			else if (origin.mV[i] > max.mV[i])
+			{
+				t = origin.mV[i] - max.mV[i];
+			}
+			d += t * t;
+		}
+		return d > r ? 0 : 1;
+	}
+
+	// Looking down +X from the origin, 90 degrees wide and high
+	void make_camera(LLCamera& camera)
+	{
+		LLVector3 frust[8];
+		const F32 dist[] = { 1.f, 200.f };
+		for (U32 i = 0; i < 2; i++)
+		{
+			F32 d = dist[i];
+			frust[i * 4 + 0].setVec(d,  d, -d);
+			frust[i * 4 + 1].setVec(d, -d, -d);
+			frust[i * 4 + 2].setVec(d, -d,  d);
+			frust[i * 4 + 3].setVec(d,  d,  d);
+		}
+		camera.calcAgentFrustumPlanes(frust);
+	}
+
+	// Checks every box the way the octree cull used to
+	S32 cull_one_at_a_time(const std::vector<TestGroup*>& groups, LLCamera& camera, F32 radius)
+	{
+		S32 visible = 0;
+		for (std::vector<TestGroup*>::const_iterator iter = groups.begin(); iter != groups.end(); ++iter)
+		{
+			const TestGroup* group = *iter;
+			for (U32 box = 0; box < LLCullBoundsTable::NUM_BOXES; box++)
+			{
+				S32 res = camera.AABBInFrustumNoFarClip(group->mBounds[box][0], group->mBounds[box][1]);
+				if (res)
+				{
+					res = llmin(res, sphere_check(group->mExtents[box][0], group->mExtents[box][1], camera.getOrigin(), radius));
+				}
+				visible += res ? 1 : 0;
+			}
+		}
+		return visible;
+	}
+
+	S32 count_visible(const LLCullBoundsTable& table)
+	{
+		S32 visible = 0;
+		for (U32 slot = 0; slot < table.getNumSlots(); slot++)
+		{
+			for (U32 box = 0; box < LLCullBoundsTable::NUM_BOXES; box++)
+			{
+				visible += table.getCullResult(slot, box) ? 1 : 0;
+			}
+		}
+		return visible;
+	}
+}
+
+namespace tut
+{
+	struct llcullbounds_data
+	{
+	};
+	typedef test_group<llcullbounds_data> llcullbounds_t;
+	typedef llcullbounds_t::object llcullbounds_object_t;
+	tut::llcullbounds_t tut_llcullbounds("llcullbounds");
+
+	template<> template<>
+	void llcullbounds_object_t::test<1>()
+	{
+		set_test_name("slots");
+		LLCullBoundsTable table;
+		ensure_equals("starts empty", table.getNumSlots(), 0U);
+		for (S32 i = 0; i < 37; i++)
+		{
+			ensure_equals("slots in order", table.alloc(), i);
+		}
+		table.free(5);
+		table.free(30);
+		ensure_equals("reuses the last freed", table.alloc(), 30);
+		ensure_equals("then the one before", table.alloc(), 5);
+		ensure_equals("then new ones", table.alloc(), 37);
+		ensure_equals("slots", table.getNumSlots(), 38U);
+	}
+
+	template<> template<>
+	void llcullbounds_object_t::test<2>()
+	{
+		set_test_name("cull matches LLCullPlanes and the sphere check box by box");
+		LLCamera camera;
+		make_camera(camera);
+		LLCullPlanes planes;
+		planes.set(camera, FALSE);
+
+		std::vector<TestGroup> groups;
+		for (S32 i = 0; i < 1001; i++)
+		{
+			groups.push_back(TestGroup());
+		}
+		LLCullBoundsTable table;
+		for (U32 i = 0; i < groups.size(); i++)
+		{
+			S32 slot = table.alloc();
+			for (U32 box = 0; box < LLCullBoundsTable::NUM_BOXES; box++)
+			{
+				table.set(slot, box, groups[i].mBounds[box], groups[i].mExtents[box]);
+			}
+		}
+
+		const F32 radii[] = { 0.f, 150.f };
+		for (U32 r = 0; r < 2; r++)
+		{
+			table.cull(planes, camera.getOrigin(), radii[r]);
+			S32 seen[3] = { 0, 0, 0 };
+			for (U32 i = 0; i < groups.size(); i++)
+			{
+				for (U32 box = 0; box < LLCullBoundsTable::NUM_BOXES; box++)
+				{
+					S32 expected = planes.AABBInFrustum(groups[i].mBounds[box][0], groups[i].mBounds[box][1]);
+					if (expected && radii[r] > 0.f)
+					{
+						expected = llmin(expected, sphere_check(groups[i].mExtents[box][0], groups[i].mExtents[box][1],
+																camera.getOrigin(), radii[r]));
+					}
+					S32 actual = table.getCullResult(i, box);
+					ensure_equals(llformat("group %d box %d radius %.0f", i, box, radii[r]), actual, expected);
+					seen[expected]++;
+				}
+			}
+			ensure("some boxes outside", seen[0] > 0);
+			ensure("some boxes partly in", seen[1] > 0);
+			ensure("some boxes fully in", seen[2] > 0);
+		}
+	}
+
+	template<> template<>
+	void llcullbounds_object_t::test<3>()
+	{
+		set_test_name("distances");
+		std::vector<TestGroup> groups;
+		for (S32 i = 0; i < 103; i++)
+		{
+			groups.push_back(TestGroup());
+		}
+		LLCullBoundsTable table;
+		for (U32 i = 0; i < groups.size(); i++)
+		{
+			S32 slot = table.alloc();
+			table.set(slot, LLCullBoundsTable::OBJECT_BOUNDS, groups[i].mBounds[1], groups[i].mExtents[1]);
+		}
+
+		LLVector3 origin(10.f, -20.f, 30.f);
+		LLVector3 elsewhere(0.f, 0.f, 0.f);
+		table.calcDistances(origin);
+		// Moved since calcDistances()
+		TestGroup moved;
+		table.set(7, LLCullBoundsTable::OBJECT_BOUNDS, moved.mBounds[1], moved.mExtents[1]);
+		groups[7] = moved;
+		for (U32 i = 0; i < groups.size(); i++)
+		{
+			ensure_approximately_equals(llformat("distance %d", i).c_str(), table.getDistance(i, origin),
+										(groups[i].mBounds[1][0] - origin).magVec(), 20);
+			ensure_approximately_equals(llformat("distance %d from elsewhere", i).c_str(), table.getDistance(i, elsewhere),
+										(groups[i].mBounds[1][0] - elsewhere).magVec(), 20);
+		}
+	}
+
+	template<> template<>
+	void llcullbounds_object_t::test<4>()
+	{
+		set_test_name("cull throughput");
+		if (!run_benchmarks())
+		{
+			// test<2> checks the table culls as the boxes do
+			return;
+		}
+		LLCamera camera;
+		make_camera(camera);
+		LLCullPlanes planes;
+		planes.set(camera, FALSE);
+		const F32 radius = 150.f;
+
+		// Allocated one by one and shuffled, as groups end up over time
+		std::vector<TestGroup*> groups;
+		for (S32 i = 0; i < BENCH_GROUPS; i++)
+		{
+			groups.push_back(new TestGroup);
+		}
+		for (S32 i = BENCH_GROUPS - 1; i > 0; i--)
+		{
+			std::swap(groups[i], groups[(S32)random_range(0.f, (F32)i)]);
+		}
+		LLCullBoundsTable table;
+		for (S32 i = 0; i < BENCH_GROUPS; i++)
+		{
+			S32 slot = table.alloc();
+			for (U32 box = 0; box < LLCullBoundsTable::NUM_BOXES; box++)
+			{
+				table.set(slot, box, groups[i]->mBounds[box], groups[i]->mExtents[box]);
+			}
+		}
+
+		S32 scalar_visible = 0;
+		LLTimer timer;
+		for (S32 pass = 0; pass < BENCH_PASSES; pass++)
+		{
+			scalar_visible = cull_one_at_a_time(groups, camera, radius);
+		}
+		F64 scalar_time = llmax(timer.getElapsedTimeF64(), 0.000001);
+
+		timer.reset();
+		for (S32 pass = 0; pass < BENCH_PASSES; pass++)
+		{
+			table.cull(planes, camera.getOrigin(), radius);
+		}
+		F64 table_time = llmax(timer.getElapsedTimeF64(), 0.000001);
+		// Up to rounding on the planes
+		S32 table_visible = count_visible(table);
+		ensure("same boxes visible", llabs(table_visible - scalar_visible) <= BENCH_GROUPS / 1000);
+
+		F64 groups_culled = (F64)BENCH_GROUPS * BENCH_PASSES;
+		std::cout << llformat("\n%d groups, 2 boxes each, %d passes:", BENCH_GROUPS, BENCH_PASSES)
+				  << llformat("\none at a time %10.0f groups/ms", groups_culled / (scalar_time * 1000.0))
+				  << llformat("\ntable         %10.0f groups/ms (%.1fx)", groups_culled / (table_time * 1000.0),
+							  scalar_time / table_time)
+				  << std::endl;
+
+		for (S32 i = 0; i < BENCH_GROUPS; i++)
+		{
+			delete groups[i];
+		}
+	}
+}
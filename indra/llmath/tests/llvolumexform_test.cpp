@@ -0,0 +1,306 @@
+/**
+ * @file llvolumexform_test.cpp
+ * @brief Tests for LLVolumeXform against the scalar per vertex math, and a
+ * throughput benchmark on prim faces
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+#include <iostream>
+
+#include "../llvolumexform.h"
+#include "../llquaternion.h"
+#include "../m3math.h"
+#include "../m4math.h"
+#include "llpointer.h"
+#include "lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	const S32 BENCH_PASSES = 2000;
+	const F32 SENTINEL = -12345.f;
+
+	// One vertex as LLVolumeGeometryManager lays out a bump map buffer, so
+	// the batch writes go through a stride with other data in between
+	struct TestVertex
+	{
+		LLVector3 mPosition;
+		LLVector3 mNormal;
+		LLVector2 mTexCoord0;
+		LLVector2 mTexCoord1;
+		U32 mColor;
+		LLVector3 mBinormal;
+	};
+
+	// Prims as they are commonly built: box, cylinder, sphere and torus
+	void make_prims(std::vector<LLPointer<LLVolume> >& prims)
+	{
+		const U8 types[][2] =
+		{
+			{ LL_PCODE_PROFILE_SQUARE, LL_PCODE_PATH_LINE },
+			{ LL_PCODE_PROFILE_CIRCLE, LL_PCODE_PATH_LINE },
+			{ LL_PCODE_PROFILE_CIRCLE_HALF, LL_PCODE_PATH_CIRCLE },
+			{ LL_PCODE_PROFILE_CIRCLE, LL_PCODE_PATH_CIRCLE },
+		};
+		for (U32 i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+		{
+			LLVolumeParams params;
+			params.setType(types[i][0], types[i][1]);
+			if (types[i][1] == LL_PCODE_PATH_CIRCLE && types[i][0] == LL_PCODE_PROFILE_CIRCLE)
+			{ //torus
+				params.setRatio(1.f, 0.25f);
+			}
+			LLPointer<LLVolume> volume = new LLVolume(params, 3.f);
+			for (S32 f = 0; f < volume->getNumVolumeFaces(); f++)
+			{
+				volume->genBinormals(f);
+			}
+			prims.push_back(volume);
+		}
+	}
+
+	// A rotated, scaled and moved object, as LLVOVolume::getRelativeXform()
+	// gives for a prim
+	void make_xforms(LLMatrix4& mat_vert, LLMatrix3& mat_normal)
+	{
+		LLQuaternion rot(0.3f, LLVector3(1.f, 2.f, 3.f));
+		LLVector3 scale(0.5f, 2.f, 3.f);
+		mat_vert.initAll(scale, rot, LLVector3(10.f, -20.f, 30.f));
+		LLMatrix3 m = rot.getMatrix3();
+		for (U32 i = 0; i < 3; i++)
+		{
+			for (U32 j = 0; j < 3; j++)
+			{
+				mat_normal.mMatrix[i][j] = m.mMatrix[i][j] / scale.mV[i];
+			}
+		}
+	}
+
+	void fill_sentinel(std::vector<TestVertex>& out)
+	{
+		for (U32 i = 0; i < out.size(); i++)
+		{
+			F32* f = (F32*) &out[i];
+			for (U32 j = 0; j < sizeof(TestVertex) / sizeof(F32); j++)
+			{
+				f[j] = SENTINEL;
+			}
+		}
+	}
+
+	template<class T> LLStrider<T> make_strider(T* first)
+	{
+		LLStrider<T> strider;
+		strider = first;
+		strider.setStride(sizeof(TestVertex));
+		return strider;
+	}
+
+	// What LLFace::getGeometryVolume() did one vertex at a time
+	void scalar_xform(const LLVolumeFace& vf, const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
+					  F32 cos_ang, F32 sin_ang, F32 os, F32 ot, F32 ms, F32 mt, std::vector<TestVertex>& out)
+	{
+		for (U32 i = 0; i < vf.mVertices.size(); i++)
+		{
+			const LLVolumeFace::VertexData& v = vf.mVertices[i];
+			TestVertex& o = out[i];
+
+			F32 s = v.mTexCoord.mV[0] - 0.5f;
+			F32 t = v.mTexCoord.mV[1] - 0.5f;
+			F32 temp = s;
+			s = s * cos_ang + t * sin_ang;
+			t = -temp * sin_ang + t * cos_ang;
+			s *= ms;
+			t *= mt;
+			s += os + 0.5f;
+			t += ot + 0.5f;
+			o.mTexCoord0.setVec(s, t);
+
+			o.mPosition = v.mPosition * mat_vert;
+
+			LLVector3 normal = v.mNormal * mat_normal;
+			normal.normVec();
+			o.mNormal = normal;
+
+			LLVector3 binormal = v.mBinormal * mat_normal;
+			binormal.normVec();
+			o.mBinormal = binormal;
+		}
+	}
+
+	void batch_xform(const LLVolumeFace& vf, const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
+					 F32 cos_ang, F32 sin_ang, F32 os, F32 ot, F32 ms, F32 mt, std::vector<TestVertex>& out)
+	{
+		const LLVolumeFace::VertexData* src = &vf.mVertices[0];
+		S32 count = vf.mVertices.size();
+		LLVolumeXform::transformTexCoords(src, count, cos_ang, sin_ang, os, ot, ms, mt, make_strider(&out[0].mTexCoord0));
+		LLVolumeXform::transformPositions(src, count, mat_vert, make_strider(&out[0].mPosition));
+		LLVolumeXform::transformNormals(src, count, mat_normal, make_strider(&out[0].mNormal));
+		LLVolumeXform::transformBinormals(src, count, mat_normal, make_strider(&out[0].mBinormal));
+	}
+
+	void ensure_same(const std::string& msg, const LLVector3& actual, const LLVector3& expected)
+	{
+		for (U32 i = 0; i < 3; i++)
+		{
+			tut::ensure_approximately_equals(msg.c_str(), actual.mV[i], expected.mV[i], 20);
+		}
+	}
+}
+
+namespace tut
+{
+	struct llvolumexform_data
+	{
+	};
+	typedef test_group<llvolumexform_data> llvolumexform_t;
+	typedef llvolumexform_t::object llvolumexform_object_t;
+	tut::llvolumexform_t tut_llvolumexform("llvolumexform");
+
+	template<> template<>
+	void llvolumexform_object_t::test<1>()
+	{
+		set_test_name("batch transforms match the scalar math and only touch their own fields");
+		std::vector<LLPointer<LLVolume> > prims;
+		make_prims(prims);
+		LLMatrix4 mat_vert;
+		LLMatrix3 mat_normal;
+		make_xforms(mat_vert, mat_normal);
+		const F32 r = 0.7f;
+
+		for (U32 p = 0; p < prims.size(); p++)
+		{
+			for (S32 f = 0; f < prims[p]->getNumVolumeFaces(); f++)
+			{
+				const LLVolumeFace& vf = prims[p]->getVolumeFace(f);
+				// One past the end to check nothing is written there
+				std::vector<TestVertex> expected(vf.mVertices.size() + 1);
+				std::vector<TestVertex> actual(vf.mVertices.size() + 1);
+				fill_sentinel(expected);
+				fill_sentinel(actual);
+				scalar_xform(vf, mat_vert, mat_normal, cosf(r), sinf(r), 0.25f, -0.5f, 2.f, 3.f, expected);
+				batch_xform(vf, mat_vert, mat_normal, cosf(r), sinf(r), 0.25f, -0.5f, 2.f, 3.f, actual);
+
+				for (U32 i = 0; i < actual.size(); i++)
+				{
+					std::string msg = llformat("prim %d face %d vertex %d", p, f, i);
+					ensure_same(msg + " position", actual[i].mPosition, expected[i].mPosition);
+					ensure_same(msg + " normal", actual[i].mNormal, expected[i].mNormal);
+					ensure_same(msg + " binormal", actual[i].mBinormal, expected[i].mBinormal);
+					ensure_approximately_equals((msg + " s").c_str(), actual[i].mTexCoord0.mV[0], expected[i].mTexCoord0.mV[0], 20);
+					ensure_approximately_equals((msg + " t").c_str(), actual[i].mTexCoord0.mV[1], expected[i].mTexCoord0.mV[1], 20);
+					ensure_equals(msg + " untouched", actual[i].mTexCoord1.mV[0], SENTINEL);
+					ensure_equals(msg + " untouched", *(F32*) &actual[i].mColor, SENTINEL);
+				}
+			}
+		}
+	}
+
+	template<> template<>
+	void llvolumexform_object_t::test<2>()
+	{
+		set_test_name("zero normals stay zero");
+		LLVolumeFace::VertexData src[5];
+		for (U32 i = 0; i < 5; i++)
+		{
+			src[i].mPosition.setVec(1.f, 2.f, 3.f);
+			src[i].mNormal.setVec(i == 2 ? 0.f : 1.f, 0.f, 0.f);
+			src[i].mBinormal.setVec(0.f, 0.f, 0.f);
+			src[i].mTexCoord.setVec(0.f, 0.f);
+		}
+		LLMatrix3 mat;
+		std::vector<TestVertex> out(5);
+		LLVolumeXform::transformNormals(src, 5, mat, make_strider(&out[0].mNormal));
+		LLVolumeXform::transformBinormals(src, 5, mat, make_strider(&out[0].mBinormal));
+		for (U32 i = 0; i < 5; i++)
+		{
+			ensure_equals(llformat("normal %d", i), out[i].mNormal, i == 2 ? LLVector3::zero : LLVector3::x_axis);
+			ensure_equals(llformat("binormal %d", i), out[i].mBinormal, LLVector3::zero);
+		}
+	}
+
+	template<> template<>
+	void llvolumexform_object_t::test<3>()
+	{
+		set_test_name("transform throughput");
+		if (!run_benchmarks())
+		{
+			return;
+		}
+		std::vector<LLPointer<LLVolume> > prims;
+		make_prims(prims);
+		LLMatrix4 mat_vert;
+		LLMatrix3 mat_normal;
+		make_xforms(mat_vert, mat_normal);
+		const F32 r = 0.7f;
+
+		S32 vertices = 0;
+		U32 max_vertices = 0;
+		for (U32 p = 0; p < prims.size(); p++)
+		{
+			for (S32 f = 0; f < prims[p]->getNumVolumeFaces(); f++)
+			{
+				vertices += prims[p]->getVolumeFace(f).mVertices.size();
+				max_vertices = llmax(max_vertices, (U32) prims[p]->getVolumeFace(f).mVertices.size());
+			}
+		}
+		std::vector<TestVertex> out(max_vertices);
+
+		LLTimer timer;
+		for (S32 pass = 0; pass < BENCH_PASSES; pass++)
+		{
+			for (U32 p = 0; p < prims.size(); p++)
+			{
+				for (S32 f = 0; f < prims[p]->getNumVolumeFaces(); f++)
+				{
+					scalar_xform(prims[p]->getVolumeFace(f), mat_vert, mat_normal, cosf(r), sinf(r), 0.25f, -0.5f, 2.f, 3.f, out);
+				}
+			}
+		}
+		F64 scalar_time = llmax(timer.getElapsedTimeF64(), 0.000001);
+
+		timer.reset();
+		for (S32 pass = 0; pass < BENCH_PASSES; pass++)
+		{
+			for (U32 p = 0; p < prims.size(); p++)
+			{
+				for (S32 f = 0; f < prims[p]->getNumVolumeFaces(); f++)
+				{
+					batch_xform(prims[p]->getVolumeFace(f), mat_vert, mat_normal, cosf(r), sinf(r), 0.25f, -0.5f, 2.f, 3.f, out);
+				}
+			}
+		}
+		F64 batch_time = llmax(timer.getElapsedTimeF64(), 0.000001);
+
+		F64 total = (F64) vertices * BENCH_PASSES;
+		std::cout << llformat("\n%d vertices in %d prims, %d passes:", vertices, (S32) prims.size(), BENCH_PASSES)
+				  << llformat("\nscalar %10.1f Mvertices/s", total / (scalar_time * 1000000.0))
+				  << llformat("\nbatch  %10.1f Mvertices/s (%.1fx)", total / (batch_time * 1000000.0),
+							  scalar_time / batch_time)
+				  << std::endl;
+	}
+}
@@ -345,7 +345,8 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 
 			packetp->mBuffer[0] |= LL_RESENT_FLAG;  // tag packet id as being a resend	
 
-			gMessageSystem->mPacketRing.sendPacket(packetp->mSocket, 
+			// LLCircuit::resendUnackedPackets() sends what is left over
+			gMessageSystem->mPacketRing.queuePacket(packetp->mSocket, 
 											   (char *)packetp->mBuffer, packetp->mBufferLength, 
 											   packetp->mHost);
 
@@ -595,6 +596,8 @@ void LLCircuit::resendUnackedPackets(S32& unacked_list_length, S32& unacked_list
 		unacked_list_length += circ->resendUnackedPackets(now);
 		unacked_list_size += circ->getUnackedPacketBytes();
 	}
+	// The resends of all circuits go out together
+	gMessageSystem->mPacketRing.flushPackets();
 }
 
 
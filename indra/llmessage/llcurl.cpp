@@ -350,7 +350,9 @@ U32 LLCurl::Easy::report(CURLcode code)
 	
 	if (code == CURLE_OK)
 	{
-		curl_easy_getinfo(mCurlEasyHandle, CURLINFO_RESPONSE_CODE, &responseCode);
+		long http_code = 0; // curl writes a long, U32 is too small on 64 bit
+		curl_easy_getinfo(mCurlEasyHandle, CURLINFO_RESPONSE_CODE, &http_code);
+		responseCode = (U32)http_code;
 		//*TODO: get reason from first line of mHeaderOutput
 	}
 	else
@@ -0,0 +1,502 @@
+/**
+ * @file llhttppipeline.cpp
+ * @brief Ranged HTTP GETs over a few persistent, pipelined connections per host.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llhttppipeline.h"
+
+#include <cmath>
+#include <curl/curl.h>
+
+#include "llbuffer.h"
+#include "llstl.h"
+#include "llthread.h"
+#include "lltimer.h"
+
+static const S32 CURL_REQUEST_TIMEOUT = 30; // seconds, same as LLCurlRequest
+static const long MAX_REDIRECTS = 5;
+static const S32 MULTI_PERFORM_CALL_REPEAT = 5;
+static const U32 HANDLE_POOL_SIZE = 16;
+static const S32 INITIAL_WINDOW = 8;
+
+// A window measurement lasts at least this long, this many requests and two latencies
+static const F64 MIN_INTERVAL = 0.25;
+static const S32 MIN_INTERVAL_COUNT = 4;
+
+//////////////////////////////////////////////////////////////////////////////
+
+LLHTTPWindow::LLHTTPWindow(S32 min_size, S32 max_size, S32 initial_size)
+	: mMinSize(llmax(min_size, 1)),
+	  mMaxSize(llmax(max_size, llmax(min_size, 1))),
+	  mBandwidth(0.0),
+	  mLatency(0.0),
+	  mAverageBytes(0.0),
+	  mIntervalStart(-1.0),
+	  mIntervalLatency(0.0),
+	  mIntervalBytes(0),
+	  mIntervalCount(0),
+	  mIntervalLimited(false)
+{
+	mSize = llclamp(initial_size, mMinSize, mMaxSize);
+}
+
+void LLHTTPWindow::sent(S32 in_flight)
+{
+	if (in_flight + 1 >= mSize)
+	{
+		mIntervalLimited = true;
+	}
+}
+
+void LLHTTPWindow::completed(S32 bytes, F64 latency, bool success, F64 now)
+{
+	if (!success)
+	{
+		// Too much in flight for the server, or it is in trouble: back off
+		// and measure again from scratch
+		mSize = llmax(mMinSize, mSize / 2);
+		mIntervalStart = -1.0;
+		mIntervalBytes = 0;
+		mIntervalCount = 0;
+		mIntervalLimited = false;
+		return;
+	}
+
+	if (mIntervalStart < 0.0)
+	{
+		// The first request of a measurement went out about one latency ago
+		mIntervalStart = now - latency;
+	}
+	if (mIntervalCount == 0 || latency < mIntervalLatency)
+	{
+		mIntervalLatency = latency;
+	}
+	mIntervalBytes += bytes;
+	mIntervalCount++;
+	mAverageBytes = mAverageBytes > 0.0 ? mAverageBytes + ((F64)bytes - mAverageBytes) / 8.0 : (F64)bytes;
+
+	F64 elapsed = now - mIntervalStart;
+	if (mIntervalCount < MIN_INTERVAL_COUNT || elapsed < llmax(MIN_INTERVAL, 2.0 * mIntervalLatency))
+	{
+		return;
+	}
+
+	mBandwidth = (F64)mIntervalBytes / elapsed;
+	// Never let it grow back: with the window at twice the bandwidth-delay
+	// product half of what is in flight waits in a queue, and counting that
+	// wait as latency would feed on itself
+	if (mLatency <= 0.0 || mIntervalLatency < mLatency)
+	{
+		mLatency = mIntervalLatency;
+	}
+
+	// Only an interval where the window was full says anything about its size.
+	// While the window is the limit the bandwidth follows it and the target
+	// doubles it, once the link is the limit the target stays put.
+	if (mIntervalLimited && mAverageBytes > 0.0)
+	{
+		F64 bdp = mBandwidth * mLatency / mAverageBytes;
+		S32 target = (S32)ceil(2.0 * bdp);
+		mSize = llclamp(target, llmax(mMinSize, mSize / 2), llmin(mMaxSize, mSize * 2));
+	}
+
+	mIntervalStart = now;
+	mIntervalBytes = 0;
+	mIntervalCount = 0;
+	mIntervalLimited = false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct LLHTTPPipeline::Request
+{
+	Request()
+		: mOffset(0),
+		  mLength(0),
+		  mHost(NULL),
+		  mHandle(NULL),
+		  mHeaders(NULL)
+	{
+		mErrorBuffer[0] = 0;
+	}
+	~Request()
+	{
+		curl_slist_free_all(mHeaders);
+	}
+
+	std::string mURL;
+	headers_t mExtraHeaders;
+	S32 mOffset;
+	S32 mLength;
+	LLCurl::ResponderPtr mResponder;
+
+	Host* mHost;
+	CURL* mHandle;
+	struct curl_slist* mHeaders;
+	LLChannelDescriptors mChannels;
+	LLIOPipe::buffer_ptr_t mOutput;
+	char mErrorBuffer[CURL_ERROR_SIZE];
+};
+
+//static
+size_t LLHTTPPipeline::writeCallback(char* data, size_t size, size_t nmemb, void* user_data)
+{
+	Request* request = (Request*)user_data;
+	S32 n = size * nmemb;
+	request->mOutput->append(request->mChannels.in(), (const U8*)data, n);
+	return n;
+}
+
+LLHTTPPipeline::LLHTTPPipeline(S32 connections_per_host, S32 min_window, S32 max_window)
+	: mMinWindow(llmax(min_window, 1)),
+	  mMaxWindow(llmax(max_window, llmax(min_window, 1)))
+{
+	mThreadID = LLThread::currentID();
+	mCurlMultiHandle = curl_multi_init();
+	llassert_always(mCurlMultiHandle);
+
+	connections_per_host = llclamp(connections_per_host, 1, mMaxWindow);
+#if LIBCURL_VERSION_NUM >= 0x073e00
+	// HTTP/1.1 pipelining is gone, HTTP/2 servers can still multiplex.
+	// Otherwise the window needs a connection per request.
+	curl_multi_setopt(mCurlMultiHandle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+	connections_per_host = mMaxWindow;
+#else
+	curl_multi_setopt(mCurlMultiHandle, CURLMOPT_PIPELINING, 1L);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x071e00
+	curl_multi_setopt(mCurlMultiHandle, CURLMOPT_MAX_HOST_CONNECTIONS, (long)connections_per_host);
+#if LIBCURL_VERSION_NUM < 0x073e00
+	curl_multi_setopt(mCurlMultiHandle, CURLMOPT_MAX_PIPELINE_LENGTH,
+					  (long)((mMaxWindow + connections_per_host - 1) / connections_per_host));
+#endif
+#endif
+	// Keep the connections to a few hosts open between requests
+	curl_multi_setopt(mCurlMultiHandle, CURLMOPT_MAXCONNECTS, (long)(connections_per_host * 4));
+}
+
+LLHTTPPipeline::~LLHTTPPipeline()
+{
+	llassert_always(mThreadID == LLThread::currentID());
+	for (active_map_t::iterator iter = mActiveMap.begin(); iter != mActiveMap.end(); ++iter)
+	{
+		curl_multi_remove_handle(mCurlMultiHandle, iter->first);
+		curl_easy_cleanup(iter->first);
+		delete iter->second;
+	}
+	mActiveMap.clear();
+	for (host_map_t::iterator iter = mHostMap.begin(); iter != mHostMap.end(); ++iter)
+	{
+		Host* host = iter->second;
+		for_each(host->mWaiting.begin(), host->mWaiting.end(), DeletePointer());
+		delete host;
+	}
+	mHostMap.clear();
+	for (std::vector<CURL*>::iterator iter = mFreeHandles.begin(); iter != mFreeHandles.end(); ++iter)
+	{
+		curl_easy_cleanup(*iter);
+	}
+	mFreeHandles.clear();
+	curl_multi_cleanup(mCurlMultiHandle);
+}
+
+//static
+std::string LLHTTPPipeline::getHostKey(const std::string& url)
+{
+	std::string::size_type scheme_end = url.find("://");
+	if (scheme_end == std::string::npos)
+	{
+		return std::string();
+	}
+	std::string::size_type host_start = scheme_end + 3;
+	std::string::size_type host_end = url.find_first_of("/?#", host_start);
+	if (host_end == host_start || host_start >= url.length())
+	{
+		return std::string();
+	}
+	std::string key = url.substr(0, host_end);
+	LLStringUtil::toLower(key);
+	return key;
+}
+
+bool LLHTTPPipeline::getByteRange(const std::string& url, const headers_t& headers,
+								  S32 offset, S32 length, LLCurl::ResponderPtr responder)
+{
+	llassert_always(mThreadID == LLThread::currentID());
+	std::string key = getHostKey(url);
+	if (key.empty())
+	{
+		llwarns << "No host in url: " << url << llendl;
+		return false;
+	}
+
+	Host*& host = mHostMap[key];
+	if (!host)
+	{
+		host = new Host(mMinWindow, mMaxWindow, INITIAL_WINDOW);
+	}
+
+	Request* request = new Request;
+	request->mURL = url;
+	request->mExtraHeaders = headers;
+	request->mOffset = offset;
+	request->mLength = length;
+	request->mResponder = responder;
+	request->mHost = host;
+	host->mWaiting.push_back(request);
+	return true;
+}
+
+S32 LLHTTPPipeline::process()
+{
+	llassert_always(mThreadID == LLThread::currentID());
+
+	sendRequests();
+	perform();
+
+	S32 finished = 0;
+	CURLMsg* msg;
+	int msgs_in_queue;
+	while ((msg = curl_multi_info_read(mCurlMultiHandle, &msgs_in_queue)))
+	{
+		if (msg->msg == CURLMSG_DONE)
+		{
+			requestDone(msg->easy_handle, msg->data.result);
+			++finished;
+		}
+	}
+
+	if (finished > 0 && sendRequests() > 0)
+	{
+		// Put the replacements on the wire now rather than next frame
+		perform();
+	}
+	return finished;
+}
+
+S32 LLHTTPPipeline::getQueued() const
+{
+	S32 queued = (S32)mActiveMap.size();
+	for (host_map_t::const_iterator iter = mHostMap.begin(); iter != mHostMap.end(); ++iter)
+	{
+		queued += (S32)iter->second->mWaiting.size();
+	}
+	return queued;
+}
+
+S32 LLHTTPPipeline::getCapacity() const
+{
+	S32 capacity = llclamp(INITIAL_WINDOW, mMinWindow, mMaxWindow);
+	for (host_map_t::const_iterator iter = mHostMap.begin(); iter != mHostMap.end(); ++iter)
+	{
+		capacity += iter->second->mWindow.getSize();
+	}
+	return capacity;
+}
+
+const LLHTTPWindow* LLHTTPPipeline::getWindow(const std::string& url) const
+{
+	host_map_t::const_iterator iter = mHostMap.find(getHostKey(url));
+	return iter != mHostMap.end() ? &iter->second->mWindow : NULL;
+}
+
+void LLHTTPPipeline::perform()
+{
+	for (S32 call_count = 0; call_count < MULTI_PERFORM_CALL_REPEAT; call_count++)
+	{
+		int running = 0;
+		CURLMcode code = curl_multi_perform(mCurlMultiHandle, &running);
+		if (CURLM_CALL_MULTI_PERFORM != code || running == 0)
+		{
+			break;
+		}
+	}
+}
+
+S32 LLHTTPPipeline::sendRequests()
+{
+	S32 sent = 0;
+	for (host_map_t::iterator iter = mHostMap.begin(); iter != mHostMap.end(); ++iter)
+	{
+		Host* host = iter->second;
+		while (host->mInFlight < host->mWindow.getSize() && !host->mWaiting.empty())
+		{
+			Request* request = host->mWaiting.front();
+			host->mWaiting.pop_front();
+			if (sendRequest(host, request))
+			{
+				++sent;
+			}
+			else
+			{
+				// Fail it the way a broken connection would
+				if (request->mResponder)
+				{
+					request->mOutput.reset(new LLBufferArray);
+					request->mResponder->completedRaw(499, "Failed to start request",
+													  request->mChannels, request->mOutput);
+				}
+				delete request;
+			}
+		}
+	}
+	return sent;
+}
+
+bool LLHTTPPipeline::sendRequest(Host* host, Request* request)
+{
+	CURL* handle = allocHandle();
+	if (!handle)
+	{
+		return false;
+	}
+	request->mHandle = handle;
+	request->mOutput.reset(new LLBufferArray);
+
+	curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &writeCallback);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*)request);
+	if (request->mResponder && request->mResponder->followRedir())
+	{
+		curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+		curl_easy_setopt(handle, CURLOPT_MAXREDIRS, MAX_REDIRECTS);
+	}
+	curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, request->mErrorBuffer);
+	if (!LLCurl::getCAPath().empty())
+	{
+		curl_easy_setopt(handle, CURLOPT_CAPATH, LLCurl::getCAPath().c_str());
+	}
+	if (!LLCurl::getCAFile().empty())
+	{
+		curl_easy_setopt(handle, CURLOPT_CAINFO, LLCurl::getCAFile().c_str());
+	}
+	curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 1L);
+	curl_easy_setopt(handle, CURLOPT_TIMEOUT, (long)CURL_REQUEST_TIMEOUT);
+	curl_easy_setopt(handle, CURLOPT_URL, request->mURL.c_str());
+	curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+
+	request->mHeaders = curl_slist_append(request->mHeaders, "Connection: keep-alive");
+	request->mHeaders = curl_slist_append(request->mHeaders, "Keep-alive: 300");
+	for (headers_t::const_iterator iter = request->mExtraHeaders.begin();
+		 iter != request->mExtraHeaders.end(); ++iter)
+	{
+		request->mHeaders = curl_slist_append(request->mHeaders, iter->c_str());
+	}
+	if (request->mLength > 0)
+	{
+		std::string range = llformat("Range: bytes=%d-%d", request->mOffset, request->mOffset + request->mLength - 1);
+		request->mHeaders = curl_slist_append(request->mHeaders, range.c_str());
+	}
+	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request->mHeaders);
+
+	CURLMcode mcode = curl_multi_add_handle(mCurlMultiHandle, handle);
+	if (mcode != CURLM_OK)
+	{
+		llwarns << "Curl Error: " << curl_multi_strerror(mcode) << llendl;
+		freeHandle(handle);
+		request->mHandle = NULL;
+		return false;
+	}
+
+	host->mWindow.sent(host->mInFlight);
+	host->mInFlight++;
+	mActiveMap[handle] = request;
+	return true;
+}
+
+void LLHTTPPipeline::requestDone(CURL* handle, CURLcode result)
+{
+	curl_multi_remove_handle(mCurlMultiHandle, handle);
+	active_map_t::iterator iter = mActiveMap.find(handle);
+	if (iter == mActiveMap.end())
+	{
+		llwarns << "Finished curl request not found" << llendl;
+		return;
+	}
+	Request* request = iter->second;
+	mActiveMap.erase(iter);
+	Host* host = request->mHost;
+	host->mInFlight--;
+
+	U32 status = 499;
+	std::string reason;
+	if (result == CURLE_OK)
+	{
+		long code = 0;
+		curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &code);
+		status = (U32)code;
+	}
+	else
+	{
+		reason = LLCurl::strerror(result) + " : " + request->mErrorBuffer;
+	}
+
+	double latency = 0.0;
+	curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &latency);
+	S32 bytes = request->mOutput->countAfter(request->mChannels.in(), NULL);
+	// 5xx and broken transfers say to slow down, 4xx are about the request
+	host->mWindow.completed(bytes, latency, result == CURLE_OK && status < 500, LLTimer::getTotalSeconds());
+
+	freeHandle(handle);
+	request->mHandle = NULL;
+
+	if (request->mResponder)
+	{
+		request->mResponder->completedRaw(status, reason, request->mChannels, request->mOutput);
+	}
+	delete request;
+}
+
+CURL* LLHTTPPipeline::allocHandle()
+{
+	if (!mFreeHandles.empty())
+	{
+		CURL* handle = mFreeHandles.back();
+		mFreeHandles.pop_back();
+		return handle;
+	}
+	CURL* handle = curl_easy_init();
+	if (!handle)
+	{
+		// this can happen if we have too many open files
+		llwarns << "curl_easy_init() returned NULL! Requests in flight: " << mActiveMap.size() << llendl;
+	}
+	return handle;
+}
+
+void LLHTTPPipeline::freeHandle(CURL* handle)
+{
+	if (mFreeHandles.size() < HANDLE_POOL_SIZE)
+	{
+		// Connections belong to the multi handle, they survive the reset
+		curl_easy_reset(handle);
+		mFreeHandles.push_back(handle);
+	}
+	else
+	{
+		curl_easy_cleanup(handle);
+	}
+}
@@ -0,0 +1,149 @@
+/**
+ * @file llhttppipeline.h
+ * @brief Ranged HTTP GETs over a few persistent, pipelined connections per host.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLHTTPPIPELINE_H
+#define LL_LLHTTPPIPELINE_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llcurl.h"
+
+// Number of requests worth keeping in flight to one host. Grows while the
+// window is what limits throughput and settles at about twice the
+// bandwidth-delay product, measured as the bandwidth seen over an interval
+// times the lowest time to first byte. Halves on errors.
+class LLHTTPWindow
+{
+public:
+	LLHTTPWindow(S32 min_size, S32 max_size, S32 initial_size);
+
+	S32 getSize() const { return mSize; }
+	// Bytes per second over the last full interval, 0 until measured
+	F64 getBandwidth() const { return mBandwidth; }
+	// Lowest time to first byte, in seconds. 0 until measured
+	F64 getLatency() const { return mLatency; }
+
+	// A request was sent with in_flight others outstanding
+	void sent(S32 in_flight);
+	// A request sent earlier finished at now (seconds, any epoch). latency
+	// is its time to first byte.
+	void completed(S32 bytes, F64 latency, bool success, F64 now);
+
+private:
+	S32 mMinSize;
+	S32 mMaxSize;
+	S32 mSize;
+
+	F64 mBandwidth;
+	F64 mLatency;
+	F64 mAverageBytes;
+
+	// Current measurement interval
+	F64 mIntervalStart;
+	F64 mIntervalLatency;
+	S32 mIntervalBytes;
+	S32 mIntervalCount;
+	bool mIntervalLimited;	// the window was full at some point
+};
+
+// Replaces LLCurlRequest for bulk ranged GETs to a few hosts, e.g. texture
+// downloads. Requests queue per host (scheme, name and port of the url) and
+// at most the window of that host are handed to curl at a time, where they
+// share up to connections_per_host persistent connections, pipelined.
+// libcurl 7.62 and later no longer pipeline HTTP/1.1, with those each
+// request in the window gets a persistent connection of its own instead.
+//
+// Responders see the same completedRaw() calls they get from LLCurlRequest.
+// Not thread safe, every call must come from the thread that made it.
+class LLHTTPPipeline
+{
+	LOG_CLASS(LLHTTPPipeline);
+public:
+	typedef std::vector<std::string> headers_t;
+
+	LLHTTPPipeline(S32 connections_per_host = 4, S32 min_window = 2, S32 max_window = 64);
+	~LLHTTPPipeline();
+
+	// Queues a GET for length bytes from offset, the whole resource if
+	// length <= 0. Only fails for urls without a host.
+	bool getByteRange(const std::string& url, const headers_t& headers,
+					  S32 offset, S32 length, LLCurl::ResponderPtr responder);
+
+	// Sends what the windows allow and reports finished requests.
+	// Call once per frame. Returns the number of requests finished.
+	S32 process();
+
+	// Requests queued or in flight
+	S32 getQueued() const;
+	S32 getInFlight() const { return (S32)mActiveMap.size(); }
+	// How many requests it is worth keeping queued or in flight: the windows
+	// of the hosts seen so far plus room to open a new one
+	S32 getCapacity() const;
+	// Window of the host of url, NULL until the host is seen
+	const LLHTTPWindow* getWindow(const std::string& url) const;
+
+	// "scheme://host:port" part of url, empty if it has none
+	static std::string getHostKey(const std::string& url);
+
+private:
+	struct Request;
+	struct Host
+	{
+		Host(S32 min_window, S32 max_window, S32 initial_window)
+			: mWindow(min_window, max_window, initial_window), mInFlight(0) {}
+
+		LLHTTPWindow mWindow;
+		std::deque<Request*> mWaiting;
+		S32 mInFlight;
+	};
+
+	void perform();
+	S32 sendRequests();
+	bool sendRequest(Host* host, Request* request);
+	void requestDone(CURL* handle, CURLcode result);
+	CURL* allocHandle();
+	void freeHandle(CURL* handle);
+	static size_t writeCallback(char* data, size_t size, size_t nmemb, void* user_data);
+
+private:
+	S32 mMinWindow;
+	S32 mMaxWindow;
+
+	CURLM* mCurlMultiHandle;
+
+	typedef std::map<std::string, Host*> host_map_t;
+	host_map_t mHostMap;
+	typedef std::map<CURL*, Request*> active_map_t;
+	active_map_t mActiveMap;
+	std::vector<CURL*> mFreeHandles;
+
+	U32 mThreadID; // debug
+};
+
+#endif // LL_LLHTTPPIPELINE_H
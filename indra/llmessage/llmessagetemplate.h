@@ -235,6 +235,27 @@ public:
 };
 
 
+// Wire layout of the variables and blocks of a message, flattened in
+// message order by LLMessageTemplate::addBlock() so LLTemplateMessageReader
+// can decode a packet into offsets without walking the maps above.
+struct LLMessageVariableLayout
+{
+	char*				mName;
+	EMsgVariableType	mType;
+	S32					mSize;		// bytes, or bytes of size info for MVT_VARIABLE
+	S32					mOffset;	// from the start of the block, -1 past an MVT_VARIABLE
+};
+
+struct LLMessageBlockLayout
+{
+	char*				mName;
+	EMsgBlockType		mType;
+	S32					mNumber;
+	S32					mFirstVariable;	// index into LLMessageTemplate::mVariableLayout
+	S32					mVariableCount;
+	S32					mFixedSize;		// bytes per repeat, -1 if it has MVT_VARIABLE members
+};
+
 enum EMsgFrequency
 {
 	MFT_NULL	= 0,  // value is size of message number in bytes
@@ -316,6 +337,32 @@ public:
 		{
 			mTotalSize = -1;
 		}
+
+		LLMessageBlockLayout block_layout;
+		block_layout.mName = blockp->mName;
+		block_layout.mType = blockp->mType;
+		block_layout.mNumber = blockp->mNumber;
+		block_layout.mFirstVariable = (S32)mVariableLayout.size();
+		block_layout.mVariableCount = (S32)blockp->mMemberVariables.size();
+		block_layout.mFixedSize = blockp->mTotalSize;
+		mBlockLayout.push_back(block_layout);
+
+		S32 offset = 0;
+		for (LLMessageBlock::message_variable_map_t::const_iterator iter = blockp->mMemberVariables.begin();
+			 iter != blockp->mMemberVariables.end(); ++iter)
+		{
+			const LLMessageVariable* varp = *iter;
+			LLMessageVariableLayout variable_layout;
+			variable_layout.mName = varp->getName();
+			variable_layout.mType = varp->getType();
+			variable_layout.mSize = varp->getSize();
+			variable_layout.mOffset = offset;
+			mVariableLayout.push_back(variable_layout);
+			if (offset >= 0)
+			{
+				offset = (varp->getType() == MVT_VARIABLE) ? -1 : offset + varp->getSize();
+			}
+		}
 	}
 
 	LLMessageBlock *getBlock(char *name)
@@ -394,6 +441,8 @@ public:
 public:
 	typedef LLDynamicArrayIndexed<LLMessageBlock*, char*, 8> message_block_map_t;
 	message_block_map_t						mMemberBlocks;
+	std::vector<LLMessageBlockLayout>		mBlockLayout;
+	std::vector<LLMessageVariableLayout>	mVariableLayout;
 	char									*mName;
 	EMsgFrequency							mFrequency;
 	EMsgTrust								mTrust;
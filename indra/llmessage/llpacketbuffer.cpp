@@ -34,8 +34,35 @@
 
 ///////////////////////////////////////////////////////////
 
-LLPacketBuffer::LLPacketBuffer(const LLHost &host, const char *datap, const S32 size) : mHost(host)
+LLPacketBuffer::LLPacketBuffer(const LLHost &host, const char *datap, const S32 size)
 {
+	init(host, datap, size);
+}
+
+LLPacketBuffer::LLPacketBuffer (S32 hSocket)
+{
+	init(hSocket);
+}
+
+///////////////////////////////////////////////////////////
+
+LLPacketBuffer::~LLPacketBuffer ()
+{
+}
+
+///////////////////////////////////////////////////////////
+
+void LLPacketBuffer::init (S32 hSocket)
+{
+	mSize = receive_packet(hSocket, mData);
+	mHost = ::get_sender();
+	mReceivingIF = ::get_receiving_interface();
+}
+
+void LLPacketBuffer::init(const LLHost &host, const char *datap, const S32 size)
+{
+	mHost = host;
+	mReceivingIF.invalidate();
 	mSize = 0;
 	mData[0] = '!';
 
@@ -51,26 +78,50 @@ LLPacketBuffer::LLPacketBuffer(const LLHost &host, const char *datap, const S32
 			mSize = size;
 		}
 	}
-	
-}
-
-LLPacketBuffer::LLPacketBuffer (S32 hSocket)
-{
-	init(hSocket);
 }
 
 ///////////////////////////////////////////////////////////
 
-LLPacketBuffer::~LLPacketBuffer ()
+// static
+S32 LLPacketBuffer::receiveBatch(S32 hSocket, LLPacketBuffer **packets, S32 count)
 {
-}
+	LLNetDatagram datagrams[NET_MAX_BATCH];
+	count = llmin(count, NET_MAX_BATCH);
+	for (S32 i = 0; i < count; i++)
+	{
+		datagrams[i].mData = packets[i]->mData;
+	}
 
-///////////////////////////////////////////////////////////
+	S32 received = receive_packets(hSocket, datagrams, count);
+	for (S32 i = 0; i < received; i++)
+	{
+		LLPacketBuffer *packetp = packets[i];
+		packetp->mSize = datagrams[i].mSize;
+		packetp->mHost.set(datagrams[i].mAddr, datagrams[i].mPort);
+		packetp->mReceivingIF.set(datagrams[i].mReceivingIF, INVALID_PORT);
+	}
+	return received;
+}
 
-void LLPacketBuffer::init (S32 hSocket)
+// static
+BOOL LLPacketBuffer::sendBatch(S32 hSocket, LLPacketBuffer * const *packets, S32 count)
 {
-	mSize = receive_packet(hSocket, mData);
-	mHost = ::get_sender();
-	mReceivingIF = ::get_receiving_interface();
+	BOOL success = TRUE;
+	LLNetDatagram datagrams[NET_MAX_BATCH];
+	while (count > 0)
+	{
+		S32 batch = llmin(count, NET_MAX_BATCH);
+		for (S32 i = 0; i < batch; i++)
+		{
+			datagrams[i].mData = packets[i]->mData;
+			datagrams[i].mSize = packets[i]->mSize;
+			datagrams[i].mAddr = packets[i]->mHost.getAddress();
+			datagrams[i].mPort = packets[i]->mHost.getPort();
+		}
+		success = send_packets(hSocket, datagrams, batch) && success;
+		packets += batch;
+		count -= batch;
+	}
+	return success;
 }
 
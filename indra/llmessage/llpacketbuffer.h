@@ -43,6 +43,13 @@ public:
 	LLHost		getHost() const					{ return mHost; }
 	LLHost		getReceivingInterface() const	{ return mReceivingIF; }
 	void init(S32 hSocket);
+	void init(const LLHost &host, const char *datap, const S32 size);
+
+	// Receive into / send from count packets with one system call where
+	// the OS allows, see receive_packets() and send_packets(). Returns how
+	// many were received, and TRUE if all were sent.
+	static S32 receiveBatch(S32 hSocket, LLPacketBuffer **packets, S32 count);
+	static BOOL sendBatch(S32 hSocket, LLPacketBuffer * const *packets, S32 count);
 
 protected:
 	char	mData[NET_BUFFER_SIZE];        // packet data		/* Flawfinder : ignore */
@@ -0,0 +1,177 @@
+/**
+ * @file llpacketreceivethread.cpp
+ * @brief Thread that reads packets off the message system's socket and
+ * decodes them ahead of LLMessageSystem::checkMessages()
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llpacketreceivethread.h"
+
+// system library includes
+#if !LL_WINDOWS
+// for ntohl()
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "llstl.h"
+#include "lltimer.h"	// ms_sleep()
+#include "net.h"
+
+// How long the thread blocks on the socket before checking whether it
+// should quit
+const S32 RECEIVE_WAIT_MS = 10;
+
+///////////////////////////////////////////////////////////
+
+LLDecodedPacket::LLDecodedPacket() :
+	LLPacketBuffer(LLHost::invalid, NULL, 0),
+	mStatus(DECODED),
+	mMessage(NULL),
+	mMessageSize(0),
+	mCompressedSize(0),
+	mAckCount(0)
+{
+}
+
+// Does what LLMessageSystem::checkMessages() does to a packet before it
+// looks at its circuit: split off the appended acks, then expand the zero
+// coding. Too short packets are left for it to complain about.
+void LLDecodedPacket::decode()
+{
+	const U8* data = (const U8*)mData;
+	mStatus = DECODED;
+	mMessage = data;
+	mMessageSize = mSize;
+	mCompressedSize = 0;
+	mAckCount = 0;
+	if (mSize < LL_MINIMUM_VALID_PACKET_SIZE)
+	{
+		return;
+	}
+
+	if (data[0] & LL_ACK_FLAG)
+	{
+		S32 acks = data[--mMessageSize];
+		if (mMessageSize < (S32)(acks * sizeof(TPACKETID)) + LL_MINIMUM_VALID_PACKET_SIZE)
+		{
+			mStatus = MALFORMED;
+			return;
+		}
+		// Last appended, first acked
+		for (S32 i = 0; i < acks; ++i)
+		{
+			U32 mem_id;
+			mMessageSize -= sizeof(TPACKETID);
+			memcpy(&mem_id, data + mMessageSize, sizeof(TPACKETID));	/* Flawfinder: ignore */
+			mAcks[i] = ntohl(mem_id);
+		}
+		mAckCount = acks;
+	}
+
+	if (data[0] & LL_ZERO_CODE_FLAG)
+	{
+		S32 expanded_size = zero_code_expand(data, mMessageSize, mExpanded);
+		if (expanded_size < 0)
+		{
+			mStatus = OVERFLOWED;
+			return;
+		}
+		mCompressedSize = mMessageSize;
+		mMessage = mExpanded;
+		mMessageSize = expanded_size;
+	}
+}
+
+///////////////////////////////////////////////////////////
+
+LLPacketReceiveThread::LLPacketReceiveThread(S32 socket) :
+	LLThread("Packet receive"),
+	mSocket(socket)
+{
+	mPackets.reserve(POOL_SIZE);
+	for (U32 i = 0; i < POOL_SIZE; ++i)
+	{
+		mPackets.push_back(new LLDecodedPacket);
+		mFree.push(mPackets.back());
+	}
+}
+
+LLPacketReceiveThread::~LLPacketReceiveThread()
+{
+	// run() never blocks for longer than RECEIVE_WAIT_MS, so rather than
+	// give up after LLThread::shutdown()'s timeout, wait for it to return
+	// before freeing the packets it may still be receiving into
+	setQuitting();
+	while (!isStopped())
+	{
+		ms_sleep(1);
+	}
+	shutdown();
+	for_each(mPackets.begin(), mPackets.end(), DeletePointer());
+	mPackets.clear();
+}
+
+// RECEIVE THREAD
+void LLPacketReceiveThread::run()
+{
+	// Taken off mFree, not received into yet
+	LLDecodedPacket* packets[NET_MAX_BATCH];
+	S32 spare = 0;
+	BOOL drained = TRUE;
+	while (!isQuitting())
+	{
+		while (spare < NET_MAX_BATCH && (packets[spare] = mFree.pop()))
+		{
+			spare++;
+		}
+		if (!spare)
+		{
+			// Every packet is waiting on the main thread, leave the rest
+			// in the socket's buffer until it catches up
+			ms_sleep(1);
+			continue;
+		}
+		if (drained && !wait_for_packet(mSocket, RECEIVE_WAIT_MS))
+		{
+			continue;
+		}
+
+		LLPacketBuffer* buffers[NET_MAX_BATCH];
+		std::copy(packets, packets + spare, buffers);
+		S32 received = LLPacketBuffer::receiveBatch(mSocket, buffers, spare);
+		for (S32 i = 0; i < received; i++)
+		{
+			packets[i]->decode();
+			// Never full, there are only POOL_SIZE packets
+			mReady.push(packets[i]);
+		}
+		std::copy(packets + received, packets + spare, packets);
+		spare -= received;
+		// A full batch may have left more behind
+		drained = (spare > 0);
+	}
+	llinfos << "LLPacketReceiveThread EXITING." << llendl;
+}
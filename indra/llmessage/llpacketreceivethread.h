@@ -0,0 +1,138 @@
+/**
+ * @file llpacketreceivethread.h
+ * @brief Thread that reads packets off the message system's socket and
+ * decodes them ahead of LLMessageSystem::checkMessages()
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETRECEIVETHREAD_H
+#define LL_LLPACKETRECEIVETHREAD_H
+
+#include <vector>
+
+#include "llapr.h"
+#include "llthread.h"
+#include "llpacketbuffer.h"
+#include "message.h"
+
+// A received packet with the acks appended to it split off and its zero
+// coding expanded, so all the main thread has left to do is dispatch it.
+class LLDecodedPacket : public LLPacketBuffer
+{
+public:
+	typedef enum e_decode_status
+	{
+		DECODED = 0,
+		MALFORMED = 1,		// claims more appended acks than the packet holds
+		OVERFLOWED = 2		// zero code expansion ran past MAX_BUFFER_SIZE
+	} EDecodeStatus;
+
+	LLDecodedPacket();
+
+	// Call once a packet has been received into it
+	void decode();
+
+	EDecodeStatus getStatus() const			{ return mStatus; }
+	const U8*	getMessage() const			{ return mMessage; }
+	S32			getMessageSize() const		{ return mMessageSize; }
+	S32			getCompressedSize() const	{ return mCompressedSize; }	// 0 if it was not zero coded
+	S32			getAckCount() const			{ return mAckCount; }
+	TPACKETID	getAck(S32 i) const			{ return mAcks[i]; }		// host byte order
+
+protected:
+	EDecodeStatus	mStatus;
+	const U8*		mMessage;			// mData or mExpanded
+	S32				mMessageSize;
+	S32				mCompressedSize;
+	S32				mAckCount;
+	TPACKETID		mAcks[256];			// the ack count is a U8
+	U8				mExpanded[MAX_BUFFER_SIZE];
+};
+
+class LLPacketReceiveThread : public LLThread
+{
+public:
+	// Packets waiting for the main thread, past this the rest stay in the
+	// socket's own buffer
+	static const U32 POOL_SIZE = 128;
+
+	LLPacketReceiveThread(S32 socket);
+	~LLPacketReceiveThread();
+
+	// MAIN THREAD
+	// Returns the oldest decoded packet, or NULL if there is none yet.
+	// Hand it back with releasePacket() once it has been dispatched.
+	LLDecodedPacket* popPacket()				{ return mReady.pop(); }
+	void releasePacket(LLDecodedPacket* packet)	{ mFree.push(packet); }
+
+private:
+	/*virtual*/ void run();
+
+	// Bounded ring of packets between exactly one producer and one
+	// consumer. Each side only ever advances its own count, so neither
+	// waits on the other.
+	class Queue
+	{
+	public:
+		Queue() : mHead(0), mTail(0) {}
+
+		// PRODUCER: returns false if full
+		bool push(LLDecodedPacket* packet)
+		{
+			U32 tail = apr_atomic_read32(&mTail);
+			if (tail - apr_atomic_read32(&mHead) >= POOL_SIZE)
+			{
+				return false;
+			}
+			mSlots[tail % POOL_SIZE] = packet;
+			// apr_atomic_inc32() is a full barrier, the slot is visible first
+			apr_atomic_inc32(&mTail);
+			return true;
+		}
+
+		// CONSUMER: returns NULL if empty
+		LLDecodedPacket* pop()
+		{
+			U32 head = apr_atomic_read32(&mHead);
+			if (head == apr_atomic_read32(&mTail))
+			{
+				return NULL;
+			}
+			LLDecodedPacket* packet = mSlots[head % POOL_SIZE];
+			apr_atomic_inc32(&mHead);
+			return packet;
+		}
+
+	private:
+		LLDecodedPacket* volatile mSlots[POOL_SIZE];
+		volatile apr_uint32_t mHead;
+		volatile apr_uint32_t mTail;
+	};
+
+	S32 mSocket;
+	std::vector<LLDecodedPacket*> mPackets;
+	Queue mReady;		// receive thread -> main thread
+	Queue mFree;		// main thread -> receive thread
+};
+
+#endif
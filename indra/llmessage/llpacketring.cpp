@@ -33,8 +33,12 @@
 #include "lltimer.h"
 #include "timing.h"
 #include "llrand.h"
+#include "llstl.h"
 #include "u64.h"
 
+// Spare buffers kept around for reuse, about half a megabyte
+const S32 MAX_FREE_PACKETS = 64;
+
 ///////////////////////////////////////////////////////////
 LLPacketRing::LLPacketRing () :
 	mUseInThrottle(FALSE),
@@ -47,7 +51,9 @@ LLPacketRing::LLPacketRing () :
 	mInBufferLength(0),
 	mOutBufferLength(0),
 	mDropPercentage(0.0f),
-	mPacketsToDrop(0x0)
+	mPacketsToDrop(0x0),
+	mBatchSize(NET_MAX_BATCH),
+	mSendBatchSocket(-1)
 {
 }
 
@@ -75,6 +81,70 @@ void LLPacketRing::cleanup ()
 		delete packetp;
 		mSendQueue.pop();
 	}
+
+	while (!mReceiveBatch.empty())
+	{
+		packetp = mReceiveBatch.front();
+		delete packetp;
+		mReceiveBatch.pop();
+	}
+
+	for_each(mSendBatch.begin(), mSendBatch.end(), DeletePointer());
+	mSendBatch.clear();
+	for_each(mFreePackets.begin(), mFreePackets.end(), DeletePointer());
+	mFreePackets.clear();
+}
+
+///////////////////////////////////////////////////////////
+LLPacketBuffer* LLPacketRing::newPacket()
+{
+	if (mFreePackets.empty())
+	{
+		return new LLPacketBuffer(LLHost::invalid, NULL, 0);
+	}
+	LLPacketBuffer* packetp = mFreePackets.back();
+	mFreePackets.pop_back();
+	return packetp;
+}
+
+void LLPacketRing::freePacket(LLPacketBuffer* packetp)
+{
+	if ((S32)mFreePackets.size() < MAX_FREE_PACKETS)
+	{
+		mFreePackets.push_back(packetp);
+	}
+	else
+	{
+		delete packetp;
+	}
+}
+
+// Tops mReceiveBatch up with whatever is waiting on the socket
+S32 LLPacketRing::receiveBatch(S32 socket)
+{
+	LLPacketBuffer* packets[NET_MAX_BATCH];
+	for (S32 i = 0; i < mBatchSize; i++)
+	{
+		packets[i] = newPacket();
+	}
+	S32 received = LLPacketBuffer::receiveBatch(socket, packets, mBatchSize);
+	for (S32 i = 0; i < mBatchSize; i++)
+	{
+		if (i < received)
+		{
+			mReceiveBatch.push(packets[i]);
+		}
+		else
+		{
+			freePacket(packets[i]);
+		}
+	}
+	return received;
+}
+
+void LLPacketRing::setBatchSize(S32 batch_size)
+{
+	mBatchSize = llclamp(batch_size, 1, NET_MAX_BATCH);
 }
 
 ///////////////////////////////////////////////////////////
@@ -136,7 +206,7 @@ S32 LLPacketRing::receiveFromRing (S32 socket, char *datap)
 	// need to set sender IP/port!!
 	mLastSender = packetp->getHost();
 	mLastReceivingIF = packetp->getReceivingInterface();
-	delete packetp;
+	freePacket(packetp);
 
 	this->mInBufferLength -= packet_size;
 
@@ -153,59 +223,28 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 	// If using the throttle, simulate a limited size input buffer.
 	if (mUseInThrottle)
 	{
-		BOOL done = FALSE;
-
-		// push any current net packet (if any) onto delay ring
-		while (!done)
+		// push any current net packets (if any) onto delay ring
+		while (!mReceiveBatch.empty() || receiveBatch(socket))
 		{
-			LLPacketBuffer *packetp;
-			packetp = new LLPacketBuffer(socket);
+			LLPacketBuffer *packetp = mReceiveBatch.front();
+			mReceiveBatch.pop();
+			mActualBitsIn += packetp->getSize() * 8;
 
-			if (packetp->getSize())
+			// Fake packet loss
+			if (fakePacketLoss())
 			{
-				mActualBitsIn += packetp->getSize() * 8;
-
-				// Fake packet loss
-				if (mDropPercentage && (ll_frand(100.f) < mDropPercentage))
-				{
-					mPacketsToDrop++;
-				}
-
-				if (mPacketsToDrop)
-				{
-					delete packetp;
-					packetp = NULL;
-					packet_size = 0;
-					mPacketsToDrop--;
-				}
+				freePacket(packetp);
 			}
-
-			// If we faked packet loss, then we don't have a packet
-			// to use for buffer overflow testing
-			if (packetp)
+			else if (mInBufferLength + packetp->getSize() > mMaxBufferLength)
 			{
-				if (mInBufferLength + packetp->getSize() > mMaxBufferLength)
-				{
-					// Toss it.
-					llwarns << "Throwing away packet, overflowing buffer" << llendl;
-					delete packetp;
-					packetp = NULL;
-				}
-				else if (packetp->getSize())
-				{
-					mReceiveQueue.push(packetp);
-					mInBufferLength += packetp->getSize();
-				}
-				else
-				{
-					delete packetp;
-					packetp = NULL;
-					done = true;
-				}
+				// Toss it.
+				llwarns << "Throwing away packet, overflowing buffer" << llendl;
+				freePacket(packetp);
 			}
 			else
 			{
-				// No packetp, keep going? - no packetp == faked packet loss
+				mReceiveQueue.push(packetp);
+				mInBufferLength += packetp->getSize();
 			}
 		}
 
@@ -215,22 +254,20 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 	}
 	else
 	{
-		// no delay, pull straight from net
-		packet_size = receive_packet(socket, datap);		
-		mLastSender = ::get_sender();
-		mLastReceivingIF = ::get_receiving_interface();
-
-		if (packet_size)  // did we actually get a packet?
+		// no delay, pull straight from net, a batch at a time
+		if (!mReceiveBatch.empty() || receiveBatch(socket))
 		{
-			if (mDropPercentage && (ll_frand(100.f) < mDropPercentage))
-			{
-				mPacketsToDrop++;
-			}
-
-			if (mPacketsToDrop)
+			LLPacketBuffer *packetp = mReceiveBatch.front();
+			mReceiveBatch.pop();
+			packet_size = packetp->getSize();
+			memcpy(datap, packetp->getData(), packet_size);	/*Flawfinder: ignore*/
+			mLastSender = packetp->getHost();
+			mLastReceivingIF = packetp->getReceivingInterface();
+			freePacket(packetp);
+
+			if (fakePacketLoss())
 			{
 				packet_size = 0;
-				mPacketsToDrop--;
 			}
 		}
 	}
@@ -238,6 +275,35 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 	return packet_size;
 }
 
+BOOL LLPacketRing::fakePacketLoss()
+{
+	if (mDropPercentage && (ll_frand(100.f) < mDropPercentage))
+	{
+		mPacketsToDrop++;
+	}
+
+	if (mPacketsToDrop)
+	{
+		mPacketsToDrop--;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+BOOL LLPacketRing::checkInThrottle()
+{
+	return !mUseInThrottle || !mInThrottle.checkOverflow(0);
+}
+
+void LLPacketRing::throttleReceived(S32 packet_size)
+{
+	if (mUseInThrottle)
+	{
+		mActualBitsIn += packet_size * 8;
+		mInThrottle.throttleOverflow(packet_size * 8.f);
+	}
+}
+
 BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host)
 {
 	BOOL status = TRUE;
@@ -266,7 +332,7 @@ BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LL
 
 				status = send_packet(h_socket, packetp->getData(), packet_size, packetp->getHost().getAddress(), packetp->getHost().getPort());
 				
-				delete packetp;
+				freePacket(packetp);
 				// Update the throttle
 				mOutThrottle.throttleOverflow(packet_size * 8.f);
 			}
@@ -302,7 +368,8 @@ BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LL
 				llinfos << "Outbound packet queue " << mOutBufferLength << " bytes" << llendl;
 				queue_timer.reset();
 			}
-			packetp = new LLPacketBuffer(host, send_buffer, buf_size);
+			packetp = newPacket();
+			packetp->init(host, send_buffer, buf_size);
 
 			mOutBufferLength += packetp->getSize();
 			mSendQueue.push(packetp);
@@ -311,3 +378,41 @@ BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LL
 
 	return status;
 }
+
+BOOL LLPacketRing::queuePacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host)
+{
+	if (mUseOutThrottle || mBatchSize <= 1)
+	{
+		return sendPacket(h_socket, send_buffer, buf_size, host);
+	}
+
+	BOOL status = TRUE;
+	if (h_socket != mSendBatchSocket)
+	{
+		status = flushPackets();
+		mSendBatchSocket = h_socket;
+	}
+	LLPacketBuffer *packetp = newPacket();
+	packetp->init(host, send_buffer, buf_size);
+	mSendBatch.push_back(packetp);
+	if ((S32)mSendBatch.size() >= mBatchSize)
+	{
+		status = flushPackets() && status;
+	}
+	return status;
+}
+
+BOOL LLPacketRing::flushPackets()
+{
+	if (mSendBatch.empty())
+	{
+		return TRUE;
+	}
+	BOOL status = LLPacketBuffer::sendBatch(mSendBatchSocket, &mSendBatch[0], (S32)mSendBatch.size());
+	for (std::vector<LLPacketBuffer *>::iterator iter = mSendBatch.begin(); iter != mSendBatch.end(); ++iter)
+	{
+		freePacket(*iter);
+	}
+	mSendBatch.clear();
+	return status;
+}
@@ -29,6 +29,7 @@
 #define LL_LLPACKETRING_H
 
 #include <queue>
+#include <vector>
 
 #include "llpacketbuffer.h"
 #include "llhost.h"
@@ -53,14 +54,39 @@ public:
 	S32  receivePacket (S32 socket, char *datap);
 	S32  receiveFromRing (S32 socket, char *datap);
 
+	// Returns TRUE if a packet that has just been received should be thrown
+	// away, for the packets received off LLPacketReceiveThread
+	BOOL fakePacketLoss();
+
+	// For the packets received off LLPacketReceiveThread, the simulated
+	// inbound bandwidth: returns FALSE while it is used up, and the next
+	// packet should stay queued on the thread.  Charge each packet taken
+	// with throttleReceived().
+	BOOL checkInThrottle();
+	void throttleReceived(S32 packet_size);
+
 	BOOL sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host);
 
+	// Collects packets to go out together with flushPackets(), or when
+	// a batch is full. Without batches the packet goes straight to sendPacket().
+	BOOL queuePacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host);
+	BOOL flushPackets();
+
+	// Most packets read off or written to the socket per system call,
+	// 1 for one at a time
+	void setBatchSize(S32 batch_size);
+
 	inline LLHost getLastSender();
 	inline LLHost getLastReceivingInterface();
 
 	S32 getAndResetActualInBits()				{ S32 bits = mActualBitsIn; mActualBitsIn = 0; return bits;}
 	S32 getAndResetActualOutBits()				{ S32 bits = mActualBitsOut; mActualBitsOut = 0; return bits;}
 protected:
+	// Buffers come from and go back to mFreePackets
+	LLPacketBuffer* newPacket();
+	void freePacket(LLPacketBuffer* packetp);
+	S32 receiveBatch(S32 socket);
+
 	BOOL mUseInThrottle;
 	BOOL mUseOutThrottle;
 	
@@ -80,6 +106,12 @@ protected:
 	std::queue<LLPacketBuffer *> mReceiveQueue;
 	std::queue<LLPacketBuffer *> mSendQueue;
 
+	S32 mBatchSize;
+	std::queue<LLPacketBuffer *> mReceiveBatch;	// received, not handed out yet
+	std::vector<LLPacketBuffer *> mSendBatch;	// queued, not sent yet
+	int mSendBatchSocket;
+	std::vector<LLPacketBuffer *> mFreePackets;
+
 	LLHost mLastSender;
 	LLHost mLastReceivingIF;
 };
@@ -41,16 +41,17 @@ LLTemplateMessageReader::LLTemplateMessageReader(message_template_number_map_t&
 												 number_template_map) :
 	mReceiveSize(0),
 	mCurrentRMessageTemplate(NULL),
-	mCurrentRMessageData(NULL),
-	mMessageNumbers(number_template_map)
+	mCurrentRMessageDecoded(FALSE),
+	mMessageNumbers(number_template_map),
+	mReceiveBuffer(MAX_BUFFER_SIZE),
+	mLastBlock(0),
+	mLastVariable(0)
 {
 }
 
 //virtual 
 LLTemplateMessageReader::~LLTemplateMessageReader()
 {
-	delete mCurrentRMessageData;
-	mCurrentRMessageData = NULL;
 }
 
 //virtual
@@ -58,8 +59,83 @@ void LLTemplateMessageReader::clearMessage()
 {
 	mReceiveSize = -1;
 	mCurrentRMessageTemplate = NULL;
-	delete mCurrentRMessageData;
-	mCurrentRMessageData = NULL;
+	mCurrentRMessageDecoded = FALSE;
+}
+
+S32 LLTemplateMessageReader::findBlock(const char* blockname)
+{
+	const std::vector<LLMessageBlockLayout>& blocks = mCurrentRMessageTemplate->mBlockLayout;
+	const S32 count = (S32)blocks.size();
+	S32 block = mLastBlock < count ? mLastBlock : 0;
+	for (S32 i = 0; i < count; i++)
+	{
+		if (blocks[block].mName == blockname)
+		{
+			mLastBlock = block;
+			return block;
+		}
+		if (++block == count)
+		{
+			block = 0;
+		}
+	}
+	return -1;
+}
+
+void LLTemplateMessageReader::getField(S32 block, S32 blocknum, S32 variable, LLMsgField& field) const
+{
+	const LLMessageBlockLayout& block_layout = mCurrentRMessageTemplate->mBlockLayout[block];
+	const LLMsgRepeat& repeat = mRepeats[mBlockFirstRepeat[block] + blocknum];
+	field.mVariable = &mCurrentRMessageTemplate->mVariableLayout[block_layout.mFirstVariable + variable];
+	if (repeat.mFirstField < 0)
+	{
+		field.mOffset = repeat.mOffset + field.mVariable->mOffset;
+		field.mSize = field.mVariable->mSize;
+	}
+	else
+	{
+		const LLMsgField& decoded = mFields[repeat.mFirstField + variable];
+		field.mOffset = decoded.mOffset;
+		field.mSize = decoded.mSize;
+	}
+}
+
+const U8* LLTemplateMessageReader::getFieldData(const LLMsgField& field) const
+{
+	if (field.mOffset + field.mSize > mReceiveSize)
+	{
+		return NULL;
+	}
+	return &mReceiveBuffer[0] + field.mOffset;
+}
+
+S32 LLTemplateMessageReader::findField(const char* blockname, S32 blocknum, const char* varname, LLMsgField& field)
+{
+	S32 block = findBlock(blockname);
+	if (block < 0 || blocknum < 0 || blocknum >= mBlockRepeats[block])
+	{
+		return LL_BLOCK_NOT_IN_MESSAGE;
+	}
+
+	// Usually the variable after the last one asked for
+	const LLMessageBlockLayout& block_layout = mCurrentRMessageTemplate->mBlockLayout[block];
+	const LLMessageVariableLayout* variables = &mCurrentRMessageTemplate->mVariableLayout[block_layout.mFirstVariable];
+	const S32 count = block_layout.mVariableCount;
+	S32 variable = mLastVariable + 1 < count ? mLastVariable + 1 : 0;
+	for (S32 i = 0; i < count; i++)
+	{
+		if (variables[variable].mName == varname)
+		{
+			mLastVariable = variable;
+			getField(block, blocknum, variable, field);
+			return 0;
+		}
+		if (++variable == count)
+		{
+			variable = 0;
+		}
+	}
+	return LL_VARIABLE_NOT_IN_BLOCK;
 }
 
 void LLTemplateMessageReader::getData(const char *blockname, const char *varname, void *datap, S32 size, S32 blocknum, S32 max_size)
@@ -71,77 +147,66 @@ void LLTemplateMessageReader::getData(const char *blockname, const char *varname
 		return;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{
-		llerrs << "Invalid mCurrentMessageData in getData!" << llendl;
+		llerrs << "No decoded message in getData!" << llendl;
 		return;
 	}
 
-	char *bnamep = (char *)blockname + blocknum; // this works because it's just a hash.  The bnamep is never derefference
-	char *vnamep = (char *)varname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	LLMsgField field;
+	S32 result = findField(blockname, blocknum, varname, field);
+	if (result == LL_BLOCK_NOT_IN_MESSAGE)
 	{
 		llerrs << "Block " << blockname << " #" << blocknum
-			<< " not in message " << mCurrentRMessageData->mName << llendl;
+			<< " not in message " << mCurrentRMessageTemplate->mName << llendl;
 		return;
 	}
-
-	LLMsgBlkData *msg_block_data = iter->second;
-	LLMsgVarData& vardata = msg_block_data->mMemberVarData[vnamep];
-
-	if (!vardata.getName())
+	if (result == LL_VARIABLE_NOT_IN_BLOCK)
 	{
-		llerrs << "Variable "<< vnamep << " not in message "
-			<< mCurrentRMessageData->mName<< " block " << bnamep << llendl;
+		llerrs << "Variable "<< varname << " not in message "
+			<< mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return;
 	}
 
-	if (size && size != vardata.getSize())
+	if (size && size != field.mSize)
 	{
-		llerrs << "Msg " << mCurrentRMessageData->mName 
-			<< " variable " << vnamep
-			<< " is size " << vardata.getSize()
+		llerrs << "Msg " << mCurrentRMessageTemplate->mName 
+			<< " variable " << varname
+			<< " is size " << field.mSize
 			<< " but copying into buffer of size " << size
 			<< llendl;
 		return;
 	}
 
-
-	const S32 vardata_size = vardata.getSize();
-	if( max_size >= vardata_size )
-	{   
-		switch( vardata_size )
-		{ 
-		case 1:
-			*((U8*)datap) = *((U8*)vardata.getData());
-			break;
-		case 2:
-			*((U16*)datap) = *((U16*)vardata.getData());
-			break;
-		case 4:
-			*((U32*)datap) = *((U32*)vardata.getData());
-			break;
-		case 8:
-			((U32*)datap)[0] = ((U32*)vardata.getData())[0];
-			((U32*)datap)[1] = ((U32*)vardata.getData())[1];
-			break;
-		default:
-			memcpy(datap, vardata.getData(), vardata_size);
-			break;
+	// Fixed size variables past the end of the message read as zeros
+	const U8* data = getFieldData(field);
+	if( max_size >= field.mSize )
+	{
+		if (data)
+		{
+			htonmemcpy(datap, data, field.mVariable->mType, field.mSize);
+		}
+		else
+		{
+			memset(datap, 0, field.mSize);
 		}
 	}
 	else
 	{
-		llwarns << "Msg " << mCurrentRMessageData->mName 
-			<< " variable " << vnamep
-			<< " is size " << vardata.getSize()
+		llwarns << "Msg " << mCurrentRMessageTemplate->mName 
+			<< " variable " << varname
+			<< " is size " << field.mSize
 			<< " but truncated to max size of " << max_size
 			<< llendl;
 
-		memcpy(datap, vardata.getData(), max_size);
+		if (data)
+		{
+			memcpy(datap, data, max_size);
+		}
+		else
+		{
+			memset(datap, 0, max_size);
+		}
 	}
 }
 
@@ -154,22 +219,19 @@ S32 LLTemplateMessageReader::getNumberOfBlocks(const char *blockname)
 		return -1;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "No decoded message in getNumberOfBlocks!" << llendl;
 		return -1;
 	}
 
-	char *bnamep = (char *)blockname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	S32 block = findBlock(blockname);
+	if (block < 0)
 	{
 		return 0;
 	}
 
-	return (iter->second)->mBlockNumber;
+	return mBlockRepeats[block];
 }
 
 S32 LLTemplateMessageReader::getSize(const char *blockname, const char *varname)
@@ -181,43 +243,35 @@ S32 LLTemplateMessageReader::getSize(const char *blockname, const char *varname)
 		return LL_MESSAGE_ERROR;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{	// This is a serious error - crash
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "No decoded message in getSize!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	char *bnamep = (char *)blockname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	LLMsgField field;
+	S32 result = findField(blockname, 0, varname, field);
+	if (result == LL_BLOCK_NOT_IN_MESSAGE)
 	{	// don't crash
-		llinfos << "Block " << bnamep << " not in message "
-			<< mCurrentRMessageData->mName << llendl;
+		llinfos << "Block " << blockname << " not in message "
+			<< mCurrentRMessageTemplate->mName << llendl;
 		return LL_BLOCK_NOT_IN_MESSAGE;
 	}
-
-	char *vnamep = (char *)varname; 
-
-	LLMsgBlkData* msg_data = iter->second;
-	LLMsgVarData& vardata = msg_data->mMemberVarData[vnamep];
-	
-	if (!vardata.getName())
+	if (result == LL_VARIABLE_NOT_IN_BLOCK)
 	{	// don't crash
 		llinfos << "Variable " << varname << " not in message "
-			<< mCurrentRMessageData->mName << " block " << bnamep << llendl;
+			<< mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return LL_VARIABLE_NOT_IN_BLOCK;
 	}
 
-	if (mCurrentRMessageTemplate->mMemberBlocks[bnamep]->mType != MBT_SINGLE)
+	if (mCurrentRMessageTemplate->mBlockLayout[mLastBlock].mType != MBT_SINGLE)
 	{	// This is a serious error - crash
-		llerrs << "Block " << bnamep << " isn't type MBT_SINGLE,"
+		llerrs << "Block " << blockname << " isn't type MBT_SINGLE,"
 			" use getSize with blocknum argument!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	return vardata.getSize();
+	return field.mSize;
 }
 
 S32 LLTemplateMessageReader::getSize(const char *blockname, S32 blocknum, const char *varname)
@@ -229,35 +283,28 @@ S32 LLTemplateMessageReader::getSize(const char *blockname, S32 blocknum, const
 		return LL_MESSAGE_ERROR;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{	// This is a serious error - crash
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "No decoded message in getSize!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	char *bnamep = (char *)blockname + blocknum; 
-	char *vnamep = (char *)varname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	LLMsgField field;
+	S32 result = findField(blockname, blocknum, varname, field);
+	if (result == LL_BLOCK_NOT_IN_MESSAGE)
 	{	// don't crash
-		llinfos << "Block " << bnamep << " not in message " 
-			<< mCurrentRMessageData->mName << llendl;
+		llinfos << "Block " << blockname << " #" << blocknum << " not in message " 
+			<< mCurrentRMessageTemplate->mName << llendl;
 		return LL_BLOCK_NOT_IN_MESSAGE;
 	}
-
-	LLMsgBlkData* msg_data = iter->second;
-	LLMsgVarData& vardata = msg_data->mMemberVarData[vnamep];
-	
-	if (!vardata.getName())
+	if (result == LL_VARIABLE_NOT_IN_BLOCK)
 	{	// don't crash
-		llinfos << "Variable " << vnamep << " not in message "
-			<<  mCurrentRMessageData->mName << " block " << bnamep << llendl;
+		llinfos << "Variable " << varname << " not in message "
+			<<  mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return LL_VARIABLE_NOT_IN_BLOCK;
 	}
 
-	return vardata.getSize();
+	return field.mSize;
 }
 
 void LLTemplateMessageReader::getBinaryData(const char *blockname, 
@@ -531,40 +578,48 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 {
 	llassert( mReceiveSize >= 0 );
 	llassert( mCurrentRMessageTemplate);
-	llassert( !mCurrentRMessageData );
-	delete mCurrentRMessageData; // just to make sure
+	llassert( !mCurrentRMessageDecoded );
+
+	// Keep our own copy, the variables are read from it in place until the
+	// next message
+	mReceiveSize = llmin(mReceiveSize, (S32)mReceiveBuffer.size());
+	memcpy(&mReceiveBuffer[0], buffer, mReceiveSize);	/* Flawfinder: ignore */
+	buffer = &mReceiveBuffer[0];
 
 	// The offset tells us how may bytes to skip after the end of the
 	// message name.
 	U8 offset = buffer[PHL_OFFSET];
 	S32 decode_pos = LL_PACKET_ID_SIZE + (S32)(mCurrentRMessageTemplate->mFrequency) + offset;
 
-	// create base working data set
-	mCurrentRMessageData = new LLMsgData(mCurrentRMessageTemplate->mName);
-	
-	// loop through the template building the data structure as we go
-	LLMessageTemplate::message_block_map_t::const_iterator iter;
-	for(iter = mCurrentRMessageTemplate->mMemberBlocks.begin();
-		iter != mCurrentRMessageTemplate->mMemberBlocks.end();
-		++iter)
+	const std::vector<LLMessageBlockLayout>& blocks = mCurrentRMessageTemplate->mBlockLayout;
+	const std::vector<LLMessageVariableLayout>& variables = mCurrentRMessageTemplate->mVariableLayout;
+	mBlockFirstRepeat.resize(blocks.size());
+	mBlockRepeats.resize(blocks.size());
+	mRepeats.clear();
+	mFields.clear();
+	mLastBlock = 0;
+	mLastVariable = 0;
+
+	// loop through the template recording where each variable is
+	for (S32 block = 0; block < (S32)blocks.size(); block++)
 	{
-		LLMessageBlock* mbci = *iter;
+		const LLMessageBlockLayout& mbci = blocks[block];
 		U8	repeat_number;
 		S32	i;
 
 		// how many of this block?
 
-		if (mbci->mType == MBT_SINGLE)
+		if (mbci.mType == MBT_SINGLE)
 		{
 			// just one
 			repeat_number = 1;
 		}
-		else if (mbci->mType == MBT_MULTIPLE)
+		else if (mbci.mType == MBT_MULTIPLE)
 		{
 			// a known number
-			repeat_number = mbci->mNumber;
+			repeat_number = mbci.mNumber;
 		}
-		else if (mbci->mType == MBT_VARIABLE)
+		else if (mbci.mType == MBT_VARIABLE)
 		{
 			// need to read the number from the message
 			// repeat number is a single byte
@@ -589,42 +644,51 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 			return FALSE;
 		}
 
-		LLMsgBlkData* cur_data_block = NULL;
+		mBlockFirstRepeat[block] = (S32)mRepeats.size();
+		mBlockRepeats[block] = repeat_number;
 
 		// now loop through the block
 		for (i = 0; i < repeat_number; i++)
 		{
-			if (i)
-			{
-				// build new name to prevent collisions
-				// TODO: This should really change to a vector
-				cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
-				cur_data_block->mName = mbci->mName + i;
-			}
-			else
+			LLMsgRepeat repeat;
+			repeat.mOffset = decode_pos;
+
+			if (mbci.mFixedSize >= 0)
 			{
-				cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
+				// fixed size members only, they are where the layout says
+				repeat.mFirstField = -1;
+				if (decode_pos + mbci.mFixedSize > mReceiveSize)
+				{
+					// each of them past the end reads as 0s
+					for (S32 var = 0; var < mbci.mVariableCount; var++)
+					{
+						const LLMessageVariableLayout& mvci = variables[mbci.mFirstVariable + var];
+						if (decode_pos + mvci.mOffset + mvci.mSize > mReceiveSize)
+						{
+							logRanOffEndOfPacket(sender, decode_pos + mvci.mOffset, mvci.mSize);
+						}
+					}
+				}
+				decode_pos += mbci.mFixedSize;
+				mRepeats.push_back(repeat);
+				continue;
 			}
 
-			// add the block to the message
-			mCurrentRMessageData->addBlock(cur_data_block);
+			repeat.mFirstField = (S32)mFields.size();
+			mRepeats.push_back(repeat);
 
 			// now read the variables
-			for (LLMessageBlock::message_variable_map_t::const_iterator iter = 
-					 mbci->mMemberVariables.begin();
-				 iter != mbci->mMemberVariables.end(); iter++)
+			for (S32 var = 0; var < mbci.mVariableCount; var++)
 			{
-				const LLMessageVariable& mvci = **iter;
-
-				// ok, build out the variables
-				// add variable block
-				cur_data_block->addVariable(mvci.getName(), mvci.getType());
+				const LLMessageVariableLayout& mvci = variables[mbci.mFirstVariable + var];
+				LLMsgField field;
+				field.mVariable = &mvci;
 
 				// what type of variable?
-				if (mvci.getType() == MVT_VARIABLE)
+				if (mvci.mType == MVT_VARIABLE)
 				{
 					// variable, get the number of bytes to read from the template
-					S32 data_size = mvci.getSize();
+					S32 data_size = mvci.mSize;
 					U8 tsizeb = 0;
 					U16 tsizeh = 0;
 					U32 tsize = 0;
@@ -658,42 +722,38 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 					}
 					decode_pos += data_size;
 
-					cur_data_block->addData(mvci.getName(), &buffer[decode_pos], tsize, mvci.getType());
+					if (tsize && decode_pos + (S32)tsize > mReceiveSize)
+					{
+						// don't hand out whatever follows the message
+						logRanOffEndOfPacket(sender, decode_pos, tsize);
+						tsize = llmax(mReceiveSize - decode_pos, 0);
+					}
+					field.mOffset = decode_pos;
+					field.mSize = tsize;
 					decode_pos += tsize;
 				}
 				else
 				{
-					// fixed!
-					// so, copy data pointer and set data size to fixed size
-					if ((decode_pos + mvci.getSize()) > mReceiveSize)
+					// fixed! past the end it reads as 0s
+					if ((decode_pos + mvci.mSize) > mReceiveSize)
 					{
-						logRanOffEndOfPacket(sender, decode_pos, mvci.getSize());
-
-						// default to 0s.
-						U32 size = mvci.getSize();
-						std::vector<U8> data(size, 0);
-						cur_data_block->addData(mvci.getName(), &(data[0]), 
-												size, mvci.getType());
+						logRanOffEndOfPacket(sender, decode_pos, mvci.mSize);
 					}
-					else
-					{
-						cur_data_block->addData(mvci.getName(), 
-												&buffer[decode_pos], 
-												mvci.getSize(), 
-												mvci.getType());
-					}
-					decode_pos += mvci.getSize();
+					field.mOffset = decode_pos;
+					field.mSize = mvci.mSize;
+					decode_pos += mvci.mSize;
 				}
+				mFields.push_back(field);
 			}
 		}
 	}
 
-	if (mCurrentRMessageData->mMemberBlocks.empty()
-		&& !mCurrentRMessageTemplate->mMemberBlocks.empty())
+	if (mRepeats.empty() && !blocks.empty())
 	{
 		lldebugs << "Empty message '" << mCurrentRMessageTemplate->mName << "' (no blocks)" << llendl;
 		return FALSE;
 	}
+	mCurrentRMessageDecoded = TRUE;
 
 	{
 		static LLTimer decode_timer;
@@ -819,9 +879,43 @@ bool LLTemplateMessageReader::isUdpBanned() const
 //virtual 
 void LLTemplateMessageReader::copyToBuilder(LLMessageBuilder& builder) const
 {
-	if(NULL == mCurrentRMessageTemplate)
+	if(NULL == mCurrentRMessageTemplate || !mCurrentRMessageDecoded)
     {
         return;
     }
-	builder.copyFromMessageData(*mCurrentRMessageData);
+
+	// Only for forwarding and LLSD, worth rebuilding the old copy
+	// of every variable here rather than keeping one around
+	LLMsgData data(mCurrentRMessageTemplate->mName);
+	const std::vector<LLMessageBlockLayout>& blocks = mCurrentRMessageTemplate->mBlockLayout;
+	for (S32 block = 0; block < (S32)blocks.size(); block++)
+	{
+		const LLMessageBlockLayout& mbci = blocks[block];
+		for (S32 i = 0; i < mBlockRepeats[block]; i++)
+		{
+			// repeats are told apart by their names, see LLMsgData
+			LLMsgBlkData* cur_data_block = new LLMsgBlkData(mbci.mName, mBlockRepeats[block]);
+			cur_data_block->mName = mbci.mName + i;
+			data.addBlock(cur_data_block);
+
+			for (S32 var = 0; var < mbci.mVariableCount; var++)
+			{
+				LLMsgField field;
+				getField(block, i, var, field);
+				cur_data_block->addVariable(field.mVariable->mName, field.mVariable->mType);
+				const U8* field_data = getFieldData(field);
+				if (field_data)
+				{
+					cur_data_block->addData(field.mVariable->mName, field_data, field.mSize, field.mVariable->mType);
+				}
+				else
+				{
+					std::vector<U8> zeros(field.mSize, 0);
+					cur_data_block->addData(field.mVariable->mName, zeros.empty() ? NULL : &zeros[0],
+												field.mSize, field.mVariable->mType);
+				}
+			}
+		}
+	}
+	builder.copyFromMessageData(data);
 }
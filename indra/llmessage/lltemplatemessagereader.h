@@ -30,9 +30,10 @@
 #include "llmessagereader.h"
 
 #include <map>
+#include <vector>
 
 class LLMessageTemplate;
-class LLMsgData;
+struct LLMessageVariableLayout;
 
 class LLTemplateMessageReader : public LLMessageReader
 {
@@ -108,9 +109,33 @@ public:
 	
 private:
 
+	// Where one variable of the current message is in mReceiveBuffer
+	struct LLMsgField
+	{
+		const LLMessageVariableLayout* mVariable;
+		S32 mOffset;
+		S32 mSize;
+	};
+
+	// One repeat of a block. Variables of a block with fixed size members
+	// only are at the offsets in their layout, the others have theirs in
+	// mFields starting at mFirstField.
+	struct LLMsgRepeat
+	{
+		S32 mOffset;
+		S32 mFirstField;
+	};
+
 	void getData(const char *blockname, const char *varname, void *datap, 
 				 S32 size = 0, S32 blocknum = 0, S32 max_size = S32_MAX);
 
+	// Returns 0, LL_BLOCK_NOT_IN_MESSAGE or LL_VARIABLE_NOT_IN_BLOCK
+	S32 findField(const char* blockname, S32 blocknum, const char* varname, LLMsgField& field);
+	S32 findBlock(const char* blockname);
+	void getField(S32 block, S32 blocknum, S32 variable, LLMsgField& field) const;
+	// NULL if the field is past the end of the message, it reads as zeros
+	const U8* getFieldData(const LLMsgField& field) const;
+
 	BOOL decodeTemplate(const U8* buffer, S32 buffer_size,  // inputs
 						LLMessageTemplate** msg_template ); // outputs
 
@@ -120,8 +145,21 @@ private:
 
 	S32	mReceiveSize;
 	LLMessageTemplate* mCurrentRMessageTemplate;
-	LLMsgData* mCurrentRMessageData;
+	BOOL mCurrentRMessageDecoded;
 	message_template_number_map_t& mMessageNumbers;
+
+	// The current message, decoded in place. Reused from message to message
+	// so reading one allocates nothing once they have grown.
+	std::vector<U8> mReceiveBuffer;
+	std::vector<S32> mBlockFirstRepeat;	// per template block, index into mRepeats
+	std::vector<S32> mBlockRepeats;		// per template block
+	std::vector<LLMsgRepeat> mRepeats;
+	std::vector<LLMsgField> mFields;
+
+	// Handlers mostly read variables in template order, lookups start
+	// where the last one left off
+	S32 mLastBlock;
+	S32 mLastVariable;
 };
 
 #endif // LL_LLTEMPLATEMESSAGEREADER_H
@@ -65,6 +65,7 @@
 #include "lltrustedmessageservice.h"
 #include "llmessagetemplate.h"
 #include "llmessagetemplateparser.h"
+#include "llpacketreceivethread.h"
 #include "llsd.h"
 #include "llsdmessagebuilder.h"
 #include "llsdmessagereader.h"
@@ -226,6 +227,9 @@ void LLMessageSystem::init()
 	mIncomingCompressedSize = 0;
 	mCurrentRecvPacketID = 0;
 
+	mReceiveThread = NULL;
+	mReceivedPacket = NULL;
+
 	mMessageFileVersionNumber = 0.f;
 
 	mTimingCallback = NULL;
@@ -364,6 +368,8 @@ LLMessageSystem::~LLMessageSystem()
 	mMessageTemplates.clear(); // don't delete templates.
 	for_each(mMessageNumbers.begin(), mMessageNumbers.end(), DeletePairedPointer());
 	mMessageNumbers.clear();
+
+	stopReceiveThread();
 	
 	if (!mbError)
 	{
@@ -394,6 +400,11 @@ LLMessageSystem::~LLMessageSystem()
 
 void LLMessageSystem::clearReceiveState()
 {
+	if (mReceivedPacket)
+	{
+		mReceiveThread->releasePacket(mReceivedPacket);
+		mReceivedPacket = NULL;
+	}
 	mCurrentRecvPacketID = 0;
 	mIncomingCompressedSize = 0;
 	mLastSender.invalidate();
@@ -403,6 +414,32 @@ void LLMessageSystem::clearReceiveState()
 }
 
 
+void LLMessageSystem::startReceiveThread()
+{
+	if (mReceiveThread || mbError)
+	{
+		return;
+	}
+	LL_INFOS("Messaging") << "Receiving packets on their own thread" << llendl;
+	mReceiveThread = new LLPacketReceiveThread(mSocket);
+	mReceiveThread->start();
+}
+
+void LLMessageSystem::stopReceiveThread()
+{
+	if (!mReceiveThread)
+	{
+		return;
+	}
+	if (mReceivedPacket)
+	{
+		mReceiveThread->releasePacket(mReceivedPacket);
+		mReceivedPacket = NULL;
+	}
+	delete mReceiveThread;
+	mReceiveThread = NULL;
+}
+
 BOOL LLMessageSystem::poll(F32 seconds)
 {
 	S32 num_socks;
@@ -553,13 +590,42 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 
 		U8* buffer = mTrueReceiveBuffer;
 		
-		mTrueReceiveSize = mPacketRing.receivePacket(mSocket, (char *)mTrueReceiveBuffer);
+		if (mReceiveThread)
+		{
+			// Throttled as LLPacketRing::receivePacket() does, but the
+			// packets held back wait on the thread, whose pool stands in
+			// for the ring's simulated input buffer
+			mReceivedPacket = mPacketRing.checkInThrottle() ? mReceiveThread->popPacket() : NULL;
+			if (mReceivedPacket)
+			{
+				mPacketRing.throttleReceived(mReceivedPacket->getSize());
+			}
+			if (mReceivedPacket && mPacketRing.fakePacketLoss())
+			{
+				mReceiveThread->releasePacket(mReceivedPacket);
+				mReceivedPacket = NULL;
+			}
+			if (mReceivedPacket)
+			{
+				mTrueReceiveSize = mReceivedPacket->getSize();
+				mLastSender = mReceivedPacket->getHost();
+				mLastReceivingIF = mReceivedPacket->getReceivingInterface();
+			}
+			else
+			{
+				mTrueReceiveSize = 0;
+			}
+		}
+		else
+		{
+			mTrueReceiveSize = mPacketRing.receivePacket(mSocket, (char *)mTrueReceiveBuffer);
+			mLastSender = mPacketRing.getLastSender();
+			mLastReceivingIF = mPacketRing.getLastReceivingInterface();
+		}
 		// If you want to dump all received packets into SecondLife.log, uncomment this
 		//dumpPacketToLog();
 		
 		receive_size = mTrueReceiveSize;
-		mLastSender = mPacketRing.getLastSender();
-		mLastReceivingIF = mPacketRing.getLastReceivingInterface();
 		
 		if (receive_size < (S32) LL_MINIMUM_VALID_PACKET_SIZE)
 		{
@@ -578,8 +644,44 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 			LLHost host;
 			LLCircuitData* cdp;
 			
+			if (mReceivedPacket)
+			{
+				// mReceiveThread has already split off the acks and
+				// expanded the zero coding
+				if (mReceivedPacket->getStatus() == LLDecodedPacket::MALFORMED)
+				{
+					LL_WARNS("Messaging") << "Malformed packet received. Packet size "
+						<< receive_size << " with invalid no. of acks "
+						<< (S32)((U8)mReceivedPacket->getData()[receive_size - 1])
+						<< llendl;
+					valid_packet = FALSE;
+					continue;
+				}
+				if (mReceivedPacket->getStatus() == LLDecodedPacket::OVERFLOWED)
+				{
+					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size" << llendl;
+					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
+					valid_packet = FALSE;
+					continue;
+				}
+				acks = mReceivedPacket->getAckCount();
+				buffer = (U8*)mReceivedPacket->getMessage();
+				receive_size = mReceivedPacket->getMessageSize();
+				mIncomingCompressedSize = mReceivedPacket->getCompressedSize();
+				if (mIncomingCompressedSize)
+				{
+					mTotalBytesIn += mIncomingCompressedSize;
+					mCompressedPacketsIn++;
+					mCompressedBytesIn += mIncomingCompressedSize;
+					mUncompressedBytesIn += receive_size;
+				}
+				else
+				{
+					mTotalBytesIn += receive_size;
+				}
+			}
 			// note if packet acks are appended.
-			if(buffer[0] & LL_ACK_FLAG)
+			else if(buffer[0] & LL_ACK_FLAG)
 			{
 				acks += buffer[--receive_size];
 				true_rcv_size = receive_size;
@@ -600,7 +702,10 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 			}
 
 			// process the message as normal
-			mIncomingCompressedSize = zeroCodeExpand(&buffer, &receive_size);
+			if (!mReceivedPacket)
+			{
+				mIncomingCompressedSize = zeroCodeExpand(&buffer, &receive_size);
+			}
 			mCurrentRecvPacketID = ntohl(*((U32*)(&buffer[1])));
 			host = getSender();
 
@@ -611,16 +716,23 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 			// this message came in on if it's valid, and NULL if the
 			// circuit was bogus.
 
-			if(cdp && (acks > 0) && ((S32)(acks * sizeof(TPACKETID)) < (true_rcv_size)))
+			if(cdp && (acks > 0) && (mReceivedPacket || ((S32)(acks * sizeof(TPACKETID)) < (true_rcv_size))))
 			{
 				TPACKETID packet_id;
 				U32 mem_id=0;
 				for(S32 i = 0; i < acks; ++i)
 				{
-					true_rcv_size -= sizeof(TPACKETID);
-					memcpy(&mem_id, &mTrueReceiveBuffer[true_rcv_size], /* Flawfinder: ignore*/
-					     sizeof(TPACKETID));
-					packet_id = ntohl(mem_id);
+					if (mReceivedPacket)
+					{
+						packet_id = mReceivedPacket->getAck(i);
+					}
+					else
+					{
+						true_rcv_size -= sizeof(TPACKETID);
+						memcpy(&mem_id, &mTrueReceiveBuffer[true_rcv_size], /* Flawfinder: ignore*/
+						     sizeof(TPACKETID));
+						packet_id = ntohl(mem_id);
+					}
 					//LL_INFOS("Messaging") << "got ack: " << packet_id << llendl;
 					cdp->ackReliablePacket(packet_id);
 				}
@@ -2888,78 +3000,70 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 	S32 in_size = *data_size;
 	mCompressedPacketsIn++;
 	mCompressedBytesIn += *data_size;
-	
-	*data[0] &= (~LL_ZERO_CODE_FLAG);
-
-	S32 count = (*data_size);  
-	
-	U8 *inptr = (U8 *)*data;
-	U8 *outptr = (U8 *)mEncodedRecvBuffer;
 
-// skip the packet id field
-
-	for (U32 ii = 0; ii < LL_PACKET_ID_SIZE; ++ii)
+	S32 out_size = zero_code_expand(*data, in_size, mEncodedRecvBuffer);
+	if (out_size < 0)
 	{
-		count--;
-		*outptr++ = *inptr++;
+		LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size" << llendl;
+		callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
+		// leaves nothing for the template reader to accept
+		out_size = 0;
 	}
 
-// reconstruct encoded packet, keeping track of net size gain
+	*data = mEncodedRecvBuffer;
+	*data_size = out_size;
+	mUncompressedBytesIn += *data_size;
 
-// sequential zero bytes are encoded as 0 [U8 count] 
-// with 0 0 [count] representing wrap (>256 zeroes)
+	return(in_size);
+}
 
-	while (count--)
+S32 zero_code_expand(const U8* in, S32 in_size, U8* out)
+{
+	const U8* in_end = in + in_size;
+	U8* out_start = out;
+	U8* out_end = out + MAX_BUFFER_SIZE;
+
+	// skip the packet id field
+	S32 header_size = llmin(in_size, (S32)LL_PACKET_ID_SIZE);
+	memcpy(out, in, header_size);		/* Flawfinder: ignore */
+	in += header_size;
+	out += header_size;
+	if (header_size)
 	{
-		if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-1]))
-		{
-			LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 1" << llendl;
-			callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-			outptr = mEncodedRecvBuffer;					
-			break;
-		}
-		if (!((*outptr++ = *inptr++)))
+		out_start[0] &= ~LL_ZERO_CODE_FLAG;
+	}
+
+	// sequential zero bytes are encoded as 0 [U8 count]
+	// with 0 0 [count] representing wrap (>256 zeroes)
+	while (in < in_end)
+	{
+		U8 byte = *in++;
+		if (byte)
 		{
-			while (((count--)) && (!(*inptr)))
-			{
-				*outptr++ = *inptr++;
-  				if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-256]))
-  				{
-  					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 2" << llendl;
-					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-					outptr = mEncodedRecvBuffer;
-					count = -1;
-					break;
-  				}
-				memset(outptr,0,255);
-				outptr += 255;
-			}
-			
-			if (count < 0)
+			if (out == out_end)
 			{
-				break;
+				return -1;
 			}
+			*out++ = byte;
+			continue;
+		}
 
-			else
-			{
-  				if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-(*inptr)]))
-				{
-  					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 3" << llendl;
-					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-					outptr = mEncodedRecvBuffer;					
-				}
-				memset(outptr,0,(*inptr) - 1);
-				outptr += ((*inptr) - 1);
-				inptr++;
-			}
-		}		
+		S32 zeroes = 0;
+		while (in < in_end && !*in)
+		{
+			zeroes += 256;
+			in++;
+		}
+		// a packet may end on a run of zeroes with no count
+		zeroes += (in < in_end) ? *in++ : 1;
+		if (out_end - out < zeroes)
+		{
+			return -1;
+		}
+		memset(out, 0, zeroes);
+		out += zeroes;
 	}
-	
-	*data = mEncodedRecvBuffer;
-	*data_size = (S32)(outptr - mEncodedRecvBuffer);
-	mUncompressedBytesIn += *data_size;
-
-	return(in_size);
+	return (S32)(out - out_start);
 }
 
 
@@ -3366,7 +3470,8 @@ void LLMessageSystem::establishBidirectionalTrust(const LLHost &host, S64 frame_
 
 void LLMessageSystem::dumpPacketToLog()
 {
-	LL_WARNS("Messaging") << "Packet Dump from:" << mPacketRing.getLastSender() << llendl;
+	const U8* packet = mReceivedPacket ? (const U8*)mReceivedPacket->getData() : mTrueReceiveBuffer;
+	LL_WARNS("Messaging") << "Packet Dump from:" << mLastSender << llendl;
 	LL_WARNS("Messaging") << "Packet Size:" << mTrueReceiveSize << llendl;
 	char line_buffer[256];		/* Flawfinder: ignore */
 	S32 i;
@@ -3377,7 +3482,7 @@ void LLMessageSystem::dumpPacketToLog()
 	{
 		S32 offset = cur_line_pos * 3;
 		snprintf(line_buffer + offset, sizeof(line_buffer) - offset,
-				 "%02x ", mTrueReceiveBuffer[i]);	/* Flawfinder: ignore */
+				 "%02x ", packet[i]);	/* Flawfinder: ignore */
 		cur_line_pos++;
 		if (cur_line_pos >= 16)
 		{
@@ -185,6 +185,8 @@ class LLMsgBlkData;
 class LLMessageTemplate;
 
 class LLMessagePollInfo;
+class LLPacketReceiveThread;
+class LLDecodedPacket;
 class LLMessageBuilder;
 class LLTemplateMessageBuilder;
 class LLSDMessageBuilder;
@@ -338,6 +340,15 @@ public:
 	BOOL	checkMessages( S64 frame_count = 0 );
 	void	processAcks();
 
+	// Moves reading the socket, splitting off appended acks and zero code
+	// expansion onto a thread of their own, leaving checkMessages() only the
+	// dispatch. Leave it off when mPacketRing simulates an incoming
+	// bandwidth limit, that needs every packet read on this thread.
+	void	startReceiveThread();
+	// Packets received but not checked yet are lost
+	void	stopReceiveThread();
+	bool	isReceiveThreadRunning() const	{ return mReceiveThread != NULL; }
+
 	BOOL	isMessageFast(const char *msg);
 	BOOL	isMessage(const char *msg)
 	{
@@ -779,6 +790,9 @@ private:
 	U8	mTrueReceiveBuffer[MAX_BUFFER_SIZE];
 	S32	mTrueReceiveSize;
 
+	LLPacketReceiveThread*	mReceiveThread;
+	LLDecodedPacket*		mReceivedPacket;	// from mReceiveThread, until clearReceiveState()
+
 	// Must be valid during decode
 	
 	BOOL	mbError;
@@ -857,6 +871,12 @@ void end_messaging_system(bool print_summary = true);
 
 void null_message_callback(LLMessageSystem *msg, void **data);
 
+// Expands the zero coding of the in_size byte packet at in into out, which
+// must hold MAX_BUFFER_SIZE bytes, and clears LL_ZERO_CODE_FLAG in the copy.
+// Returns the expanded size, or -1 if the packet expands past MAX_BUFFER_SIZE.
+// Safe to call from any thread.
+S32 zero_code_expand(const U8* in, S32 in_size, U8* out);
+
 //
 // Inlines
 //
@@ -37,6 +37,7 @@
 	#include <windows.h>
 #else
 	#include <sys/types.h>
+	#include <sys/select.h>
 	#include <sys/socket.h>
 	#include <netinet/in.h>
 	#include <arpa/inet.h>
@@ -44,6 +45,13 @@
 	#include <errno.h>
 #endif
 
+// recvmmsg() needs glibc 2.12 and sendmmsg() 2.14
+#if LL_LINUX && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 14))
+#define LL_NET_MMSG 1
+#else
+#define LL_NET_MMSG 0
+#endif
+
 // linden library includes
 #include "llerror.h"
 #include "llhost.h"
@@ -75,6 +83,7 @@ typedef int socklen_t;
 #endif
 
 static U32 gsnReceivingIFAddr = INVALID_HOST_IP_ADDRESS; // Address to which datagram was sent
+static U32 gsnSocketCalls = 0; // sendto/recvfrom and friends, not exact once LLPacketReceiveThread is also counting
 
 const char* LOOPBACK_ADDRESS_STRING = "127.0.0.1";
 const char* BROADCAST_ADDRESS_STRING = "255.255.255.255";
@@ -115,6 +124,11 @@ U32 get_receiving_interface_ip(void)
 	return gsnReceivingIFAddr;
 }
 
+U32 get_socket_call_count()
+{
+	return gsnSocketCalls;
+}
+
 const char* u32_to_ip_string(U32 ip)
 {
 	static char buffer[MAXADDRSTR];	 /* Flawfinder: ignore */ 
@@ -328,6 +342,7 @@ S32 receive_packet(int hSocket, char * receiveBuffer)
 	int nRet;
 	int addr_size = sizeof(struct sockaddr_in);
 
+	gsnSocketCalls++;
 	nRet = recvfrom(hSocket, receiveBuffer, NET_BUFFER_SIZE, 0, (struct sockaddr*)&stSrcAddr, &addr_size);
 	if (nRet == SOCKET_ERROR ) 
 	{
@@ -341,6 +356,17 @@ S32 receive_packet(int hSocket, char * receiveBuffer)
 	return nRet;
 }
 
+BOOL wait_for_packet(int hSocket, S32 timeout_ms)
+{
+	fd_set read_fds;
+	FD_ZERO(&read_fds);
+	FD_SET((SOCKET)hSocket, &read_fds);
+	struct timeval timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+	return select(hSocket + 1, &read_fds, NULL, NULL, &timeout) > 0;
+}
+
 // Returns TRUE on success.
 BOOL send_packet(int hSocket, const char *sendBuffer, int size, U32 recipient, int nPort)
 {
@@ -353,6 +379,7 @@ BOOL send_packet(int hSocket, const char *sendBuffer, int size, U32 recipient, i
 	stDstAddr.sin_port = htons(nPort);
 	do
 	{
+		gsnSocketCalls++;
 		nRet = sendto(hSocket, sendBuffer, size, 0, (struct sockaddr*)&stDstAddr, sizeof(stDstAddr));					
 
 		if (nRet == SOCKET_ERROR ) 
@@ -581,6 +608,7 @@ int receive_packet(int hSocket, char * receiveBuffer)
 	socklen_t addr_size = sizeof(struct sockaddr_in);
 
 	gsnReceivingIFAddr = INVALID_HOST_IP_ADDRESS;
+	gsnSocketCalls++;
 
 #if LL_LINUX
 	nRet = recvfrom_destip(hSocket, receiveBuffer, NET_BUFFER_SIZE, (struct sockaddr*)&stSrcAddr, &addr_size, &gsnReceivingIFAddr);
@@ -601,6 +629,17 @@ int receive_packet(int hSocket, char * receiveBuffer)
 	return nRet;
 }
 
+BOOL wait_for_packet(int hSocket, S32 timeout_ms)
+{
+	fd_set read_fds;
+	FD_ZERO(&read_fds);
+	FD_SET(hSocket, &read_fds);
+	struct timeval timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+	return select(hSocket + 1, &read_fds, NULL, NULL, &timeout) > 0;
+}
+
 BOOL send_packet(int hSocket, const char * sendBuffer, int size, U32 recipient, int nPort)
 {
 	int		ret;
@@ -613,6 +652,7 @@ BOOL send_packet(int hSocket, const char * sendBuffer, int size, U32 recipient,
 
 	do
 	{
+		gsnSocketCalls++;
 		ret = sendto(hSocket, sendBuffer, size, 0,	(struct sockaddr*)&stDstAddr, sizeof(stDstAddr));
 		send_attempts++;
 
@@ -663,4 +703,144 @@ BOOL send_packet(int hSocket, const char * sendBuffer, int size, U32 recipient,
 
 #endif
 
+//////////////////////////////////////////////////////////////////////////////////////////
+// Batched Versions
+//////////////////////////////////////////////////////////////////////////////////////////
+
+#if LL_NET_MMSG
+// Kernels before 2.6.33 (recvmmsg) and 3.0 (sendmmsg) say ENOSYS,
+// after that we go one datagram at a time
+static BOOL gbNoReceiveBatches = FALSE;
+static BOOL gbNoSendBatches = FALSE;
+#endif
+
+S32 receive_packets(int hSocket, LLNetDatagram* datagrams, S32 count)
+{
+	count = llmin(count, NET_MAX_BATCH);
+#if LL_NET_MMSG
+	if (!gbNoReceiveBatches)
+	{
+		struct mmsghdr msgs[NET_MAX_BATCH];
+		struct iovec iov[NET_MAX_BATCH];
+		struct sockaddr_in from[NET_MAX_BATCH];
+		char cmsg[NET_MAX_BATCH][CMSG_SPACE(sizeof(struct in_pktinfo))];
+		memset(msgs, 0, sizeof(msgs[0]) * count);
+		for (S32 i = 0; i < count; i++)
+		{
+			iov[i].iov_base = datagrams[i].mData;
+			iov[i].iov_len = NET_BUFFER_SIZE;
+			msgs[i].msg_hdr.msg_name = &from[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = cmsg[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(cmsg[i]);
+		}
+
+		gsnSocketCalls++;
+		int received = recvmmsg(hSocket, msgs, count, MSG_DONTWAIT, NULL);
+		if (received >= 0)
+		{
+			for (S32 i = 0; i < received; i++)
+			{
+				LLNetDatagram& datagram = datagrams[i];
+				datagram.mSize = msgs[i].msg_len;
+				datagram.mAddr = from[i].sin_addr.s_addr;
+				datagram.mPort = ntohs(from[i].sin_port);
+				datagram.mReceivingIF = INVALID_HOST_IP_ADDRESS;
+				for (struct cmsghdr* cmsgptr = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsgptr != NULL;
+					 cmsgptr = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsgptr))
+				{
+					if (cmsgptr->cmsg_level == SOL_IP && cmsgptr->cmsg_type == IP_PKTINFO)
+					{
+						// same choice as recvfrom_destip()
+						datagram.mReceivingIF = ((in_pktinfo*)CMSG_DATA(cmsgptr))->ipi_spec_dst.s_addr;
+					}
+				}
+			}
+			return received;
+		}
+		if (errno != ENOSYS)
+		{
+			// Nothing waiting, or an error receive_packet() would also
+			// have returned 0 for
+			return 0;
+		}
+		llinfos << "recvmmsg() not supported, receiving one packet at a time" << llendl;
+		gbNoReceiveBatches = TRUE;
+	}
+#endif
+
+	S32 received = 0;
+	while (received < count)
+	{
+		LLNetDatagram& datagram = datagrams[received];
+		datagram.mSize = receive_packet(hSocket, datagram.mData);
+		if (datagram.mSize <= 0)
+		{
+			break;
+		}
+		datagram.mAddr = get_sender_ip();
+		datagram.mPort = get_sender_port();
+		datagram.mReceivingIF = get_receiving_interface_ip();
+		received++;
+	}
+	return received;
+}
+
+BOOL send_packets(int hSocket, const LLNetDatagram* datagrams, S32 count)
+{
+	BOOL success = TRUE;
+	S32 sent = 0;
+#if LL_NET_MMSG
+	while (sent < count && !gbNoSendBatches)
+	{
+		struct mmsghdr msgs[NET_MAX_BATCH];
+		struct iovec iov[NET_MAX_BATCH];
+		struct sockaddr_in to[NET_MAX_BATCH];
+		S32 batch = llmin(count - sent, NET_MAX_BATCH);
+		memset(msgs, 0, sizeof(msgs[0]) * batch);
+		memset(to, 0, sizeof(to[0]) * batch);
+		for (S32 i = 0; i < batch; i++)
+		{
+			const LLNetDatagram& datagram = datagrams[sent + i];
+			to[i].sin_family = AF_INET;
+			to[i].sin_addr.s_addr = datagram.mAddr;
+			to[i].sin_port = htons(datagram.mPort);
+			iov[i].iov_base = datagram.mData;
+			iov[i].iov_len = datagram.mSize;
+			msgs[i].msg_hdr.msg_name = &to[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(to[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		gsnSocketCalls++;
+		int ret = sendmmsg(hSocket, msgs, batch, 0);
+		if (ret > 0)
+		{
+			sent += ret;
+			continue;
+		}
+		if (ret < 0 && errno == ENOSYS)
+		{
+			llinfos << "sendmmsg() not supported, sending one packet at a time" << llendl;
+			gbNoSendBatches = TRUE;
+			break;
+		}
+		// The first datagram of the batch failed, let send_packet() retry
+		// it and report it the way it always has
+		const LLNetDatagram& datagram = datagrams[sent++];
+		success = send_packet(hSocket, datagram.mData, datagram.mSize, datagram.mAddr, datagram.mPort) && success;
+	}
+#endif
+
+	for (; sent < count; sent++)
+	{
+		const LLNetDatagram& datagram = datagrams[sent];
+		success = send_packet(hSocket, datagram.mData, datagram.mSize, datagram.mAddr, datagram.mPort) && success;
+	}
+	return success;
+}
+
 //EOF
@@ -43,6 +43,34 @@ void	end_net(S32& socket_out);
 // returns size of packet or -1 in case of error
 S32		receive_packet(int hSocket, char * receiveBuffer);
 
+// Returns TRUE once a packet is waiting on hSocket, FALSE if none arrived within timeout_ms
+BOOL	wait_for_packet(int hSocket, S32 timeout_ms);
+
+// Most datagrams receive_packets() and send_packets() move per system call
+const S32 NET_MAX_BATCH = 32;
+
+// One datagram of a batch
+struct LLNetDatagram
+{
+	char*	mData;			// NET_BUFFER_SIZE bytes to receive into, or the data to send
+	S32		mSize;			// bytes received, or bytes to send
+	U32		mAddr;			// sender or recipient, network byte order
+	U32		mPort;			// sender or recipient port, host byte order
+	U32		mReceivingIF;	// address the datagram was sent to, received datagrams only
+};
+
+// Receives up to count waiting datagrams, count at most NET_MAX_BATCH, with a
+// single recvmmsg() on Linux and one receive_packet() each elsewhere.
+// Returns how many were received, 0 if none were waiting.
+S32		receive_packets(int hSocket, LLNetDatagram* datagrams, S32 count);
+
+// Sends count datagrams, NET_MAX_BATCH to a sendmmsg() on Linux and one
+// send_packet() each elsewhere. Returns TRUE if all of them were sent.
+BOOL	send_packets(int hSocket, const LLNetDatagram* datagrams, S32 count);
+
+// Socket send and receive system calls made so far
+U32		get_socket_call_count();
+
 BOOL	send_packet(int hSocket, const char *sendBuffer, int size, U32 recipient, int nPort);	// Returns TRUE on success.
 
 //void	get_sender(char * tmp);
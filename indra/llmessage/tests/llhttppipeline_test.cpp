@@ -0,0 +1,277 @@
+/**
+ * @file   llhttppipeline_test.cpp
+ * @brief  Test of LLHTTPPipeline against test_llhttppipeline_peer.py, with a
+ *         textures/sec comparison against LLCurlRequest at 150 ms RTT.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+// Precompiled header
+#include "linden_common.h"
+// associated header
+#include "llhttppipeline.h"
+// STL headers
+#include <deque>
+#include <iostream>
+#include <vector>
+// std headers
+#include <cmath>
+#include <cstdlib>
+// other Linden headers
+#include "../test/lltut.h"
+#include "llapr.h"
+#include "llbuffer.h"
+#include "lltimer.h"
+
+/*****************************************************************************
+*   Helpers
+*****************************************************************************/
+namespace
+{
+	// Must match test_llhttppipeline_peer.py
+	S32 texture_size(S32 n)
+	{
+		return 8000 + (n * 7919) % 56000;
+	}
+
+	const S32 FIRST_REQUEST_SIZE = 48 * 1024;
+	const S32 TEXTURE_COUNT = 1000;
+	const S32 LLCURLREQUEST_MAX_IN_FLIGHT = 32; // what LLTextureFetchWorker allows
+	const F32 FETCH_TIMEOUT = 60.f;
+
+	struct FetchResult
+	{
+		FetchResult() : mStatus(0), mDone(false) {}
+		U32 mStatus;
+		std::vector<U8> mData;
+		bool mDone;
+	};
+
+	class TextureResponder : public LLCurl::Responder
+	{
+	public:
+		TextureResponder(FetchResult* result, S32* done_count)
+			: mResult(result), mDoneCount(done_count)
+		{
+		}
+
+		virtual void completedRaw(U32 status, const std::string& reason,
+								  const LLChannelDescriptors& channels,
+								  const LLIOPipe::buffer_ptr_t& buffer)
+		{
+			mResult->mStatus = status;
+			S32 size = buffer->countAfter(channels.in(), NULL);
+			mResult->mData.resize(size);
+			if (size > 0)
+			{
+				buffer->readAfter(channels.in(), NULL, &mResult->mData[0], size);
+			}
+			mResult->mDone = true;
+			++*mDoneCount;
+		}
+
+	private:
+		FetchResult* mResult;
+		S32* mDoneCount;
+	};
+
+	bool check_texture(const FetchResult& result, S32 n)
+	{
+		S32 size = llmin(texture_size(n), FIRST_REQUEST_SIZE);
+		if (!result.mDone || result.mStatus != 206 || (S32)result.mData.size() != size)
+		{
+			return false;
+		}
+		for (S32 i = 0; i < size; i++)
+		{
+			if (result.mData[i] != (U8)(n * 31 + i))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::string texture_url(const std::string& server, S32 n)
+	{
+		return llformat("%stexture/%d", server.c_str(), n);
+	}
+}
+
+/*****************************************************************************
+*   TUT
+*****************************************************************************/
+namespace tut
+{
+	struct llhttppipeline_data
+	{
+		std::string mServer;
+
+		llhttppipeline_data()
+		{
+			static bool init = false;
+			if (!init)
+			{
+				ll_init_apr();
+				LLCurl::initClass();
+				init = true;
+			}
+			const char* port = getenv("LL_TEXTURE_SERVER_PORT");
+			if (port)
+			{
+				mServer = llformat("http://127.0.0.1:%s/", port);
+			}
+		}
+	};
+	typedef test_group<llhttppipeline_data> llhttppipeline_group;
+	typedef llhttppipeline_group::object llhttppipeline_object;
+	llhttppipeline_group llhttppipelinegrp("llhttppipeline");
+
+	template<> template<>
+	void llhttppipeline_object::test<1>()
+	{
+		set_test_name("host keys");
+		ensure_equals(LLHTTPPipeline::getHostKey("http://Sim1.agni.lindenlab.com:12046/cap/abc/?texture_id=x"),
+					  "http://sim1.agni.lindenlab.com:12046");
+		ensure_equals(LLHTTPPipeline::getHostKey("https://example.com"), "https://example.com");
+		ensure_equals(LLHTTPPipeline::getHostKey("https://example.com?x=1"), "https://example.com");
+		ensure_equals(LLHTTPPipeline::getHostKey("example.com/texture"), "");
+		ensure_equals(LLHTTPPipeline::getHostKey("http:///texture"), "");
+	}
+
+	template<> template<>
+	void llhttppipeline_object::test<2>()
+	{
+		set_test_name("window follows the bandwidth-delay product");
+		// Requests of SIZE bytes through a link of BANDWIDTH bytes/s and LATENCY
+		// seconds round trip, always as many in flight as the window allows.
+		const F64 LATENCY = 0.15;
+		const F64 BANDWIDTH = 4000000.0;
+		const S32 SIZE = 40000;
+		const F64 BDP = BANDWIDTH * LATENCY / SIZE; // 15 requests
+
+		LLHTTPWindow window(2, 64, 8);
+		std::deque<std::pair<F64, F64> > in_flight; // finish time, time to first byte
+		F64 now = 0.0;
+		F64 link_free = 0.0;
+		while (now < 30.0)
+		{
+			while ((S32)in_flight.size() < window.getSize())
+			{
+				window.sent((S32)in_flight.size());
+				F64 start = llmax(now + LATENCY / 2.0, link_free);
+				link_free = start + SIZE / BANDWIDTH;
+				in_flight.push_back(std::make_pair(link_free + LATENCY / 2.0, start + LATENCY / 2.0 - now));
+			}
+			now = in_flight.front().first;
+			window.completed(SIZE, in_flight.front().second, true, now);
+			in_flight.pop_front();
+		}
+		ensure("latency measured", fabs(window.getLatency() - LATENCY) < 0.02);
+		ensure("bandwidth measured", fabs(window.getBandwidth() - BANDWIDTH) < BANDWIDTH * 0.1);
+		ensure("settled near twice the BDP", window.getSize() >= (S32)(1.5 * BDP) && window.getSize() <= (S32)(2.5 * BDP));
+
+		S32 size = window.getSize();
+		window.completed(0, 0.0, false, now);
+		ensure_equals("halved on error", window.getSize(), size / 2);
+		for (S32 i = 0; i < 10; i++)
+		{
+			window.completed(0, 0.0, false, now);
+		}
+		ensure_equals("not below the minimum", window.getSize(), 2);
+	}
+
+	template<> template<>
+	void llhttppipeline_object::test<3>()
+	{
+		set_test_name("textures/sec at 150 ms RTT");
+		ensure("run through test_llhttppipeline_peer.py", !mServer.empty());
+		std::vector<std::string> headers;
+		headers.push_back("Accept: image/x-j2c");
+
+		// Today's transport: an LLCurlRequest with a fixed cap on requests in flight
+		F64 curl_time;
+		{
+			std::vector<FetchResult> results(TEXTURE_COUNT);
+			S32 done = 0;
+			S32 next = 0;
+			LLCurlRequest request;
+			LLTimer timer;
+			while (done < TEXTURE_COUNT && timer.getElapsedTimeF32() < FETCH_TIMEOUT)
+			{
+				while (next < TEXTURE_COUNT && next - done < LLCURLREQUEST_MAX_IN_FLIGHT)
+				{
+					request.getByteRange(texture_url(mServer, next), headers, 0, FIRST_REQUEST_SIZE,
+										 new TextureResponder(&results[next], &done));
+					next++;
+				}
+				request.process();
+				ms_sleep(1);
+			}
+			curl_time = timer.getElapsedTimeF64();
+			for (S32 n = 0; n < TEXTURE_COUNT; n++)
+			{
+				ensure(llformat("LLCurlRequest texture %d", n), check_texture(results[n], n));
+			}
+		}
+
+		// Everything queued at once, the windows decide what is in flight
+		F64 pipeline_time;
+		S32 window_size;
+		{
+			std::vector<FetchResult> results(TEXTURE_COUNT);
+			S32 done = 0;
+			LLHTTPPipeline pipeline;
+			LLTimer timer;
+			for (S32 n = 0; n < TEXTURE_COUNT; n++)
+			{
+				ensure("queued", pipeline.getByteRange(texture_url(mServer, n), headers, 0, FIRST_REQUEST_SIZE,
+													   new TextureResponder(&results[n], &done)));
+			}
+			ensure_equals("all queued", pipeline.getQueued(), TEXTURE_COUNT);
+			while (done < TEXTURE_COUNT && timer.getElapsedTimeF32() < FETCH_TIMEOUT)
+			{
+				pipeline.process();
+				ms_sleep(1);
+			}
+			pipeline_time = timer.getElapsedTimeF64();
+			for (S32 n = 0; n < TEXTURE_COUNT; n++)
+			{
+				ensure(llformat("LLHTTPPipeline texture %d", n), check_texture(results[n], n));
+			}
+			ensure_equals("nothing left", pipeline.getQueued(), 0);
+			const LLHTTPWindow* window = pipeline.getWindow(mServer);
+			ensure("window", window != NULL);
+			window_size = window->getSize();
+		}
+
+		if (run_benchmarks())
+		{
+			std::cout << "\n" << TEXTURE_COUNT << " textures at 150 ms RTT:"
+					  << llformat("\nLLCurlRequest, %d in flight: %.1f textures/sec",
+								  LLCURLREQUEST_MAX_IN_FLIGHT, TEXTURE_COUNT / curl_time)
+					  << llformat("\nLLHTTPPipeline, window %d:    %.1f textures/sec",
+								  window_size, TEXTURE_COUNT / pipeline_time)
+					  << std::endl;
+		}
+	}
+} // namespace tut
@@ -0,0 +1,225 @@
+/**
+ * @file   llpacketring_test.cpp
+ * @brief  Loopback test of LLPacketRing's batched sends and receives, with a
+ *         packets/sec and syscalls/packet comparison against one at a time.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+// Precompiled header
+#include "linden_common.h"
+// associated header
+#include "../llpacketring.h"
+// STL headers
+#include <iostream>
+// other Linden headers
+#include "../test/lltut.h"
+#include "lltimer.h"
+#include "net.h"
+
+/*****************************************************************************
+*   Helpers
+*****************************************************************************/
+namespace
+{
+	const F32 RECEIVE_TIMEOUT = 5.f;
+	// Packets in flight at once, well inside the sockets' buffers
+	const S32 ROUND_SIZE = 256;
+
+	S32 packet_size(S32 n)
+	{
+		return 20 + (n * 37) % 480;
+	}
+
+	void fill_packet(char* data, S32 n)
+	{
+		for (S32 i = 0; i < packet_size(n); i++)
+		{
+			data[i] = (char)(n * 13 + i);
+		}
+	}
+
+	bool check_packet(const char* data, S32 size, S32 n)
+	{
+		if (size != packet_size(n))
+		{
+			return false;
+		}
+		for (S32 i = 0; i < size; i++)
+		{
+			if (data[i] != (char)(n * 13 + i))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+/*****************************************************************************
+*   TUT
+*****************************************************************************/
+namespace tut
+{
+	struct llpacketring_data
+	{
+		S32 mSendSocket;
+		S32 mReceiveSocket;
+		LLHost mReceiveHost;
+
+		llpacketring_data() :
+			mSendSocket(-1),
+			mReceiveSocket(-1)
+		{
+			int port = NET_USE_OS_ASSIGNED_PORT;
+			ensure_equals("sending socket", start_net(mSendSocket, port), 0);
+			port = NET_USE_OS_ASSIGNED_PORT;
+			ensure_equals("receiving socket", start_net(mReceiveSocket, port), 0);
+			mReceiveHost.set(LOOPBACK_ADDRESS_STRING, port);
+		}
+
+		~llpacketring_data()
+		{
+			end_net(mReceiveSocket);
+			end_net(mSendSocket);
+		}
+
+		// Sends packets first to first + count - 1 through sender, then reads
+		// them back through receiver. Returns how many arrived intact.
+		S32 roundTrip(LLPacketRing& sender, LLPacketRing& receiver, S32 first, S32 count)
+		{
+			char data[NET_BUFFER_SIZE];	/* Flawfinder: ignore */
+			for (S32 n = first; n < first + count; n++)
+			{
+				fill_packet(data, n);
+				sender.queuePacket(mSendSocket, data, packet_size(n), mReceiveHost);
+			}
+			sender.flushPackets();
+
+			S32 intact = 0;
+			S32 received = 0;
+			LLTimer timer;
+			while (received < count && timer.getElapsedTimeF32() < RECEIVE_TIMEOUT)
+			{
+				S32 size = receiver.receivePacket(mReceiveSocket, data);
+				if (!size)
+				{
+					ms_sleep(0);
+					continue;
+				}
+				if (check_packet(data, size, first + received))
+				{
+					intact++;
+				}
+				received++;
+			}
+			return intact;
+		}
+	};
+	typedef test_group<llpacketring_data> llpacketring_group;
+	typedef llpacketring_group::object llpacketring_object;
+	llpacketring_group llpacketringgrp("llpacketring");
+
+	template<> template<>
+	void llpacketring_object::test<1>()
+	{
+		set_test_name("batched loopback delivery");
+		LLPacketRing sender;
+		LLPacketRing receiver;
+		// More than one batch, and a batch that is not full
+		const S32 COUNT = 3 * NET_MAX_BATCH + 5;
+		ensure_equals("all intact and in order", roundTrip(sender, receiver, 0, COUNT), COUNT);
+
+		char data[NET_BUFFER_SIZE];	/* Flawfinder: ignore */
+		fill_packet(data, 1);
+		sender.queuePacket(mSendSocket, data, packet_size(1), mReceiveHost);
+		sender.flushPackets();
+		LLTimer timer;
+		while (!receiver.receivePacket(mReceiveSocket, data) && timer.getElapsedTimeF32() < RECEIVE_TIMEOUT)
+		{
+			ms_sleep(0);
+		}
+		ensure_equals("sender address", receiver.getLastSender().getAddress(), mReceiveHost.getAddress());
+		ensure("sender port", receiver.getLastSender().getPort() != mReceiveHost.getPort());
+	}
+
+	template<> template<>
+	void llpacketring_object::test<2>()
+	{
+		set_test_name("packets/sec and syscalls/packet");
+		const S32 PACKETS = 50 * ROUND_SIZE;
+		const S32 batch_sizes[2] = { 1, NET_MAX_BATCH };
+		F64 packets_per_sec[2];
+		F64 calls_per_packet[2];
+		for (S32 b = 0; b < 2; b++)
+		{
+			LLPacketRing sender;
+			LLPacketRing receiver;
+			sender.setBatchSize(batch_sizes[b]);
+			receiver.setBatchSize(batch_sizes[b]);
+
+			U32 calls = get_socket_call_count();
+			S32 intact = 0;
+			LLTimer timer;
+			for (S32 first = 0; first < PACKETS; first += ROUND_SIZE)
+			{
+				intact += roundTrip(sender, receiver, first, ROUND_SIZE);
+			}
+			F64 elapsed = timer.getElapsedTimeF64();
+			calls = get_socket_call_count() - calls;
+			ensure_equals(llformat("batch size %d intact", batch_sizes[b]), intact, PACKETS);
+
+			packets_per_sec[b] = PACKETS / llmax(elapsed, 0.001);
+			calls_per_packet[b] = (F64)calls / PACKETS;
+		}
+
+		if (run_benchmarks())
+		{
+			std::cout << "\n" << PACKETS << " packets over loopback, sends and receives:"
+					  << llformat("\none at a time: %9.0f packets/sec, %.3f syscalls/packet",
+								  packets_per_sec[0], calls_per_packet[0])
+					  << llformat("\nbatches of %d: %9.0f packets/sec, %.3f syscalls/packet",
+								  NET_MAX_BATCH, packets_per_sec[1], calls_per_packet[1])
+					  << std::endl;
+		}
+#if LL_LINUX
+		ensure("fewer system calls", calls_per_packet[1] < calls_per_packet[0] / 4);
+#endif
+	}
+
+	template<> template<>
+	void llpacketring_object::test<3>()
+	{
+		set_test_name("inbound throttle for packets off the receive thread");
+		LLPacketRing ring;
+		ensure("unthrottled", ring.checkInThrottle());
+		ring.throttleReceived(100000);
+		ensure("unthrottled after a large packet", ring.checkInThrottle());
+		ensure_equals("no bits counted unthrottled", ring.getAndResetActualInBits(), 0);
+
+		ring.setUseInThrottle(TRUE);
+		ring.setInBandwidth(8000.f);
+		ring.throttleReceived(100000);
+		ensure("held back past the bandwidth", !ring.checkInThrottle());
+		ensure_equals("bits counted", ring.getAndResetActualInBits(), 800000);
+	}
+} // namespace tut
@@ -0,0 +1,193 @@
+#!/usr/bin/python
+"""\
+@file   test_llhttppipeline_peer.py
+@brief  This script asynchronously runs the executable (with args) specified on
+        the command line, returning its result code. While that executable is
+        running, we serve stand-in textures over HTTP/1.1 as if from across a
+        slow link: every response is held back one round trip time, each new
+        connection costs another one, and all responses share one link of
+        limited bandwidth. Requests pipelined on a connection are read as
+        they arrive and answered in order.
+
+$LicenseInfo:firstyear=2010&license=viewerlgpl$
+Second Life Viewer Source Code
+Copyright (C) 2010, Linden Research, Inc.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation;
+version 2.1 of the License only.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+$/LicenseInfo$
+"""
+
+import os
+import re
+import socket
+import sys
+import time
+from threading import Thread, Lock, Condition
+
+mydir = os.path.dirname(__file__)       # expected to be .../indra/llmessage/tests/
+sys.path.insert(0, mydir)
+from testrunner import run, debug
+
+RTT = 0.150                             # seconds
+BANDWIDTH = 16 * 1024 * 1024            # bytes per second, for all connections
+
+# Texture n is texture_size(n) bytes long, byte i of it is (n * 31 + i) & 0xff.
+# llhttppipeline_test.cpp checks what it gets against the same formula.
+PATTERN = bytearray(range(256)) * 512
+
+def texture_size(n):
+    return 8000 + (n * 7919) % 56000
+
+def texture_data(n, start, end):
+    data = bytearray()
+    pos = start
+    while pos < end:
+        first = (n * 31 + pos) & 0xff
+        chunk = min(end - pos, len(PATTERN) - 256)
+        data += PATTERN[first:first + chunk]
+        pos += chunk
+    return bytes(data)
+
+class Link(object):
+    """The shared bottleneck: responses go out one after the other."""
+    def __init__(self):
+        self.lock = Lock()
+        self.free_at = 0.0
+
+    def reserve(self, due, size):
+        self.lock.acquire()
+        try:
+            start = max(due, self.free_at)
+            self.free_at = start + float(size) / BANDWIDTH
+            return self.free_at
+        finally:
+            self.lock.release()
+
+link = Link()
+
+class Connection(object):
+    def __init__(self, sock):
+        self.sock = sock
+        self.rfile = sock.makefile('rb')
+        self.pending = []
+        self.cond = Condition()
+        self.closed = False
+
+    def start(self):
+        reader = Thread(target=self.read_requests)
+        writer = Thread(target=self.write_responses)
+        reader.setDaemon(True)
+        writer.setDaemon(True)
+        reader.start()
+        writer.start()
+
+    def read_requests(self):
+        # a new connection costs a round trip before the first request arrives
+        time.sleep(RTT)
+        try:
+            while True:
+                line = self.rfile.readline()
+                if not line:
+                    break
+                request = line.decode('latin-1').split()
+                headers = {}
+                while True:
+                    line = self.rfile.readline().decode('latin-1').strip()
+                    if not line:
+                        break
+                    name, _, value = line.partition(':')
+                    headers[name.strip().lower()] = value.strip()
+                self.cond.acquire()
+                self.pending.append((time.time() + RTT, request, headers))
+                self.cond.notify()
+                self.cond.release()
+        except socket.error:
+            pass
+        self.cond.acquire()
+        self.closed = True
+        self.cond.notify()
+        self.cond.release()
+
+    def write_responses(self):
+        while True:
+            self.cond.acquire()
+            while not self.pending and not self.closed:
+                self.cond.wait()
+            if not self.pending:
+                self.cond.release()
+                break
+            due, request, headers = self.pending.pop(0)
+            self.cond.release()
+            response = self.answer(request, headers)
+            done = link.reserve(due, len(response))
+            delay = done - time.time()
+            if delay > 0:
+                time.sleep(delay)
+            try:
+                self.sock.sendall(response)
+            except socket.error:
+                break
+        try:
+            self.sock.close()
+        except socket.error:
+            pass
+
+    def answer(self, request, headers):
+        match = None
+        if len(request) >= 2 and request[0] == "GET":
+            match = re.match(r"/texture/(\d+)$", request[1])
+        if not match:
+            return ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n").encode('latin-1')
+        n = int(match.group(1))
+        size = texture_size(n)
+        start, end = 0, size
+        status = "200 OK"
+        extra = ""
+        match = re.match(r"bytes=(\d+)-(\d*)$", headers.get("range", ""))
+        if match:
+            start = int(match.group(1))
+            if match.group(2):
+                end = min(size, int(match.group(2)) + 1)
+            if start >= size:
+                return ("HTTP/1.1 416 Requested Range Not Satisfiable\r\n"
+                        "Content-Range: bytes */%d\r\nContent-Length: 0\r\n\r\n" % size).encode('latin-1')
+            status = "206 Partial Content"
+            extra = "Content-Range: bytes %d-%d/%d\r\n" % (start, end - 1, size)
+        head = ("HTTP/1.1 %s\r\nContent-Type: image/x-j2c\r\n%sContent-Length: %d\r\n\r\n"
+                % (status, extra, end - start))
+        return head.encode('latin-1') + texture_data(n, start, end)
+
+class TestHTTPServer(Thread):
+    def __init__(self, sock, **kwds):
+        Thread.__init__(self, **kwds)
+        self.sock = sock
+
+    def run(self):
+        debug("Starting HTTP server...\n")
+        while True:
+            conn, addr = self.sock.accept()
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            Connection(conn).start()
+
+if __name__ == "__main__":
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('127.0.0.1', 0))
+    sock.listen(128)
+    # the test program finds us through its environment
+    os.environ["LL_TEXTURE_SERVER_PORT"] = str(sock.getsockname()[1])
+    sys.exit(run(server=TestHTTPServer(sock, name="httpd"), *sys.argv[1:]))
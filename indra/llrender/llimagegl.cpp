@@ -33,6 +33,7 @@
 
 #include "llerror.h"
 #include "llimage.h"
+#include "llimagedxt.h"
 
 #include "llmath.h"
 #include "llgl.h"
@@ -1288,6 +1289,65 @@ BOOL LLImageGL::createGLTexture(S32 discard_level, const U8* data_in, BOOL data_
 	return TRUE;
 }
 
+BOOL LLImageGL::createGLTexture(S32 discard_level, LLImageDXT* imagedxt, S32 usename, S32 category)
+{
+	if (gGLManager.mIsDisabled)
+	{
+		llwarns << "Trying to create a texture while GL is disabled!" << llendl;
+		return FALSE;
+	}
+	if (!gGLManager.mHasCompressedTextures || mHasExplicitFormat)
+	{
+		return FALSE;
+	}
+
+	LLGLenum format;
+	switch (imagedxt->getFileFormat())
+	{
+	  case LLImageDXT::FORMAT_DXR1:
+		// The RGBA variant is the one dataFormatBytes() knows about. Our
+		// encoder never emits the punch through alpha mode.
+		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		break;
+	  case LLImageDXT::FORMAT_DXR3:
+		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		break;
+	  case LLImageDXT::FORMAT_DXR5:
+		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		break;
+	  default:
+		return FALSE;
+	}
+
+	mGLTextureCreated = false ;
+	llassert(gGLManager.mInited);
+	stop_glerror();
+
+	if (discard_level < 0)
+	{
+		llassert(mCurrentDiscardLevel >= 0);
+		discard_level = mCurrentDiscardLevel;
+	}
+	discard_level = llclamp(discard_level, 0, (S32)mMaxDiscardLevel);
+
+	S32 w = imagedxt->getWidth() << discard_level;
+	S32 h = imagedxt->getHeight() << discard_level;
+
+	// setSize may call destroyGLTexture if the size does not match
+	setSize(w, h, imagedxt->getComponents());
+
+	mFormatInternal = format;
+	mFormatPrimary = format;
+	mFormatType = GL_UNSIGNED_BYTE;
+	mFormatSwapBytes = FALSE;
+
+	setCategory(category) ;
+
+	// Mips are stored smallest first, setImage() walks back from the largest
+	const U8* data = imagedxt->getData() + imagedxt->getMipOffset(0);
+	return createGLTexture(discard_level, data, TRUE, usename);
+}
+
 BOOL LLImageGL::readBackRaw(S32 discard_level, LLImageRaw* imageraw, bool compressed_ok) const
 {
 	llassert_always(sAllowReadBackRaw) ;
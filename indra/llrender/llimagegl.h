@@ -37,6 +37,7 @@
 
 #include "llrender.h"
 class LLTextureAtlas ;
+class LLImageDXT ;
 #define BYTES_TO_MEGA_BYTES(x) ((x) >> 20)
 #define MEGA_BYTES_TO_BYTES(x) ((x) << 20)
 
@@ -104,6 +105,9 @@ public:
 	BOOL createGLTexture(S32 discard_level, const LLImageRaw* imageraw, S32 usename = 0, BOOL to_create = TRUE, 
 		S32 category = sMaxCatagories - 1);
 	BOOL createGLTexture(S32 discard_level, const U8* data, BOOL data_hasmips = FALSE, S32 usename = 0);
+	// Uploads a block compressed (DXR1/3/5) image and its mips as is. Fails if the
+	// driver can't take S3TC textures or the texture has an explicit format.
+	BOOL createGLTexture(S32 discard_level, LLImageDXT* imagedxt, S32 usename = 0, S32 category = sMaxCatagories - 1);
 	void setImage(const LLImageRaw* imageraw);
 	void setImage(const U8* data_in, BOOL data_hasmips = FALSE);
 	BOOL setSubImage(const LLImageRaw* imageraw, S32 x_pos, S32 y_pos, S32 width, S32 height, BOOL force_fast_update = FALSE);
@@ -133,6 +137,7 @@ public:
 	LLGLenum getFormatType() const { return mFormatType; }
 
 	BOOL getHasGLTexture() const { return mTexName != 0; }
+	BOOL getHasExplicitFormat() const { return mHasExplicitFormat; }
 	LLGLuint getTexName() const { return mTexName; }
 
 	BOOL getIsAlphaMask() const { return mIsMask; }
@@ -45,9 +45,19 @@ S32	gGLViewport[4];
 
 U32 LLRender::sUICalls = 0;
 U32 LLRender::sUIVerts = 0;
+U32 LLRender::sCalls = 0;
+U32 LLRender::sVerts = 0;
+U32 LLRender::sFrameCalls = 0;
+U32 LLRender::sFrameVerts = 0;
 
 static const U32 LL_NUM_TEXTURE_LAYERS = 16; 
 
+// Vertices gathered between flushes, and how many end() lets pile up
+static const U32 LL_IMMEDIATE_BUFFER_SIZE = 16384;
+static const U32 LL_IMMEDIATE_BATCH_SIZE = LL_IMMEDIATE_BUFFER_SIZE / 2;
+// Vertices in the stream buffer ring, enough for a busy UI frame
+static const U32 LL_STREAM_BUFFER_SIZE = 65536;
+
 static GLenum sGLTextureType[] =
 {
 	GL_TEXTURE_2D,
@@ -189,8 +199,6 @@ bool LLTexUnit::bind(LLTexture* texture, bool for_rendering, bool forceBind)
 	stop_glerror();
 	if (mIndex < 0) return false;
 
-	gGL.flush();
-
 	LLImageGL* gl_tex = NULL ;
 	if (texture == NULL || !(gl_tex = texture->getGLTexture()))
 	{
@@ -218,6 +226,7 @@ bool LLTexUnit::bind(LLTexture* texture, bool for_rendering, bool forceBind)
 	}
 	if ((mCurrTexture != gl_tex->getTexName()) || forceBind)
 	{
+		gGL.flush();
 		activate();
 		enable(gl_tex->getTarget());
 		mCurrTexture = gl_tex->getTexName();
@@ -282,8 +291,6 @@ bool LLTexUnit::bind(LLCubeMap* cubeMap)
 {
 	if (mIndex < 0) return false;
 
-	gGL.flush();
-
 	if (cubeMap == NULL)
 	{
 		llwarns << "NULL LLTexUnit::bind cubemap" << llendl;
@@ -294,6 +301,7 @@ bool LLTexUnit::bind(LLCubeMap* cubeMap)
 	{
 		if (gGLManager.mHasCubeMap && LLCubeMap::sUseCubeMaps)
 		{
+			gGL.flush();
 			activate();
 			enable(LLTexUnit::TT_CUBE_MAP);
 			mCurrTexture = cubeMap->mImages[0]->getTexName();
@@ -323,8 +331,6 @@ bool LLTexUnit::bind(LLRenderTarget* renderTarget, bool bindDepth)
 {
 	if (mIndex < 0) return false;
 
-	gGL.flush();
-
 	if (bindDepth)
 	{
 		if (renderTarget->hasStencil())
@@ -750,10 +756,11 @@ LLRender::LLRender()
     mCount(0),
     mMode(LLRender::TRIANGLES),
     mCurrTextureUnitIndex(0),
+    mStreamOffset(0),
     mMaxAnisotropy(0.f) 
 {
 	mBuffer = new LLVertexBuffer(immediate_mask, 0);
-	mBuffer->allocateBuffer(4096, 0, TRUE);
+	mBuffer->allocateBuffer(LL_IMMEDIATE_BUFFER_SIZE, 0, TRUE);
 	mBuffer->getVertexStrider(mVerticesp);
 	mBuffer->getTexCoord0Strider(mTexcoordsp);
 	mBuffer->getColorStrider(mColorsp);
@@ -792,6 +799,13 @@ void LLRender::shutdown()
 	mTexUnits.clear();
 	delete mDummyTexUnit;
 	mDummyTexUnit = NULL;
+	mStreamBuffer = NULL;
+}
+
+void LLRender::resetVertexBuffers()
+{
+	flush();
+	mStreamBuffer = NULL;
 }
 
 void LLRender::refreshState(void)
@@ -828,6 +842,7 @@ void LLRender::scalef(const GLfloat& x, const GLfloat& y, const GLfloat& z)
 
 void LLRender::pushMatrix()
 {
+	// Callers go on to change the pushed matrix with gl calls of their own
 	flush();
 	glPushMatrix();
 }
@@ -927,7 +942,12 @@ void LLRender::setColorMask(bool writeColor, bool writeAlpha)
 
 void LLRender::setColorMask(bool writeColorR, bool writeColorG, bool writeColorB, bool writeAlpha)
 {
-	flush();
+	if (mDirty ||
+		mCurrColorMask[0] != writeColorR || mCurrColorMask[1] != writeColorG ||
+		mCurrColorMask[2] != writeColorB || mCurrColorMask[3] != writeAlpha)
+	{
+		flush();
+	}
 
 	mCurrColorMask[0] = writeColorR;
 	mCurrColorMask[1] = writeColorG;
@@ -973,7 +993,10 @@ void LLRender::setSceneBlendType(eBlendType type)
 
 void LLRender::setAlphaRejectSettings(eCompareFunc func, F32 value)
 {
-	flush();
+	if (mDirty || mCurrAlphaFunc != func || mCurrAlphaFuncVal != value)
+	{
+		flush();
+	}
 
 	mCurrAlphaFunc = func;
 	mCurrAlphaFuncVal = value;
@@ -1095,7 +1118,7 @@ void LLRender::end()
 		mMode != LLRender::LINES &&
 		mMode != LLRender::TRIANGLES &&
 		mMode != LLRender::POINTS) ||
-		mCount > 2048)
+		mCount > LL_IMMEDIATE_BATCH_SIZE)
 	{
 		flush();
 	}
@@ -1151,6 +1174,8 @@ void LLRender::flush()
 			sUICalls++;
 			sUIVerts += mCount;
 		}
+		sCalls++;
+		sVerts += mCount;
 		
 		if (gDebugGL)
 		{
@@ -1177,10 +1202,27 @@ void LLRender::flush()
 					llerrs << "Incomplete line rendered." << llendl;
 				}
 			}
+
+			checkBatchState();
 		}
 
-		mBuffer->setBuffer(immediate_mask);
-		mBuffer->drawArrays(mMode, 0, mCount);
+		if (useStreamBuffer())
+		{
+			BOOL orphan = mStreamOffset + mCount > (U32)mStreamBuffer->getRequestedVerts();
+			if (orphan)
+			{
+				mStreamOffset = 0;
+			}
+			mStreamBuffer->updateVertices(mBuffer->getMappedData(), mStreamOffset, mCount, orphan);
+			mStreamBuffer->setBuffer(immediate_mask);
+			mStreamBuffer->drawArrays(mMode, mStreamOffset, mCount);
+			mStreamOffset += mCount;
+		}
+		else
+		{
+			mBuffer->setBuffer(immediate_mask);
+			mBuffer->drawArrays(mMode, 0, mCount);
+		}
 		
 		mVerticesp[0] = mVerticesp[mCount];
 		mTexcoordsp[0] = mTexcoordsp[mCount];
@@ -1189,10 +1231,71 @@ void LLRender::flush()
 	}
 }
 
+//static
+void LLRender::resetFrameStats()
+{
+	sFrameCalls = sCalls;
+	sFrameVerts = sVerts;
+	sCalls = 0;
+	sVerts = 0;
+}
+
+// bind(), setColorMask() and setAlphaRejectSettings() skip the flush when
+// asked for what is cached as current, so a batch is drawn with the state
+// it was gathered under only if the cache matches GL.  Warn of a mismatch.
+void LLRender::checkBatchState()
+{
+	LLTexUnit* unit = mTexUnits[mCurrTextureUnitIndex];
+	if (unit->getCurrType() == LLTexUnit::TT_TEXTURE)
+	{
+		GLint texture = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+		if ((U32)texture != unit->getCurrTexture())
+		{
+			llwarns << "Texture " << texture << " bound behind LLTexUnit's back, expected "
+				   << unit->getCurrTexture() << llendl;
+		}
+	}
+
+	GLboolean mask[4];
+	glGetBooleanv(GL_COLOR_WRITEMASK, mask);
+	for (U32 i = 0; i < 4; i++)
+	{
+		if ((mask[i] == GL_TRUE) != mCurrColorMask[i])
+		{
+			llwarns << "Color mask set behind LLRender's back." << llendl;
+			break;
+		}
+	}
+
+	GLint alpha_func = 0;
+	glGetIntegerv(GL_ALPHA_TEST_FUNC, &alpha_func);
+	GLenum expected_func = (mCurrAlphaFunc == CF_DEFAULT) ? GL_GREATER : sGLCompareFunc[mCurrAlphaFunc];
+	if ((GLenum)alpha_func != expected_func)
+	{
+		llwarns << "Alpha function set behind LLRender's back." << llendl;
+	}
+}
+
+bool LLRender::useStreamBuffer()
+{
+	if (mStreamBuffer.isNull())
+	{
+		// Left empty if stream VBOs are off, to fall back on client arrays
+		mStreamBuffer = new LLVertexBuffer(immediate_mask, GL_STREAM_DRAW_ARB);
+		if (mStreamBuffer->useVBOs())
+		{
+			mStreamBuffer->allocateBuffer(LL_STREAM_BUFFER_SIZE, 0, true);
+		}
+		mStreamOffset = 0;
+	}
+	return mStreamBuffer->getRequestedVerts() > 0;
+}
+
 void LLRender::vertex3f(const GLfloat& x, const GLfloat& y, const GLfloat& z)
 { 
-	//the range of mVerticesp, mColorsp and mTexcoordsp is [0, 4095]
-	if (mCount > 4094)
+	//the range of mVerticesp, mColorsp and mTexcoordsp is [0, LL_IMMEDIATE_BUFFER_SIZE-1]
+	if (mCount > LL_IMMEDIATE_BUFFER_SIZE - 2)
 	{
 	//	llwarns << "GL immediate mode overflow.  Some geometry not drawn." << llendl;
 		return;
@@ -1216,7 +1319,7 @@ void LLRender::vertex3f(const GLfloat& x, const GLfloat& y, const GLfloat& z)
 
 void LLRender::vertexBatchPreTransformed(LLVector3* verts, S32 vert_count)
 {
-	if (mCount + vert_count > 4094)
+	if (mCount + vert_count > LL_IMMEDIATE_BUFFER_SIZE - 2)
 	{
 		//	llwarns << "GL immediate mode overflow.  Some geometry not drawn." << llendl;
 		return;
@@ -1236,7 +1339,7 @@ void LLRender::vertexBatchPreTransformed(LLVector3* verts, S32 vert_count)
 
 void LLRender::vertexBatchPreTransformed(LLVector3* verts, LLVector2* uvs, S32 vert_count)
 {
-	if (mCount + vert_count > 4094)
+	if (mCount + vert_count > LL_IMMEDIATE_BUFFER_SIZE - 2)
 	{
 		//	llwarns << "GL immediate mode overflow.  Some geometry not drawn." << llendl;
 		return;
@@ -1257,7 +1360,7 @@ void LLRender::vertexBatchPreTransformed(LLVector3* verts, LLVector2* uvs, S32 v
 
 void LLRender::vertexBatchPreTransformed(LLVector3* verts, LLVector2* uvs, LLColor4U* colors, S32 vert_count)
 {
-	if (mCount + vert_count > 4094)
+	if (mCount + vert_count > LL_IMMEDIATE_BUFFER_SIZE - 2)
 	{
 		//	llwarns << "GL immediate mode overflow.  Some geometry not drawn." << llendl;
 		return;
@@ -272,6 +272,10 @@ public:
 	LLRender();
 	~LLRender();
 	void shutdown();
+
+	// Drops the stream buffer flush() uploads into, to be made again on
+	// the next flush(), as the pipeline does with its own vertex buffers
+	void resetVertexBuffers();
 	
 	// Refreshes renderer state to the cached values
 	// Needed when the render context has changed and invalidated the current state
@@ -347,8 +351,20 @@ public:
 public:
 	static U32 sUICalls;
 	static U32 sUIVerts;
+	// Of all flushes, UI or not
+	static U32 sCalls;
+	static U32 sVerts;
+	// sCalls and sVerts as they stood at the last resetFrameStats()
+	static U32 sFrameCalls;
+	static U32 sFrameVerts;
+
+	// Call once a frame, to keep that frame's flush counts for display
+	static void resetFrameStats();
 	
 private:
+	bool useStreamBuffer();
+	void checkBatchState();
+
 	bool				mDirty;
 	U32				mCount;
 	U32				mMode;
@@ -358,6 +374,10 @@ private:
 	F32				mCurrAlphaFuncVal;
 
 	LLPointer<LLVertexBuffer>	mBuffer;
+	// Ring buffer each flush() appends its vertices to, orphaned when it
+	// wraps so the driver need not wait on draws still using it
+	LLPointer<LLVertexBuffer>	mStreamBuffer;
+	U32				mStreamOffset;
 	LLStrider<LLVector3>		mVerticesp;
 	LLStrider<LLVector2>		mTexcoordsp;
 	LLStrider<LLColor4U>		mColorsp;
@@ -1297,3 +1297,32 @@ void LLVertexBuffer::markDirty(U32 vert_index, U32 vert_count, U32 indices_index
 	
 	}*/
 }
+
+void LLVertexBuffer::updateVertices(const U8* data, S32 index, S32 count, BOOL orphan)
+{
+	llassert(useVBOs());
+	if (index < 0 || count < 0 || index + count > mRequestedNumVerts)
+	{
+		llerrs << "Bad vertex buffer update range: [" << index << ", " << index+count << "]" << llendl;
+	}
+	if (mLocked)
+	{
+		llerrs << "LLVertexBuffer::updateVertices() called on a mapped buffer." << llendl;
+	}
+
+	stop_glerror();
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, mGLBuffer);
+	sBindCount++;
+	sVBOActive = TRUE;
+	// Forget which buffer the vertex pointers were set up for, so the next
+	// setBuffer() of any buffer binds it again and sets them up
+	sGLRenderBuffer = 0;
+	if (orphan || mResized)
+	{
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, getSize(), NULL, mUsage);
+		mResized = FALSE;
+	}
+	glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, index * mStride, count * mStride, data);
+	stop_glerror();
+	mEmpty = FALSE;
+}
@@ -192,6 +192,12 @@ public:
 	
 	void markDirty(U32 vert_index, U32 vert_count, U32 indices_index, U32 indices_count);
 
+	// Copies count vertices laid out as this buffer's into it at index with
+	// glBufferSubData instead of mapping it, first orphaning its storage if
+	// orphan is TRUE so the driver need not wait on draws still using it.
+	// VBOs only.
+	void updateVertices(const U8* data, S32 index, S32 count, BOOL orphan);
+
 	void draw(U32 mode, U32 count, U32 indices_offset) const;
 	void drawArrays(U32 mode, U32 offset, U32 count) const;
 	void drawRange(U32 mode, U32 start, U32 end, U32 count, U32 indices_offset) const;
@@ -0,0 +1,984 @@
+/**
+ * @file llshardedvfs.cpp
+ * @brief Implementation of the lock-striped virtual file system
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <algorithm>
+#include <vector>
+#if !LL_WINDOWS
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "llshardedvfs.h"
+#include "llvfsblock.h"
+
+#include "llstl.h"
+#include "lltimer.h"
+
+namespace
+{
+	// Snapshot of an eviction candidate, taken under its shard lock.
+	struct LRUCandidate
+	{
+		LLVFSFileSpecifier mSpec;
+		U32 mAccessTime;
+		S32 mLength;
+
+		bool operator<(const LRUCandidate& rhs) const
+		{
+			return (mAccessTime == rhs.mAccessTime)
+				? mSpec < rhs.mSpec
+				: mAccessTime < rhs.mAccessTime;
+		}
+	};
+}
+
+LLShardedVFS::LLShardedVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash)
+:	LLVFS(index_filename, data_filename, read_only, presize, remove_after_crash),
+	mMappedData(NULL),
+	mMappedSize(0),
+	mFileMutex(NULL)
+{
+	for (S32 i = 0; i < SHARD_COUNT; i++)
+	{
+		mShards[i].mMutex = new LLMutex(0);
+	}
+	mFileMutex = new LLMutex(0);
+
+	if (!isValid())
+	{
+		return;
+	}
+
+	// Distribute the index the base class loaded across the shards.
+	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	{
+		getShard(it->first).mFileBlocks.insert(*it);
+	}
+	mFileBlocks.clear();
+
+	mapDataFile();
+}
+
+LLShardedVFS::~LLShardedVFS()
+{
+	// Checkpoint while flushData() can still see the mapping
+	closeJournal();
+	unmapDataFile();
+
+	for (S32 i = 0; i < SHARD_COUNT; i++)
+	{
+		if (mShards[i].mMutex->isLocked())
+		{
+			LL_ERRS("VFS") << "LLShardedVFS destroyed with shard mutex locked" << LL_ENDL;
+		}
+		for_each(mShards[i].mFileBlocks.begin(), mShards[i].mFileBlocks.end(), DeletePairedPointer());
+		mShards[i].mFileBlocks.clear();
+		delete mShards[i].mMutex;
+		mShards[i].mMutex = NULL;
+	}
+
+	delete mFileMutex;
+	mFileMutex = NULL;
+}
+
+void LLShardedVFS::mapDataFile()
+{
+#if LL_WINDOWS
+	LL_INFOS("VFS") << "Memory mapped VFS not supported on this platform, using stdio" << LL_ENDL;
+#else
+	// The mapping must cover every byte the allocator can hand out,
+	// including the tail free block of a VFS that was not presized.
+	U32 arena_size = 0;
+	if (!mFreeBlocksByLocation.empty())
+	{
+		LLVFSBlock* last_free = mFreeBlocksByLocation.rbegin()->second;
+		arena_size = last_free->mLocation + last_free->mLength;
+	}
+	for (S32 i = 0; i < SHARD_COUNT; i++)
+	{
+		for (fileblock_map::iterator it = mShards[i].mFileBlocks.begin(); it != mShards[i].mFileBlocks.end(); ++it)
+		{
+			LLVFSFileBlock* block = it->second;
+			if (block->mLength > 0)
+			{
+				arena_size = llmax(arena_size, block->mLocation + (U32)block->mLength);
+			}
+		}
+	}
+
+	fflush(mDataFP);
+	fseek(mDataFP, 0, SEEK_END);
+	U32 data_size = (U32)ftell(mDataFP);
+	if (arena_size > data_size)
+	{
+		if (mReadOnly || ftruncate(fileno(mDataFP), arena_size) != 0)
+		{
+			LL_WARNS("VFS") << "Can't extend VFS data file to " << arena_size << " bytes, using stdio" << LL_ENDL;
+			return;
+		}
+		data_size = arena_size;
+	}
+	if (!data_size)
+	{
+		return;
+	}
+
+	int prot = mReadOnly ? PROT_READ : (PROT_READ | PROT_WRITE);
+	void* addr = mmap(NULL, data_size, prot, MAP_SHARED, fileno(mDataFP), 0);
+	if (MAP_FAILED == addr)
+	{
+		LL_WARNS("VFS") << "Can't map " << data_size << " bytes of " << mDataFilename << ", using stdio" << LL_ENDL;
+		return;
+	}
+
+	mMappedData = (U8*)addr;
+	mMappedSize = data_size;
+	LL_INFOS("VFS") << "Mapped " << mMappedSize << " bytes of VFS data file " << mDataFilename << LL_ENDL;
+#endif
+}
+
+void LLShardedVFS::unmapDataFile()
+{
+#if !LL_WINDOWS
+	if (mMappedData)
+	{
+		munmap(mMappedData, mMappedSize);
+	}
+#endif
+	mMappedData = NULL;
+	mMappedSize = 0;
+}
+
+S32 LLShardedVFS::readData(U32 location, U8* buffer, S32 length)
+{
+	if (mMappedData)
+	{
+		if (location >= mMappedSize)
+		{
+			return 0;
+		}
+		length = llmin(length, (S32)(mMappedSize - location));
+		memcpy(buffer, mMappedData + location, length);		/* Flawfinder: ignore */
+		return length;
+	}
+
+	LLMutexLock lock(mFileMutex);
+	fseek(mDataFP, location, SEEK_SET);
+	return (S32)fread(buffer, 1, length, mDataFP);
+}
+
+S32 LLShardedVFS::writeData(U32 location, const U8* buffer, S32 length)
+{
+	if (mMappedData)
+	{
+		if (location >= mMappedSize)
+		{
+			return 0;
+		}
+		length = llmin(length, (S32)(mMappedSize - location));
+		memcpy(mMappedData + location, buffer, length);		/* Flawfinder: ignore */
+		return length;
+	}
+
+	LLMutexLock lock(mFileMutex);
+	fseek(mDataFP, location, SEEK_SET);
+	return (S32)fwrite(buffer, 1, length, mDataFP);
+}
+
+BOOL LLShardedVFS::allocate(S32 length, U32& location)
+{
+	BOOL res = FALSE;
+
+	lockData();
+	LLVFSBlock* free_block = findFreeSpace(length);
+	if (!free_block && !mUncommittedFreeBlocks.empty())
+	{
+		writeJournal();
+		free_block = findFreeSpace(length);
+	}
+	if (free_block)
+	{
+		location = free_block->mLocation;
+		useFreeSpace(free_block, length);		// takes ownership of free_block
+		res = TRUE;
+	}
+	unlockData();
+
+	return res;
+}
+
+// mDataMutex and the shard lock of the file being moved must be LOCKED
+BOOL LLShardedVFS::moveData(U32 src_location, U32 dst_location, S32 length)
+{
+	if (mMappedData)
+	{
+		if (src_location + length > mMappedSize || dst_location + length > mMappedSize)
+		{
+			llwarns << "VFS: Move outside mapped data file" << llendl;
+			return FALSE;
+		}
+		memmove(mMappedData + dst_location, mMappedData + src_location, length);
+		return TRUE;
+	}
+
+	LLMutexLock lock(mFileMutex);
+	return LLVFS::moveData(src_location, dst_location, length);
+}
+
+// mDataMutex must be LOCKED
+void LLShardedVFS::flushData()
+{
+	if (mMappedData)
+	{
+		// Stores to a shared mapping are in the page cache already, they
+		// survive the viewer crashing.  Just start writeback early.
+#if !LL_WINDOWS
+		msync(mMappedData, mMappedSize, MS_ASYNC);
+#endif
+		return;
+	}
+
+	LLMutexLock lock(mFileMutex);
+	LLVFS::flushData();
+}
+
+BOOL LLShardedVFS::relocateForCompaction(const LLVFSFileSpecifier& spec, U32 free_location)
+{
+	BOOL moved = FALSE;
+	Shard& shard = getShard(spec);
+
+	shard.mMutex->lock();
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it != shard.mFileBlocks.end())
+	{
+		lockData();
+		moved = slideFileIntoFreeBlock(it->second, free_location);
+		unlockData();
+	}
+	shard.mMutex->unlock();
+
+	return moved;
+}
+
+void LLShardedVFS::removeShardFileBlock(LLVFSFileBlock* block)
+{
+	lockData();
+	removeFileBlock(block);
+	unlockData();
+}
+
+BOOL LLShardedVFS::evictLRU(S32 size, const LLVFSFileSpecifier& immune)
+{
+	LLTimer timer;
+
+	// Snapshot candidates one shard at a time.
+	std::vector<LRUCandidate> candidates;
+	for (S32 i = 0; i < SHARD_COUNT; i++)
+	{
+		LLMutexLock lock(mShards[i].mMutex);
+		for (fileblock_map::iterator it = mShards[i].mFileBlocks.begin(); it != mShards[i].mFileBlocks.end(); ++it)
+		{
+			LLVFSFileBlock* tmp = it->second;
+			if (tmp->mLength > 0 &&
+				!(it->first == immune) &&
+				!tmp->mLocks[VFSLOCK_READ] &&
+				!tmp->mLocks[VFSLOCK_APPEND] &&
+				!tmp->mLocks[VFSLOCK_OPEN])
+			{
+				LRUCandidate candidate;
+				candidate.mSpec = it->first;
+				candidate.mAccessTime = tmp->mAccessTime;
+				candidate.mLength = tmp->mLength;
+				candidates.push_back(candidate);
+			}
+		}
+	}
+
+	if (candidates.empty())
+	{
+		llwarns << "VFS: Can't make " << size << " bytes of free space in VFS, giving up" << llendl;
+		return FALSE;
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+
+	// Like LLVFS::findFreeBlock(): if the oldest file is big enough, it is
+	// the only one to go, otherwise clean out the oldest 5MB or enough to
+	// hold the file, whichever is larger.
+	S32 cleanup_target = (candidates.front().mLength >= size)
+		? size
+		: llmax(size, VFS_CLEANUP_SIZE);
+	if (cleanup_target > size)
+	{
+		llinfos << "VFS: LRU: Aggressive: " << (S32)candidates.size() << " files remain" << llendl;
+	}
+
+	S32 cleaned_up = 0;
+	S32 removed = 0;
+	for (std::vector<LRUCandidate>::iterator iter = candidates.begin();
+		 iter != candidates.end() && cleaned_up < cleanup_target;
+		 ++iter)
+	{
+		Shard& shard = getShard(iter->mSpec);
+		LLMutexLock lock(shard.mMutex);
+
+		// The file may have been touched, locked or removed since the snapshot.
+		fileblock_map::iterator it = shard.mFileBlocks.find(iter->mSpec);
+		if (it == shard.mFileBlocks.end())
+		{
+			continue;
+		}
+		LLVFSFileBlock* file_block = it->second;
+		if (file_block->mLength <= 0 ||
+			file_block->mAccessTime != iter->mAccessTime ||
+			file_block->mLocks[VFSLOCK_READ] ||
+			file_block->mLocks[VFSLOCK_APPEND] ||
+			file_block->mLocks[VFSLOCK_OPEN])
+		{
+			continue;
+		}
+
+		cleaned_up += file_block->mLength;
+		removeShardFileBlock(file_block);
+		removed++;
+	}
+
+	F32 time = timer.getElapsedTimeF32();
+	if (time > 0.5f)
+	{
+		llwarns << "VFS: Spent " << time << " seconds in evictLRU!" << llendl;
+	}
+
+	return removed > 0;
+}
+
+BOOL LLShardedVFS::getExists(const LLUUID &file_id, const LLAssetType::EType file_type)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock lock(shard.mMutex);
+
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it != shard.mFileBlocks.end())
+	{
+		LLVFSFileBlock *block = it->second;
+		block->mAccessTime = (U32)time(NULL);
+		return (block->mLength > 0) ? TRUE : FALSE;
+	}
+	return FALSE;
+}
+
+S32 LLShardedVFS::getSize(const LLUUID &file_id, const LLAssetType::EType file_type)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock lock(shard.mMutex);
+
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it != shard.mFileBlocks.end())
+	{
+		LLVFSFileBlock *block = it->second;
+		block->mAccessTime = (U32)time(NULL);
+		return block->mSize;
+	}
+	return 0;
+}
+
+S32 LLShardedVFS::getMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock lock(shard.mMutex);
+
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it != shard.mFileBlocks.end())
+	{
+		LLVFSFileBlock *block = it->second;
+		block->mAccessTime = (U32)time(NULL);
+		return block->mLength;
+	}
+	return 0;
+}
+
+BOOL LLShardedVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type, S32 max_size)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+	if (mReadOnly)
+	{
+		llerrs << "Attempt to write to read-only VFS" << llendl;
+	}
+	if (max_size <= 0)
+	{
+		llwarns << "VFS: Attempt to assign size " << max_size << " to vfile " << file_id << llendl;
+		return FALSE;
+	}
+
+	// round all sizes upward to KB increments, see LLVFS::setMaxSize()
+	if (file_type != LLAssetType::AT_TEXTURE)
+	{
+		if (max_size & FILE_BLOCK_MASK)
+		{
+			max_size += FILE_BLOCK_MASK;
+			max_size &= ~FILE_BLOCK_MASK;
+		}
+	}
+
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+
+	while (TRUE)
+	{
+		shard.mMutex->lock();
+
+		LLVFSFileBlock *block = NULL;
+		fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+		if (it != shard.mFileBlocks.end())
+		{
+			block = it->second;
+		}
+
+		if (block && block->mLength > 0)
+		{
+			block->mAccessTime = (U32)time(NULL);
+
+			if (max_size == block->mLength)
+			{
+				shard.mMutex->unlock();
+				return TRUE;
+			}
+			else if (max_size < block->mLength)
+			{
+				// this file is shrinking
+				lockData();
+				releaseSpace(new LLVFSBlock(block->mLocation + max_size, block->mLength - max_size));
+				block->mLength = max_size;
+				if (block->mLength < block->mSize)
+				{
+					llerrs << "Truncating virtual file " << file_id << " to " << block->mLength << " bytes" << llendl;
+					block->mSize = block->mLength;
+				}
+				sync(block);
+				unlockData();
+
+				shard.mMutex->unlock();
+				return TRUE;
+			}
+
+			// this file is growing
+			// first check for an adjacent free block to grow into
+			S32 size_increase = max_size - block->mLength;
+
+			lockData();
+			blocks_location_map_t::iterator iter = mFreeBlocksByLocation.upper_bound(block->mLocation);
+			if (iter != mFreeBlocksByLocation.end())
+			{
+				LLVFSBlock *free_block = iter->second;
+				if (free_block->mLocation == block->mLocation + block->mLength &&
+					free_block->mLength >= size_increase)
+				{
+					useFreeSpace(free_block, size_increase);
+					block->mLength += size_increase;
+					sync(block);
+					unlockData();
+
+					shard.mMutex->unlock();
+					return TRUE;
+				}
+			}
+			unlockData();
+
+			// no adjacent free block, move the file
+			U32 new_data_location = 0;
+			if (allocate(max_size, new_data_location))
+			{
+				// Copy before releasing the old range, another shard could
+				// allocate it as soon as it is back on the free lists.
+				if (block->mSize > 0)
+				{
+					std::vector<U8> buffer(block->mSize);
+					if (readData(block->mLocation, &buffer[0], block->mSize) != block->mSize ||
+						writeData(new_data_location, &buffer[0], block->mSize) != block->mSize)
+					{
+						llwarns << "Short copy relocating vfile " << file_id << llendl;
+					}
+				}
+
+				lockData();
+				releaseSpace(new LLVFSBlock(block->mLocation, block->mLength));
+				block->mLocation = new_data_location;
+				block->mLength = max_size;
+				sync(block);
+				unlockData();
+
+				shard.mMutex->unlock();
+				return TRUE;
+			}
+		}
+		else
+		{
+			// find a free block in the list
+			U32 new_data_location = 0;
+			if (allocate(max_size, new_data_location))
+			{
+				if (block)
+				{
+					block->mLocation = new_data_location;
+					block->mLength = max_size;
+				}
+				else
+				{
+					// this file doesn't exist, create it
+					block = new LLVFSFileBlock(file_id, file_type, new_data_location, max_size);
+					shard.mFileBlocks.insert(fileblock_map::value_type(spec, block));
+				}
+				block->mAccessTime = (U32)time(NULL);
+
+				lockData();
+				sync(block);
+				unlockData();
+
+				shard.mMutex->unlock();
+				return TRUE;
+			}
+		}
+
+		// Out of space.  Eviction visits every shard, so drop ours first.
+		BOOL had_block = (block && block->mLength > 0);
+		shard.mMutex->unlock();
+
+		if (!evictLRU(max_size, spec))
+		{
+			if (had_block)
+			{
+				llwarns << "VFS: No space (" << max_size << ") to resize existing vfile " << file_id << llendl;
+			}
+			else
+			{
+				llwarns << "VFS: No space (" << max_size << ") for new virtual file " << file_id << llendl;
+			}
+			dumpStatistics();
+			return FALSE;
+		}
+	}
+}
+
+// WARNING: HERE BE DRAGONS!  See LLVFS::renameFile().
+void LLShardedVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type,
+							  const LLUUID &new_id, const LLAssetType::EType &new_type)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+	if (mReadOnly)
+	{
+		llerrs << "Attempt to write to read-only VFS" << llendl;
+	}
+
+	LLVFSFileSpecifier new_spec(new_id, new_type);
+	LLVFSFileSpecifier old_spec(file_id, file_type);
+	S32 old_index = getShardIndex(old_spec);
+	S32 new_index = getShardIndex(new_spec);
+	Shard& old_shard = mShards[old_index];
+	Shard& new_shard = mShards[new_index];
+
+	// Always lock in ascending shard order.
+	mShards[llmin(old_index, new_index)].mMutex->lock();
+	if (old_index != new_index)
+	{
+		mShards[llmax(old_index, new_index)].mMutex->lock();
+	}
+
+	fileblock_map::iterator it = old_shard.mFileBlocks.find(old_spec);
+	if (it != old_shard.mFileBlocks.end())
+	{
+		LLVFSFileBlock *src_block = it->second;
+
+		// if there's something in the target location, remove it
+		fileblock_map::iterator new_it = new_shard.mFileBlocks.find(new_spec);
+		if (new_it != new_shard.mFileBlocks.end())
+		{
+			LLVFSFileBlock *dest_block = new_it->second;
+			removeShardFileBlock(dest_block);
+
+			for (S32 i = 0; i < (S32)VFSLOCK_COUNT; i++)
+			{
+				if (dest_block->mLocks[i])
+				{
+					llerrs << "Renaming VFS block to a locked file." << llendl;
+				}
+				dest_block->mLocks[i] = src_block->mLocks[i];
+			}
+
+			new_shard.mFileBlocks.erase(new_it);
+			delete dest_block;
+		}
+
+		src_block->mFileID = new_id;
+		src_block->mFileType = new_type;
+		src_block->mAccessTime = (U32)time(NULL);
+
+		old_shard.mFileBlocks.erase(old_spec);
+		new_shard.mFileBlocks.insert(fileblock_map::value_type(new_spec, src_block));
+
+		lockData();
+		sync(src_block);
+		unlockData();
+	}
+	else
+	{
+		llwarns << "VFS: Attempt to rename nonexistent vfile " << file_id << ":" << file_type << llendl;
+	}
+
+	if (old_index != new_index)
+	{
+		mShards[llmax(old_index, new_index)].mMutex->unlock();
+	}
+	mShards[llmin(old_index, new_index)].mMutex->unlock();
+}
+
+void LLShardedVFS::removeFile(const LLUUID &file_id, const LLAssetType::EType file_type)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+	if (mReadOnly)
+	{
+		llerrs << "Attempt to write to read-only VFS" << llendl;
+	}
+
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock lock(shard.mMutex);
+
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it != shard.mFileBlocks.end())
+	{
+		removeShardFileBlock(it->second);
+	}
+	else
+	{
+		llwarns << "VFS: attempting to remove nonexistent file " << file_id << " type " << file_type << llendl;
+	}
+}
+
+S32 LLShardedVFS::getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8 *buffer, S32 location, S32 length)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+	llassert(location >= 0);
+	llassert(length >= 0);
+
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock lock(shard.mMutex);
+
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it == shard.mFileBlocks.end())
+	{
+		return 0;
+	}
+
+	LLVFSFileBlock *block = it->second;
+	block->mAccessTime = (U32)time(NULL);
+
+	if (location > block->mSize)
+	{
+		llwarns << "VFS: Attempt to read location " << location << " in file " << file_id << " of length " << block->mSize << llendl;
+		return 0;
+	}
+
+	if (length > block->mSize - location)
+	{
+		length = block->mSize - location;
+	}
+	return readData(block->mLocation + location, buffer, length);
+}
+
+S32 LLShardedVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type, const U8 *buffer, S32 location, S32 length)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+	if (mReadOnly)
+	{
+		llerrs << "Attempt to write to read-only VFS" << llendl;
+	}
+
+	llassert(length > 0);
+
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock lock(shard.mMutex);
+
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it == shard.mFileBlocks.end())
+	{
+		return 0;
+	}
+
+	LLVFSFileBlock *block = it->second;
+
+	S32 in_loc = location;
+	if (location == -1)
+	{
+		location = block->mSize;
+	}
+	llassert(location >= 0);
+
+	block->mAccessTime = (U32)time(NULL);
+
+	if (block->mLength == BLOCK_LENGTH_INVALID)
+	{
+		// Block was removed, ignore write
+		llwarns << "VFS: Attempt to write to invalid block"
+				<< " in file " << file_id
+				<< " location: " << in_loc
+				<< " bytes: " << length
+				<< llendl;
+		return length;
+	}
+	else if (location > block->mLength)
+	{
+		llwarns << "VFS: Attempt to write to location " << location
+				<< " in file " << file_id
+				<< " type " << S32(file_type)
+				<< " of size " << block->mSize
+				<< " block length " << block->mLength
+				<< llendl;
+		return length;
+	}
+
+	if (length > block->mLength - location)
+	{
+		llwarns << "VFS: Truncating write to virtual file " << file_id << " type " << S32(file_type) << llendl;
+		length = block->mLength - location;
+	}
+
+	S32 write_len = writeData(block->mLocation + location, buffer, length);
+	if (write_len != length)
+	{
+		llwarns << llformat("VFS Write Error: %d != %d",write_len,length) << llendl;
+	}
+
+	if (location + length > block->mSize)
+	{
+		block->mSize = location + write_len;
+		lockData();
+		sync(block);
+		unlockData();
+	}
+
+	return write_len;
+}
+
+void LLShardedVFS::incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
+{
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock shard_lock(shard.mMutex);
+
+	LLVFSFileBlock *block;
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it != shard.mFileBlocks.end())
+	{
+		block = it->second;
+	}
+	else
+	{
+		// Create a dummy block which isn't saved
+		block = new LLVFSFileBlock(file_id, file_type, 0, BLOCK_LENGTH_INVALID);
+		block->mAccessTime = (U32)time(NULL);
+		shard.mFileBlocks.insert(fileblock_map::value_type(spec, block));
+	}
+
+	block->mLocks[lock]++;
+	mLockCounts[lock]++;
+}
+
+void LLShardedVFS::decLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
+{
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock shard_lock(shard.mMutex);
+
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it != shard.mFileBlocks.end())
+	{
+		LLVFSFileBlock *block = it->second;
+
+		if (block->mLocks[lock] > 0)
+		{
+			block->mLocks[lock]--;
+		}
+		else
+		{
+			llwarns << "VFS: Decrementing zero-value lock " << lock << llendl;
+		}
+		mLockCounts[lock]--;
+	}
+}
+
+BOOL LLShardedVFS::isLocked(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
+{
+	LLVFSFileSpecifier spec(file_id, file_type);
+	Shard& shard = getShard(spec);
+	LLMutexLock shard_lock(shard.mMutex);
+
+	fileblock_map::iterator it = shard.mFileBlocks.find(spec);
+	if (it != shard.mFileBlocks.end())
+	{
+		return (it->second->mLocks[lock] > 0);
+	}
+	return FALSE;
+}
+
+//============================================================================
+// debugging
+//============================================================================
+
+void LLShardedVFS::gatherFileBlocks()
+{
+	for (S32 i = 0; i < SHARD_COUNT; i++)
+	{
+		mShards[i].mMutex->lock();
+		mFileBlocks.insert(mShards[i].mFileBlocks.begin(), mShards[i].mFileBlocks.end());
+	}
+}
+
+void LLShardedVFS::releaseFileBlocks()
+{
+	mFileBlocks.clear();
+	for (S32 i = SHARD_COUNT - 1; i >= 0; i--)
+	{
+		mShards[i].mMutex->unlock();
+	}
+}
+
+void LLShardedVFS::audit()
+{
+	gatherFileBlocks();
+	LLVFS::audit();
+	releaseFileBlocks();
+}
+
+void LLShardedVFS::checkMem()
+{
+	gatherFileBlocks();
+	LLVFS::checkMem();
+	releaseFileBlocks();
+}
+
+void LLShardedVFS::dumpMap()
+{
+	gatherFileBlocks();
+	LLVFS::dumpMap();
+	releaseFileBlocks();
+}
+
+void LLShardedVFS::dumpStatistics()
+{
+	gatherFileBlocks();
+	LLVFS::dumpStatistics();
+	releaseFileBlocks();
+}
+
+void LLShardedVFS::listFiles()
+{
+	gatherFileBlocks();
+	LLVFS::listFiles();
+	releaseFileBlocks();
+}
+
+void LLShardedVFS::dumpFiles()
+{
+	// LLVFS::dumpFiles() calls back into getData(), so collect the file
+	// list first and read each file with no shard held.
+	std::vector<std::pair<LLVFSFileSpecifier, S32> > files;
+	for (S32 i = 0; i < SHARD_COUNT; i++)
+	{
+		LLMutexLock lock(mShards[i].mMutex);
+		for (fileblock_map::iterator it = mShards[i].mFileBlocks.begin(); it != mShards[i].mFileBlocks.end(); ++it)
+		{
+			LLVFSFileBlock *file_block = it->second;
+			if (file_block->mLength != BLOCK_LENGTH_INVALID && file_block->mSize > 0)
+			{
+				files.push_back(std::make_pair(it->first, file_block->mSize));
+			}
+		}
+	}
+
+	S32 files_extracted = 0;
+	for (std::vector<std::pair<LLVFSFileSpecifier, S32> >::iterator iter = files.begin();
+		 iter != files.end(); ++iter)
+	{
+		const LLVFSFileSpecifier& file_spec = iter->first;
+		S32 size = iter->second;
+		std::vector<U8> buffer(size);
+		size = getData(file_spec.mFileID, file_spec.mFileType, &buffer[0], 0, size);
+		if (size <= 0)
+		{
+			continue;
+		}
+
+		std::string filename = file_spec.mFileID.asString() + get_extension(file_spec.mFileType);
+		llinfos << " Writing " << filename << llendl;
+
+		LLAPRFile outfile;
+		outfile.open(filename, LL_APR_WB);
+		outfile.write(&buffer[0], size);
+		outfile.close();
+
+		files_extracted++;
+	}
+
+	llinfos << "Extracted " << files_extracted << " files out of " << (S32)files.size() << llendl;
+}
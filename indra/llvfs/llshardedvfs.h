@@ -0,0 +1,143 @@
+/**
+ * @file llshardedvfs.h
+ * @brief Lock-striped virtual file system backed by a memory-mapped data file
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLSHARDEDVFS_H
+#define LL_LLSHARDEDVFS_H
+
+#include "llvfs.h"
+
+// LLShardedVFS uses the same on-disk format as LLVFS, but partitions the
+// file index by hash of LLVFSFileSpecifier into independently locked shards.
+// mDataMutex only guards the free lists and the index file, and is held just
+// long enough to allocate, free or sync a block.  File data is read and
+// written through a memory mapping of the data file, so readers of
+// different files never queue up behind each other.
+//
+// Lock order is always shard(s) -> mDataMutex.  Shards are locked in
+// ascending index order when more than one is needed (renameFile and the
+// debug dumps).  LRU eviction never holds more than one shard lock.
+//
+// Use LLVFS::createLLVFS(..., sharded = TRUE) to create one.
+class LLShardedVFS : public LLVFS
+{
+	friend class LLVFS;
+protected:
+	LLShardedVFS(const std::string& index_filename,
+			const std::string& data_filename,
+			const BOOL read_only,
+			const U32 presize,
+			const BOOL remove_after_crash);
+public:
+	/*virtual*/ ~LLShardedVFS();
+
+	// ---------- The following functions lock/unlock one shard ----------
+	/*virtual*/ BOOL getExists(const LLUUID &file_id, const LLAssetType::EType file_type);
+	/*virtual*/ S32	 getSize(const LLUUID &file_id, const LLAssetType::EType file_type);
+
+	/*virtual*/ S32  getMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type);
+	/*virtual*/ BOOL setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type, S32 max_size);
+
+	/*virtual*/ void renameFile(const LLUUID &file_id, const LLAssetType::EType file_type,
+		const LLUUID &new_id, const LLAssetType::EType &new_type);
+	/*virtual*/ void removeFile(const LLUUID &file_id, const LLAssetType::EType file_type);
+
+	/*virtual*/ S32 getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8 *buffer, S32 location, S32 length);
+	/*virtual*/ S32 storeData(const LLUUID &file_id, const LLAssetType::EType file_type, const U8 *buffer, S32 location, S32 length);
+
+	/*virtual*/ void incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
+	/*virtual*/ void decLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
+	/*virtual*/ BOOL isLocked(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
+	// ----------------------------------------------------------------
+
+	// Debugging functions.  These lock every shard for their duration.
+	/*virtual*/ void audit();
+	/*virtual*/ void checkMem();
+	/*virtual*/ void dumpMap();
+	/*virtual*/ void dumpStatistics();
+	/*virtual*/ void listFiles();
+	/*virtual*/ void dumpFiles();
+
+	// TRUE if file data is served from a memory mapping rather than stdio.
+	BOOL isMapped() const			{ return mMappedData != NULL; }
+
+	enum { SHARD_COUNT = 32 };		// must be a power of two
+
+protected:
+	struct Shard
+	{
+		LLMutex*		mMutex;
+		fileblock_map	mFileBlocks;
+	};
+
+	S32 getShardIndex(const LLVFSFileSpecifier& spec) const
+	{
+		return (S32)((spec.mFileID.getCRC32() ^ (U32)spec.mFileType) & (SHARD_COUNT - 1));
+	}
+	Shard& getShard(const LLVFSFileSpecifier& spec) { return mShards[getShardIndex(spec)]; }
+
+	void mapDataFile();
+	void unmapDataFile();
+
+	// Copy between the data file and memory. Caller must hold the shard
+	// lock of the file that owns the range.
+	S32 readData(U32 location, U8* buffer, S32 length);
+	S32 writeData(U32 location, const U8* buffer, S32 length);
+
+	// Take length bytes from the free lists, locks mDataMutex.
+	// Returns FALSE if no single free block is large enough.
+	BOOL allocate(S32 length, U32& location);
+
+	// Moves through the mapping, or stdio under mFileMutex.
+	/*virtual*/ BOOL moveData(U32 src_location, U32 dst_location, S32 length);
+	// msync the mapping, or fflush under mFileMutex.
+	/*virtual*/ void flushData();
+	// Locks the file's shard, then mDataMutex.
+	/*virtual*/ BOOL relocateForCompaction(const LLVFSFileSpecifier& spec, U32 free_location);
+
+	// Shard lock must be held; locks mDataMutex.
+	void removeShardFileBlock(LLVFSFileBlock* block);
+
+	// Evict least recently used unlocked files until at least size
+	// bytes have been returned to the free lists.  Must be called with
+	// no shard locks held.  Returns FALSE if nothing could be evicted.
+	BOOL evictLRU(S32 size, const LLVFSFileSpecifier& immune);
+
+	// Lock every shard and expose all file blocks through mFileBlocks
+	// so the LLVFS debugging functions can run unchanged.
+	void gatherFileBlocks();
+	void releaseFileBlocks();
+
+protected:
+	Shard	mShards[SHARD_COUNT];
+
+	U8*		mMappedData;
+	U32		mMappedSize;
+
+	// Serializes stdio access to mDataFP when the data file can't be mapped.
+	LLMutex* mFileMutex;
+};
+
+#endif // LL_LLSHARDEDVFS_H
@@ -40,44 +40,15 @@
 #endif
     
 #include "llvfs.h"
+#include "llvfsblock.h"
+#include "llshardedvfs.h"
 
+#include "llcrc.h"
 #include "llstl.h"
 #include "lltimer.h"
     
-const S32 FILE_BLOCK_MASK = 0x000003FF;	 // 1024-byte blocks
-const S32 VFS_CLEANUP_SIZE = 5242880;  // how much space we free up in a single stroke
-const S32 BLOCK_LENGTH_INVALID = -1;	// mLength for invalid LLVFSFileBlocks
-
 LLVFS *gVFS = NULL;
 
-// internal class definitions
-class LLVFSBlock
-{
-public:
-	LLVFSBlock() 
-	{
-		mLocation = 0;
-		mLength = 0;
-	}
-    
-	LLVFSBlock(U32 loc, S32 size)
-	{
-		mLocation = loc;
-		mLength = size;
-	}
-    
-	static bool locationSortPredicate(
-		const LLVFSBlock* lhs,
-		const LLVFSBlock* rhs)
-	{
-		return lhs->mLocation < rhs->mLocation;
-	}
-
-public:
-	U32 mLocation;
-	S32	mLength;		// allocated block size
-};
-    
 LLVFSFileSpecifier::LLVFSFileSpecifier()
 :	mFileID(),
 	mFileType( LLAssetType::AT_NONE )
@@ -102,137 +73,25 @@ bool LLVFSFileSpecifier::operator==(const LLVFSFileSpecifier &rhs) const
 	return (mFileID == rhs.mFileID && 
 			mFileType == rhs.mFileType);
 }
-    
-    
-class LLVFSFileBlock : public LLVFSBlock, public LLVFSFileSpecifier
-{
-public:
-	LLVFSFileBlock() : LLVFSBlock(), LLVFSFileSpecifier()
-	{
-		init();
-	}
-    
-	LLVFSFileBlock(const LLUUID &file_id, LLAssetType::EType file_type, U32 loc = 0, S32 size = 0)
-		: LLVFSBlock(loc, size), LLVFSFileSpecifier( file_id, file_type )
-	{
-		init();
-	}
-
-	void init()
-	{
-		mSize = 0;
-		mIndexLocation = -1;
-		mAccessTime = (U32)time(NULL);
 
-		for (S32 i = 0; i < (S32)VFSLOCK_COUNT; i++)
-		{
-			mLocks[(EVFSLock)i] = 0;
-		}
-	}
-
-	#ifdef LL_LITTLE_ENDIAN
-	inline void swizzleCopy(void *dst, void *src, int size) { memcpy(dst, src, size); /* Flawfinder: ignore */}
-
-	#else
-	
-	inline U32 swizzle32(U32 x)
-	{
-		return(((x >> 24) & 0x000000FF) | ((x >> 8)  & 0x0000FF00) | ((x << 8)  & 0x00FF0000) |((x << 24) & 0xFF000000));
-	}
-	
-	inline U16 swizzle16(U16 x)
-	{
-		return(	((x >> 8)  & 0x000000FF) | ((x << 8)  & 0x0000FF00) );
-	}
-	
-	inline void swizzleCopy(void *dst, void *src, int size) 
-	{
-		if(size == 4)
-		{
-			((U32*)dst)[0] = swizzle32(((U32*)src)[0]); 
-		}
-		else if(size == 2)
-		{
-			((U16*)dst)[0] = swizzle16(((U16*)src)[0]); 
-		}
-		else
-		{
-			// Perhaps this should assert...
-			memcpy(dst, src, size);	/* Flawfinder: ignore */
-		}
-	}
-	
-	#endif
-
-	void serialize(U8 *buffer)
-	{
-		swizzleCopy(buffer, &mLocation, 4);
-		buffer += 4;
-		swizzleCopy(buffer, &mLength, 4);
-		buffer +=4;
-		swizzleCopy(buffer, &mAccessTime, 4);
-		buffer +=4;
-		memcpy(buffer, &mFileID.mData, 16); /* Flawfinder: ignore */	
-		buffer += 16;
-		S16 temp_type = mFileType;
-		swizzleCopy(buffer, &temp_type, 2);
-		buffer += 2;
-		swizzleCopy(buffer, &mSize, 4);
-	}
-    
-	void deserialize(U8 *buffer, const S32 index_loc)
-	{
-		mIndexLocation = index_loc;
-    
-		swizzleCopy(&mLocation, buffer, 4);
-		buffer += 4;
-		swizzleCopy(&mLength, buffer, 4);
-		buffer += 4;
-		swizzleCopy(&mAccessTime, buffer, 4);
-		buffer += 4;
-		memcpy(&mFileID.mData, buffer, 16);
-		buffer += 16;
-		S16 temp_type;
-		swizzleCopy(&temp_type, buffer, 2);
-		mFileType = (LLAssetType::EType)temp_type;
-		buffer += 2;
-		swizzleCopy(&mSize, buffer, 4);
-	}
-    
-	static BOOL insertLRU(LLVFSFileBlock* const& first,
-						  LLVFSFileBlock* const& second)
-	{
-		return (first->mAccessTime == second->mAccessTime)
-			? *first < *second
-			: first->mAccessTime < second->mAccessTime;
-	}
-    
-public:
-	S32  mSize;
-	S32  mIndexLocation; // location of index entry
-	U32  mAccessTime;
-	BOOL mLocks[VFSLOCK_COUNT]; // number of outstanding locks of each type
-    
-	static const S32 SERIAL_SIZE;
-};
+const S32 LLVFSFileBlock::SERIAL_SIZE = 34;
 
-// Helper structure for doing lru w/ stl... is there a simpler way?
-struct LLVFSFileBlock_less
+bool LLVFS::LLVFSBlockLocationLess::operator()(const LLVFSBlock* lhs, const LLVFSBlock* rhs) const
 {
-	bool operator()(LLVFSFileBlock* const& lhs, LLVFSFileBlock* const& rhs) const
-	{
-		return (LLVFSFileBlock::insertLRU(lhs, rhs)) ? true : false;
-	}
-};
-
-
-const S32 LLVFSFileBlock::SERIAL_SIZE = 34;
+	return lhs->mLocation < rhs->mLocation;
+}
      
 
 LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash)
 :	mRemoveAfterCrash(remove_after_crash),
 	mDataFP(NULL),
-	mIndexFP(NULL)
+	mIndexFP(NULL),
+	mFreeSizeClassMask(0),
+	mFreeBytes(0),
+	mCompactCursor(0),
+	mJournalFP(NULL),
+	mJournalRecordCount(0),
+	mIndexEnd(0)
 {
 	mDataMutex = new LLMutex(0);
 
@@ -245,6 +104,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 	mReadOnly = read_only;
 	mIndexFilename = index_filename;
 	mDataFilename = data_filename;
+	mJournalFilename = index_filename + ".journal";
     
 	const char *file_mode = mReadOnly ? "rb" : "r+b";
     
@@ -267,6 +127,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 			// Since we're creating this data file, assume any index file is bogus
 			// remove the index, since this vfs is now blank
 			LLFile::remove(mIndexFilename);
+			LLFile::remove(mJournalFilename);
 		}
 		else
 		{
@@ -283,8 +144,10 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 	}
 
 	// Did we leave this file open for writing last time?
-	// If so, close it and start over.
-	if (!mReadOnly && mRemoveAfterCrash)
+	// If so, close it and start over, unless it was journaled.
+	llstat journal_info;
+	BOOL have_journal = !mReadOnly && !LLFile::stat(mJournalFilename, &journal_info);
+	if (!mReadOnly && mRemoveAfterCrash && !have_journal)
 	{
 		llstat marker_info;
 		std::string marker = mDataFilename + ".open";
@@ -314,6 +177,12 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 		}
 	}
 
+	// Bring the index up to date with anything journaled before a crash
+	if (have_journal)
+	{
+		replayJournal();
+	}
+
 	// determine the real file size
 	fseek(mDataFP, 0, SEEK_END);
 	U32 data_size = ftell(mDataFP);
@@ -552,6 +421,12 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 		}
 	}
 
+	// Index allocated files by location for compaction.
+	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	{
+		updateLocationIndex(it->second, FALSE);
+	}
+
 	LL_INFOS("VFS") << "Using VFS index file " << mIndexFilename << LL_ENDL;
 	LL_INFOS("VFS") << "Using VFS data file " << mDataFilename << LL_ENDL;
 
@@ -564,6 +439,8 @@ LLVFS::~LLVFS()
 	{
 		LL_ERRS("VFS") << "LLVFS destroyed with mutex locked" << LL_ENDL;
 	}
+
+	closeJournal();
 	
 	unlockAndClose(mIndexFP);
 	mIndexFP = NULL;
@@ -574,8 +451,12 @@ LLVFS::~LLVFS()
 		delete (*it).second;
 	}
 	mFileBlocks.clear();
+	mFileBlocksByLocation.clear();
 	
-	mFreeBlocksByLength.clear();
+	for (S32 i = 0; i < FREE_SIZE_CLASS_COUNT; i++)
+	{
+		mFreeBlocksBySizeClass[i].clear();
+	}
 
 	for_each(mFreeBlocksByLocation.begin(), mFreeBlocksByLocation.end(), DeletePairedPointer());
     
@@ -600,9 +481,12 @@ LLVFS * LLVFS::createLLVFS(const std::string& index_filename,
 		const std::string& data_filename, 
 		const BOOL read_only, 
 		const U32 presize, 
-		const BOOL remove_after_crash)
+		const BOOL remove_after_crash,
+		const BOOL sharded)
 {
-	LLVFS * new_vfs = new LLVFS(index_filename, data_filename, read_only, presize, remove_after_crash);
+	LLVFS * new_vfs = sharded
+		? new LLShardedVFS(index_filename, data_filename, read_only, presize, remove_after_crash)
+		: new LLVFS(index_filename, data_filename, read_only, presize, remove_after_crash);
 
 	if( !new_vfs->isValid() )
 	{	// First name failed, retry with new names
@@ -616,7 +500,9 @@ LLVFS * LLVFS::createLLVFS(const std::string& index_filename,
 			retry_vfs_data_name = data_filename + llformat(".%u", count);
 
 			delete new_vfs;	// Delete bad VFS and try again
-			new_vfs = new LLVFS(retry_vfs_index_name, retry_vfs_data_name, read_only, presize, remove_after_crash);
+			new_vfs = sharded
+				? new LLShardedVFS(retry_vfs_index_name, retry_vfs_data_name, read_only, presize, remove_after_crash)
+				: new LLVFS(retry_vfs_index_name, retry_vfs_data_name, read_only, presize, remove_after_crash);
 
 			count++;
 		}
@@ -743,8 +629,7 @@ BOOL LLVFS::checkAvailable(S32 max_size)
 {
 	lockData();
 	
-	blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(max_size); // first entry >= size
-	const BOOL res(iter == mFreeBlocksByLength.end() ? FALSE : TRUE);
+	const BOOL res(findFreeSpace(max_size) ? TRUE : FALSE);
 
 	unlockData();
 	
@@ -803,7 +688,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			// this file is shrinking
 			LLVFSBlock *free_block = new LLVFSBlock(block->mLocation + max_size, block->mLength - max_size);
 
-			addFreeBlock(free_block);
+			releaseSpace(free_block);
     
 			block->mLength = max_size;
     
@@ -866,23 +751,12 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 					// create a new free block where this file used to be
 					LLVFSBlock *new_free_block = new LLVFSBlock(block->mLocation, block->mLength);
 
-					addFreeBlock(new_free_block);
+					releaseSpace(new_free_block);
 					
 					if (block->mSize > 0)
 					{
 						// move the file into the new block
-						std::vector<U8> buffer(block->mSize);
-						fseek(mDataFP, block->mLocation, SEEK_SET);
-						if (fread(&buffer[0], block->mSize, 1, mDataFP) == 1)
-						{
-							fseek(mDataFP, new_data_location, SEEK_SET);
-							if (fwrite(&buffer[0], block->mSize, 1, mDataFP) != 1)
-							{
-								llwarns << "Short write" << llendl;
-							}
-						} else {
-							llwarns << "Short read" << llendl;
-						}
+						moveData(block->mLocation, new_data_location, block->mSize);
 					}
 				}
     
@@ -1026,7 +900,7 @@ void LLVFS::removeFileBlock(LLVFSFileBlock *fileblock)
 		// turn this file into an empty block
 		LLVFSBlock *free_block = new LLVFSBlock(fileblock->mLocation, fileblock->mLength);
 		
-		addFreeBlock(free_block);
+		releaseSpace(free_block);
 	}
 	
 	fileblock->mLocation = 0;
@@ -1274,31 +1148,80 @@ BOOL LLVFS::isLocked(const LLUUID &file_id, const LLAssetType::EType file_type,
 // protected
 //============================================================================
 
-void LLVFS::eraseBlockLength(LLVFSBlock *block)
+// static
+S32 LLVFS::getSizeClass(S32 length)
 {
-	// find the corresponding map entry in the length map and erase it
-	S32 length = block->mLength;
-	blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(length);
-	blocks_length_map_t::iterator end = mFreeBlocksByLength.end();
-	bool found_block = false;
-	while(iter != end)
-	{
-		LLVFSBlock *tblock = iter->second;
-		llassert(tblock->mLength == length); // there had -better- be an entry with our length!
-		if (tblock == block)
-		{
-			mFreeBlocksByLength.erase(iter);
-			found_block = true;
-			break;
-		}
-		++iter;
+	llassert(length > 0);
+	U32 bits = (U32)length;
+	S32 size_class = 0;
+	while (bits >>= 1)
+	{
+		size_class++;
 	}
-	if(!found_block)
+	return size_class;
+}
+
+// Add block to the size class free list.
+void LLVFS::insertBlockLength(LLVFSBlock *block)
+{
+	S32 size_class = getSizeClass(block->mLength);
+	mFreeBlocksBySizeClass[size_class].insert(block);
+	mFreeSizeClassMask |= (1U << size_class);
+	mFreeBytes += block->mLength;
+}
+
+// Remove block from the size class free list.  Must be called before
+// changing the block's location or length.
+void LLVFS::eraseBlockLength(LLVFSBlock *block)
+{
+	S32 size_class = getSizeClass(block->mLength);
+	blocks_size_class_t& free_list = mFreeBlocksBySizeClass[size_class];
+	if (free_list.erase(block) != 1)
 	{
 		llerrs << "eraseBlock could not find block" << llendl;
 	}
+	if (free_list.empty())
+	{
+		mFreeSizeClassMask &= ~(1U << size_class);
+	}
+	mFreeBytes -= block->mLength;
 }
 
+// mDataMutex must be LOCKED before calling this
+LLVFSBlock *LLVFS::findFreeSpace(S32 size)
+{
+	if (size <= 0)
+	{
+		return NULL;
+	}
+	S32 size_class = getSizeClass(size);
+
+	// Every block in a larger class fits, take the lowest address
+	// in the smallest such class.
+	U32 larger = (size_class + 1 < FREE_SIZE_CLASS_COUNT)
+		? mFreeSizeClassMask & ~((2U << size_class) - 1)
+		: 0;
+	if (larger)
+	{
+		S32 fit_class = size_class + 1;
+		while (!(larger & (1U << fit_class)))
+		{
+			fit_class++;
+		}
+		return *mFreeBlocksBySizeClass[fit_class].begin();
+	}
+
+	// Otherwise first fit within size's own class.
+	blocks_size_class_t& free_list = mFreeBlocksBySizeClass[size_class];
+	for (blocks_size_class_t::iterator iter = free_list.begin(); iter != free_list.end(); ++iter)
+	{
+		if ((*iter)->mLength >= size)
+		{
+			return *iter;
+		}
+	}
+	return NULL;
+}
 
 // Remove block from both free lists (by location and by length).
 void LLVFS::eraseBlock(LLVFSBlock *block)
@@ -1353,7 +1276,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		eraseBlockLength(prev_block);
 		eraseBlock(next_block);
 		prev_block->mLength += block->mLength + next_block->mLength;
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(prev_block->mLength, prev_block));
+		insertBlockLength(prev_block);
 		delete block;
 		block = NULL;
 		delete next_block;
@@ -1366,7 +1289,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		// therefore only need to update the length map. JC
 		eraseBlockLength(prev_block);
 		prev_block->mLength += block->mLength;
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(prev_block->mLength, prev_block)); // multimap insert
+		insertBlockLength(prev_block);
 		delete block;
 		block = NULL;
 	}
@@ -1380,7 +1303,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		next_block->mLength += block->mLength;
 		// Don't hint here, next_free_it iterator may be invalid.
 		mFreeBlocksByLocation.insert(blocks_location_map_t::value_type(next_block->mLocation, next_block)); // multimap insert
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(next_block->mLength, next_block)); // multimap insert			
+		insertBlockLength(next_block);
 		delete block;
 		block = NULL;
 	}
@@ -1389,7 +1312,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		// Can't merge with other free blocks.
 		// Hint that insert should go near next_free_it.
  		mFreeBlocksByLocation.insert(next_free_it, blocks_location_map_t::value_type(block->mLocation, block)); // multimap insert
- 		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(block->mLength, block)); // multimap insert
+ 		insertBlockLength(block);
 	}
 }
 
@@ -1418,7 +1341,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 // 			// merge first_block with second_block, since they're adjacent
 // 			first_block->mLength += second_block->mLength;
 // 			// add the first block to the length map (with the new size)
-// 			mFreeBlocksByLength.insert(blocks_length_map_t::value_type(first_block->mLength, first_block)); // multimap insert
+// 			insertBlockLength(first_block);
 //
 // 			// erase and delete the second block
 // 			eraseBlock(second_block);
@@ -1475,6 +1398,8 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 		llerrs << "VFS syncing zero-length block" << llendl;
 	}
 
+	updateLocationIndex(block, remove);
+
     BOOL set_index_to_end = FALSE;
 	long seek_pos = block->mIndexLocation;
 		
@@ -1485,6 +1410,12 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 			seek_pos = mIndexHoles.front();
 			mIndexHoles.pop_front();
 		}
+		else if (mJournalFP)
+		{
+			// Records may be appended faster than they reach the index file
+			seek_pos = mIndexEnd;
+			mIndexEnd += LLVFSFileBlock::SERIAL_SIZE;
+		}
 		else
 		{
 			set_index_to_end = TRUE;
@@ -1515,6 +1446,13 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 		block->serialize(buffer);
 	}
 
+	if (mJournalFP)
+	{
+		// Batched up by writeJournal(), only the latest record per slot matters
+		mPendingIndexRecords[seek_pos].assign(buffer, buffer + LLVFSFileBlock::SERIAL_SIZE);
+		return;
+	}
+
 	// If set_index_to_end, file pointer is already at seek_pos
 	// and we don't need to do anything.  Only seek if not at end.
 	if (!set_index_to_end)
@@ -1533,6 +1471,248 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 	return;
 }
 
+// mDataMutex must be LOCKED before calling this
+void LLVFS::updateLocationIndex(LLVFSFileBlock *block, BOOL remove)
+{
+	if (block->mLocationIndexed)
+	{
+		// Another file may already have been given this location,
+		// only drop the entry if it is still ours.
+		fileblock_location_map_t::iterator it = mFileBlocksByLocation.find(block->mIndexedLocation);
+		if (it != mFileBlocksByLocation.end() && it->second.mBlock == block)
+		{
+			mFileBlocksByLocation.erase(it);
+		}
+		block->mLocationIndexed = FALSE;
+	}
+
+	if (!remove && block->mLength > 0)
+	{
+		LLVFSLocationEntry& entry = mFileBlocksByLocation[block->mLocation];
+		entry.mBlock = block;
+		entry.mSpec = LLVFSFileSpecifier(block->mFileID, block->mFileType);
+		entry.mLength = block->mLength;
+		block->mLocationIndexed = TRUE;
+		block->mIndexedLocation = block->mLocation;
+	}
+}
+
+// mDataMutex must be LOCKED before calling this
+void LLVFS::releaseSpace(LLVFSBlock *block)
+{
+	if (mJournalFP)
+	{
+		// The index on disk may still say a file lives here until the
+		// journal is committed, so don't let anything overwrite it yet.
+		mUncommittedFreeBlocks.push_back(block);
+	}
+	else
+	{
+		addFreeBlock(block);
+	}
+}
+
+// mDataMutex must be LOCKED before calling this
+void LLVFS::flushData()
+{
+	fflush(mDataFP);
+}
+
+// mDataMutex must be LOCKED before calling this
+void LLVFS::writeJournal()
+{
+	if (!mJournalFP)
+	{
+		return;
+	}
+
+	if (!mPendingIndexRecords.empty())
+	{
+		// Data first, so a committed record never points at unwritten data
+		flushData();
+
+		const S32 record_size = sizeof(S32) + LLVFSFileBlock::SERIAL_SIZE;
+		const U32 count = (U32)mPendingIndexRecords.size();
+		std::vector<U8> batch(VFS_JOURNAL_HEADER_SIZE + count * record_size);
+
+		U8 *cur = &batch[VFS_JOURNAL_HEADER_SIZE];
+		for (index_record_map_t::iterator it = mPendingIndexRecords.begin(); it != mPendingIndexRecords.end(); ++it)
+		{
+			memcpy(cur, &it->first, sizeof(S32));		/* Flawfinder: ignore */
+			memcpy(cur + sizeof(S32), &it->second[0], LLVFSFileBlock::SERIAL_SIZE);		/* Flawfinder: ignore */
+			cur += record_size;
+			mJournaledIndexRecords[it->first].swap(it->second);
+		}
+		mPendingIndexRecords.clear();
+
+		LLCRC crc;
+		crc.update(&batch[VFS_JOURNAL_HEADER_SIZE], count * record_size);
+		U32 header[3] = { VFS_JOURNAL_MAGIC, count, crc.getCRC() };
+		memcpy(&batch[0], header, VFS_JOURNAL_HEADER_SIZE);		/* Flawfinder: ignore */
+
+		if (fwrite(&batch[0], batch.size(), 1, mJournalFP) != 1)
+		{
+			llwarns << "Short write" << llendl;
+		}
+		fflush(mJournalFP);
+		mJournalRecordCount += count;
+	}
+
+	// Space freed by the records just committed can be reused now
+	for (std::vector<LLVFSBlock*>::iterator it = mUncommittedFreeBlocks.begin(); it != mUncommittedFreeBlocks.end(); ++it)
+	{
+		addFreeBlock(*it);
+	}
+	mUncommittedFreeBlocks.clear();
+}
+
+// mDataMutex must be LOCKED before calling this
+void LLVFS::checkpointJournal()
+{
+	if (!mJournalFP)
+	{
+		return;
+	}
+
+	writeJournal();
+	if (mJournaledIndexRecords.empty())
+	{
+		return;
+	}
+
+	// In index order, so this is one pass over the file
+	for (index_record_map_t::iterator it = mJournaledIndexRecords.begin(); it != mJournaledIndexRecords.end(); ++it)
+	{
+		fseek(mIndexFP, it->first, SEEK_SET);
+		if (fwrite(&it->second[0], LLVFSFileBlock::SERIAL_SIZE, 1, mIndexFP) != 1)
+		{
+			llwarns << "Short write" << llendl;
+		}
+	}
+	fflush(mIndexFP);
+	mJournaledIndexRecords.clear();
+
+	// Everything is in the index now, start over with an empty journal
+	fclose(mJournalFP);
+	mJournalRecordCount = 0;
+	mJournalFP = LLFile::fopen(mJournalFilename, "wb");	/* Flawfinder: ignore */
+	if (!mJournalFP)
+	{
+		LL_WARNS("VFS") << "Can't reopen VFS journal " << mJournalFilename << ", journaling disabled" << LL_ENDL;
+	}
+}
+
+void LLVFS::closeJournal()
+{
+	if (!mJournalFP)
+	{
+		return;
+	}
+
+	lockData();
+	checkpointJournal();
+	unlockData();
+
+	if (mJournalFP)
+	{
+		fclose(mJournalFP);
+		mJournalFP = NULL;
+	}
+	LLFile::remove(mJournalFilename);
+}
+
+// Apply the committed batches of a journal left behind by a crash to the
+// index file.  A torn or corrupt batch ends the journal.
+BOOL LLVFS::replayJournal()
+{
+	std::vector<U8> journal;
+	LLFILE *journal_fp = LLFile::fopen(mJournalFilename, "rb");	/* Flawfinder: ignore */
+	if (journal_fp)
+	{
+		fseek(journal_fp, 0, SEEK_END);
+		long journal_size = ftell(journal_fp);
+		fseek(journal_fp, 0, SEEK_SET);
+		if (journal_size > 0)
+		{
+			journal.resize(journal_size);
+			journal.resize(fread(&journal[0], 1, journal_size, journal_fp));
+		}
+		fclose(journal_fp);
+	}
+
+	const size_t record_size = sizeof(S32) + LLVFSFileBlock::SERIAL_SIZE;
+	index_record_map_t records;
+	S32 batches = 0;
+	size_t offset = 0;
+	while (offset + VFS_JOURNAL_HEADER_SIZE <= journal.size())
+	{
+		U32 header[3];
+		memcpy(header, &journal[offset], VFS_JOURNAL_HEADER_SIZE);		/* Flawfinder: ignore */
+		size_t available = journal.size() - offset - VFS_JOURNAL_HEADER_SIZE;
+		if (header[0] != VFS_JOURNAL_MAGIC || header[1] > available / record_size)
+		{
+			break;
+		}
+		const U8 *cur = &journal[offset + VFS_JOURNAL_HEADER_SIZE];
+		LLCRC crc;
+		crc.update(cur, header[1] * record_size);
+		if (crc.getCRC() != header[2])
+		{
+			break;
+		}
+
+		for (U32 i = 0; i < header[1]; i++, cur += record_size)
+		{
+			S32 index_location;
+			memcpy(&index_location, cur, sizeof(S32));		/* Flawfinder: ignore */
+			if (index_location >= 0)
+			{
+				records[index_location].assign(cur + sizeof(S32), cur + record_size);
+			}
+		}
+		offset += VFS_JOURNAL_HEADER_SIZE + header[1] * record_size;
+		batches++;
+	}
+
+	BOOL success = TRUE;
+	if (!records.empty())
+	{
+		LLFILE *index_fp = LLFile::fopen(mIndexFilename, "r+b");	/* Flawfinder: ignore */
+		if (!index_fp)
+		{
+			index_fp = LLFile::fopen(mIndexFilename, "w+b");	/* Flawfinder: ignore */
+		}
+		if (index_fp)
+		{
+			for (index_record_map_t::iterator it = records.begin(); it != records.end(); ++it)
+			{
+				fseek(index_fp, it->first, SEEK_SET);
+				if (fwrite(&it->second[0], LLVFSFileBlock::SERIAL_SIZE, 1, index_fp) != 1)
+				{
+					success = FALSE;
+				}
+			}
+			fclose(index_fp);
+		}
+		else
+		{
+			success = FALSE;
+		}
+	}
+
+	if (success)
+	{
+		LL_INFOS("VFS") << "Recovered " << records.size() << " index records from " << batches
+			<< " journal batches in " << mJournalFilename << LL_ENDL;
+	}
+	else
+	{
+		LL_WARNS("VFS") << "Couldn't replay VFS journal " << mJournalFilename << " into " << mIndexFilename << LL_ENDL;
+	}
+	LLFile::remove(mJournalFilename);
+	return success;
+}
+
 // mDataMutex must be LOCKED before calling this
 // Can initiate LRU-based file removal to make space.
 // The immune file block will not be removed.
@@ -1554,9 +1734,13 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 	while (! block)
 	{
 		// look for a suitable free block
-		blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(size); // first entry >= size
-		if (iter != mFreeBlocksByLength.end())
-			block = iter->second;
+		block = findFreeSpace(size);
+		if (!block && !mUncommittedFreeBlocks.empty())
+		{
+			// Commit the journal to get back space freed since the last batch
+			writeJournal();
+			block = findFreeSpace(size);
+		}
     	
 		// no large enough free blocks, time to clean out some junk
 		if (! block)
@@ -1639,6 +1823,144 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 	return block;
 }
 
+// mDataMutex must be LOCKED before calling this
+S32 LLVFS::findLargestFreeExtent() const
+{
+	if (!mFreeSizeClassMask)
+	{
+		return 0;
+	}
+	S32 size_class = FREE_SIZE_CLASS_COUNT - 1;
+	while (!(mFreeSizeClassMask & (1U << size_class)))
+	{
+		size_class--;
+	}
+	S32 largest = 0;
+	const blocks_size_class_t& free_list = mFreeBlocksBySizeClass[size_class];
+	for (blocks_size_class_t::const_iterator iter = free_list.begin(); iter != free_list.end(); ++iter)
+	{
+		largest = llmax(largest, (*iter)->mLength);
+	}
+	return largest;
+}
+
+// mDataMutex must be LOCKED before calling this
+BOOL LLVFS::moveData(U32 src_location, U32 dst_location, S32 length)
+{
+	std::vector<U8> buffer(length);
+	fseek(mDataFP, src_location, SEEK_SET);
+	if (fread(&buffer[0], length, 1, mDataFP) != 1)
+	{
+		llwarns << "Short read" << llendl;
+		return FALSE;
+	}
+	fseek(mDataFP, dst_location, SEEK_SET);
+	if (fwrite(&buffer[0], length, 1, mDataFP) != 1)
+	{
+		llwarns << "Short write" << llendl;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL LLVFS::findCompactionCandidate(LLVFSFileSpecifier& spec, U32& free_location)
+{
+	BOOL found = FALSE;
+
+	lockData();
+	for (blocks_location_map_t::iterator iter = mFreeBlocksByLocation.lower_bound(mCompactCursor);
+		 iter != mFreeBlocksByLocation.end(); ++iter)
+	{
+		LLVFSBlock *free_block = iter->second;
+		fileblock_location_map_t::iterator file_iter = mFileBlocksByLocation.find(free_block->mLocation + free_block->mLength);
+		if (file_iter != mFileBlocksByLocation.end() &&
+			file_iter->second.mLength <= VFS_COMPACT_MAX_FILE_LENGTH &&
+			free_block->mLength >= file_iter->second.mLength)
+		{
+			spec = file_iter->second.mSpec;
+			free_location = free_block->mLocation;
+			// The free block moves up past the file, so the next call
+			// picks it up again and keeps bubbling it towards its neighbour.
+			mCompactCursor = free_location + 1;
+			found = TRUE;
+			break;
+		}
+	}
+	if (!found)
+	{
+		// Sweep finished, start over next time
+		mCompactCursor = 0;
+	}
+	unlockData();
+
+	return found;
+}
+
+BOOL LLVFS::relocateForCompaction(const LLVFSFileSpecifier& spec, U32 free_location)
+{
+	BOOL moved = FALSE;
+
+	lockData();
+	fileblock_map::iterator it = mFileBlocks.find(spec);
+	if (it != mFileBlocks.end())
+	{
+		moved = slideFileIntoFreeBlock(it->second, free_location);
+	}
+	unlockData();
+
+	return moved;
+}
+
+// mDataMutex must be LOCKED before calling this
+BOOL LLVFS::slideFileIntoFreeBlock(LLVFSFileBlock *block, U32 free_location)
+{
+	blocks_location_map_t::iterator free_iter = mFreeBlocksByLocation.find(free_location);
+	if (free_iter == mFreeBlocksByLocation.end())
+	{
+		return FALSE;
+	}
+	LLVFSBlock *free_block = free_iter->second;
+
+	// Things may have changed since the candidate was picked
+	if (block->mLength <= 0 ||
+		block->mLength > VFS_COMPACT_MAX_FILE_LENGTH ||
+		block->mLocation != free_block->mLocation + free_block->mLength)
+	{
+		return FALSE;
+	}
+	for (S32 i = 0; i < (S32)VFSLOCK_COUNT; i++)
+	{
+		if (block->mLocks[i])
+		{
+			return FALSE;
+		}
+	}
+	if (free_block->mLength < block->mLength)
+	{
+		// The index on disk points at the old copy until sync() writes it,
+		// or until the journal is committed, so a crash before then must
+		// find that copy intact.  Only slide into a free block that doesn't
+		// overlap it.
+		return FALSE;
+	}
+
+	U32 new_location = free_block->mLocation;
+	if (block->mSize > 0 && !moveData(block->mLocation, new_location, block->mSize))
+	{
+		return FALSE;
+	}
+
+	// Swap the file and the free block, which may now merge with the next one.
+	eraseBlock(free_block);
+	free_block->mLocation = new_location + block->mLength;
+	block->mLocation = new_location;
+	releaseSpace(free_block);		// takes ownership (and may delete) free_block
+
+	sync(block);
+
+	return TRUE;
+}
+
 //============================================================================
 // public
 //============================================================================
@@ -1676,6 +1998,118 @@ void LLVFS::pokeFiles()
 	}
 }
 
+S32 LLVFS::getLargestFreeExtent()
+{
+	lockData();
+	S32 largest = findLargestFreeExtent();
+	unlockData();
+	return largest;
+}
+
+F32 LLVFS::getFragmentation()
+{
+	lockData();
+	S32 largest = findLargestFreeExtent();
+	U64 free_bytes = mFreeBytes;
+	unlockData();
+
+	if (free_bytes == 0)
+	{
+		return 0.f;
+	}
+	return 1.f - (F32)largest / (F32)free_bytes;
+}
+
+BOOL LLVFS::needsCompaction()
+{
+	if (!isValid() || mReadOnly)
+	{
+		return FALSE;
+	}
+	lockData();
+	BOOL fragmented = mFreeBlocksByLocation.size() > 1;
+	unlockData();
+	return fragmented && getFragmentation() > VFS_COMPACT_FRAGMENTATION;
+}
+
+S32 LLVFS::compact(S32 max_moves)
+{
+	if (!isValid() || mReadOnly)
+	{
+		return 0;
+	}
+
+	S32 moves = 0;
+	LLVFSFileSpecifier spec;
+	U32 free_location;
+	while (moves < max_moves && findCompactionCandidate(spec, free_location))
+	{
+		if (relocateForCompaction(spec, free_location))
+		{
+			moves++;
+		}
+	}
+	if (moves && mJournalFP)
+	{
+		// Vacated space only merges once it is committed
+		lockData();
+		writeJournal();
+		unlockData();
+	}
+	return moves;
+}
+
+BOOL LLVFS::enableJournal()
+{
+	if (!isValid() || mReadOnly)
+	{
+		return FALSE;
+	}
+
+	LLMutexLock lock(mDataMutex);
+	if (mJournalFP)
+	{
+		return TRUE;
+	}
+
+	mJournalFP = LLFile::fopen(mJournalFilename, "wb");	/* Flawfinder: ignore */
+	if (!mJournalFP)
+	{
+		LL_WARNS("VFS") << "Can't open VFS journal " << mJournalFilename << LL_ENDL;
+		return FALSE;
+	}
+
+	// Anything written the old way has to be in the index before the
+	// journal can stand in for it.
+	flushData();
+	fflush(mIndexFP);
+	fseek(mIndexFP, 0, SEEK_END);
+	mIndexEnd = ftell(mIndexFP);
+	mJournalRecordCount = 0;
+
+	LL_INFOS("VFS") << "Journaling VFS index to " << mJournalFilename << LL_ENDL;
+	return TRUE;
+}
+
+void LLVFS::commitJournal(BOOL checkpoint)
+{
+	LLMutexLock lock(mDataMutex);
+	if (!mJournalFP)
+	{
+		return;
+	}
+
+	if (checkpoint ||
+		mJournalRecordCount + (S32)mPendingIndexRecords.size() >= VFS_JOURNAL_CHECKPOINT_RECORDS)
+	{
+		checkpointJournal();
+	}
+	else
+	{
+		writeJournal();
+	}
+}
+
     
 void LLVFS::dumpMap()
 {
@@ -1703,6 +2137,8 @@ void LLVFS::audit()
 	// Lock the mutex through this whole function.
 	LLMutexLock lock_data(mDataMutex);
 	
+	// The index file has to be current to compare against
+	checkpointJournal();
 	fflush(mIndexFP);
 
 	fseek(mIndexFP, 0, SEEK_END);
@@ -1966,7 +2402,11 @@ void LLVFS::dumpStatistics()
 	llinfos << "Invalid blocks: " << invalid_file_count << llendl;
 	llinfos << "File blocks:    " << mFileBlocks.size() << llendl;
 
-	S32 length_list_count = (S32)mFreeBlocksByLength.size();
+	S32 length_list_count = 0;
+	for (S32 i = 0; i < FREE_SIZE_CLASS_COUNT; i++)
+	{
+		length_list_count += (S32)mFreeBlocksBySizeClass[i].size();
+	}
 	S32 location_list_count = (S32)mFreeBlocksByLocation.size();
 	if (length_list_count == location_list_count)
 	{
@@ -1980,6 +2420,15 @@ void LLVFS::dumpStatistics()
 	}
 	llinfos << "Max file: " << max_file_size/1024 << "K" << llendl;
 	llinfos << "Max free: " << max_free_size/1024 << "K" << llendl;
+	llinfos << "Largest free extent: " << findLargestFreeExtent()/1024 << "K" << llendl;
+	if (mJournalFP)
+	{
+		llinfos << "Journal: " << mPendingIndexRecords.size() << " pending, "
+				<< mJournaledIndexRecords.size() << " awaiting checkpoint, "
+				<< mUncommittedFreeBlocks.size() << " uncommitted free blocks" << llendl;
+	}
+	llinfos << llformat("Fragmentation: %.1f%%",
+						(total_free_size > 0 ? 1.f - (F32)max_free_size / (F32)total_free_size : 0.f) * 100.f) << llendl;
 	llinfos << "Total file size: " << total_file_size/1024 << "K" << llendl;
 	llinfos << "Total free size: " << total_free_size/1024 << "K" << llendl;
 	llinfos << "Sum: " << (total_file_size + total_free_size) << " bytes" << llendl;
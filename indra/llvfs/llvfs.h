@@ -28,6 +28,9 @@
 #define LL_LLVFS_H
 
 #include <deque>
+#include <map>
+#include <set>
+#include <vector>
 #include "lluuid.h"
 #include "linked_lists.h"
 #include "llassettype.h"
@@ -71,7 +74,7 @@ public:
 
 class LLVFS
 {
-private:
+protected:
 	// Use createLLVFS() to open a VFS file
 	// Pass 0 to not presize
 	LLVFS(const std::string& index_filename, 
@@ -80,38 +83,41 @@ private:
 			const U32 presize, 
 			const BOOL remove_after_crash);
 public:
-	~LLVFS();
+	virtual ~LLVFS();
 
 	// Use this function normally to create LLVFS files
 	// Pass 0 to not presize
+	// If sharded is TRUE, the index is split across independently locked
+	// shards and reads are served from a memory-mapped data file (see LLShardedVFS).
 	static LLVFS * createLLVFS(const std::string& index_filename, 
 			const std::string& data_filename, 
 			const BOOL read_only, 
 			const U32 presize, 
-			const BOOL remove_after_crash);
+			const BOOL remove_after_crash,
+			const BOOL sharded = FALSE);
 
 	BOOL isValid() const			{ return (VFSVALID_OK == mValid); }
 	EVFSValid getValidState() const	{ return mValid; }
 
 	// ---------- The following fucntions lock/unlock mDataMutex ----------
-	BOOL getExists(const LLUUID &file_id, const LLAssetType::EType file_type);
-	S32	 getSize(const LLUUID &file_id, const LLAssetType::EType file_type);
+	virtual BOOL getExists(const LLUUID &file_id, const LLAssetType::EType file_type);
+	virtual S32	 getSize(const LLUUID &file_id, const LLAssetType::EType file_type);
 
 	BOOL checkAvailable(S32 max_size);
 	
-	S32  getMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type);
-	BOOL setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type, S32 max_size);
+	virtual S32  getMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type);
+	virtual BOOL setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type, S32 max_size);
 
-	void renameFile(const LLUUID &file_id, const LLAssetType::EType file_type,
+	virtual void renameFile(const LLUUID &file_id, const LLAssetType::EType file_type,
 		const LLUUID &new_id, const LLAssetType::EType &new_type);
-	void removeFile(const LLUUID &file_id, const LLAssetType::EType file_type);
+	virtual void removeFile(const LLUUID &file_id, const LLAssetType::EType file_type);
 
-	S32 getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8 *buffer, S32 location, S32 length);
-	S32 storeData(const LLUUID &file_id, const LLAssetType::EType file_type, const U8 *buffer, S32 location, S32 length);
+	virtual S32 getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8 *buffer, S32 location, S32 length);
+	virtual S32 storeData(const LLUUID &file_id, const LLAssetType::EType file_type, const U8 *buffer, S32 location, S32 length);
 
-	void incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
-	void decLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
-	BOOL isLocked(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
+	virtual void incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
+	virtual void decLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
+	virtual BOOL isLocked(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
 	// ----------------------------------------------------------------
 
 	// Used to trigger evil WinXP behavior of "preloading" entire file into memory.
@@ -119,27 +125,94 @@ public:
 
 	// Verify that the index file contents match the in-memory file structure
 	// Very slow, do not call routinely. JC
-	void audit();
+	virtual void audit();
 	// Check for uninitialized blocks.  Slow, do not call in release. JC
-	void checkMem();
+	virtual void checkMem();
 	// for debugging, prints a map of the vfs
-	void dumpMap();
+	virtual void dumpMap();
 	void dumpLockCounts();
-	void dumpStatistics();
-	void listFiles();
-	void dumpFiles();
+	virtual void dumpStatistics();
+	virtual void listFiles();
+	virtual void dumpFiles();
+
+	// ---------- Free space compaction ----------
+	// 1 - (largest free extent / total free space).  0 means all free space is contiguous.
+	F32  getFragmentation();
+	S32  getLargestFreeExtent();
+	// TRUE if fragmentation is high enough that compact() is worthwhile.
+	BOOL needsCompaction();
+	// Slide up to max_moves small files down into the free block preceding
+	// them so that free blocks coalesce.  Resumes where the last call left
+	// off.  Returns the number of files moved, 0 once a sweep is finished.
+	// Only files no longer than the free block move, so the copy the index
+	// on disk points at is never overwritten.
+	// Called at low priority from LLVFSThread, see LLVFSThread::compact().
+	S32  compact(S32 max_moves);
+
+	// ---------- Index journal ----------
+	// Batch index updates in a write-ahead journal (index_filename.journal)
+	// instead of writing each record into the index file as it changes.
+	// Freed space is not reused until the records freeing it are committed,
+	// so a journal left behind by a crash can be replayed when the VFS is
+	// next opened rather than the cache being thrown away.
+	// LLVFSThread commits it periodically, see LLVFSThread::setJournalVFS().
+	BOOL enableJournal();
+	BOOL isJournaled() const		{ return mJournalFP != NULL; }
+	// Append pending index records to the journal as one batch, and write
+	// them into the index file once enough have accumulated or checkpoint is TRUE.
+	void commitJournal(BOOL checkpoint = FALSE);
 
 protected:
 	void removeFileBlock(LLVFSFileBlock *fileblock);
 	
+	void insertBlockLength(LLVFSBlock *block);
 	void eraseBlockLength(LLVFSBlock *block);
 	void eraseBlock(LLVFSBlock *block);
 	void addFreeBlock(LLVFSBlock *block);
 	//void mergeFreeBlocks();
 	void useFreeSpace(LLVFSBlock *free_block, S32 length);
 	void sync(LLVFSFileBlock *block, BOOL remove = FALSE);
+	void updateLocationIndex(LLVFSFileBlock *block, BOOL remove);
 	void presizeDataFile(const U32 size);
 
+	// Return space that a file no longer uses to the free lists.  When
+	// journaling this is deferred until the journal is committed.
+	// mDataMutex must be LOCKED.
+	void releaseSpace(LLVFSBlock *block);
+
+	// Journal helpers, mDataMutex must be LOCKED except for replayJournal()
+	// which runs from the constructor before the index is read.
+	void writeJournal();
+	void checkpointJournal();
+	void closeJournal();
+	BOOL replayJournal();
+	// Make file data written so far visible to the OS, so that it reaches
+	// the disk ahead of the journal records referring to it.
+	virtual void flushData();
+
+	// Size class of a free block: floor(log2(length))
+	static S32 getSizeClass(S32 length);
+
+	// Find a free block of at least size bytes without evicting anything.
+	// O(log n) except when the only candidates share size's own class.
+	// mDataMutex must be LOCKED.
+	LLVFSBlock *findFreeSpace(S32 size);
+	// mDataMutex must be LOCKED.
+	S32 findLargestFreeExtent() const;
+
+	// Copy length bytes of file data, ranges may overlap.
+	// mDataMutex must be LOCKED (and for subclasses, whatever guards the file).
+	virtual BOOL moveData(U32 src_location, U32 dst_location, S32 length);
+
+	// Compaction steps.  findCompactionCandidate() locks mDataMutex and picks
+	// the file following the next free block after mCompactCursor.
+	// relocateForCompaction() takes whatever locks the file needs, looks the
+	// file up and calls slideFileIntoFreeBlock() with mDataMutex LOCKED,
+	// which re-validates the candidate before moving it.
+	BOOL findCompactionCandidate(LLVFSFileSpecifier& spec, U32& free_location);
+	virtual BOOL relocateForCompaction(const LLVFSFileSpecifier& spec, U32 free_location);
+	BOOL slideFileIntoFreeBlock(LLVFSFileBlock *block, U32 free_location);
+
 	static LLFILE *openAndLock(const std::string& filename, const char* mode, BOOL read_lock);
 	static void unlockAndClose(FILE *fp);
 	
@@ -157,14 +230,49 @@ protected:
 	typedef std::map<LLVFSFileSpecifier, LLVFSFileBlock*> fileblock_map;
 	fileblock_map mFileBlocks;
 
-	typedef std::multimap<S32, LLVFSBlock*>	blocks_length_map_t;
-	blocks_length_map_t 	mFreeBlocksByLength;
+	// Free blocks are binned into power of two size classes, each ordered by
+	// location so allocations within a class are address-ordered first fit.
+	// mFreeSizeClassMask has bit N set when class N is non-empty.
+	struct LLVFSBlockLocationLess
+	{
+		bool operator()(const LLVFSBlock* lhs, const LLVFSBlock* rhs) const;
+	};
+	enum { FREE_SIZE_CLASS_COUNT = 32 };
+	typedef std::set<LLVFSBlock*, LLVFSBlockLocationLess> blocks_size_class_t;
+	blocks_size_class_t		mFreeBlocksBySizeClass[FREE_SIZE_CLASS_COUNT];
+	U32						mFreeSizeClassMask;
+	U64						mFreeBytes;
 	typedef std::multimap<U32, LLVFSBlock*>	blocks_location_map_t;
 	blocks_location_map_t 	mFreeBlocksByLocation;
 
+	// Files with allocated space by data location, kept up to date by sync().
+	// The spec and length are snapshots taken under mDataMutex so that
+	// compaction can pick a file without holding the lock that guards it;
+	// mBlock is only used for identity and never dereferenced from here.
+	struct LLVFSLocationEntry
+	{
+		LLVFSFileBlock*		mBlock;
+		LLVFSFileSpecifier	mSpec;
+		S32					mLength;
+	};
+	typedef std::map<U32, LLVFSLocationEntry> fileblock_location_map_t;
+	fileblock_location_map_t mFileBlocksByLocation;
+	U32						mCompactCursor;
+
 	LLFILE *mDataFP;
 	LLFILE *mIndexFP;
 
+	// Index records by index file offset.  Pending records are not in the
+	// journal yet, journaled records are not in the index file yet.
+	typedef std::map<S32, std::vector<U8> > index_record_map_t;
+	LLFILE*					mJournalFP;
+	std::string				mJournalFilename;
+	index_record_map_t		mPendingIndexRecords;
+	index_record_map_t		mJournaledIndexRecords;
+	S32						mJournalRecordCount;	// records appended since the last checkpoint
+	std::vector<LLVFSBlock*> mUncommittedFreeBlocks;
+	S32						mIndexEnd;				// next new index record location when journaling
+
 	std::deque<S32> mIndexHoles;
 
 	std::string mIndexFilename;
@@ -173,7 +281,7 @@ protected:
 
 	EVFSValid mValid;
 
-	S32 mLockCounts[VFSLOCK_COUNT];
+	LLAtomicS32 mLockCounts[VFSLOCK_COUNT];
 	BOOL mRemoveAfterCrash;
 };
 
@@ -0,0 +1,200 @@
+/** 
+ * @file llvfsblock.h
+ * @brief Internal block structures shared by the LLVFS implementations
+ *
+ * $LicenseInfo:firstyear=2002&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * 
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLVFSBLOCK_H
+#define LL_LLVFSBLOCK_H
+
+// Internal to llvfs.  Do not include this from outside the library.
+
+#include "llvfs.h"
+
+const S32 FILE_BLOCK_MASK = 0x000003FF;	 // 1024-byte blocks
+const S32 VFS_CLEANUP_SIZE = 5242880;  // how much space we free up in a single stroke
+const S32 BLOCK_LENGTH_INVALID = -1;	// mLength for invalid LLVFSFileBlocks
+const S32 VFS_COMPACT_MAX_FILE_LENGTH = 262144;	// larger files are never moved by compaction
+const F32 VFS_COMPACT_FRAGMENTATION = 0.5f;	// compact when free space is less contiguous than this
+const U32 VFS_JOURNAL_MAGIC = 0x4c4e4a56;	// "VJNL", starts each journal batch
+const S32 VFS_JOURNAL_HEADER_SIZE = 12;		// magic, record count, crc of the records
+const S32 VFS_JOURNAL_CHECKPOINT_RECORDS = 4096;	// checkpoint after this many journaled records
+
+
+// internal class definitions
+class LLVFSBlock
+{
+public:
+	LLVFSBlock() 
+	{
+		mLocation = 0;
+		mLength = 0;
+	}
+    
+	LLVFSBlock(U32 loc, S32 size)
+	{
+		mLocation = loc;
+		mLength = size;
+	}
+    
+	static bool locationSortPredicate(
+		const LLVFSBlock* lhs,
+		const LLVFSBlock* rhs)
+	{
+		return lhs->mLocation < rhs->mLocation;
+	}
+
+public:
+	U32 mLocation;
+	S32	mLength;		// allocated block size
+};
+    
+class LLVFSFileBlock : public LLVFSBlock, public LLVFSFileSpecifier
+{
+public:
+	LLVFSFileBlock() : LLVFSBlock(), LLVFSFileSpecifier()
+	{
+		init();
+	}
+    
+	LLVFSFileBlock(const LLUUID &file_id, LLAssetType::EType file_type, U32 loc = 0, S32 size = 0)
+		: LLVFSBlock(loc, size), LLVFSFileSpecifier( file_id, file_type )
+	{
+		init();
+	}
+
+	void init()
+	{
+		mSize = 0;
+		mIndexLocation = -1;
+		mAccessTime = (U32)time(NULL);
+		mLocationIndexed = FALSE;
+		mIndexedLocation = 0;
+
+		for (S32 i = 0; i < (S32)VFSLOCK_COUNT; i++)
+		{
+			mLocks[(EVFSLock)i] = 0;
+		}
+	}
+
+	#ifdef LL_LITTLE_ENDIAN
+	inline void swizzleCopy(void *dst, void *src, int size) { memcpy(dst, src, size); /* Flawfinder: ignore */}
+
+	#else
+	
+	inline U32 swizzle32(U32 x)
+	{
+		return(((x >> 24) & 0x000000FF) | ((x >> 8)  & 0x0000FF00) | ((x << 8)  & 0x00FF0000) |((x << 24) & 0xFF000000));
+	}
+	
+	inline U16 swizzle16(U16 x)
+	{
+		return(	((x >> 8)  & 0x000000FF) | ((x << 8)  & 0x0000FF00) );
+	}
+	
+	inline void swizzleCopy(void *dst, void *src, int size) 
+	{
+		if(size == 4)
+		{
+			((U32*)dst)[0] = swizzle32(((U32*)src)[0]); 
+		}
+		else if(size == 2)
+		{
+			((U16*)dst)[0] = swizzle16(((U16*)src)[0]); 
+		}
+		else
+		{
+			// Perhaps this should assert...
+			memcpy(dst, src, size);	/* Flawfinder: ignore */
+		}
+	}
+	
+	#endif
+
+	void serialize(U8 *buffer)
+	{
+		swizzleCopy(buffer, &mLocation, 4);
+		buffer += 4;
+		swizzleCopy(buffer, &mLength, 4);
+		buffer +=4;
+		swizzleCopy(buffer, &mAccessTime, 4);
+		buffer +=4;
+		memcpy(buffer, &mFileID.mData, 16); /* Flawfinder: ignore */	
+		buffer += 16;
+		S16 temp_type = mFileType;
+		swizzleCopy(buffer, &temp_type, 2);
+		buffer += 2;
+		swizzleCopy(buffer, &mSize, 4);
+	}
+    
+	void deserialize(U8 *buffer, const S32 index_loc)
+	{
+		mIndexLocation = index_loc;
+    
+		swizzleCopy(&mLocation, buffer, 4);
+		buffer += 4;
+		swizzleCopy(&mLength, buffer, 4);
+		buffer += 4;
+		swizzleCopy(&mAccessTime, buffer, 4);
+		buffer += 4;
+		memcpy(&mFileID.mData, buffer, 16);
+		buffer += 16;
+		S16 temp_type;
+		swizzleCopy(&temp_type, buffer, 2);
+		mFileType = (LLAssetType::EType)temp_type;
+		buffer += 2;
+		swizzleCopy(&mSize, buffer, 4);
+	}
+    
+	static BOOL insertLRU(LLVFSFileBlock* const& first,
+						  LLVFSFileBlock* const& second)
+	{
+		return (first->mAccessTime == second->mAccessTime)
+			? *first < *second
+			: first->mAccessTime < second->mAccessTime;
+	}
+    
+public:
+	S32  mSize;
+	S32  mIndexLocation; // location of index entry
+	U32  mAccessTime;
+	BOOL mLocks[VFSLOCK_COUNT]; // number of outstanding locks of each type
+	BOOL mLocationIndexed;		// in LLVFS::mFileBlocksByLocation at mIndexedLocation
+	U32  mIndexedLocation;
+    
+	static const S32 SERIAL_SIZE;
+};
+
+// Helper structure for doing lru w/ stl... is there a simpler way?
+struct LLVFSFileBlock_less
+{
+	bool operator()(LLVFSFileBlock* const& lhs, LLVFSFileBlock* const& rhs) const
+	{
+		return (LLVFSFileBlock::insertLRU(lhs, rhs)) ? true : false;
+	}
+};
+
+// Debug Only!  File name extension used when dumping vfiles to disk.
+std::string get_extension(LLAssetType::EType type);
+
+#endif // LL_LLVFSBLOCK_H
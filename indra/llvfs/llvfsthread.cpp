@@ -34,6 +34,17 @@
 
 /*static*/ LLVFSThread* LLVFSThread::sLocal = NULL;
 
+/*static*/ LLVFS* LLVFSThread::sCompactVFS = NULL;
+/*static*/ F32 LLVFSThread::sCompactPeriod = 0.f;
+/*static*/ LLTimer LLVFSThread::sCompactTimer;
+
+/*static*/ LLVFS* LLVFSThread::sJournalVFS = NULL;
+/*static*/ F32 LLVFSThread::sJournalPeriod = 0.f;
+/*static*/ LLTimer LLVFSThread::sJournalTimer;
+
+// Files moved per compaction request before yielding to other requests
+const S32 VFS_COMPACT_MOVES_PER_REQUEST = 8;
+
 //============================================================================
 // Run on MAIN thread
 //static
@@ -46,6 +57,19 @@ void LLVFSThread::initClass(bool local_is_threaded)
 //static
 S32 LLVFSThread::updateClass(U32 ms_elapsed)
 {
+	if (sCompactVFS && sCompactTimer.getElapsedTimeF32() > sCompactPeriod)
+	{
+		sCompactTimer.reset();
+		if (sCompactVFS->needsCompaction())
+		{
+			sLocal->compact(sCompactVFS);
+		}
+	}
+	if (sJournalVFS && sJournalTimer.getElapsedTimeF32() > sJournalPeriod)
+	{
+		sJournalTimer.reset();
+		sLocal->commitJournal(sJournalVFS);
+	}
 	sLocal->update(ms_elapsed);
 	return sLocal->getPending();
 }
@@ -53,6 +77,8 @@ S32 LLVFSThread::updateClass(U32 ms_elapsed)
 //static
 void LLVFSThread::cleanupClass()
 {
+	sCompactVFS = NULL;
+	sJournalVFS = NULL;
 	sLocal->setQuitting();
 	while (sLocal->getPending())
 	{
@@ -62,10 +88,28 @@ void LLVFSThread::cleanupClass()
 	sLocal = 0;
 }
 
+//static
+void LLVFSThread::setCompactionVFS(LLVFS* vfs, F32 period)
+{
+	sCompactVFS = vfs;
+	sCompactPeriod = period;
+	sCompactTimer.reset();
+}
+
+//static
+void LLVFSThread::setJournalVFS(LLVFS* vfs, F32 period)
+{
+	sJournalVFS = vfs;
+	sJournalPeriod = period;
+	sJournalTimer.reset();
+}
+
 //----------------------------------------------------------------------------
 
 LLVFSThread::LLVFSThread(bool threaded) :
-	LLQueuedThread("VFS", threaded)
+	LLQueuedThread("VFS", threaded),
+	mCompactHandle(nullHandle()),
+	mJournalHandle(nullHandle())
 {
 }
 
@@ -161,6 +205,61 @@ S32 LLVFSThread::writeImmediate(LLVFS* vfs, const LLUUID &file_id, const LLAsset
 	return res;
 }
 
+bool LLVFSThread::isPending(handle_t handle)
+{
+	if (handle == nullHandle())
+	{
+		return false;
+	}
+	status_t status = getRequestStatus(handle);
+	return (status == STATUS_QUEUED || status == STATUS_INPROGRESS);
+}
+
+void LLVFSThread::compact(LLVFS* vfs)
+{
+	if (isPending(mCompactHandle))
+	{
+		return;
+	}
+
+	handle_t handle = generateHandle();
+
+	// Priority 0, so every read and write queued meanwhile goes first
+	Request* req = new Request(handle, 0, FLAG_AUTO_COMPLETE, FILE_COMPACT, vfs, LLUUID::null, LLAssetType::AT_NONE,
+							   NULL, 0, 0);
+
+	bool res = addRequest(req);
+	if (!res)
+	{
+		llwarns << "LLVFSThread::compact called after LLVFSThread::cleanupClass()" << llendl;
+		req->deleteRequest();
+		handle = nullHandle();
+	}
+	mCompactHandle = handle;
+}
+
+void LLVFSThread::commitJournal(LLVFS* vfs)
+{
+	if (isPending(mJournalHandle))
+	{
+		return;
+	}
+
+	handle_t handle = generateHandle();
+
+	// Ahead of compaction, behind reads
+	Request* req = new Request(handle, PRIORITY_LOW, FLAG_AUTO_COMPLETE, FILE_JOURNAL, vfs, LLUUID::null, LLAssetType::AT_NONE,
+							   NULL, 0, 0);
+
+	bool res = addRequest(req);
+	if (!res)
+	{
+		llwarns << "LLVFSThread::commitJournal called after LLVFSThread::cleanupClass()" << llendl;
+		req->deleteRequest();
+		handle = nullHandle();
+	}
+	mJournalHandle = handle;
+}
 
 // LLVFSThread::handle_t LLVFSThread::rename(LLVFS* vfs, const LLUUID &file_id, const LLAssetType::EType file_type,
 // 										  const LLUUID &new_id, const LLAssetType::EType new_type, U32 flags)
@@ -199,6 +298,12 @@ LLVFSThread::Request::Request(handle_t handle, U32 priority, U32 flags,
 	mBytes(numbytes),
 	mBytesRead(0)
 {
+	if (mOperation == FILE_COMPACT || mOperation == FILE_JOURNAL)
+	{
+		// No file, buffer or locks involved
+		return;
+	}
+
 	llassert(mBuffer);
 
 	if (numbytes <= 0 && mOperation != FILE_RENAME)
@@ -230,7 +335,11 @@ LLVFSThread::Request::Request(handle_t handle, U32 priority, U32 flags,
 // dec locks as soon as a request finishes
 void LLVFSThread::Request::finishRequest(bool completed)
 {
-	if (mOperation == FILE_WRITE)
+	if (mOperation == FILE_COMPACT || mOperation == FILE_JOURNAL)
+	{
+		return;
+	}
+	else if (mOperation == FILE_WRITE)
 	{
 		mVFS->decLock(mFileID, mFileType, VFSLOCK_APPEND);
 	}
@@ -290,6 +399,24 @@ bool LLVFSThread::Request::processRequest()
 		complete = true;
 		//llinfos << llformat("LLVFSThread::RENAME '%s': %d bytes arg:%d",getFilename(),mBytesRead) << llendl;
 	}
+	else if (mOperation ==  FILE_COMPACT)
+	{
+		// Returning false puts us back in the queue behind anything more important
+		S32 moved = mVFS->compact(VFS_COMPACT_MOVES_PER_REQUEST);
+		mBytesRead += moved;
+		complete = (moved == 0 || !mVFS->needsCompaction() ||
+					(LLVFSThread::sLocal && LLVFSThread::sLocal->isQuitting()));
+		if (complete && mBytesRead > 0)
+		{
+			llinfos << "LLVFSThread::COMPACT moved " << mBytesRead << " files, fragmentation now "
+					<< llformat("%.1f%%", mVFS->getFragmentation() * 100.f) << llendl;
+		}
+	}
+	else if (mOperation ==  FILE_JOURNAL)
+	{
+		mVFS->commitJournal();
+		complete = true;
+	}
 	else
 	{
 		llerrs << llformat("LLVFSThread::unknown operation: %d", mOperation) << llendl;
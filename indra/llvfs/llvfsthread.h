@@ -35,6 +35,7 @@
 #include "llapr.h"
 
 #include "llqueuedthread.h"
+#include "lltimer.h"
 
 #include "llvfs.h"
 
@@ -47,7 +48,9 @@ public:
 	enum operation_t {
 		FILE_READ,
 		FILE_WRITE,
-		FILE_RENAME
+		FILE_RENAME,
+		FILE_COMPACT,
+		FILE_JOURNAL
 	};
 
 	//------------------------------------------------------------------------
@@ -98,10 +101,10 @@ public:
 		LLUUID mFileID;
 		LLAssetType::EType mFileType;
 		
-		U8* mBuffer;	// dest for reads, source for writes, new UUID for rename
+		U8* mBuffer;	// dest for reads, source for writes, new UUID for rename, NULL for compact and journal
 		S32 mOffset;	// offset into file, -1 = append (WRITE only)
 		S32 mBytes;		// bytes to read from file, -1 = all (new mFileType for rename)
-		S32	mBytesRead;	// bytes read from file
+		S32	mBytesRead;	// bytes read from file, files moved for compact
 	};
 
 	//------------------------------------------------------------------------
@@ -126,6 +129,12 @@ public:
 					  U8* buffer, S32 offset, S32 numbytes);
 	S32 writeImmediate(LLVFS* vfs, const LLUUID &file_id, const LLAssetType::EType file_type,
 					   U8* buffer, S32 offset, S32 numbytes);
+	// Queue a lowest priority free space compaction pass over vfs, unless
+	// one is already pending.  Runs a few moves at a time so reads and
+	// writes queued in the meantime are not held up.
+	void compact(LLVFS* vfs);
+	// Queue a commit of vfs' index journal, unless one is already pending.
+	void commitJournal(LLVFS* vfs);
 
 	/*virtual*/ bool processRequest(QueuedRequest* req);
 
@@ -134,6 +143,26 @@ public:
 	static S32 updateClass(U32 ms_elapsed);
 	static void cleanupClass();		// Delete sLocal
 	static void setDataPath(const std::string& path) { sDataPath = path; }
+	// Check vfs for fragmentation every period seconds from updateClass()
+	// and compact it when needed.  Pass NULL to stop.
+	static void setCompactionVFS(LLVFS* vfs, F32 period);
+	// Commit vfs' index journal every period seconds from updateClass().
+	// Pass NULL to stop.
+	static void setJournalVFS(LLVFS* vfs, F32 period);
+
+private:
+	bool isPending(handle_t handle);
+
+	handle_t mCompactHandle;
+	handle_t mJournalHandle;
+
+	static LLVFS* sCompactVFS;
+	static F32 sCompactPeriod;
+	static LLTimer sCompactTimer;
+
+	static LLVFS* sJournalVFS;
+	static F32 sJournalPeriod;
+	static LLTimer sJournalTimer;
 };
 
 //============================================================================
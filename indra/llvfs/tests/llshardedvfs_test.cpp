@@ -0,0 +1,547 @@
+/**
+ * @file llshardedvfs_test.cpp
+ * @brief Tests and contention benchmark for LLShardedVFS, VFS compaction and journaling
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+#include <iostream>
+#include <sstream>
+
+#include "../llvfs.h"
+#include "../llshardedvfs.h"
+#include "lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	const S32 BENCH_FILE_COUNT = 512;
+	const S32 BENCH_FILE_SIZE = 16 * 1024;
+	const S32 BENCH_OPS_PER_THREAD = 20000;
+	const S32 BENCH_THREAD_COUNT = 8;
+	const U32 BENCH_PRESIZE = 32 * 1024 * 1024;
+
+	void fill_file(std::vector<U8>& buffer, const LLUUID& id)
+	{
+		for (S32 i = 0; i < (S32)buffer.size(); i++)
+		{
+			buffer[i] = id.mData[i % UUID_BYTES] ^ (U8)i;
+		}
+	}
+
+	void copy_file(const std::string& from, const std::string& to)
+	{
+		std::vector<U8> buffer;
+		LLFILE* fp = LLFile::fopen(from, "rb");
+		if (fp)
+		{
+			fseek(fp, 0, SEEK_END);
+			buffer.resize(ftell(fp));
+			fseek(fp, 0, SEEK_SET);
+			if (!buffer.empty())
+			{
+				buffer.resize(fread(&buffer[0], 1, buffer.size(), fp));
+			}
+			fclose(fp);
+		}
+		fp = LLFile::fopen(to, "wb");
+		if (fp)
+		{
+			if (!buffer.empty())
+			{
+				fwrite(&buffer[0], 1, buffer.size(), fp);
+			}
+			fclose(fp);
+		}
+	}
+
+	// Snapshots its files as a crash would leave them each time compaction
+	// has moved a file's data, before the index knows about the move.
+	class LLCrashingVFS : public LLVFS
+	{
+	public:
+		LLCrashingVFS(const std::string& index_filename, const std::string& data_filename)
+		:	LLVFS(index_filename, data_filename, FALSE, 0, FALSE),
+			mIndexName(index_filename),
+			mDataName(data_filename)
+		{
+		}
+
+		std::vector<std::string> mSnapshots;	// crashed index file names
+
+	protected:
+		/*virtual*/ BOOL moveData(U32 src_location, U32 dst_location, S32 length)
+		{
+			BOOL res = LLVFS::moveData(src_location, dst_location, length);
+			flushData();
+			std::string crashed = mIndexName + llformat("_crash%d", (S32)mSnapshots.size());
+			copy_file(mIndexName, crashed + ".index");
+			copy_file(mIndexName + ".journal", crashed + ".index.journal");
+			copy_file(mDataName, crashed + ".data");
+			mSnapshots.push_back(crashed);
+			return res;
+		}
+
+	private:
+		std::string mIndexName;
+		std::string mDataName;
+	};
+
+	// Hammers a VFS with random reads, and every eighth operation
+	// rewrites a file with the same contents so stores contend too.
+	class LLVFSHammerThread : public LLThread
+	{
+	public:
+		LLVFSHammerThread(LLVFS* vfs, const std::vector<LLUUID>& ids, U32 seed)
+		:	LLThread("VFS hammer"),
+			mVFS(vfs),
+			mIDs(ids),
+			mSeed(seed),
+			mErrors(0)
+		{
+		}
+
+		/*virtual*/ void run()
+		{
+			std::vector<U8> buffer(BENCH_FILE_SIZE);
+			std::vector<U8> expected(BENCH_FILE_SIZE);
+			U32 r = mSeed;
+			for (S32 i = 0; i < BENCH_OPS_PER_THREAD; i++)
+			{
+				r = r * 1103515245 + 12345;
+				const LLUUID& id = mIDs[(r >> 8) % mIDs.size()];
+				fill_file(expected, id);
+				if ((i & 7) == 7)
+				{
+					if (mVFS->storeData(id, LLAssetType::AT_TEXTURE, &expected[0], 0, BENCH_FILE_SIZE) != BENCH_FILE_SIZE)
+					{
+						mErrors++;
+					}
+				}
+				else if (mVFS->getData(id, LLAssetType::AT_TEXTURE, &buffer[0], 0, BENCH_FILE_SIZE) != BENCH_FILE_SIZE ||
+						 buffer != expected)
+				{
+					mErrors++;
+				}
+			}
+		}
+
+		LLVFS* mVFS;
+		const std::vector<LLUUID>& mIDs;
+		U32 mSeed;
+		S32 mErrors;
+	};
+}
+
+namespace tut
+{
+	struct shardedvfs_test
+	{
+		std::string mTestDir;
+		std::vector<std::string> mFiles;
+
+		shardedvfs_test()
+		{
+			LLUUID random;
+			random.generate();
+			std::ostringstream oStr;
+#ifdef LL_WINDOWS
+			char* tmp_dir = getenv("TMP");
+			oStr << (tmp_dir ? tmp_dir : "c:/tmp") << "/llvfs-test-" << random << "/";
+#else
+			oStr << "/tmp/llvfs-test-" << random << "/";
+#endif
+			mTestDir = oStr.str();
+			LLFile::mkdir(mTestDir);
+		}
+
+		~shardedvfs_test()
+		{
+			for (std::vector<std::string>::iterator iter = mFiles.begin(); iter != mFiles.end(); ++iter)
+			{
+				LLFile::remove(*iter);
+			}
+			LLFile::rmdir(mTestDir);
+		}
+
+		LLVFS* createVFS(const std::string& name, BOOL sharded)
+		{
+			std::string index = mTestDir + name + ".index";
+			std::string data = mTestDir + name + ".data";
+			mFiles.push_back(index);
+			mFiles.push_back(data);
+			return LLVFS::createLLVFS(index, data, FALSE, BENCH_PRESIZE, FALSE, sharded);
+		}
+
+		void populate(LLVFS* vfs, std::vector<LLUUID>& ids)
+		{
+			std::vector<U8> buffer(BENCH_FILE_SIZE);
+			for (S32 i = 0; i < BENCH_FILE_COUNT; i++)
+			{
+				LLUUID id;
+				id.generate();
+				fill_file(buffer, id);
+				vfs->setMaxSize(id, LLAssetType::AT_TEXTURE, BENCH_FILE_SIZE);
+				vfs->storeData(id, LLAssetType::AT_TEXTURE, &buffer[0], 0, BENCH_FILE_SIZE);
+				ids.push_back(id);
+			}
+		}
+
+		// Returns operations per second, or 0 on errors.
+		F64 hammer(LLVFS* vfs, const std::vector<LLUUID>& ids, S32 thread_count)
+		{
+			std::vector<LLVFSHammerThread*> threads;
+			for (S32 i = 0; i < thread_count; i++)
+			{
+				threads.push_back(new LLVFSHammerThread(vfs, ids, 0x9e3779b9 * (i + 1)));
+			}
+
+			LLTimer timer;
+			for (S32 i = 0; i < thread_count; i++)
+			{
+				threads[i]->start();
+			}
+			S32 errors = 0;
+			for (S32 i = 0; i < thread_count; i++)
+			{
+				while (!threads[i]->isStopped())
+				{
+					ms_sleep(1);
+				}
+				errors += threads[i]->mErrors;
+				delete threads[i];
+			}
+			F64 elapsed = timer.getElapsedTimeF64();
+
+			ensure_equals("no errors hammering VFS", errors, 0);
+			return (F64)(thread_count * BENCH_OPS_PER_THREAD) / llmax(elapsed, 0.001);
+		}
+	};
+	typedef test_group<shardedvfs_test> shardedvfs_group_t;
+	typedef shardedvfs_group_t::object shardedvfs_object_t;
+	tut::shardedvfs_group_t shardedvfs_instance("LLShardedVFS");
+
+	template<> template<>
+	void shardedvfs_object_t::test<1>()
+		// basic store, read, rename and remove
+	{
+		LLVFS* vfs = createVFS("basic", TRUE);
+		ensure("created sharded VFS", vfs != NULL && vfs->isValid());
+
+		LLUUID id, renamed;
+		id.generate();
+		renamed.generate();
+		const U8 data[] = "sharded vfs test data";
+		const S32 len = (S32)sizeof(data);
+
+		ensure("setMaxSize", vfs->setMaxSize(id, LLAssetType::AT_NOTECARD, len));
+		ensure_equals("storeData", vfs->storeData(id, LLAssetType::AT_NOTECARD, data, 0, len), len);
+		ensure("getExists", vfs->getExists(id, LLAssetType::AT_NOTECARD));
+		ensure_equals("getSize", vfs->getSize(id, LLAssetType::AT_NOTECARD), len);
+
+		U8 buffer[sizeof(data)];
+		ensure_equals("getData", vfs->getData(id, LLAssetType::AT_NOTECARD, buffer, 0, len), len);
+		ensure("data round trips", memcmp(buffer, data, len) == 0);
+
+		vfs->renameFile(id, LLAssetType::AT_NOTECARD, renamed, LLAssetType::AT_NOTECARD);
+		ensure("old name gone", !vfs->getExists(id, LLAssetType::AT_NOTECARD));
+		ensure_equals("renamed getData", vfs->getData(renamed, LLAssetType::AT_NOTECARD, buffer, 0, len), len);
+		ensure("renamed data intact", memcmp(buffer, data, len) == 0);
+
+		// growing past the next file forces a relocation
+		LLUUID neighbour;
+		neighbour.generate();
+		vfs->setMaxSize(neighbour, LLAssetType::AT_NOTECARD, len);
+		ensure("grow", vfs->setMaxSize(renamed, LLAssetType::AT_NOTECARD, 64 * 1024));
+		ensure_equals("grown getData", vfs->getData(renamed, LLAssetType::AT_NOTECARD, buffer, 0, len), len);
+		ensure("grown data intact", memcmp(buffer, data, len) == 0);
+
+		vfs->removeFile(renamed, LLAssetType::AT_NOTECARD);
+		ensure("removed", !vfs->getExists(renamed, LLAssetType::AT_NOTECARD));
+
+		delete vfs;
+	}
+
+	template<> template<>
+	void shardedvfs_object_t::test<2>()
+		// index written by the sharded VFS reloads
+	{
+		LLUUID id;
+		id.generate();
+		std::vector<U8> buffer(BENCH_FILE_SIZE);
+		fill_file(buffer, id);
+
+		LLVFS* vfs = createVFS("reload", TRUE);
+		vfs->setMaxSize(id, LLAssetType::AT_TEXTURE, BENCH_FILE_SIZE);
+		vfs->storeData(id, LLAssetType::AT_TEXTURE, &buffer[0], 0, BENCH_FILE_SIZE);
+		delete vfs;
+
+		vfs = LLVFS::createLLVFS(mTestDir + "reload.index", mTestDir + "reload.data", FALSE, BENCH_PRESIZE, FALSE, FALSE);
+		ensure("reopened with LLVFS", vfs != NULL);
+		std::vector<U8> readback(BENCH_FILE_SIZE);
+		ensure_equals("size after reload", vfs->getData(id, LLAssetType::AT_TEXTURE, &readback[0], 0, BENCH_FILE_SIZE), BENCH_FILE_SIZE);
+		ensure("data after reload", readback == buffer);
+		delete vfs;
+	}
+
+	template<> template<>
+	void shardedvfs_object_t::test<3>()
+		// many threads at once, and with LL_BENCHMARKS the LLVFS vs
+		// LLShardedVFS contention benchmark
+	{
+		std::vector<LLUUID> ids;
+		LLVFS* vfs = createVFS("bench_single", FALSE);
+		populate(vfs, ids);
+		F64 single_ops = hammer(vfs, ids, BENCH_THREAD_COUNT);
+		delete vfs;
+
+		ids.clear();
+		vfs = createVFS("bench_sharded", TRUE);
+		populate(vfs, ids);
+		F64 sharded_ops = hammer(vfs, ids, BENCH_THREAD_COUNT);
+		BOOL mapped = ((LLShardedVFS*)vfs)->isMapped();
+		delete vfs;
+
+		if (run_benchmarks())
+		{
+			std::cout << "\nLLVFS " << BENCH_THREAD_COUNT << " threads: " << (S32)single_ops << " ops/sec"
+					  << "\nLLShardedVFS " << BENCH_THREAD_COUNT << " threads: " << (S32)sharded_ops << " ops/sec"
+					  << (mapped ? " (mapped)" : " (stdio)")
+					  << std::endl;
+		}
+	}
+
+	template<> template<>
+	void shardedvfs_object_t::test<4>()
+		// compaction coalesces free space and keeps file data intact
+	{
+		for (S32 sharded = 0; sharded < 2; sharded++)
+		{
+			LLVFS* vfs = createVFS(sharded ? "compact_sharded" : "compact", sharded);
+			std::vector<LLUUID> ids;
+			populate(vfs, ids);
+
+			// punch holes between the files
+			std::vector<LLUUID> kept;
+			for (S32 i = 0; i < (S32)ids.size(); i++)
+			{
+				if (i & 1)
+				{
+					vfs->removeFile(ids[i], LLAssetType::AT_TEXTURE);
+				}
+				else
+				{
+					kept.push_back(ids[i]);
+				}
+			}
+			ensure("fragmented", vfs->getFragmentation() > 0.f);
+			S32 largest_before = vfs->getLargestFreeExtent();
+
+			S32 passes = 0;
+			while (vfs->compact(64) > 0)
+			{
+				passes++;
+			}
+			ensure("compaction moved files", passes > 0);
+			ensure_equals("free space contiguous", vfs->getFragmentation(), 0.f);
+			ensure("largest free extent grew", vfs->getLargestFreeExtent() > largest_before);
+
+			std::vector<U8> expected(BENCH_FILE_SIZE);
+			std::vector<U8> buffer(BENCH_FILE_SIZE);
+			for (S32 i = 0; i < (S32)kept.size(); i++)
+			{
+				fill_file(expected, kept[i]);
+				ensure_equals("size after compaction", vfs->getData(kept[i], LLAssetType::AT_TEXTURE, &buffer[0], 0, BENCH_FILE_SIZE), BENCH_FILE_SIZE);
+				ensure("data after compaction", buffer == expected);
+			}
+			delete vfs;
+		}
+	}
+
+	template<> template<>
+	void shardedvfs_object_t::test<5>()
+		// a committed journal is replayed after a crash
+	{
+		for (S32 sharded = 0; sharded < 2; sharded++)
+		{
+			std::string name = sharded ? "journal_sharded" : "journal";
+			LLVFS* vfs = createVFS(name, sharded);
+			ensure("journal enabled", vfs->enableJournal());
+
+			std::vector<LLUUID> ids;
+			std::vector<U8> buffer(BENCH_FILE_SIZE);
+			for (S32 i = 0; i < 16; i++)
+			{
+				LLUUID id;
+				id.generate();
+				fill_file(buffer, id);
+				vfs->setMaxSize(id, LLAssetType::AT_TEXTURE, BENCH_FILE_SIZE);
+				vfs->storeData(id, LLAssetType::AT_TEXTURE, &buffer[0], 0, BENCH_FILE_SIZE);
+				ids.push_back(id);
+			}
+			// committed but never checkpointed into the index file
+			vfs->commitJournal();
+
+			// snapshot the files as a crash would leave them
+			std::string crashed = mTestDir + name + "_crashed";
+			copy_file(mTestDir + name + ".index", crashed + ".index");
+			copy_file(mTestDir + name + ".index.journal", crashed + ".index.journal");
+			copy_file(mTestDir + name + ".data", crashed + ".data");
+			mFiles.push_back(crashed + ".index");
+			mFiles.push_back(crashed + ".index.journal");
+			mFiles.push_back(crashed + ".data");
+			delete vfs;
+
+			vfs = LLVFS::createLLVFS(crashed + ".index", crashed + ".data", FALSE, BENCH_PRESIZE, TRUE, sharded);
+			ensure("reopened after crash", vfs != NULL);
+			std::vector<U8> expected(BENCH_FILE_SIZE);
+			for (S32 i = 0; i < (S32)ids.size(); i++)
+			{
+				fill_file(expected, ids[i]);
+				ensure_equals("size after replay", vfs->getData(ids[i], LLAssetType::AT_TEXTURE, &buffer[0], 0, BENCH_FILE_SIZE), BENCH_FILE_SIZE);
+				ensure("data after replay", buffer == expected);
+			}
+			delete vfs;
+		}
+	}
+
+	template<> template<>
+	void shardedvfs_object_t::test<6>()
+		// a crash part way through journaled compaction replays intact files
+	{
+		const S32 SMALL_SIZE = 4 * 1024;
+		std::string index = mTestDir + "crash_compact.index";
+		std::string data = mTestDir + "crash_compact.data";
+		mFiles.push_back(index);
+		mFiles.push_back(index + ".journal");
+		mFiles.push_back(data);
+		LLCrashingVFS* vfs = new LLCrashingVFS(index, data);
+		ensure("created", vfs->isValid());
+		ensure("journal enabled", vfs->enableJournal());
+
+		// Small and large files in turn.  Removing the small ones leaves
+		// gaps shorter than the large files after them, which the large
+		// files could only slide into over their own committed data.
+		std::vector<LLUUID> kept;
+		std::vector<LLUUID> removed;
+		std::vector<U8> buffer(BENCH_FILE_SIZE);
+		for (S32 i = 0; i < 64; i++)
+		{
+			LLUUID id;
+			id.generate();
+			S32 size = (i & 1) ? BENCH_FILE_SIZE : SMALL_SIZE;
+			fill_file(buffer, id);
+			vfs->setMaxSize(id, LLAssetType::AT_TEXTURE, size);
+			vfs->storeData(id, LLAssetType::AT_TEXTURE, &buffer[0], 0, size);
+			if (!(i & 1) || i % 8 == 1)
+			{
+				removed.push_back(id);
+			}
+			else
+			{
+				kept.push_back(id);
+			}
+		}
+		for (S32 i = 0; i < (S32)removed.size(); i++)
+		{
+			vfs->removeFile(removed[i], LLAssetType::AT_TEXTURE);
+		}
+		// The removals have to be committed before their space is reused
+		vfs->commitJournal();
+
+		while (vfs->compact(64) > 0)
+		{
+		}
+		ensure("compaction moved files", !vfs->mSnapshots.empty());
+		std::vector<std::string> snapshots = vfs->mSnapshots;
+		delete vfs;
+
+		std::vector<U8> expected(BENCH_FILE_SIZE);
+		for (S32 s = 0; s < (S32)snapshots.size(); s++)
+		{
+			mFiles.push_back(snapshots[s] + ".index");
+			mFiles.push_back(snapshots[s] + ".index.journal");
+			mFiles.push_back(snapshots[s] + ".data");
+			LLVFS* crashed = LLVFS::createLLVFS(snapshots[s] + ".index", snapshots[s] + ".data", FALSE, 0, TRUE, FALSE);
+			ensure("reopened after crash", crashed != NULL);
+			for (S32 i = 0; i < (S32)kept.size(); i++)
+			{
+				fill_file(expected, kept[i]);
+				ensure_equals(llformat("size after replay %d", s), crashed->getData(kept[i], LLAssetType::AT_TEXTURE, &buffer[0], 0, BENCH_FILE_SIZE), BENCH_FILE_SIZE);
+				ensure(llformat("data after replay %d", s), buffer == expected);
+			}
+			delete crashed;
+		}
+	}
+
+	template<> template<>
+	void shardedvfs_object_t::test<7>()
+		// compaction never slides a file over its own data
+	{
+		const S32 SMALL_SIZE = 4 * 1024;
+		for (S32 sharded = 0; sharded < 2; sharded++)
+		{
+			LLVFS* vfs = createVFS(sharded ? "overlap_sharded" : "overlap", sharded);
+
+			// Every gap left is shorter than the large file after it
+			std::vector<LLUUID> kept;
+			std::vector<LLUUID> removed;
+			std::vector<U8> buffer(BENCH_FILE_SIZE);
+			for (S32 i = 0; i < 32; i++)
+			{
+				LLUUID id;
+				id.generate();
+				S32 size = (i & 1) ? BENCH_FILE_SIZE : SMALL_SIZE;
+				fill_file(buffer, id);
+				vfs->setMaxSize(id, LLAssetType::AT_TEXTURE, size);
+				vfs->storeData(id, LLAssetType::AT_TEXTURE, &buffer[0], 0, size);
+				if (i & 1)
+				{
+					kept.push_back(id);
+				}
+				else
+				{
+					removed.push_back(id);
+				}
+			}
+			for (S32 i = 0; i < (S32)removed.size(); i++)
+			{
+				vfs->removeFile(removed[i], LLAssetType::AT_TEXTURE);
+			}
+			ensure("fragmented", vfs->getFragmentation() > 0.f);
+			ensure_equals("nothing to move", vfs->compact(64), 0);
+
+			std::vector<U8> expected(BENCH_FILE_SIZE);
+			for (S32 i = 0; i < (S32)kept.size(); i++)
+			{
+				fill_file(expected, kept[i]);
+				ensure_equals("size after compaction", vfs->getData(kept[i], LLAssetType::AT_TEXTURE, &buffer[0], 0, BENCH_FILE_SIZE), BENCH_FILE_SIZE);
+				ensure("data after compaction", buffer == expected);
+			}
+			delete vfs;
+		}
+	}
+}
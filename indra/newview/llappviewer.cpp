@@ -86,6 +86,7 @@
 // Linden library includes
 #include "llimagej2c.h"
 #include "llmemory.h"
+#include "llparallelpool.h"
 #include "llprimitive.h"
 #include "llurlaction.h"
 #include "llvfile.h"
@@ -148,6 +149,7 @@
 #include "llsdserialize.h"
 
 #include "llworld.h"
+#include "llviewerregion.h"
 #include "llhudeffecttrail.h"
 #include "llvectorperfoptions.h"
 #include "llslurl.h"
@@ -264,6 +266,7 @@ LLTimer gRenderStartTime;
 LLFrameTimer gForegroundTime;
 LLTimer gLogoutTimer;
 static const F32 LOGOUT_REQUEST_TIME = 6.f;  // this will be cut short by the LogoutReply msg.
+static const S32 MAX_DEFAULT_JOB_THREADS = 3;	// ThreadPoolViewerJobs of -1
 F32 gLogoutMaxTime = LOGOUT_REQUEST_TIME;
 
 BOOL				gDisconnected = FALSE;
@@ -564,6 +567,7 @@ const std::string LLAppViewer::sGlobalSettingsName = "Global";
 LLTextureCache* LLAppViewer::sTextureCache = NULL; 
 LLImageDecodeThread* LLAppViewer::sImageDecodeThread = NULL; 
 LLTextureFetch* LLAppViewer::sTextureFetch = NULL; 
+LLParallelPool* LLAppViewer::sJobPool = NULL;
 
 LLAppViewer::LLAppViewer() : 
 	mMarkerFile(),
@@ -1609,6 +1613,8 @@ bool LLAppViewer::cleanup()
     sTextureFetch = NULL;
 	delete sImageDecodeThread;
     sImageDecodeThread = NULL;
+	delete sJobPool;
+	sJobPool = NULL;
 	delete mFastTimerLogThread;
 	mFastTimerLogThread = NULL;
 	
@@ -1718,6 +1724,26 @@ void watchdog_killer_callback()
 	llerrs << "Watchdog killer event" << llendl;
 }
 
+// LLTextureFetch's view of the regions, from the agent and the world
+class LLViewerTextureFetchRegions : public LLTextureFetchRegions
+{
+public:
+	/*virtual*/ std::string getHttpUrl(const LLHost& host)
+	{
+		LLViewerRegion* region = NULL;
+		if (host == LLHost::invalid)
+			region = gAgent.getRegion();
+		else
+			region = LLWorld::getInstance()->getRegion(host);
+		return region ? region->getHttpUrl() : LLStringUtil::null;
+	}
+
+	/*virtual*/ LLHost getAgentRegionHost()
+	{
+		return gAgent.getRegionHost();
+	}
+};
+
 bool LLAppViewer::initThreads()
 {
 #if MEM_TRACK_MEM
@@ -1730,10 +1756,28 @@ bool LLAppViewer::initThreads()
 	LLLFSThread::initClass(enable_threads && false);
 
 	// Image decoding
-	LLAppViewer::sImageDecodeThread = new LLImageDecodeThread(enable_threads && true);
-	LLAppViewer::sTextureCache = new LLTextureCache(enable_threads && true);
-	LLAppViewer::sTextureFetch = new LLTextureFetch(LLAppViewer::getTextureCache(), sImageDecodeThread, enable_threads && true);
+	// Lock-free request queues keep the main thread from stalling on the workers
+	const bool concurrent_queues = gSavedSettings.getBOOL("ThreadConcurrentQueues");
+	// Texture fetch stays on one thread, its HTTP requests aren't thread safe
+	LLAppViewer::sImageDecodeThread = new LLImageDecodeThread(enable_threads && true, concurrent_queues,
+															  gSavedSettings.getS32("ThreadPoolImageDecode"));
+	LLAppViewer::sTextureCache = new LLTextureCache(enable_threads && true, concurrent_queues,
+													gSavedSettings.getS32("ThreadPoolTextureCache"));
+	LLAppViewer::sTextureFetch = new LLTextureFetch(new LLViewerTextureFetchRegions, LLAppViewer::getTextureCache(), sImageDecodeThread,
+													enable_threads && true, concurrent_queues);
 	LLImage::initClass();
+	// Helpers for the main thread's own batches of independent work.  By
+	// default one per core past the first, up to a few, leaving the other
+	// cores to the decode, cache and volume build threads.
+	S32 job_threads = gSavedSettings.getS32("ThreadPoolViewerJobs");
+	if (job_threads < 0)
+	{
+		job_threads = llclamp(gSysCPU.getCPUCount() - 1, 0, MAX_DEFAULT_JOB_THREADS);
+	}
+	if (enable_threads && job_threads > 0)
+	{
+		LLAppViewer::sJobPool = new LLParallelPool("viewerjobs", job_threads);
+	}
 
 	if (LLFastTimer::sLog || LLFastTimer::sMetricLog)
 	{
@@ -2233,6 +2277,8 @@ bool LLAppViewer::initConfiguration()
 	//LLVolumeMgr::initClass();
 	LLVolumeMgr* volume_manager = new LLVolumeMgr();
 	volume_manager->useMutex();	// LLApp and LLMutex magic must be manually enabled
+	// Volumes for LOD changes are built ahead on these
+	volume_manager->startBuildThread(gSavedSettings.getS32("ThreadPoolVolumeBuild"));
 	LLPrimitive::setVolumeManager(volume_manager);
 
 	// Note: this is where we used to initialize gFeatureManagerp.
@@ -3079,7 +3125,7 @@ U32 LLAppViewer::getObjectCacheVersion()
 {
 	// Viewer object cache version, change if object update
 	// format changes. JC
-	const U32 INDRA_OBJECT_CACHE_VERSION = 14;
+	const U32 INDRA_OBJECT_CACHE_VERSION = 15;
 
 	return INDRA_OBJECT_CACHE_VERSION;
 }
@@ -3148,6 +3194,7 @@ bool LLAppViewer::initCache()
 	const S64 MAX_CACHE_SIZE = 1024*MB;
 	cache_size = llmin(cache_size, MAX_CACHE_SIZE);
 	S64 texture_cache_size = ((cache_size * 8)/10);
+	LLAppViewer::getTextureCache()->setDXTCacheEnabled(gSavedSettings.getBOOL("TextureCacheCompressed"));
 	S64 extra = LLAppViewer::getTextureCache()->initCache(LL_PATH_CACHE, texture_cache_size, texture_cache_mismatch);
 	texture_cache_size -= extra;
 
@@ -3279,7 +3326,8 @@ bool LLAppViewer::initCache()
 	gSavedSettings.setU32("VFSSalt", new_salt);
 
 	// Don't remove VFS after viewer crashes.  If user has corrupt data, they can reinstall. JC
-	gVFS = LLVFS::createLLVFS(new_vfs_index_file, new_vfs_data_file, false, vfs_size_u32, false);
+	gVFS = LLVFS::createLLVFS(new_vfs_index_file, new_vfs_data_file, false, vfs_size_u32, false,
+							  gSavedSettings.getBOOL("VFSSharded"));
 	if( !gVFS )
 	{
 		return false;
@@ -3300,6 +3348,18 @@ bool LLAppViewer::initCache()
 	{
 		LLVFile::initClass();
 
+		F32 compaction_period = gSavedSettings.getF32("VFSCompactionPeriod");
+		if (compaction_period > 0.f)
+		{
+			LLVFSThread::setCompactionVFS(gVFS, compaction_period);
+		}
+
+		// Commit index changes once a second, see LLVFS::enableJournal()
+		if (gSavedSettings.getBOOL("VFSJournal") && gVFS->enableJournal())
+		{
+			LLVFSThread::setJournalVFS(gVFS, 1.f);
+		}
+
 #ifndef LL_RELEASE_FOR_DOWNLOAD
 		if (gSavedSettings.getBOOL("DumpVFSCaches"))
 		{
@@ -3717,6 +3777,12 @@ void LLAppViewer::idle()
 			gObjectList.update(gAgent, *LLWorld::getInstance());
 		}
 	}
+
+	{
+		static LLFastTimer::DeclareTimer ftm("Volume Builds");
+		LLFastTimer t(ftm);
+		LLVOVolume::updateVolumeBuilds();
+	}
 	
 	//////////////////////////////////////
 	//
@@ -38,6 +38,7 @@ class LLPumpIO;
 class LLTextureCache;
 class LLImageDecodeThread;
 class LLTextureFetch;
+class LLParallelPool;
 class LLWatchdogTimeout;
 class LLCommandLineParser;
 
@@ -93,6 +94,8 @@ public:
 	static LLTextureCache* getTextureCache() { return sTextureCache; }
 	static LLImageDecodeThread* getImageDecodeThread() { return sImageDecodeThread; }
 	static LLTextureFetch* getTextureFetch() { return sTextureFetch; }
+	// Helpers for splitting main thread work, NULL if disabled
+	static LLParallelPool* getJobPool() { return sJobPool; }
 
 	static U32 getTextureCacheVersion() ;
 	static U32 getObjectCacheVersion() ;
@@ -231,6 +234,7 @@ private:
 	static LLTextureCache* sTextureCache; 
 	static LLImageDecodeThread* sImageDecodeThread; 
 	static LLTextureFetch* sTextureFetch;
+	static LLParallelPool* sJobPool;
 
 	S32 mNumSessions;
 
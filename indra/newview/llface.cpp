@@ -32,6 +32,7 @@
 
 #include "llviewercontrol.h"
 #include "llvolume.h"
+#include "llvolumexform.h"
 #include "m3math.h"
 #include "v3color.h"
 
@@ -47,6 +48,7 @@
 #include "pipeline.h"
 #include "llviewerregion.h"
 #include "llviewerwindow.h"
+#include "llparallelpool.h"
 
 #define LL_MAX_INDICES_COUNT 1000000
 
@@ -282,6 +284,17 @@ void LLFace::setTexture(LLViewerTexture* tex)
 	mTexture = tex ;
 }
 
+void LLFace::setVirtualSize(F32 size)
+{
+	// Coming into or going out of view, or a change big enough to move the
+	// texture in the fetch order
+	if (mTexture.notNull() && (size > mVSize * 1.25f || size < mVSize * 0.8f))
+	{
+		mTexture->dirtyDecodePriority();
+	}
+	mVSize = size;
+}
+
 void LLFace::dirtyTexture()
 {
 	gPipeline.markTextured(getDrawable());
@@ -951,6 +964,52 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 								const U16 &index_offset)
 {
 	LLFastTimer t(FTM_FACE_GET_GEOM);
+	GeomParams params;
+	if (!prepareGeometryVolume(volume, f, mat_vert, mat_normal, index_offset, params))
+	{
+		return FALSE;
+	}
+
+	GeomStriders striders;
+	if (params.mFullRebuild)
+	{
+		mVertexBuffer->getIndexStrider(striders.mIndices, mIndicesIndex);
+	}
+	if (params.mRebuildPos)
+	{
+		mVertexBuffer->getVertexStrider(striders.mVertices, mGeomIndex);
+	}
+	if (params.mRebuildNormal)
+	{
+		mVertexBuffer->getNormalStrider(striders.mNormals, mGeomIndex);
+	}
+	if (params.mRebuildBinormal)
+	{
+		mVertexBuffer->getBinormalStrider(striders.mBinormals, mGeomIndex);
+	}
+	if (params.mRebuildTCoord)
+	{
+		mVertexBuffer->getTexCoord0Strider(striders.mTexCoords, mGeomIndex);
+	}
+	if (params.mRebuildTCoord2)
+	{
+		mVertexBuffer->getTexCoord1Strider(striders.mTexCoords2, mGeomIndex);
+	}
+	if (params.mRebuildColor)
+	{
+		mVertexBuffer->getColorStrider(striders.mColors, mGeomIndex);
+	}
+
+	fillGeometryVolume(params, striders);
+	return TRUE;
+}
+
+BOOL LLFace::prepareGeometryVolume(const LLVolume& volume,
+								   const S32 &f,
+								   const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
+								   const U16 &index_offset,
+								   GeomParams& params)
+{
 	const LLVolumeFace &vf = volume.getVolumeFace(f);
 	S32 num_vertices = (S32)vf.mVertices.size();
 	S32 num_indices = LLPipeline::sUseTriStrips ? (S32)vf.mTriStrip.size() : (S32) vf.mIndices.size();
@@ -978,25 +1037,24 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		}
 	}
 
-	LLStrider<LLVector3> vertices;
-	LLStrider<LLVector2> tex_coords;
-	LLStrider<LLVector2> tex_coords2;
-	LLStrider<LLVector3> normals;
-	LLStrider<LLColor4U> colors;
-	LLStrider<LLVector3> binormals;
-	LLStrider<U16> indicesp;
+	params.mVolumeFace = &vf;
+	params.mNumVertices = num_vertices;
+	params.mNumIndices = num_indices;
+	params.mUseTriStrips = LLPipeline::sUseTriStrips;
+	params.mIndexOffset = index_offset;
+	params.mMatVert = mat_vert;
+	params.mMatNormal = mat_normal;
 
 	BOOL full_rebuild = mDrawablep->isState(LLDrawable::REBUILD_VOLUME);
 	
 	BOOL global_volume = mDrawablep->getVOVolume()->isVolumeGlobal();
-	LLVector3 scale;
 	if (global_volume)
 	{
-		scale.setVec(1,1,1);
+		params.mScale.setVec(1,1,1);
 	}
 	else
 	{
-		scale = mVObjp->getScale();
+		params.mScale = mVObjp->getScale();
 	}
 	
 	BOOL rebuild_pos = full_rebuild || mDrawablep->isState(LLDrawable::REBUILD_POSITION);
@@ -1008,57 +1066,31 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 	const LLTextureEntry *tep = mVObjp->getTE(f);
 	U8  bump_code = tep ? tep->getBumpmap() : 0;
 
-	if (rebuild_pos)
-	{
-		mVertexBuffer->getVertexStrider(vertices, mGeomIndex);
-	}
-	if (rebuild_normal)
-	{
-		mVertexBuffer->getNormalStrider(normals, mGeomIndex);
-	}
-	if (rebuild_binormal)
-	{
-		mVertexBuffer->getBinormalStrider(binormals, mGeomIndex);
-	}
-
-	F32 tcoord_xoffset = 0.f ;
-	F32 tcoord_yoffset = 0.f ;
-	F32 tcoord_xscale = 1.f ;
-	F32 tcoord_yscale = 1.f ;
-	BOOL in_atlas = FALSE ;
+	params.mFullRebuild = full_rebuild;
+	params.mRebuildPos = rebuild_pos;
+	params.mRebuildColor = rebuild_color;
+	params.mRebuildTCoord = rebuild_tcoord;
+	params.mRebuildTCoord2 = rebuild_tcoord && bump_code && mVertexBuffer->hasDataType(LLVertexBuffer::TYPE_TEXCOORD1);
+	params.mRebuildNormal = rebuild_normal;
+	params.mRebuildBinormal = rebuild_binormal;
 
+	params.mInAtlas = FALSE;
 	if (rebuild_tcoord)
 	{
-		mVertexBuffer->getTexCoord0Strider(tex_coords, mGeomIndex);
-		if (bump_code && mVertexBuffer->hasDataType(LLVertexBuffer::TYPE_TEXCOORD1))
-		{
-			mVertexBuffer->getTexCoord1Strider(tex_coords2, mGeomIndex);
-		}
-
-		in_atlas = isAtlasInUse() ;
-		if(in_atlas)
+		params.mInAtlas = isAtlasInUse();
+		if (params.mInAtlas)
 		{
-			const LLVector2* tmp = getTexCoordOffset() ;
-			tcoord_xoffset = tmp->mV[0] ; 
-			tcoord_yoffset = tmp->mV[1] ;
-
-			tmp = getTexCoordScale() ;
-			tcoord_xscale = tmp->mV[0] ; 
-			tcoord_yscale = tmp->mV[1] ;	
+			params.mAtlasOffset = *getTexCoordOffset();
+			params.mAtlasScale = *getTexCoordScale();
+			params.mAddressMode = mTexture->getAddressMode();
 		}
 	}
-	if (rebuild_color)
-	{	
-		mVertexBuffer->getColorStrider(colors, mGeomIndex);
-	}
 
 	F32 r = 0, os = 0, ot = 0, ms = 0, mt = 0, cos_ang = 0, sin_ang = 0;
 	
 	BOOL is_static = mDrawablep->isStatic();
 	BOOL is_global = is_static;
 
-	LLVector3 center_sum(0.f, 0.f, 0.f);
-	
 	if (is_global)
 	{
 		setState(GLOBAL);
@@ -1068,10 +1100,6 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		clearState(GLOBAL);
 	}
 
-	LLVector2 tmin, tmax;
-	
-	
-
 	if (rebuild_tcoord)
 	{
 		if (tep)
@@ -1121,6 +1149,18 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		}
 	}
 
+	params.mUseTexMatrix = tex_mode && mTextureMatrix;
+	if (params.mUseTexMatrix)
+	{
+		params.mTexMatrix = *mTextureMatrix;
+	}
+	params.mCosAng = cos_ang;
+	params.mSinAng = sin_ang;
+	params.mOffS = os;
+	params.mOffT = ot;
+	params.mMagS = ms;
+	params.mMagT = mt;
+
 	LLColor4U color = tep->getColor();
 
 	if (rebuild_color)
@@ -1141,37 +1181,14 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 			}
 		}
 	}
-
-    // INDICES
-	if (full_rebuild)
-	{
-		mVertexBuffer->getIndexStrider(indicesp, mIndicesIndex);
-		if (LLPipeline::sUseTriStrips)
-		{
-			for (U32 i = 0; i < (U32) num_indices; i++)
-			{
-				*indicesp++ = vf.mTriStrip[i] + index_offset;
-			}
-		}
-		else
-		{
-			for (U32 i = 0; i < (U32) num_indices; i++)
-			{
-				*indicesp++ = vf.mIndices[i] + index_offset;
-			}
-		}
-	}
-	
+	params.mColor = color;
 	
 	//bump setup
-	LLVector3 binormal_dir( -sin_ang, cos_ang, 0 );
-	LLVector3 bump_s_primary_light_ray;
-	LLVector3 bump_t_primary_light_ray;
-
-	LLQuaternion bump_quat;
-	if (mDrawablep->isActive())
+	params.mBinormalDir.setVec(-sin_ang, cos_ang, 0);
+	params.mBumpRotate = mDrawablep->isActive();
+	if (params.mBumpRotate)
 	{
-		bump_quat = LLQuaternion(mDrawablep->getRenderMatrix());
+		params.mBumpQuat = LLQuaternion(mDrawablep->getRenderMatrix());
 	}
 	
 	if (bump_code)
@@ -1218,19 +1235,90 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		LLVector3   moon_ray = gSky.getMoonDirection();
 		LLVector3& primary_light_ray = (sun_ray.mV[VZ] > 0) ? sun_ray : moon_ray;
 
-		bump_s_primary_light_ray = offset_multiple * s_scale * primary_light_ray;
-		bump_t_primary_light_ray = offset_multiple * t_scale * primary_light_ray;
+		params.mBumpS = offset_multiple * s_scale * primary_light_ray;
+		params.mBumpT = offset_multiple * t_scale * primary_light_ray;
 	}
 		
-	U8 texgen = getTextureEntry()->getTexGen();
-	if (rebuild_tcoord && texgen != LLTextureEntry::TEX_GEN_DEFAULT)
+	params.mTexGen = getTextureEntry()->getTexGen();
+	if (rebuild_tcoord && params.mTexGen != LLTextureEntry::TEX_GEN_DEFAULT)
 	{ //planar texgen needs binormals
 		mVObjp->getVolume()->genBinormals(f);
 	}
 
+	if (rebuild_tcoord)
+	{
+		mTexExtents[0].setVec(0,0);
+		mTexExtents[1].setVec(1,1);
+		xform(mTexExtents[0], cos_ang, sin_ang, os, ot, ms, mt);
+		xform(mTexExtents[1], cos_ang, sin_ang, os, ot, ms, mt);		
+	}
+
+	mLastVertexBuffer = mVertexBuffer;
+	mLastGeomCount = mGeomCount;
+	mLastGeomIndex = mGeomIndex;
+	mLastIndicesCount = mIndicesCount;
+	mLastIndicesIndex = mIndicesIndex;
+
+	return TRUE;
+}
+
+//static
+void LLFace::fillGeometryVolume(const GeomParams& params, GeomStriders& striders)
+{
+	const LLVolumeFace& vf = *params.mVolumeFace;
+	const S32 num_vertices = params.mNumVertices;
+
+    // INDICES
+	if (params.mFullRebuild)
+	{
+		LLStrider<U16>& indicesp = striders.mIndices;
+		const U16 index_offset = params.mIndexOffset;
+		if (params.mUseTriStrips)
+		{
+			for (U32 i = 0; i < (U32) params.mNumIndices; i++)
+			{
+				*indicesp++ = vf.mTriStrip[i] + index_offset;
+			}
+		}
+		else
+		{
+			for (U32 i = 0; i < (U32) params.mNumIndices; i++)
+			{
+				*indicesp++ = vf.mIndices[i] + index_offset;
+			}
+		}
+	}
+
+	const U8 texgen = params.mTexGen;
+	const LLVolumeFace::VertexData* src = num_vertices ? &vf.mVertices[0] : NULL;
+
+	// Positions, normals and binormals in batches.  Texture coordinates too
+	// when only the texture entry's transform applies, and no bump offset
+	// is built from them.
+	if (params.mRebuildPos)
+	{
+		LLVolumeXform::transformPositions(src, num_vertices, params.mMatVert, striders.mVertices);
+	}
+	if (params.mRebuildNormal)
+	{
+		LLVolumeXform::transformNormals(src, num_vertices, params.mMatNormal, striders.mNormals);
+	}
+	if (params.mRebuildBinormal)
+	{
+		LLVolumeXform::transformBinormals(src, num_vertices, params.mMatNormal, striders.mBinormals);
+	}
+
+	BOOL batch_tcoord = params.mRebuildTCoord && !params.mRebuildTCoord2 && texgen == LLTextureEntry::TEX_GEN_DEFAULT &&
+						!params.mUseTexMatrix && !params.mInAtlas;
+	if (batch_tcoord)
+	{
+		LLVolumeXform::transformTexCoords(src, num_vertices, params.mCosAng, params.mSinAng,
+										  params.mOffS, params.mOffT, params.mMagS, params.mMagT, striders.mTexCoords);
+	}
+
 	for (S32 i = 0; i < num_vertices; i++)
 	{
-		if (rebuild_tcoord)
+		if (params.mRebuildTCoord && !batch_tcoord)
 		{
 			LLVector2 tc = vf.mVertices[i].mTexCoord;
 		
@@ -1238,7 +1326,7 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 			{
 				LLVector3 vec = vf.mVertices[i].mPosition; 
 			
-				vec.scaleVec(scale);
+				vec.scaleVec(params.mScale);
 
 				switch (texgen)
 				{
@@ -1256,19 +1344,19 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 				}		
 			}
 
-			if (tex_mode && mTextureMatrix)
+			if (params.mUseTexMatrix)
 			{
 				LLVector3 tmp(tc.mV[0], tc.mV[1], 0.f);
-				tmp = tmp * *mTextureMatrix;
+				tmp = tmp * params.mTexMatrix;
 				tc.mV[0] = tmp.mV[0];
 				tc.mV[1] = tmp.mV[1];
 			}
 			else
 			{
-				xform(tc, cos_ang, sin_ang, os, ot, ms, mt);
+				xform(tc, params.mCosAng, params.mSinAng, params.mOffS, params.mOffT, params.mMagS, params.mMagT);
 			}
 
-			if(in_atlas)
+			if (params.mInAtlas)
 			{
 				//
 				//manually calculate tex-coord per vertex for varying address modes.
@@ -1276,7 +1364,7 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 				//
 
 				S32 int_part = 0 ;
-				switch(mTexture->getAddressMode())
+				switch(params.mAddressMode)
 				{
 				case LLTexUnit::TAM_CLAMP:
 					if(tc.mV[0] < 0.f)
@@ -1350,77 +1438,236 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 					break;
 				}
 			
-				tc.mV[0] = tcoord_xoffset + tcoord_xscale * tc.mV[0] ;
-				tc.mV[1] = tcoord_yoffset + tcoord_yscale * tc.mV[1] ;
+				tc.mV[0] = params.mAtlasOffset.mV[0] + params.mAtlasScale.mV[0] * tc.mV[0] ;
+				tc.mV[1] = params.mAtlasOffset.mV[1] + params.mAtlasScale.mV[1] * tc.mV[1] ;
 			}
 			
 
-			*tex_coords++ = tc;
+			*striders.mTexCoords++ = tc;
 		
-			if (bump_code && mVertexBuffer->hasDataType(LLVertexBuffer::TYPE_TEXCOORD1))
+			if (params.mRebuildTCoord2)
 			{
 				LLVector3 tangent = vf.mVertices[i].mBinormal % vf.mVertices[i].mNormal;
 
 				LLMatrix3 tangent_to_object;
 				tangent_to_object.setRows(tangent, vf.mVertices[i].mBinormal, vf.mVertices[i].mNormal);
-				LLVector3 binormal = binormal_dir * tangent_to_object;
-				binormal = binormal * mat_normal;
+				LLVector3 binormal = params.mBinormalDir * tangent_to_object;
+				binormal = binormal * params.mMatNormal;
 				
-				if (mDrawablep->isActive())
+				if (params.mBumpRotate)
 				{
-					binormal *= bump_quat;
+					binormal *= params.mBumpQuat;
 				}
 
 				binormal.normVec();
-				tc += LLVector2( bump_s_primary_light_ray * tangent, bump_t_primary_light_ray * binormal );
+				tc += LLVector2( params.mBumpS * tangent, params.mBumpT * binormal );
 				
-				*tex_coords2++ = tc;
+				*striders.mTexCoords2++ = tc;
 			}	
 		}
 			
-		if (rebuild_pos)
+		if (params.mRebuildColor)
 		{
-			*vertices++ = vf.mVertices[i].mPosition * mat_vert;
+			*striders.mColors++ = params.mColor;		
 		}
-		
-		if (rebuild_normal)
+	}
+}
+
+//============================================================================
+
+static LLFastTimer::DeclareTimer FTM_FACE_GEOM_STAGE("Face Geom Stage");
+static LLFastTimer::DeclareTimer FTM_FACE_GEOM_UPLOAD("Face Geom Upload");
+
+class LLFaceGeomBatch::FillJob : public LLParallelPool::Job
+{
+public:
+	FillJob(LLFaceGeomBatch& batch) : mBatch(batch) { }
+
+	/*virtual*/ void run(S32 index)
+	{
+		Entry& entry = mBatch.mEntries[index];
+		const LLFace::GeomParams& params = entry.mParams;
+		LLVertexBuffer* buffer = entry.mBuffer;
+		const S32 stride = buffer->getStride();
+		U8* base = &mBatch.mVertexData[entry.mVertexStart];
+
+		LLFace::GeomStriders striders;
+		if (params.mFullRebuild)
 		{
-			LLVector3 normal = vf.mVertices[i].mNormal * mat_normal;
-			normal.normVec();
-			
-			*normals++ = normal;
+			striders.mIndices = &mBatch.mIndexData[entry.mIndicesStart];
 		}
-		
-		if (rebuild_binormal)
+		if (params.mRebuildPos)
 		{
-			LLVector3 binormal = vf.mVertices[i].mBinormal * mat_normal;
-			binormal.normVec();
-			*binormals++ = binormal;
+			striders.mVertices = (LLVector3*) (base + buffer->getOffset(LLVertexBuffer::TYPE_VERTEX));
+			striders.mVertices.setStride(stride);
 		}
-		
-		if (rebuild_color)
+		if (params.mRebuildNormal)
+		{
+			striders.mNormals = (LLVector3*) (base + buffer->getOffset(LLVertexBuffer::TYPE_NORMAL));
+			striders.mNormals.setStride(stride);
+		}
+		if (params.mRebuildBinormal)
+		{
+			striders.mBinormals = (LLVector3*) (base + buffer->getOffset(LLVertexBuffer::TYPE_BINORMAL));
+			striders.mBinormals.setStride(stride);
+		}
+		if (params.mRebuildTCoord)
+		{
+			striders.mTexCoords = (LLVector2*) (base + buffer->getOffset(LLVertexBuffer::TYPE_TEXCOORD0));
+			striders.mTexCoords.setStride(stride);
+		}
+		if (params.mRebuildTCoord2)
 		{
-			*colors++ = color;		
+			striders.mTexCoords2 = (LLVector2*) (base + buffer->getOffset(LLVertexBuffer::TYPE_TEXCOORD1));
+			striders.mTexCoords2.setStride(stride);
 		}
+		if (params.mRebuildColor)
+		{
+			striders.mColors = (LLColor4U*) (base + buffer->getOffset(LLVertexBuffer::TYPE_COLOR));
+			striders.mColors.setStride(stride);
+		}
+
+		LLFace::fillGeometryVolume(params, striders);
 	}
 
-	if (rebuild_tcoord)
+private:
+	LLFaceGeomBatch& mBatch;
+};
+
+LLFaceGeomBatch::LLFaceGeomBatch()
+:	mNumEntries(0),
+	mVertexBytes(0),
+	mNumIndices(0)
+{
+}
+
+BOOL LLFaceGeomBatch::add(LLFace* face, const LLVolume& volume,
+						  const S32 &f,
+						  const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
+						  const U16 &index_offset)
+{
+	LLFastTimer t(FTM_FACE_GET_GEOM);
+	llassert(face->mVertexBuffer.notNull());
+
+	if (mNumEntries == (S32) mEntries.size())
 	{
-		mTexExtents[0].setVec(0,0);
-		mTexExtents[1].setVec(1,1);
-		xform(mTexExtents[0], cos_ang, sin_ang, os, ot, ms, mt);
-		xform(mTexExtents[1], cos_ang, sin_ang, os, ot, ms, mt);		
+		mEntries.push_back(Entry());
 	}
+	Entry& entry = mEntries[mNumEntries];
 
-	mLastVertexBuffer = mVertexBuffer;
-	mLastGeomCount = mGeomCount;
-	mLastGeomIndex = mGeomIndex;
-	mLastIndicesCount = mIndicesCount;
-	mLastIndicesIndex = mIndicesIndex;
+	if (!face->prepareGeometryVolume(volume, f, mat_vert, mat_normal, index_offset, entry.mParams))
+	{
+		return FALSE;
+	}
 
+	entry.mFace = face;
+	entry.mBuffer = face->mVertexBuffer;
+	entry.mVertexStart = mVertexBytes;
+	entry.mIndicesStart = mNumIndices;
+	mNumEntries++;
+
+	// Only reserved here, the pointers are taken in build() once nothing
+	// else can be added
+	mVertexBytes += entry.mParams.mNumVertices * entry.mBuffer->getStride();
+	if (entry.mParams.mFullRebuild)
+	{
+		mNumIndices += entry.mParams.mNumIndices;
+	}
 	return TRUE;
 }
 
+void LLFaceGeomBatch::build(LLParallelPool* pool)
+{
+	if (!mNumEntries)
+	{
+		return;
+	}
+
+	// Grown and never shrunk, so a steady frame does not allocate
+	if (mVertexData.size() < mVertexBytes)
+	{
+		mVertexData.resize(mVertexBytes);
+	}
+	if (mIndexData.size() < mNumIndices + 1)
+	{
+		mIndexData.resize(mNumIndices + 1);
+	}
+
+	{
+		LLFastTimer t(FTM_FACE_GEOM_STAGE);
+		FillJob job(*this);
+		LLParallelPool::run(pool, job, mNumEntries);
+	}
+
+	{
+		LLFastTimer t(FTM_FACE_GEOM_UPLOAD);
+		for (S32 i = 0; i < mNumEntries; i++)
+		{
+			upload(mEntries[i]);
+			mEntries[i].mBuffer = NULL;
+		}
+	}
+
+	mNumEntries = 0;
+	mVertexBytes = 0;
+	mNumIndices = 0;
+}
+
+void LLFaceGeomBatch::upload(Entry& entry)
+{
+	LLFace* face = entry.mFace;
+	LLVertexBuffer* buffer = entry.mBuffer;
+	const LLFace::GeomParams& params = entry.mParams;
+
+	if (buffer->mapBuffer() == NULL)
+	{
+		llwarns << "mapBuffer failed!" << llendl;
+		return;
+	}
+
+	const S32 stride = buffer->getStride();
+	const U8* src = &mVertexData[entry.mVertexStart];
+	U8* dst = buffer->getMappedData() + face->getGeomIndex() * stride;
+
+	U32 written = 0;
+	written |= params.mRebuildPos ? LLVertexBuffer::MAP_VERTEX : 0;
+	written |= params.mRebuildNormal ? LLVertexBuffer::MAP_NORMAL : 0;
+	written |= params.mRebuildBinormal ? LLVertexBuffer::MAP_BINORMAL : 0;
+	written |= params.mRebuildTCoord ? LLVertexBuffer::MAP_TEXCOORD0 : 0;
+	written |= params.mRebuildTCoord2 ? LLVertexBuffer::MAP_TEXCOORD1 : 0;
+	written |= params.mRebuildColor ? LLVertexBuffer::MAP_COLOR : 0;
+
+	if (written == (buffer->getTypeMask() & ((1 << LLVertexBuffer::TYPE_MAX) - 1)))
+	{ //every attribute, copy the vertices in one go
+		memcpy(dst, src, params.mNumVertices * stride);
+	}
+	else
+	{ //leave alone what this rebuild did not touch
+		for (S32 type = 0; type < LLVertexBuffer::TYPE_MAX; type++)
+		{
+			if (!(written & (1 << type)))
+			{
+				continue;
+			}
+			const S32 offset = buffer->getOffset(type);
+			const S32 size = LLVertexBuffer::sTypeOffsets[type];
+			for (S32 i = 0; i < params.mNumVertices; i++)
+			{
+				memcpy(dst + i * stride + offset, src + i * stride + offset, size);
+			}
+		}
+	}
+
+	if (params.mFullRebuild)
+	{
+		memcpy(buffer->getMappedIndices() + face->getIndicesStart() * sizeof(U16),
+			   &mIndexData[entry.mIndicesStart], params.mNumIndices * sizeof(U16));
+	}
+
+	buffer->markDirty(face->getGeomIndex(), face->getGeomCount(), 
+					  face->getIndicesStart(), face->getIndicesCount());
+}
+
 //check if the face has a media
 BOOL LLFace::hasMedia() const 
 {
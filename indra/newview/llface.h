@@ -33,6 +33,7 @@
 #include "v2math.h"
 #include "v3math.h"
 #include "v4math.h"
+#include "m3math.h"
 #include "m4math.h"
 #include "v4coloru.h"
 #include "llquaternion.h"
@@ -45,12 +46,14 @@
 
 class LLFacePool;
 class LLVolume;
+class LLVolumeFace;
 class LLViewerTexture;
 class LLTextureEntry;
 class LLVertexProgram;
 class LLViewerTexture;
 class LLGeometryManager;
 class LLTextureAtlasSlot;
+class LLParallelPool;
 
 const F32 MIN_ALPHA_SIZE = 1024.f;
 const F32 MIN_TEX_ANIM_SIZE = 512.f;
@@ -97,7 +100,7 @@ public:
 	void			setState(U32 state)			{ mState |= state; }
 	void			clearState(U32 state)		{ mState &= ~state; }
 	BOOL			isState(U32 state)	const	{ return ((mState & state) != 0) ? TRUE : FALSE; }
-	void			setVirtualSize(F32 size) { mVSize = size; }
+	void			setVirtualSize(F32 size);
 	void			setPixelArea(F32 area)	{ mPixelArea = area; }
 	F32				getVirtualSize() const { return mVSize; }
 	F32				getPixelArea() const { return mPixelArea; }
@@ -144,6 +147,72 @@ public:
 						const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
 						const U16 &index_offset);
 
+	// Everything the per vertex loop of getGeometryVolume() reads besides
+	// the volume face, so the loop can run off the main thread
+	struct GeomParams
+	{
+		const LLVolumeFace* mVolumeFace;
+		S32			mNumVertices;
+		S32			mNumIndices;
+		BOOL		mUseTriStrips;
+		U16			mIndexOffset;
+		LLMatrix4	mMatVert;
+		LLMatrix3	mMatNormal;
+		LLVector3	mScale;
+
+		// what to write, indices only on a full rebuild
+		BOOL		mFullRebuild;
+		BOOL		mRebuildPos;
+		BOOL		mRebuildNormal;
+		BOOL		mRebuildBinormal;
+		BOOL		mRebuildTCoord;
+		BOOL		mRebuildTCoord2;
+		BOOL		mRebuildColor;
+
+		// texture coordinates
+		U8			mTexGen;
+		BOOL		mUseTexMatrix;
+		LLMatrix4	mTexMatrix;
+		F32			mCosAng, mSinAng, mOffS, mOffT, mMagS, mMagT;
+		BOOL		mInAtlas;
+		LLTexUnit::eTextureAddressMode mAddressMode;
+		LLVector2	mAtlasOffset;
+		LLVector2	mAtlasScale;
+
+		// bump offsets in the second texture coordinates
+		LLVector3	mBinormalDir;
+		LLVector3	mBumpS;
+		LLVector3	mBumpT;
+		BOOL		mBumpRotate;
+		LLQuaternion mBumpQuat;
+
+		LLColor4U	mColor;
+	};
+
+	// Where fillGeometryVolume() writes, a mapped vertex buffer or staging
+	// memory laid out like one
+	struct GeomStriders
+	{
+		LLStrider<LLVector3> mVertices;
+		LLStrider<LLVector3> mNormals;
+		LLStrider<LLVector3> mBinormals;
+		LLStrider<LLVector2> mTexCoords;
+		LLStrider<LLVector2> mTexCoords2;
+		LLStrider<LLColor4U> mColors;
+		LLStrider<U16>		 mIndices;
+	};
+
+	// getGeometryVolume() in two halves: prepareGeometryVolume() checks the
+	// face fits mVertexBuffer and does everything that touches the face, its
+	// object or the pipeline, on the main thread.  fillGeometryVolume() only
+	// reads params and the volume face, on any thread.
+	BOOL prepareGeometryVolume(const LLVolume& volume,
+						const S32 &f,
+						const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
+						const U16 &index_offset,
+						GeomParams& params);
+	static void fillGeometryVolume(const GeomParams& params, GeomStriders& striders);
+
 	// For avatar
 	U16			 getGeometryAvatar(
 									LLStrider<LLVector3> &vertices,
@@ -342,4 +411,50 @@ public:
 	};
 };
 
+// Fills the geometry of many faces at once.  add() runs the main thread
+// half of LLFace::getGeometryVolume() and reserves staging memory laid out
+// like the face's vertex buffer.  build() fills all the staged faces on a
+// job pool, then maps each vertex buffer on this thread and copies the
+// faces in, so only mapBuffer() and a copy per face are left on the GL
+// thread.
+class LLFaceGeomBatch
+{
+public:
+	LLFaceGeomBatch();
+
+	// As LLFace::getGeometryVolume(), but the face is written by build()
+	BOOL add(LLFace* face, const LLVolume& volume,
+			 const S32 &f,
+			 const LLMatrix4& mat_vert, const LLMatrix3& mat_normal,
+			 const U16 &index_offset);
+
+	// Fills the faces added since the last build() on pool, in place if it
+	// is NULL, and copies them into their vertex buffers, which are left
+	// mapped as getGeometryVolume() leaves them.
+	void build(LLParallelPool* pool);
+
+	S32 getNumFaces() const		{ return mNumEntries; }
+
+private:
+	struct Entry
+	{
+		LLFace* mFace;
+		LLPointer<LLVertexBuffer> mBuffer;
+		LLFace::GeomParams mParams;
+		U32 mVertexStart;	// in bytes into mVertexData
+		U32 mIndicesStart;	// into mIndexData
+	};
+
+	class FillJob;
+
+	void upload(Entry& entry);
+
+	std::vector<Entry> mEntries;	// reused, mNumEntries are in use
+	S32 mNumEntries;
+	std::vector<U8> mVertexData;
+	std::vector<U16> mIndexData;
+	U32 mVertexBytes;
+	U32 mNumIndices;
+};
+
 #endif // LL_LLFACE_H
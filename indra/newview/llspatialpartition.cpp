@@ -42,6 +42,8 @@
 #include "lloctree.h"
 #include "llvoavatar.h"
 #include "lltextureatlas.h"
+#include "llappviewer.h"
+#include "llparallelpool.h"
 
 static LLFastTimer::DeclareTimer FTM_FRUSTUM_CULL("Frustum Culling");
 static LLFastTimer::DeclareTimer FTM_CULL_REBOUND("Cull Rebound");
@@ -877,6 +879,7 @@ void LLSpatialGroup::shift(const LLVector3 &offset)
 	mObjectBounds[0] += offset;
 	mObjectExtents[0] += offset;
 	mObjectExtents[1] += offset;
+	updateBoundsTable();
 
 	//if (!mSpatialPartition->mRenderByGroup)
 	{
@@ -1174,6 +1177,8 @@ LLSpatialGroup::LLSpatialGroup(OctreeNode* node, LLSpatialPartition* part) :
 
 	mBounds[0] = LLVector3(node->getCenter());
 	mBounds[1] = LLVector3(node->getSize());
+	mBoundsIndex = part->mBoundsTable.alloc();
+	updateBoundsTable();
 
 	part->mLODSeed = (part->mLODSeed+1)%part->mLODPeriod;
 	mLODHash = part->mLODSeed;
@@ -1263,7 +1268,7 @@ F32 LLSpatialPartition::calcDistance(LLSpatialGroup* group, LLCamera& camera)
 	}
 	else
 	{
-		dist = eye.magVec();
+		dist = mBoundsTable.getDistance(group->mBoundsIndex, camera.getOrigin());
 	}
 
 	if (dist < 16.f)
@@ -1278,7 +1283,8 @@ F32 LLSpatialPartition::calcDistance(LLSpatialGroup* group, LLCamera& camera)
 
 F32 LLSpatialPartition::calcPixelArea(LLSpatialGroup* group, LLCamera& camera)
 {
-	return LLPipeline::calcPixelArea(group->mObjectBounds[0], group->mObjectBounds[1], camera);
+	return LLPipeline::calcPixelArea(mBoundsTable.getDistance(group->mBoundsIndex, camera.getOrigin()),
+									 group->mObjectBounds[1]);
 }
 
 F32 LLSpatialGroup::getUpdateUrgency() const
@@ -1362,6 +1368,12 @@ void LLSpatialGroup::handleDestruction(const TreeNode* node)
 	mBufferMap.clear();
 	sZombieGroups++;
 	mOctreeNode = NULL;
+
+	if (mBoundsIndex >= 0)
+	{
+		mSpatialPartition->mBoundsTable.free(mBoundsIndex);
+		mBoundsIndex = -1;
+	}
 }
 
 void LLSpatialGroup::handleStateChange(const TreeNode* node)
@@ -1495,6 +1507,8 @@ BOOL LLSpatialGroup::rebound()
 		mBounds[0] = (newMin + newMax)*0.5f;
 		mBounds[1] = (newMax - newMin)*0.5f;
 	}
+
+	updateBoundsTable();
 	
 	setState(OCCLUSION_DIRTY);
 	
@@ -1503,6 +1517,15 @@ BOOL LLSpatialGroup::rebound()
 	return TRUE;
 }
 
+void LLSpatialGroup::updateBoundsTable()
+{
+	if (mBoundsIndex >= 0)
+	{
+		mSpatialPartition->mBoundsTable.set(mBoundsIndex, LLCullBoundsTable::BOUNDS, mBounds, mExtents);
+		mSpatialPartition->mBoundsTable.set(mBoundsIndex, LLCullBoundsTable::OBJECT_BOUNDS, mObjectBounds, mObjectExtents);
+	}
+}
+
 static LLFastTimer::DeclareTimer FTM_OCCLUSION_READBACK("Readback Occlusion");
 void LLSpatialGroup::checkOcclusion()
 {
@@ -2218,6 +2241,229 @@ S32 LLSpatialPartition::cull(LLCamera &camera, std::vector<LLDrawable *>* result
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+// LLSpatialCullBatch
+//-----------------------------------------------------------------------------
+
+// Checks every group of a partition against its camera, and for the world
+// camera finds their distances as well
+class LLSpatialCullBatch::BoundsJob : public LLParallelPool::Job
+{
+public:
+	BoundsJob(std::vector<Entry>& entries)
+		: mEntries(entries)
+	{
+	}
+
+	/*virtual*/ void run(S32 index)
+	{
+		Entry& entry = mEntries[index];
+		LLCullBoundsTable& table = entry.mPart->mBoundsTable;
+		table.cull(entry.mPlanes, entry.mCamera.getOrigin(),
+				   entry.mSphereCheck ? entry.mCamera.mFrustumCornerDist : 0.f);
+		if (LLViewerCamera::sCurCameraID == LLViewerCamera::CAMERA_WORLD)
+		{
+			table.calcDistances(entry.mCamera.getOrigin());
+		}
+	}
+
+private:
+	std::vector<Entry>& mEntries;
+};
+
+class LLSpatialCullBatch::CullJob : public LLParallelPool::Job
+{
+public:
+	CullJob(std::vector<Branch>& branches)
+		: mBranches(branches)
+	{
+	}
+
+	/*virtual*/ void run(S32 index)
+	{
+		Branch& branch = mBranches[index];
+		branch.mRecords.clear();
+		branch.record(branch.mNode, branch.mEntry->mRoot.mRes);
+	}
+
+private:
+	std::vector<Branch>& mBranches;
+};
+
+// As LLOctreeCull::traverse() and checkObjects(), except that a group only
+// takes its parent's result, never a sibling's
+void LLSpatialCullBatch::Entry::check(const LLSpatialGroup::OctreeNode* node, S32 parent_res, Record& record) const
+{
+	LLSpatialGroup* group = (LLSpatialGroup*) node->getListener(0);
+	const LLCullBoundsTable& table = mPart->mBoundsTable;
+	record.mGroup = group;
+	record.mSubtree = 0;
+
+	if (parent_res == 2 ||
+		(parent_res && group->isState(LLSpatialGroup::SKIP_FRUSTUM_CHECK)))
+	{	//fully in, just add everything
+		record.mRes = parent_res;
+	}
+	else
+	{
+		record.mRes = table.getCullResult(group->mBoundsIndex, LLCullBoundsTable::BOUNDS);
+	}
+
+	record.mVisit = record.mRes &&
+					node->getElementCount() != 0 &&
+					(node->getChildCount() == 0 ||	//leaf state, already checked tightest bounding box
+					 record.mRes != 1 ||
+					 table.getCullResult(group->mBoundsIndex, LLCullBoundsTable::OBJECT_BOUNDS));
+}
+
+// Any thread.  Appends node and, if it's at least partly in, its
+// descendants in traversal order.
+void LLSpatialCullBatch::Branch::record(const LLSpatialGroup::OctreeNode* node, S32 parent_res)
+{
+	U32 index = mRecords.size();
+	mRecords.push_back(Record());
+	mEntry->check(node, parent_res, mRecords[index]);
+
+	S32 res = mRecords[index].mRes;
+	if (res)
+	{
+		for (U32 i = 0; i < node->getChildCount(); i++)
+		{
+			record(node->getChild(i), res);
+		}
+	}
+	mRecords[index].mSubtree = mRecords.size() - index - 1;
+}
+
+LLSpatialCullBatch::LLSpatialCullBatch()
+:	mNumEntries(0),
+	mNumBranches(0)
+{
+}
+
+void LLSpatialCullBatch::add(LLSpatialPartition* part, LLCamera& camera)
+{
+	if (mEntries.size() <= mNumEntries)
+	{
+		mEntries.resize(mNumEntries + 1);
+	}
+	Entry& entry = mEntries[mNumEntries++];
+	entry.mPart = part;
+	entry.mCamera = camera;
+
+	// As LLSpatialPartition::cull() picks its LLOctreeCull
+	if (LLPipeline::sShadowRender)
+	{
+		entry.mPlanes.set(camera, TRUE);
+		entry.mSphereCheck = FALSE;
+	}
+	else
+	{
+		entry.mPlanes.set(camera, FALSE);
+		entry.mSphereCheck = !part->mInfiniteFarClip && LLPipeline::sUseFarClip;
+	}
+}
+
+// As earlyFail() and processGroup() of LLOctreeCull
+void LLSpatialCullBatch::replay(Entry& entry, const Record* record, const Record* end)
+{
+	LLCamera& camera = entry.mCamera;
+	while (record < end)
+	{
+		LLSpatialGroup* group = record->mGroup;
+		group->checkOcclusion();
+
+		if (group->mOctreeNode->getParent() &&	//never occlusion cull the root node
+			LLPipeline::sUseOcclusion &&			//ignore occlusion if disabled
+			group->isOcclusionState(LLSpatialGroup::OCCLUDED))
+		{
+			gPipeline.markOccluder(group);
+			record += record->mSubtree + 1;
+			continue;
+		}
+
+		if (record->mVisit)
+		{
+			if (group->needsUpdate() ||
+				group->mVisible[LLViewerCamera::sCurCameraID] < LLDrawable::getCurrentFrame() - 1)
+			{
+				group->doOcclusion(&camera);
+			}
+			gPipeline.markNotCulled(group, camera);
+		}
+		record++;
+	}
+}
+
+void LLSpatialCullBatch::cull()
+{
+	LLMemType mt(LLMemType::MTYPE_SPACE_PARTITION);
+
+	{
+		LLFastTimer ftm(FTM_CULL_REBOUND);
+		for (U32 i = 0; i < mNumEntries; i++)
+		{
+			LLSpatialGroup::OctreeNode* octree = mEntries[i].mPart->mOctree;
+#if LL_OCTREE_PARANOIA_CHECK
+			((LLSpatialGroup*)octree->getListener(0))->checkStates();
+#endif
+			((LLSpatialGroup*)octree->getListener(0))->rebound();
+#if LL_OCTREE_PARANOIA_CHECK
+			((LLSpatialGroup*)octree->getListener(0))->validate();
+#endif
+		}
+	}
+
+	LLFastTimer ftm(FTM_FRUSTUM_CULL);
+
+	BoundsJob bounds_job(mEntries);
+	LLParallelPool::run(LLAppViewer::getJobPool(), bounds_job, mNumEntries);
+
+	// Roots here, their children's subtrees on the pool
+	mNumBranches = 0;
+	for (U32 i = 0; i < mNumEntries; i++)
+	{
+		Entry& entry = mEntries[i];
+		const LLSpatialGroup::OctreeNode* root = entry.mPart->mOctree;
+		entry.check(root, 0, entry.mRoot);
+		if (!entry.mRoot.mRes)
+		{
+			continue;
+		}
+
+		for (U32 c = 0; c < root->getChildCount(); c++)
+		{
+			if (mBranches.size() <= mNumBranches)
+			{
+				mBranches.resize(mNumBranches + 1);
+			}
+			Branch& branch = mBranches[mNumBranches++];
+			branch.mEntry = &entry;
+			branch.mNode = root->getChild(c);
+		}
+	}
+
+	CullJob job(mBranches);
+	LLParallelPool::run(LLAppViewer::getJobPool(), job, mNumBranches);
+
+	U32 next_branch = 0;
+	for (U32 i = 0; i < mNumEntries; i++)
+	{
+		Entry& entry = mEntries[i];
+		replay(entry, &entry.mRoot, &entry.mRoot + 1);
+		while (next_branch < mNumBranches && mBranches[next_branch].mEntry == &entry)
+		{
+			const std::vector<Record>& records = mBranches[next_branch++].mRecords;
+			if (!records.empty())
+			{
+				replay(entry, &records[0], &records[0] + records.size());
+			}
+		}
+	}
+
+	mNumEntries = 0;
+}
+
 BOOL earlyFail(LLCamera* camera, LLSpatialGroup* group)
 {
 	if (camera->getOrigin().isExactlyZero())
@@ -39,6 +39,7 @@
 #include "lldrawpool.h"
 #include "llface.h"
 #include "llviewercamera.h"
+#include "llcullbounds.h"
 
 #include <queue>
 
@@ -266,6 +267,7 @@ public:
 	BOOL boundObjects(BOOL empty, LLVector3& newMin, LLVector3& newMax);
 	void unbound();
 	BOOL rebound();
+	void updateBoundsTable(); //copy bounds to mSpatialPartition->mBoundsTable
 	void buildOcclusion(); //rebuild mOcclusionVerts
 	void checkOcclusion(); //read back last occlusion query (if any)
 	void doOcclusion(LLCamera* camera); //issue occlusion query
@@ -343,6 +345,7 @@ public:
 	
 	LLVector3 mObjectExtents[2]; // extents (min, max) of objects in this node
 	LLVector3 mObjectBounds[2]; // bounding box (center, size) of objects in this node
+	S32 mBoundsIndex; // slot in mSpatialPartition->mBoundsTable, -1 once destroyed
 
 	LLPointer<LLVertexBuffer> mVertexBuffer;
 	F32*					mOcclusionVerts;
@@ -434,6 +437,70 @@ public:
 	BOOL mDepthMask; //if TRUE, objects in this partition will be written to depth during alpha rendering
 	U32 mDrawableType;
 	U32 mPartitionType;
+	LLCullBoundsTable mBoundsTable; // every group's bounds, for culling and distances
+};
+
+// Culls the octrees of many partitions at once.  The frustum checks only
+// read group bounds, so they run on LLAppViewer::getJobPool(): first over
+// each partition's whole mBoundsTable, then one octree branch per job,
+// each branch recording the groups it reaches in traversal order from the
+// table's results.  Occlusion and LLPipeline::markNotCulled() need GL and the
+// pipeline, so cull() then plays the records back on this thread in the
+// order LLSpatialPartition::cull() would have visited the groups.
+class LLSpatialCullBatch
+{
+public:
+	LLSpatialCullBatch();
+
+	// Culls part against camera as it is now on the next cull()
+	void add(LLSpatialPartition* part, LLCamera& camera);
+
+	// Culls everything add()ed since the last call
+	void cull();
+
+private:
+	// One group the traversal reached
+	struct Record
+	{
+		LLSpatialGroup* mGroup;
+		S32 mRes;		// frustum check, 0 outside, 1 partly in, 2 fully in
+		BOOL mVisit;	// has objects in the frustum, process it
+		U32 mSubtree;	// number of records after this one for its descendants
+	};
+
+	struct Entry
+	{
+		// Checks the group at node, given its parent's result
+		void check(const LLSpatialGroup::OctreeNode* node, S32 parent_res, Record& record) const;
+
+		LLSpatialPartition* mPart;
+		LLCamera mCamera;
+		LLCullPlanes mPlanes;
+		BOOL mSphereCheck;	// also check against the sphere through the far corners
+		Record mRoot;
+	};
+
+	// A child of some partition's root, and the records of its subtree
+	struct Branch
+	{
+		void record(const LLSpatialGroup::OctreeNode* node, S32 parent_res);
+
+		const Entry* mEntry;
+		const LLSpatialGroup::OctreeNode* mNode;
+		std::vector<Record> mRecords;
+	};
+
+	class BoundsJob;
+	class CullJob;
+
+	void replay(Entry& entry, const Record* record, const Record* end);
+
+	// Only the first mNumEntries and mNumBranches are in use, the rest are
+	// kept with their buffers for the next cull()
+	std::vector<Entry> mEntries;
+	std::vector<Branch> mBranches;
+	U32 mNumEntries;
+	U32 mNumBranches;
 };
 
 // class for creating bridges between spatial partitions
@@ -612,6 +679,10 @@ class LLVolumeGeometryManager: public LLGeometryManager
 	virtual void getGeometry(LLSpatialGroup* group);
 	void genDrawInfo(LLSpatialGroup* group, U32 mask, std::vector<LLFace*>& faces, BOOL distance_sort = FALSE);
 	void registerFace(LLSpatialGroup* group, LLFace* facep, U32 type);
+
+	// Faces waiting to be filled, shared by every partition since groups
+	// are rebuilt one at a time
+	static LLFaceGeomBatch sGeomBatch;
 };
 
 //spatial partition that uses volume geometry manager (implemented in LLVOVolume.cpp)
@@ -588,6 +588,10 @@ bool idle_startup()
 				msg->mPacketRing.setUseOutThrottle(TRUE);
 				msg->mPacketRing.setOutBandwidth(outBandwidth);
 			}
+			if (inBandwidth == 0.f && gSavedSettings.getBOOL("MessageReceiveThread"))
+			{
+				msg->startReceiveThread();
+			}
 		}
 
 		LL_INFOS("AppInit") << "Message System Initialized." << LL_ENDL;
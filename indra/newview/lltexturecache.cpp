@@ -31,6 +31,7 @@
 #include "llapr.h"
 #include "lldir.h"
 #include "llimage.h"
+#include "llimagedxt.h"
 #include "lllfsthread.h"
 #include "llviewercontrol.h"
 
@@ -42,13 +43,34 @@
 //  Unordered array of Entry structs
 // cache/texture.cache
 //  First TEXTURE_CACHE_ENTRY_SIZE bytes of each texture in texture.entries in same order
-// cache/textures/[0-F]/UUID.texture
-//  Actual texture body files
+// cache/texture.bodies
+//  Ring of texture bodies (see LLTextureCacheArena), located by Entry::mBodyOffset
+// All three are memory mapped, a cache hit copies out of them without any file I/O.
+// Caches from before the body ring (version 1.4) kept each body in
+// cache/textures/[0-F]/UUID.texture and are moved into it on startup.
+// cache/textures/dxt/dxt.entries
+//  Array of DXTEntry structs, only present between a clean shutdown and the next startup
+// cache/textures/dxt/[0-F]/UUID.dxt
+//  BC1/BC3 compressed copies of decoded textures (optional)
 
 //note: there is no good to define 1024 for TEXTURE_CACHE_ENTRY_SIZE while FIRST_PACKET_SIZE is 600 on sim side.
 const S32 TEXTURE_CACHE_ENTRY_SIZE = FIRST_PACKET_SIZE;//1024;
 const F32 TEXTURE_CACHE_PURGE_AMOUNT = .20f; // % amount to reduce the cache by when it exceeds its limit
 const F32 TEXTURE_CACHE_LRU_SIZE = .10f; // % amount for LRU list (low overhead to regenerate)
+const F32 TEXTURE_CACHE_DXT_SIZE = .25f; // % of the texture bodies budget given to the compressed tier
+const S32 TEXTURE_CACHE_DXT_MIN_SIZE = 16; // don't bother compressing smaller textures
+const F32 TEXTURE_CACHE_UNPACKED_VERSION = 1.4f; // last version with a file per body
+const S64 TEXTURE_CACHE_MAX_MAPPED_SIZE_32 = 384*1024*1024; // address space we can spare for the mappings in a 32 bit build
+const S32 TEXTURE_CACHE_MAX_ARENA_SIZE = 0x7f000000; // body offsets are S32
+
+// Entry as laid out by version 1.4, read when moving its bodies into the arena
+struct LLTextureCacheUnpackedEntry
+{
+	LLUUID mID;
+	S32 mImageSize;
+	S32 mBodySize;
+	U32 mTime;
+};
 
 class LLTextureCacheWorker : public LLWorkerClass
 {
@@ -413,19 +435,17 @@ bool LLTextureCacheRemoteWorker::doRead()
 		}
 	}
 
-	// Third state / stage : read data from the header cache (texture.entries) file
+	// Third state / stage : read data from the header cache (texture.cache) file
 	if (!done && (mState == HEADER))
 	{
 		llassert_always(idx >= 0);	// we need an entry here or reading the header makes no sense
 		llassert_always(mOffset < TEXTURE_CACHE_ENTRY_SIZE);
-		S32 offset = idx * TEXTURE_CACHE_ENTRY_SIZE + mOffset;
 		// Compute the size we need to read (in bytes)
 		S32 size = TEXTURE_CACHE_ENTRY_SIZE - mOffset;
 		size = llmin(size, mDataSize);
 		// Allocate the read buffer
 		mReadData = new U8[size];
-		S32 bytes_read = LLAPRFile::readEx(mCache->mHeaderDataFileName, 
-											 mReadData, offset, size, mCache->getLocalAPRFilePool());
+		S32 bytes_read = mCache->readHeaderData(idx, mReadData, mOffset, size);
 		if (bytes_read != size)
 		{
 			llwarns << "LLTextureCacheWorker: "  << mID
@@ -447,71 +467,58 @@ bool LLTextureCacheRemoteWorker::doRead()
 		}
 	}
 
-	// Fourth state / stage : read the rest of the data from the UUID based cached file
+	// Fourth state / stage : read the rest of the data from the body arena
 	if (!done && (mState == BODY))
 	{
-		std::string filename = mCache->getTextureFileName(mID);
-		S32 filesize = LLAPRFile::size(filename, mCache->getLocalAPRFilePool());
-
-		if (filesize && (filesize + TEXTURE_CACHE_ENTRY_SIZE) > mOffset)
+		S32 data_offset, body_size, body_offset;
+		
+		// Reserve the whole data buffer first, readBody() tells how much of it the body fills
+		U8* data = new U8[mDataSize];
+
+		// Set the data pointers taking the read offset into account. 2 cases:
+		if (mOffset < TEXTURE_CACHE_ENTRY_SIZE)
+		{
+			// Offset within the header record. That means we read something from the header cache.
+			// Note: most common case is (mOffset = 0), so this is the "normal" code path.
+			data_offset = TEXTURE_CACHE_ENTRY_SIZE - mOffset;	// i.e. TEXTURE_CACHE_ENTRY_SIZE if mOffset nul (common case)
+			body_offset = 0;
+			body_size = mDataSize - data_offset;
+			// Copy the raw data we've been holding from the header cache into the new sized buffer
+			llassert_always(mReadData);
+			memcpy(data, mReadData, data_offset);
+			delete[] mReadData;
+			mReadData = NULL;
+		}
+		else
 		{
-			S32 max_datasize = TEXTURE_CACHE_ENTRY_SIZE + filesize - mOffset;
-			mDataSize = llmin(max_datasize, mDataSize);
-
-			S32 data_offset, file_size, file_offset;
-			
-			// Reserve the whole data buffer first
-			U8* data = new U8[mDataSize];
-
-			// Set the data file pointers taking the read offset into account. 2 cases:
-			if (mOffset < TEXTURE_CACHE_ENTRY_SIZE)
-			{
-				// Offset within the header record. That means we read something from the header cache.
-				// Note: most common case is (mOffset = 0), so this is the "normal" code path.
-				data_offset = TEXTURE_CACHE_ENTRY_SIZE - mOffset;	// i.e. TEXTURE_CACHE_ENTRY_SIZE if mOffset nul (common case)
-				file_offset = 0;
-				file_size = mDataSize - data_offset;
-				// Copy the raw data we've been holding from the header cache into the new sized buffer
-				llassert_always(mReadData);
-				memcpy(data, mReadData, data_offset);
-				delete[] mReadData;
-				mReadData = NULL;
-			}
-			else
-			{
-				// Offset bigger than the header record. That means we haven't read anything yet.
-				data_offset = 0;
-				file_offset = mOffset - TEXTURE_CACHE_ENTRY_SIZE;
-				file_size = mDataSize;
-				// No data from header cache to copy in that case, we skipped it all
-			}
+			// Offset bigger than the header record. That means we haven't read anything yet.
+			data_offset = 0;
+			body_offset = mOffset - TEXTURE_CACHE_ENTRY_SIZE;
+			body_size = mDataSize;
+			// No data from header cache to copy in that case, we skipped it all
+		}
 
-			// Now use that buffer as the object read buffer
-			llassert_always(mReadData == NULL);
-			mReadData = data;
+		// Now use that buffer as the object read buffer
+		llassert_always(mReadData == NULL);
+		mReadData = data;
 
-			// Read the data at last
-			S32 bytes_read = LLAPRFile::readEx(filename, 
-											 mReadData + data_offset,
-											 file_offset, file_size,
-											 mCache->getLocalAPRFilePool());
-			if (bytes_read != file_size)
-			{
-				llwarns << "LLTextureCacheWorker: "  << mID
-						<< " incorrect number of bytes read from body: " << bytes_read
-						<< " / " << file_size << llendl;
-				delete[] mReadData;
-				mReadData = NULL;
-				mDataSize = -1; // failed
-				done = true;
-			}
+		// Read the data at last
+		S32 bytes_read = mCache->readBody(mID, mReadData + data_offset, body_offset, body_size);
+		if (bytes_read > 0)
+		{
+			mDataSize = data_offset + bytes_read;
 		}
 		else
 		{
 			// No body, we're done.
 			mDataSize = llmax(TEXTURE_CACHE_ENTRY_SIZE - mOffset, 0);
-			lldebugs << "No body file for: " << filename << llendl;
-		}	
+			if (!mDataSize)
+			{
+				delete[] mReadData;
+				mReadData = NULL;
+			}
+			lldebugs << "No body for: " << mID << llendl;
+		}
 		// Nothing else to do at that point...
 		done = true;
 	}
@@ -584,25 +591,8 @@ bool LLTextureCacheRemoteWorker::doWrite()
 	if (!done && (mState == HEADER))
 	{
 		llassert_always(idx >= 0);	// we need an entry here or storing the header makes no sense
-		S32 offset = idx * TEXTURE_CACHE_ENTRY_SIZE;	// skip to the correct spot in the header file
-		S32 size = TEXTURE_CACHE_ENTRY_SIZE;			// record size is fixed for the header
-		S32 bytes_written;
-
-		if (mDataSize < TEXTURE_CACHE_ENTRY_SIZE)
-		{
-			// We need to write a full record in the header cache so, if the amount of data is smaller
-			// than a record, we need to transfer the data to a buffer padded with 0 and write that
-			U8* padBuffer = new U8[TEXTURE_CACHE_ENTRY_SIZE];
-			memset(padBuffer, 0, TEXTURE_CACHE_ENTRY_SIZE);		// Init with zeros
-			memcpy(padBuffer, mWriteData, mDataSize);			// Copy the write buffer
-			bytes_written = LLAPRFile::writeEx(mCache->mHeaderDataFileName, padBuffer, offset, size, mCache->getLocalAPRFilePool());
-			delete [] padBuffer;
-		}
-		else
-		{
-			// Write the header record (== first TEXTURE_CACHE_ENTRY_SIZE bytes of the raw file) in the header file
-			bytes_written = LLAPRFile::writeEx(mCache->mHeaderDataFileName, mWriteData, offset, size, mCache->getLocalAPRFilePool());
-		}
+		// Write the header record (== first TEXTURE_CACHE_ENTRY_SIZE bytes of the raw file, padded with 0) in the header file
+		S32 bytes_written = mCache->writeHeaderData(idx, mWriteData, mDataSize);
 
 		if (bytes_written <= 0)
 		{
@@ -624,28 +614,17 @@ bool LLTextureCacheRemoteWorker::doWrite()
 		}
 	}
 	
-	// Fourth stage / state : write the body file, i.e. the rest of the texture in a "UUID" file name
+	// Fourth stage / state : write the body, i.e. the rest of the texture, to the body arena
 	if (!done && (mState == BODY))
 	{
 		llassert(mDataSize > TEXTURE_CACHE_ENTRY_SIZE);	// wouldn't make sense to be here otherwise...
-		S32 file_size = mDataSize - TEXTURE_CACHE_ENTRY_SIZE;
+		S32 body_size = mDataSize - TEXTURE_CACHE_ENTRY_SIZE;
 		
+		if (!mCache->writeBody(mID, mWriteData + TEXTURE_CACHE_ENTRY_SIZE, body_size))
 		{
-			// build the cache file name from the UUID
-			std::string filename = mCache->getTextureFileName(mID);			
-// 			llinfos << "Writing Body: " << filename << " Bytes: " << file_offset+file_size << llendl;
-			S32 bytes_written = LLAPRFile::writeEx(	filename, 
-													mWriteData + TEXTURE_CACHE_ENTRY_SIZE,
-													0, file_size,
-													mCache->getLocalAPRFilePool());
-			if (bytes_written <= 0)
-			{
-				llwarns << "LLTextureCacheWorker: "  << mID
-						<< " incorrect number of bytes written to body: " << bytes_written
-						<< " / " << file_size << llendl;
-				mDataSize = -1; // failed
-				done = true;
-			}
+			llwarns << "LLTextureCacheWorker: "  << mID
+					<< " unable to write " << body_size << " bytes of body" << llendl;
+			mDataSize = -1; // failed
 		}
 		
 		// Nothing else to do at that point...
@@ -656,6 +635,108 @@ bool LLTextureCacheRemoteWorker::doWrite()
 	return done;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+
+// Reads and writes the compressed tier. Writes take a raw image and do the
+// block compression here, on the cache thread.
+class LLTextureCacheDXTWorker : public LLTextureCacheWorker
+{
+public:
+	LLTextureCacheDXTWorker(LLTextureCache* cache, U32 priority, const LLUUID& id,
+							LLImageRaw* raw, S32 discard, // for writes
+							LLTextureCache::Responder* responder)
+			: LLTextureCacheWorker(cache, priority, id, NULL, 0, 0, 0, responder),
+			mRawImage(raw),
+			mDiscard(discard)
+	{
+		mImageFormat = IMG_CODEC_DXT;
+	}
+
+	virtual bool doRead();
+	virtual bool doWrite();
+
+private:
+	LLPointer<LLImageRaw> mRawImage;
+	S32 mDiscard;
+};
+
+bool LLTextureCacheDXTWorker::doRead()
+{
+	std::string filename = mCache->getDXTFileName(mID);
+	S32 file_size = LLAPRFile::size(filename, mCache->getLocalAPRFilePool());
+	mDataSize = 0;
+	if (file_size <= (S32)sizeof(LLImageDXT::dxtfile_header_t))
+	{
+		mCache->removeDXTEntry(mID);
+		return true;
+	}
+
+	mReadData = new U8[file_size];
+	S32 bytes_read = LLAPRFile::readEx(filename, mReadData, 0, file_size, mCache->getLocalAPRFilePool());
+	if (bytes_read != file_size)
+	{
+		LL_WARNS("TextureCache") << "Error reading compressed texture: " << filename
+				<< " Bytes: " << bytes_read << " / " << file_size << LL_ENDL;
+		delete[] mReadData;
+		mReadData = NULL;
+		mCache->removeDXTEntry(mID);
+		return true;
+	}
+
+	// LLImageDXT::updateData() is not forgiving, check the header here
+	LLImageDXT::dxtfile_header_t* header = (LLImageDXT::dxtfile_header_t*)mReadData;
+	LLImageDXT::EFileFormat format = LLImageDXT::getFormat(header->pixel_fmt.fourcc);
+	if (header->fourcc != 0x20534444 ||
+		(format != LLImageDXT::FORMAT_DXR1 && format != LLImageDXT::FORMAT_DXR5) ||
+		header->maxwidth < TEXTURE_CACHE_DXT_MIN_SIZE || header->maxwidth > MAX_IMAGE_SIZE ||
+		header->maxheight < TEXTURE_CACHE_DXT_MIN_SIZE || header->maxheight > MAX_IMAGE_SIZE)
+	{
+		LL_WARNS("TextureCache") << "Bad compressed texture header: " << filename << LL_ENDL;
+		delete[] mReadData;
+		mReadData = NULL;
+		mCache->removeDXTEntry(mID);
+		return true;
+	}
+	mDataSize = file_size;
+	mImageSize = file_size;
+	return true;
+}
+
+bool LLTextureCacheDXTWorker::doWrite()
+{
+	LLPointer<LLImageDXT> dxt = new LLImageDXT();
+	BOOL encoded = dxt->encodeCompressed(mRawImage);
+	mRawImage = NULL;
+	S32 size = encoded ? dxt->getDataSize() : 0;
+	if (size > 0)
+	{
+		// Write beside and swap in, a reader may have the old file open
+		std::string filename = mCache->getDXTFileName(mID);
+		std::string tmp_filename = filename + ".tmp";
+		LLAPRFile::remove(tmp_filename, mCache->getLocalAPRFilePool());
+		S32 bytes_written = LLAPRFile::writeEx(tmp_filename, dxt->getData(), 0, size, mCache->getLocalAPRFilePool());
+		if (bytes_written != size)
+		{
+			LL_WARNS("TextureCache") << "Error writing compressed texture: " << tmp_filename
+					<< " Bytes: " << bytes_written << " / " << size << LL_ENDL;
+			LLAPRFile::remove(tmp_filename, mCache->getLocalAPRFilePool());
+			size = 0;
+		}
+		else
+		{
+			LLAPRFile::remove(filename, mCache->getLocalAPRFilePool());
+			if (!LLAPRFile::rename(tmp_filename, filename, mCache->getLocalAPRFilePool()))
+			{
+				LLAPRFile::remove(tmp_filename, mCache->getLocalAPRFilePool());
+				size = 0;
+			}
+		}
+	}
+	mCache->addDXTEntry(mID, mDiscard, size); // size 0 drops the entry
+	mDataSize = size;
+	return true;
+}
+
 //virtual
 bool LLTextureCacheWorker::doWork(S32 param)
 {
@@ -732,15 +813,17 @@ void LLTextureCacheWorker::endWork(S32 param, bool aborted)
 
 //////////////////////////////////////////////////////////////////////////////
 
-LLTextureCache::LLTextureCache(bool threaded)
-	: LLWorkerThread("TextureCache", threaded),
+LLTextureCache::LLTextureCache(bool threaded, bool concurrent_queue, S32 pool_size)
+	: LLWorkerThread("TextureCache", threaded, concurrent_queue, pool_size),
 	  mWorkersMutex(NULL),
 	  mHeaderMutex(NULL),
 	  mListMutex(NULL),
-	  mHeaderAPRFile(NULL),
 	  mReadOnly(TRUE), //do not allow to change the texture cache until setReadOnly() is called.
 	  mTexturesSizeTotal(0),
-	  mDoPurge(FALSE)
+	  mDoPurge(FALSE),
+	  mDXTCacheEnabled(FALSE),
+	  mDXTMutex(NULL),
+	  mDXTSizeTotal(0)
 {
 }
 
@@ -748,6 +831,11 @@ LLTextureCache::~LLTextureCache()
 {
 	clearDeleteList() ;
 	writeUpdatedEntries() ;
+	if (mDXTCacheEnabled && !mReadOnly)
+	{
+		LLMutexLock lock(&mDXTMutex);
+		writeDXTEntries();
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -782,7 +870,25 @@ S32 LLTextureCache::update(U32 max_time_ms)
 		}
 	}
 
+	// Nobody waits on compressed tier writes, reap them here
+	std::vector<LLTextureCacheWorker*> dxt_writers_done;
+	for (handle_map_t::iterator iter1 = mDXTWriters.begin(); iter1 != mDXTWriters.end(); )
+	{
+		handle_map_t::iterator cur_iter = iter1++;
+		if (cur_iter->second->complete())
+		{
+			dxt_writers_done.push_back(cur_iter->second);
+			mDXTWriters.erase(cur_iter);
+		}
+	}
+
 	unlockWorkers(); 
+
+	for (std::vector<LLTextureCacheWorker*>::iterator iter1 = dxt_writers_done.begin();
+		 iter1 != dxt_writers_done.end(); ++iter1)
+	{
+		(*iter1)->scheduleDelete();
+	}
 	
 	// call 'completed' with workers list unlocked (may call readComplete() or writeComplete()
 	for (responder_list_t::iterator iter1 = completed_list.begin();
@@ -821,6 +927,14 @@ std::string LLTextureCache::getTextureFileName(const LLUUID& id)
 	return filename;
 }
 
+std::string LLTextureCache::getDXTFileName(const LLUUID& id)
+{
+	std::string idstr = id.asString();
+	std::string delem = gDirUtilp->getDirDelimiter();
+	std::string filename = mDXTDirName + delem + idstr[0] + delem + idstr + ".dxt";
+	return filename;
+}
+
 //debug
 BOOL LLTextureCache::isInCache(const LLUUID& id) 
 {
@@ -873,14 +987,19 @@ BOOL LLTextureCache::isInLocal(const LLUUID& id)
 
 //static
 const S32 MAX_REASONABLE_FILE_SIZE = 512*1024*1024; // 512 MB
-F32 LLTextureCache::sHeaderCacheVersion = 1.4f;
+F32 LLTextureCache::sHeaderCacheVersion = 1.5f;
 U32 LLTextureCache::sCacheMaxEntries = MAX_REASONABLE_FILE_SIZE / TEXTURE_CACHE_ENTRY_SIZE;
 S64 LLTextureCache::sCacheMaxTexturesSize = 0; // no limit
+F32 LLTextureCache::sDXTCacheVersion = 1.0f;
+S64 LLTextureCache::sCacheMaxDXTSize = 0;
 const char* entries_filename = "texture.entries";
 const char* cache_filename = "texture.cache";
+const char* bodies_filename = "texture.bodies";
 const char* old_textures_dirname = "textures";
 //change the location of the texture cache to prevent from being deleted by old version viewers.
 const char* textures_dirname = "texturecache";
+const char* dxt_dirname = "dxt";
+const char* dxt_entries_filename = "dxt.entries";
 
 void LLTextureCache::setDirNames(ELLPath location)
 {
@@ -888,7 +1007,10 @@ void LLTextureCache::setDirNames(ELLPath location)
 
 	mHeaderEntriesFileName = gDirUtilp->getExpandedFilename(location, textures_dirname, entries_filename);
 	mHeaderDataFileName = gDirUtilp->getExpandedFilename(location, textures_dirname, cache_filename);
+	mBodyArenaFileName = gDirUtilp->getExpandedFilename(location, textures_dirname, bodies_filename);
 	mTexturesDirName = gDirUtilp->getExpandedFilename(location, textures_dirname);
+	mDXTDirName = mTexturesDirName + delem + dxt_dirname;
+	mDXTEntriesFileName = mDXTDirName + delem + dxt_entries_filename;
 }
 
 void LLTextureCache::purgeCache(ELLPath location)
@@ -898,7 +1020,6 @@ void LLTextureCache::purgeCache(ELLPath location)
 	if (!mReadOnly)
 	{
 		setDirNames(location);
-		llassert_always(mHeaderAPRFile == NULL);
 
 		//remove the legacy cache if exists
 		std::string texture_dir = mTexturesDirName ;
@@ -931,6 +1052,15 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL texture_cache
 {
 	llassert_always(getPending() == 0) ; //should not start accessing the texture cache before initialized.
 
+	S64 unmapped_size = 0; // handed back to the caller along with the unused space
+	if (sizeof(void*) < 8 && max_size > TEXTURE_CACHE_MAX_MAPPED_SIZE_32)
+	{
+		// headers and bodies are all mapped, leave some address space for everything else
+		LL_INFOS("TextureCache") << "Limiting the texture cache to " << TEXTURE_CACHE_MAX_MAPPED_SIZE_32/(1024*1024) << " MB" << LL_ENDL;
+		unmapped_size = max_size - TEXTURE_CACHE_MAX_MAPPED_SIZE_32;
+		max_size = TEXTURE_CACHE_MAX_MAPPED_SIZE_32;
+	}
+
 	S64 header_size = (max_size * 2) / 10;
 	S64 max_entries = header_size / TEXTURE_CACHE_ENTRY_SIZE;
 	sCacheMaxEntries = (S32)(llmin((S64)sCacheMaxEntries, max_entries));
@@ -941,9 +1071,21 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL texture_cache
 	else
 		sCacheMaxTexturesSize = max_size;
 	max_size -= sCacheMaxTexturesSize;
+	if (mDXTCacheEnabled)
+	{
+		sCacheMaxDXTSize = (S64)(sCacheMaxTexturesSize * TEXTURE_CACHE_DXT_SIZE);
+		sCacheMaxTexturesSize -= sCacheMaxDXTSize;
+	}
+	if (sCacheMaxTexturesSize > TEXTURE_CACHE_MAX_ARENA_SIZE)
+	{
+		unmapped_size += sCacheMaxTexturesSize - TEXTURE_CACHE_MAX_ARENA_SIZE;
+		sCacheMaxTexturesSize = TEXTURE_CACHE_MAX_ARENA_SIZE;
+	}
+	max_size += unmapped_size;
 	
 	LL_INFOS("TextureCache") << "Headers: " << sCacheMaxEntries
-			<< " Textures size: " << sCacheMaxTexturesSize/(1024*1024) << " MB" << LL_ENDL;
+			<< " Textures size: " << sCacheMaxTexturesSize/(1024*1024) << " MB"
+			<< " Compressed size: " << sCacheMaxDXTSize/(1024*1024) << " MB" << LL_ENDL;
 
 	setDirNames(location);
 	
@@ -963,14 +1105,32 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL texture_cache
 	{
 		LLFile::mkdir(mTexturesDirName);
 		
-		const char* subdirs = "0123456789abcdef";
-		for (S32 i=0; i<16; i++)
+		if (mDXTCacheEnabled)
 		{
-			std::string dirname = mTexturesDirName + gDirUtilp->getDirDelimiter() + subdirs[i];
-			LLFile::mkdir(dirname);
+			const char* subdirs = "0123456789abcdef";
+			LLFile::mkdir(mDXTDirName);
+			for (S32 i=0; i<16; i++)
+			{
+				std::string dirname = mDXTDirName + gDirUtilp->getDirDelimiter() + subdirs[i];
+				LLFile::mkdir(dirname);
+			}
 		}
 	}
+	openCacheFiles();
 	readHeaderCache();
+	if (mDXTCacheEnabled)
+	{
+		LLMutexLock lock(&mDXTMutex);
+		if (mReadOnly)
+		{
+			// can't keep the index consistent with another instance writing it
+			mDXTCacheEnabled = FALSE;
+		}
+		else
+		{
+			readDXTEntries();
+		}
+	}
 	purgeTextures(true); // calc mTexturesSize and make some room in the texture cache if we need it
 
 	llassert_always(getPending() == 0) ; //should not start accessing the texture cache before initialized.
@@ -978,37 +1138,167 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL texture_cache
 	return max_size; // unused cache space
 }
 
-//----------------------------------------------------------------------------
-// mHeaderMutex must be locked for the following functions!
-
-LLAPRFile* LLTextureCache::openHeaderEntriesFile(bool readonly, S32 offset)
+//called in the main thread by initCache().
+void LLTextureCache::openCacheFiles()
 {
-	llassert_always(mHeaderAPRFile == NULL);
-	apr_int32_t flags = readonly ? APR_READ|APR_BINARY : APR_READ|APR_WRITE|APR_BINARY;
-	mHeaderAPRFile = new LLAPRFile(mHeaderEntriesFileName, flags, getLocalAPRFilePool());
-	if(offset > 0)
+	closeCacheFiles();
+
+	bool readonly = mReadOnly ? true : false;
+	if (!mEntriesFile.open(mHeaderEntriesFileName, (S64)sizeof(EntriesInfo) + (S64)sCacheMaxEntries * sizeof(Entry), readonly))
 	{
-		mHeaderAPRFile->seek(APR_SET, offset);
+		LL_WARNS("TextureCache") << "Unable to map " << mHeaderEntriesFileName << ", falling back to file I/O" << LL_ENDL;
+	}
+	if (!mHeaderDataFile.open(mHeaderDataFileName, (S64)sCacheMaxEntries * TEXTURE_CACHE_ENTRY_SIZE, readonly))
+	{
+		LL_WARNS("TextureCache") << "Unable to map " << mHeaderDataFileName << ", falling back to file I/O" << LL_ENDL;
+	}
+	if (!mBodyArena.open(mBodyArenaFileName, (S32)sCacheMaxTexturesSize, readonly))
+	{
+		LL_WARNS("TextureCache") << "Unable to map " << mBodyArenaFileName << ", only headers will be cached" << LL_ENDL;
+	}
+
+	if (!mReadOnly && (mBodyArena.wasReset() || !mBodyArena.isOpen()))
+	{
+		// The bodies are gone, keep the headers
+		LLMutexLock lock(&mHeaderMutex);
+		readEntriesHeader();
+		U32 num_entries = mHeaderEntriesInfo.mEntries;
+		if (mHeaderEntriesInfo.mVersion == sHeaderCacheVersion && num_entries > 0)
+		{
+			std::vector<Entry> entries(num_entries);
+			if (readEntries(0, &entries[0], num_entries))
+			{
+				for (U32 i = 0; i < num_entries; i++)
+				{
+					entries[i].mBodySize = 0;
+					entries[i].mBodyOffset = -1;
+				}
+				writeEntries(0, &entries[0], num_entries);
+			}
+		}
 	}
-	return mHeaderAPRFile;
 }
 
-void LLTextureCache::closeHeaderEntriesFile()
+void LLTextureCache::closeCacheFiles()
+{
+	mEntriesFile.close();
+	mHeaderDataFile.close();
+	mBodyArena.close();
+}
+
+// Moves a version 1.4 cache, which kept each body in its own file, into the
+// body arena. The header cache file is laid out the same and stays as it is.
+//mHeaderMutex is locked before calling this.
+bool LLTextureCache::migrateUnpackedCache()
 {
-	if(!mHeaderAPRFile)
+	U32 num_entries = mHeaderEntriesInfo.mEntries;
+	if (!mEntriesFile.isOpen() || !mBodyArena.isOpen() || num_entries > sCacheMaxEntries)
 	{
-		return ;
+		return false;
+	}
+	S64 old_size = (S64)num_entries * sizeof(LLTextureCacheUnpackedEntry);
+	if ((S64)sizeof(EntriesInfo) + old_size > mEntriesFile.getSize())
+	{
+		return false;
+	}
+
+	LL_INFOS("TextureCache") << "Moving " << num_entries << " texture cache entries into " << mBodyArenaFileName << LL_ENDL;
+
+	std::vector<LLTextureCacheUnpackedEntry> old_entries(num_entries);
+	std::vector<Entry> entries(num_entries);
+	if (num_entries)
+	{
+		memcpy(&old_entries[0], mEntriesFile.getData() + sizeof(EntriesInfo), old_size);
+	}
+
+	// Oldest bodies go in first so that if they don't all fit, the newest survive
+	typedef std::pair<U32, U32> time_idx_t;
+	std::set<time_idx_t> bodies;
+	std::map<LLUUID, U32> idx_map;
+	for (U32 i = 0; i < num_entries; i++)
+	{
+		const LLTextureCacheUnpackedEntry& old_entry = old_entries[i];
+		entries[i] = Entry(old_entry.mID, old_entry.mImageSize, 0, old_entry.mTime);
+		if (old_entry.mBodySize > 0 && old_entry.mImageSize > old_entry.mBodySize)
+		{
+			bodies.insert(std::make_pair(old_entry.mTime, i));
+			idx_map[old_entry.mID] = i;
+		}
 	}
 
-	delete mHeaderAPRFile;
-	mHeaderAPRFile = NULL;
+	mBodyArena.clear();
+	S32 moved = 0;
+	for (std::set<time_idx_t>::iterator iter = bodies.begin(); iter != bodies.end(); ++iter)
+	{
+		Entry& entry = entries[iter->second];
+		S32 body_size = old_entries[iter->second].mBodySize;
+		std::string filename = getTextureFileName(entry.mID);
+		if (LLAPRFile::size(filename, getLocalAPRFilePool()) == body_size)
+		{
+			std::vector<LLUUID> evicted;
+			S32 offset = mBodyArena.allocate(entry.mID, body_size, evicted);
+			if (offset >= 0)
+			{
+				S32 bytes_read = LLAPRFile::readEx(filename, mBodyArena.getData(offset), 0, body_size, getLocalAPRFilePool());
+				if (bytes_read == body_size)
+				{
+					entry.mBodySize = body_size;
+					entry.mBodyOffset = offset;
+					moved++;
+				}
+				else
+				{
+					mBodyArena.release(offset, entry.mID);
+				}
+			}
+			for (std::vector<LLUUID>::iterator iter2 = evicted.begin(); iter2 != evicted.end(); ++iter2)
+			{
+				std::map<LLUUID, U32>::iterator iter3 = idx_map.find(*iter2);
+				if (iter3 != idx_map.end())
+				{
+					entries[iter3->second].mBodySize = 0;
+					entries[iter3->second].mBodyOffset = -1;
+					moved--;
+				}
+			}
+		}
+		LLAPRFile::remove(filename, getLocalAPRFilePool());
+	}
+
+	// Entries first, then the version that makes them valid
+	if (num_entries && !writeEntries(0, &entries[0], num_entries))
+	{
+		return false;
+	}
+	mHeaderEntriesInfo.mVersion = sHeaderCacheVersion;
+	writeEntriesHeader();
+
+	// Whatever is left in the body directories had no entry
+	const char* subdirs = "0123456789abcdef";
+	std::string delem = gDirUtilp->getDirDelimiter();
+	for (S32 i=0; i<16; i++)
+	{
+		std::string dirname = mTexturesDirName + delem + subdirs[i];
+		gDirUtilp->deleteFilesInDir(dirname, delem + "*");
+		LLFile::rmdir(dirname);
+	}
+
+	LL_INFOS("TextureCache") << "Moved " << moved << " of " << bodies.size() << " texture bodies" << LL_ENDL;
+	return true;
 }
 
+//----------------------------------------------------------------------------
+// mHeaderMutex must be locked for the following functions!
+
 void LLTextureCache::readEntriesHeader()
 {
 	// mHeaderEntriesInfo initializes to default values so safe not to read it
-	llassert_always(mHeaderAPRFile == NULL);
-	if (LLAPRFile::isExist(mHeaderEntriesFileName, getLocalAPRFilePool()))
+	if (mEntriesFile.isOpen())
+	{
+		// a new file maps as zeros, which reads as a version mismatch
+		memcpy(&mHeaderEntriesInfo, mEntriesFile.getData(), sizeof(EntriesInfo));
+	}
+	else if (LLAPRFile::isExist(mHeaderEntriesFileName, getLocalAPRFilePool()))
 	{
 		LLAPRFile::readEx(mHeaderEntriesFileName, (U8*)&mHeaderEntriesInfo, 0, sizeof(EntriesInfo),
 						  getLocalAPRFilePool());
@@ -1023,12 +1313,58 @@ void LLTextureCache::readEntriesHeader()
 
 void LLTextureCache::writeEntriesHeader()
 {
-	llassert_always(mHeaderAPRFile == NULL);
 	if (!mReadOnly)
 	{
-		LLAPRFile::writeEx(mHeaderEntriesFileName, (U8*)&mHeaderEntriesInfo, 0, sizeof(EntriesInfo),
-						   getLocalAPRFilePool());
+		if (mEntriesFile.isOpen())
+		{
+			memcpy(mEntriesFile.getData(), &mHeaderEntriesInfo, sizeof(EntriesInfo));
+		}
+		else
+		{
+			LLAPRFile::writeEx(mHeaderEntriesFileName, (U8*)&mHeaderEntriesInfo, 0, sizeof(EntriesInfo),
+							   getLocalAPRFilePool());
+		}
+	}
+}
+
+// Falls back to file I/O when the entries file could not be mapped.
+// Returns false if the entries are not all there.
+bool LLTextureCache::readEntries(U32 idx, Entry* entries, U32 count)
+{
+	S64 offset = (S64)sizeof(EntriesInfo) + (S64)idx * sizeof(Entry);
+	S64 size = (S64)count * sizeof(Entry);
+	if (mEntriesFile.isOpen())
+	{
+		if (offset + size > mEntriesFile.getSize())
+		{
+			return false;
+		}
+		memcpy(entries, mEntriesFile.getData() + offset, size);
+		return true;
 	}
+	S32 bytes_read = LLAPRFile::readEx(mHeaderEntriesFileName, entries, (S32)offset, (S32)size, getLocalAPRFilePool());
+	return bytes_read == size;
+}
+
+bool LLTextureCache::writeEntries(U32 idx, const Entry* entries, U32 count)
+{
+	if (mReadOnly)
+	{
+		return true;
+	}
+	S64 offset = (S64)sizeof(EntriesInfo) + (S64)idx * sizeof(Entry);
+	S64 size = (S64)count * sizeof(Entry);
+	if (mEntriesFile.isOpen())
+	{
+		if (offset + size > mEntriesFile.getSize())
+		{
+			return false;
+		}
+		memcpy(mEntriesFile.getData() + offset, entries, size);
+		return true;
+	}
+	S32 bytes_written = LLAPRFile::writeEx(mHeaderEntriesFileName, (void*)entries, (S32)offset, (S32)size, getLocalAPRFilePool());
+	return bytes_written == size;
 }
 
 //mHeaderMutex is locked before calling this.
@@ -1092,22 +1428,13 @@ S32 LLTextureCache::openAndReadEntry(const LLUUID& id, Entry& entry, bool create
 		// Remove this entry from the LRU if it exists
 		mLRU.erase(id);
 		// Read the entry
-		idx_entry_map_t::iterator iter = mUpdatedEntryMap.find(idx) ;
-		if(iter != mUpdatedEntryMap.end())
-		{
-			entry = iter->second ;
-		}
-		else
-		{
-			readEntryFromHeaderImmediately(idx, entry) ;
-		}
-		if(entry.mImageSize <= entry.mBodySize)//it happens on 64-bit systems, do not know why
+		readEntry(idx, entry) ;
+		if(idx >= 0 && entry.mImageSize <= entry.mBodySize)//it happens on 64-bit systems, do not know why
 		{
 			llwarns << "corrupted entry: " << id << " entry image size: " << entry.mImageSize << " entry body size: " << entry.mBodySize << llendl ;
 
 			//erase this entry and the cached texture from the cache.
-			std::string tex_filename = getTextureFileName(id);
-			removeEntry(idx, entry, tex_filename) ;
+			removeEntry(idx, entry) ;
 			mUpdatedEntryMap.erase(idx) ;
 			idx = -1 ;
 		}
@@ -1118,28 +1445,11 @@ S32 LLTextureCache::openAndReadEntry(const LLUUID& id, Entry& entry, bool create
 //mHeaderMutex is locked before calling this.
 void LLTextureCache::writeEntryToHeaderImmediately(S32& idx, Entry& entry, bool write_header)
 {	
-	LLAPRFile* aprfile ;
-	S32 bytes_written ;
-	S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
 	if(write_header)
 	{
-		aprfile = openHeaderEntriesFile(false, 0);		
-		bytes_written = aprfile->write((U8*)&mHeaderEntriesInfo, sizeof(EntriesInfo)) ;
-		if(bytes_written != sizeof(EntriesInfo))
-		{
-			clearCorruptedCache() ; //clear the cache.
-			idx = -1 ;//mark the idx invalid.
-			return ;
-		}
-
-		mHeaderAPRFile->seek(APR_SET, offset);
-	}
-	else
-	{
-		aprfile = openHeaderEntriesFile(false, offset);
+		writeEntriesHeader() ;
 	}
-	bytes_written = aprfile->write((void*)&entry, (S32)sizeof(Entry));
-	if(bytes_written != sizeof(Entry))
+	if(!writeEntries(idx, &entry, 1))
 	{
 		clearCorruptedCache() ; //clear the cache.
 		idx = -1 ;//mark the idx invalid.
@@ -1147,25 +1457,34 @@ void LLTextureCache::writeEntryToHeaderImmediately(S32& idx, Entry& entry, bool
 		return ;
 	}
 
-	closeHeaderEntriesFile();
 	mUpdatedEntryMap.erase(idx) ;
 }
 
 //mHeaderMutex is locked before calling this.
 void LLTextureCache::readEntryFromHeaderImmediately(S32& idx, Entry& entry)
 {
-	S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
-	LLAPRFile* aprfile = openHeaderEntriesFile(true, offset);
-	S32 bytes_read = aprfile->read((void*)&entry, (S32)sizeof(Entry));
-	closeHeaderEntriesFile();
-
-	if(bytes_read != sizeof(Entry))
+	if(!readEntries(idx, &entry, 1))
 	{
 		clearCorruptedCache() ; //clear the cache.
 		idx = -1 ;//mark the idx invalid.
 	}
 }
 
+//mHeaderMutex is locked before calling this.
+//read an entry, including a time stamp update not written yet.
+void LLTextureCache::readEntry(S32& idx, Entry& entry)
+{
+	idx_entry_map_t::iterator iter = mUpdatedEntryMap.find(idx) ;
+	if(iter != mUpdatedEntryMap.end())
+	{
+		entry = iter->second ;
+	}
+	else
+	{
+		readEntryFromHeaderImmediately(idx, entry) ;
+	}
+}
+
 //mHeaderMutex is locked before calling this.
 //update an existing entry time stamp, delay writing.
 void LLTextureCache::updateEntryTimeStamp(S32 idx, Entry& entry)
@@ -1218,6 +1537,10 @@ bool LLTextureCache::updateEntry(S32& idx, Entry& entry, S32 new_image_size, S32
 			mTexturesSizeMap[entry.mID] = new_body_size ;
 			mTexturesSizeTotal -= entry.mBodySize ;
 			mTexturesSizeTotal += new_body_size ;
+
+			//the old body goes, writeBody() stores the new one
+			mBodyArena.release(entry.mBodyOffset, entry.mID) ;
+			entry.mBodyOffset = -1 ;
 		}
 		entry.mTime = time(NULL);
 		entry.mImageSize = new_image_size ; 
@@ -1250,33 +1573,20 @@ U32 LLTextureCache::openAndReadEntries(std::vector<Entry>& entries)
 	mFreeList.clear();
 	mTexturesSizeTotal = 0;
 
-	LLAPRFile* aprfile = NULL; 
-	if(mUpdatedEntryMap.empty())
-	{
-		aprfile = openHeaderEntriesFile(true, (S32)sizeof(EntriesInfo));
-	}
-	else //update the header file first.
+	//update the header file first.
+	updatedHeaderEntriesFile() ;
+
+	entries.resize(num_entries);
+	if (num_entries && !readEntries(0, &entries[0], num_entries))
 	{
-		aprfile = openHeaderEntriesFile(false, 0);
-		updatedHeaderEntriesFile() ;
-		if(!aprfile)
-		{
-			return 0;
-		}
-		aprfile->seek(APR_SET, (S32)sizeof(EntriesInfo));
+		llwarns << "Corrupted header entries, failed to read " << num_entries << " entries" << llendl;
+		entries.clear();
+		purgeAllTextures(false);
+		return 0;
 	}
 	for (U32 idx=0; idx<num_entries; idx++)
 	{
-		Entry entry;
-		S32 bytes_read = aprfile->read((void*)(&entry), (S32)sizeof(Entry));
-		if (bytes_read < sizeof(Entry))
-		{
-			llwarns << "Corrupted header entries, failed at " << idx << " / " << num_entries << llendl;
-			closeHeaderEntriesFile();
-			purgeAllTextures(false);
-			return 0;
-		}
-		entries.push_back(entry);
+		const Entry& entry = entries[idx];
 // 		llinfos << "ENTRY: " << entry.mTime << " TEX: " << entry.mID << " IDX: " << idx << " Size: " << entry.mImageSize << llendl;
 		if(entry.mImageSize > entry.mBodySize)
 		{
@@ -1289,7 +1599,6 @@ U32 LLTextureCache::openAndReadEntries(std::vector<Entry>& entries)
 			mFreeList.insert(idx);
 		}
 	}
-	closeHeaderEntriesFile();
 	return num_entries;
 }
 
@@ -1298,63 +1607,35 @@ void LLTextureCache::writeEntriesAndClose(const std::vector<Entry>& entries)
 	S32 num_entries = entries.size();
 	llassert_always(num_entries == mHeaderEntriesInfo.mEntries);
 	
-	if (!mReadOnly)
+	if (!mReadOnly && num_entries)
 	{
-		LLAPRFile* aprfile = openHeaderEntriesFile(false, (S32)sizeof(EntriesInfo));
-		for (S32 idx=0; idx<num_entries; idx++)
+		if (!writeEntries(0, &entries[0], num_entries))
 		{
-			S32 bytes_written = aprfile->write((void*)(&entries[idx]), (S32)sizeof(Entry));
-			if(bytes_written != sizeof(Entry))
-			{
-				clearCorruptedCache() ; //clear the cache.
-				return ;
-			}
+			clearCorruptedCache() ; //clear the cache.
+			return ;
 		}
-		closeHeaderEntriesFile();
 	}
 }
 
 void LLTextureCache::writeUpdatedEntries()
 {
 	lockHeaders() ;
-	if (!mReadOnly && !mUpdatedEntryMap.empty())
-	{
-		openHeaderEntriesFile(false, 0);
-		updatedHeaderEntriesFile() ;
-		closeHeaderEntriesFile();
-	}
+	updatedHeaderEntriesFile() ;
 	unlockHeaders() ;
 }
 
-//mHeaderMutex is locked and mHeaderAPRFile is created before calling this.
+//mHeaderMutex is locked before calling this.
 void LLTextureCache::updatedHeaderEntriesFile()
 {
-	if (!mReadOnly && !mUpdatedEntryMap.empty() && mHeaderAPRFile)
+	if (!mReadOnly && !mUpdatedEntryMap.empty())
 	{
 		//entriesInfo
-		mHeaderAPRFile->seek(APR_SET, 0);
-		S32 bytes_written = mHeaderAPRFile->write((U8*)&mHeaderEntriesInfo, sizeof(EntriesInfo)) ;
-		if(bytes_written != sizeof(EntriesInfo))
-		{
-			clearCorruptedCache() ; //clear the cache.
-			return ;
-		}
+		writeEntriesHeader() ;
 		
 		//write each updated entry
-		S32 entry_size = (S32)sizeof(Entry) ;
-		S32 prev_idx = -1 ;
-		S32 delta_idx ;
 		for (idx_entry_map_t::iterator iter = mUpdatedEntryMap.begin(); iter != mUpdatedEntryMap.end(); ++iter)
 		{
-			delta_idx = iter->first - prev_idx - 1;
-			prev_idx = iter->first ;
-			if(delta_idx)
-			{
-				mHeaderAPRFile->seek(APR_CUR, delta_idx * entry_size);
-			}
-			
-			bytes_written = mHeaderAPRFile->write((void*)(&iter->second), entry_size);
-			if(bytes_written != entry_size)
+			if (!writeEntries(iter->first, &iter->second, 1))
 			{
 				clearCorruptedCache() ; //clear the cache.
 				return ;
@@ -1374,6 +1655,11 @@ void LLTextureCache::readHeaderCache()
 
 	readEntriesHeader();
 	
+	if (mHeaderEntriesInfo.mVersion == TEXTURE_CACHE_UNPACKED_VERSION && !mReadOnly)
+	{
+		migrateUnpackedCache(); // bumps the version if it worked
+	}
+
 	if (mHeaderEntriesInfo.mVersion != sHeaderCacheVersion)
 	{
 		if (!mReadOnly)
@@ -1446,8 +1732,7 @@ void LLTextureCache::readHeaderCache()
 			{
 				for (std::set<U32>::iterator iter = purge_list.begin(); iter != purge_list.end(); ++iter)
 				{
-					std::string tex_filename = getTextureFileName(entries[*iter].mID);
-					removeEntry((S32)*iter, entries[*iter], tex_filename);
+					removeEntry((S32)*iter, entries[*iter]);
 				}
 				// If we removed any entries, we need to rebuild the entries list,
 				// write the header, and call this again
@@ -1484,19 +1769,11 @@ void LLTextureCache::clearCorruptedCache()
 {
 	llwarns << "the texture cache is corrupted, need to be cleared." << llendl ;
 
-	closeHeaderEntriesFile();//close possible file handler
 	purgeAllTextures(false) ; //clear the cache.
 	
 	if (!mReadOnly) //regenerate the directory tree if not exists.
 	{
 		LLFile::mkdir(mTexturesDirName);
-		
-		const char* subdirs = "0123456789abcdef";
-		for (S32 i=0; i<16; i++)
-		{
-			std::string dirname = mTexturesDirName + gDirUtilp->getDirDelimiter() + subdirs[i];
-			LLFile::mkdir(dirname);
-		}
 	}
 
 	return ;
@@ -1504,6 +1781,10 @@ void LLTextureCache::clearCorruptedCache()
 
 void LLTextureCache::purgeAllTextures(bool purge_directories)
 {
+	{
+		LLMutexLock lock(&mDXTMutex);
+		purgeDXTTextures(purge_directories);
+	}
 	if (!mReadOnly)
 	{
 		const char* subdirs = "0123456789abcdef";
@@ -1511,19 +1792,25 @@ void LLTextureCache::purgeAllTextures(bool purge_directories)
 		std::string mask = delem + "*";
 		for (S32 i=0; i<16; i++)
 		{
+			// body files of caches from before the body arena
 			std::string dirname = mTexturesDirName + delem + subdirs[i];
-			llinfos << "Deleting files in directory: " << dirname << llendl;
-			gDirUtilp->deleteFilesInDir(dirname,mask);
-			if (purge_directories)
+			if (LLFile::isdir(dirname))
 			{
+				llinfos << "Deleting files in directory: " << dirname << llendl;
+				gDirUtilp->deleteFilesInDir(dirname,mask);
 				LLFile::rmdir(dirname);
 			}
 		}
 		if (purge_directories)
 		{
+			closeCacheFiles();
 			gDirUtilp->deleteFilesInDir(mTexturesDirName, mask);
 			LLFile::rmdir(mTexturesDirName);
-		}		
+		}
+		else
+		{
+			mBodyArena.clear();
+		}
 	}
 	mHeaderIDMap.clear();
 	mTexturesSizeMap.clear();
@@ -1547,10 +1834,12 @@ void LLTextureCache::purgeTextures(bool validate)
 		return;
 	}
 
-	if (!mThreaded)
+	// No LLAppViewer when run from lltexturefetchreplay
+	LLAppViewer* app = LLAppViewer::instance();
+	if (!mThreaded && app)
 	{
 		// *FIX:Mani - watchdog off.
-		LLAppViewer::instance()->pauseMainloopTimeout();
+		app->pauseMainloopTimeout();
 	}
 	
 	LLMutexLock lock(&mHeaderMutex);
@@ -1605,23 +1894,22 @@ void LLTextureCache::purgeTextures(bool validate)
 	{
 		S32 idx = iter->second;
 		bool purge_entry = false;
-		std::string filename = getTextureFileName(entries[idx].mID);
+		const LLUUID& id = entries[idx].mID;
 		if (cache_size >= purged_cache_size)
 		{
 			purge_entry = true;
 		}
 		else if (validate)
 		{
-			// make sure file exists and is the correct size
+			// make sure the body is still in the arena
 			U32 uuididx = entries[idx].mID.mData[0];
 			if (uuididx == validate_idx)
 			{
- 				LL_DEBUGS("TextureCache") << "Validating: " << filename << "Size: " << entries[idx].mBodySize << LL_ENDL;
-				S32 bodysize = LLAPRFile::size(filename, getLocalAPRFilePool());
-				if (bodysize != entries[idx].mBodySize)
+ 				LL_DEBUGS("TextureCache") << "Validating: " << id << "Size: " << entries[idx].mBodySize << LL_ENDL;
+				if (!mBodyArena.isValid(entries[idx].mBodyOffset, id, entries[idx].mBodySize))
 				{
-					LL_WARNS("TextureCache") << "TEXTURE CACHE BODY HAS BAD SIZE: " << bodysize << " != " << entries[idx].mBodySize
-							<< filename << LL_ENDL;
+					LL_WARNS("TextureCache") << "TEXTURE CACHE BODY MISSING: " << id
+							<< " Offset: " << entries[idx].mBodyOffset << " Size: " << entries[idx].mBodySize << LL_ENDL;
 					purge_entry = true;
 				}
 			}
@@ -1634,9 +1922,9 @@ void LLTextureCache::purgeTextures(bool validate)
 		if (purge_entry)
 		{
 			purge_count++;
-	 		LL_DEBUGS("TextureCache") << "PURGING: " << filename << LL_ENDL;
-			removeEntry(idx, entries[idx], filename) ;
+	 		LL_DEBUGS("TextureCache") << "PURGING: " << id << LL_ENDL;
 			cache_size -= entries[idx].mBodySize;
+			removeEntry(idx, entries[idx]) ;
 		}
 	}
 
@@ -1645,7 +1933,10 @@ void LLTextureCache::purgeTextures(bool validate)
 	writeEntriesAndClose(entries);
 	
 	// *FIX:Mani - watchdog back on.
-	LLAppViewer::instance()->resumeMainloopTimeout();
+	if (app)
+	{
+		app->resumeMainloopTimeout();
+	}
 	
 	LL_INFOS("TextureCache") << "TEXTURE CACHE:"
 			<< " PURGED: " << purge_count
@@ -1846,30 +2137,43 @@ void LLTextureCache::addCompleted(Responder* responder, bool success)
 //called after mHeaderMutex is locked.
 void LLTextureCache::removeCachedTexture(const LLUUID& id)
 {
+	id_map_t::iterator iter = mHeaderIDMap.find(id);
+	if(iter != mHeaderIDMap.end())
+	{
+		S32 idx = iter->second;
+		Entry entry;
+		readEntry(idx, entry);
+		if(idx >= 0 && entry.mID == id && entry.mBodySize > 0)
+		{
+			mBodyArena.release(entry.mBodyOffset, id);
+		}
+	}
 	if(mTexturesSizeMap.find(id) != mTexturesSizeMap.end())
 	{
 		mTexturesSizeTotal -= mTexturesSizeMap[id] ;
 		mTexturesSizeMap.erase(id);
 	}
 	mHeaderIDMap.erase(id);
-	LLAPRFile::remove(getTextureFileName(id), getLocalAPRFilePool());		
 }
 
 //called after mHeaderMutex is locked.
-void LLTextureCache::removeEntry(S32 idx, Entry& entry, std::string& filename)
+void LLTextureCache::removeEntry(S32 idx, Entry& entry)
 {
 	if(idx >= 0) //valid entry
 	{
+		if(entry.mBodySize > 0)
+		{
+			mBodyArena.release(entry.mBodyOffset, entry.mID);
+		}
+		mTexturesSizeTotal -= entry.mBodySize;
 		entry.mImageSize = -1;
 		entry.mBodySize = 0;
+		entry.mBodyOffset = -1;
 		mHeaderIDMap.erase(entry.mID);
 		mTexturesSizeMap.erase(entry.mID);
 
-		mTexturesSizeTotal -= entry.mBodySize;
 		mFreeList.insert(idx);	
 	}
-
-	LLAPRFile::remove(filename, getLocalAPRFilePool());		
 }
 
 bool LLTextureCache::removeFromCache(const LLUUID& id)
@@ -1882,8 +2186,7 @@ bool LLTextureCache::removeFromCache(const LLUUID& id)
 
 		Entry entry;
 		S32 idx = openAndReadEntry(id, entry, false);
-		std::string tex_filename = getTextureFileName(id);
-		removeEntry(idx, entry, tex_filename) ;
+		removeEntry(idx, entry) ;
 		if (idx >= 0)
 		{			
 			writeEntryToHeaderImmediately(idx, entry);					
@@ -1895,6 +2198,438 @@ bool LLTextureCache::removeFromCache(const LLUUID& id)
 	return ret ;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Header and body data, called from the work threads
+
+// Reads size bytes of header record idx, starting offset bytes into it
+S32 LLTextureCache::readHeaderData(S32 idx, U8* data, S32 offset, S32 size)
+{
+	S64 file_offset = (S64)idx * TEXTURE_CACHE_ENTRY_SIZE + offset;
+	if (mHeaderDataFile.isOpen())
+	{
+		if (file_offset + size > mHeaderDataFile.getSize())
+		{
+			return 0;
+		}
+		memcpy(data, mHeaderDataFile.getData() + file_offset, size);
+		return size;
+	}
+	return LLAPRFile::readEx(mHeaderDataFileName, data, (S32)file_offset, size, getLocalAPRFilePool());
+}
+
+// Fills header record idx with the first TEXTURE_CACHE_ENTRY_SIZE bytes of data, padded with 0
+S32 LLTextureCache::writeHeaderData(S32 idx, U8* data, S32 size)
+{
+	size = llmin(size, TEXTURE_CACHE_ENTRY_SIZE);
+	S64 file_offset = (S64)idx * TEXTURE_CACHE_ENTRY_SIZE;
+	if (mHeaderDataFile.isOpen())
+	{
+		if (mHeaderDataFile.isReadOnly() || file_offset + TEXTURE_CACHE_ENTRY_SIZE > mHeaderDataFile.getSize())
+		{
+			return 0;
+		}
+		U8* record = mHeaderDataFile.getData() + file_offset;
+		memcpy(record, data, size);
+		memset(record + size, 0, TEXTURE_CACHE_ENTRY_SIZE - size);
+		return TEXTURE_CACHE_ENTRY_SIZE;
+	}
+
+	S32 bytes_written;
+	if (size < TEXTURE_CACHE_ENTRY_SIZE)
+	{
+		// We need to write a full record in the header cache so, if the amount of data is smaller
+		// than a record, we need to transfer the data to a buffer padded with 0 and write that
+		U8* padBuffer = new U8[TEXTURE_CACHE_ENTRY_SIZE];
+		memset(padBuffer, 0, TEXTURE_CACHE_ENTRY_SIZE);		// Init with zeros
+		memcpy(padBuffer, data, size);						// Copy the write buffer
+		bytes_written = LLAPRFile::writeEx(mHeaderDataFileName, padBuffer, (S32)file_offset, TEXTURE_CACHE_ENTRY_SIZE, getLocalAPRFilePool());
+		delete [] padBuffer;
+	}
+	else
+	{
+		bytes_written = LLAPRFile::writeEx(mHeaderDataFileName, data, (S32)file_offset, TEXTURE_CACHE_ENTRY_SIZE, getLocalAPRFilePool());
+	}
+	return bytes_written;
+}
+
+// Copies up to size bytes of the body of id, starting offset bytes into it.
+// Returns the number of bytes copied, 0 if there is no body.
+S32 LLTextureCache::readBody(const LLUUID& id, U8* data, S32 offset, S32 size)
+{
+	LLMutexLock lock(&mHeaderMutex);
+
+	id_map_t::iterator iter = mHeaderIDMap.find(id);
+	if (iter == mHeaderIDMap.end())
+	{
+		return 0;
+	}
+	S32 idx = iter->second;
+	Entry entry;
+	readEntry(idx, entry);
+	if (idx < 0 || entry.mID != id || entry.mBodySize <= 0 || entry.mBodyOffset < 0)
+	{
+		// no body, or it is being written
+		return 0;
+	}
+	if (!mBodyArena.isValid(entry.mBodyOffset, id, entry.mBodySize))
+	{
+		// Shouldn't happen, failsafe only
+		LL_WARNS("TextureCache") << "Lost the body of " << id << LL_ENDL;
+		std::vector<LLUUID> lost(1, id);
+		evictBodies(lost);
+		return 0;
+	}
+
+	size = llmin(size, entry.mBodySize - offset);
+	if (size <= 0)
+	{
+		return 0;
+	}
+	memcpy(data, mBodyArena.getData(entry.mBodyOffset + offset), size);
+
+	if (!mReadOnly && offset == 0 && size == entry.mBodySize && mBodyArena.isStale(entry.mBodyOffset))
+	{
+		// Still in use and about to be overwritten: move it to the head,
+		// which turns the ring's first in first out order into an LRU.
+		std::vector<LLUUID> evicted;
+		mBodyArena.release(entry.mBodyOffset, id);
+		entry.mBodyOffset = mBodyArena.allocate(id, entry.mBodySize, evicted);
+		if (entry.mBodyOffset >= 0)
+		{
+			memcpy(mBodyArena.getData(entry.mBodyOffset), data, size);
+		}
+		else
+		{
+			mTexturesSizeTotal -= entry.mBodySize;
+			mTexturesSizeMap[id] = 0;
+			entry.mBodySize = 0;
+		}
+		writeEntryToHeaderImmediately(idx, entry);
+		evictBodies(evicted);
+	}
+	return size;
+}
+
+// Stores the body of id, whose entry updateEntry() has sized already
+bool LLTextureCache::writeBody(const LLUUID& id, U8* data, S32 size)
+{
+	LLMutexLock lock(&mHeaderMutex);
+
+	id_map_t::iterator iter = mHeaderIDMap.find(id);
+	if (mReadOnly || iter == mHeaderIDMap.end())
+	{
+		return false;
+	}
+	S32 idx = iter->second;
+	Entry entry;
+	readEntry(idx, entry);
+	if (idx < 0 || entry.mID != id)
+	{
+		return false;
+	}
+	if (mBodyArena.isValid(entry.mBodyOffset, id, size))
+	{
+		// same size as what we have, overwrite it in place
+		memcpy(mBodyArena.getData(entry.mBodyOffset), data, size);
+		return true;
+	}
+
+	// updateEntry() sized it, but a reader may have dropped it since
+	mTexturesSizeTotal += size - entry.mBodySize;
+	mTexturesSizeMap[id] = size;
+	entry.mBodySize = size;
+
+	std::vector<LLUUID> evicted;
+	mBodyArena.release(entry.mBodyOffset, id);
+	entry.mBodyOffset = mBodyArena.allocate(id, size, evicted);
+	if (entry.mBodyOffset >= 0)
+	{
+		memcpy(mBodyArena.getData(entry.mBodyOffset), data, size);
+	}
+	else
+	{
+		// no arena, or bigger than all of it: keep the header only
+		mTexturesSizeTotal -= entry.mBodySize;
+		mTexturesSizeMap[id] = 0;
+		entry.mBodySize = 0;
+	}
+	writeEntryToHeaderImmediately(idx, entry);
+	evictBodies(evicted);
+
+	return idx >= 0 && entry.mBodyOffset >= 0;
+}
+
+// Drops the bodies the arena overwrote from their entries, keeping the headers
+//mHeaderMutex is locked before calling this.
+void LLTextureCache::evictBodies(const std::vector<LLUUID>& evicted)
+{
+	for (std::vector<LLUUID>::const_iterator iter = evicted.begin(); iter != evicted.end(); ++iter)
+	{
+		id_map_t::iterator iter2 = mHeaderIDMap.find(*iter);
+		if (iter2 == mHeaderIDMap.end())
+		{
+			continue;
+		}
+		S32 idx = iter2->second;
+		Entry entry;
+		readEntry(idx, entry);
+		if (idx < 0)
+		{
+			return; // the cache was cleared
+		}
+		if (entry.mID != *iter)
+		{
+			continue;
+		}
+		mTexturesSizeTotal -= entry.mBodySize;
+		mTexturesSizeMap[entry.mID] = 0;
+		entry.mBodySize = 0;
+		entry.mBodyOffset = -1;
+		writeEntryToHeaderImmediately(idx, entry);
+		if (idx < 0)
+		{
+			return;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Compressed tier
+
+S32 LLTextureCache::getDXTDiscard(const LLUUID& id)
+{
+	if (!mDXTCacheEnabled)
+	{
+		return -1;
+	}
+	LLMutexLock lock(&mDXTMutex);
+	dxt_entry_map_t::iterator iter = mDXTEntries.find(id);
+	if (iter == mDXTEntries.end())
+	{
+		return -1;
+	}
+	iter->second.mTime = time(NULL); // about to be read, keep it in the LRU
+	return iter->second.mDiscard;
+}
+
+LLTextureCache::handle_t LLTextureCache::readDXTFromCache(const LLUUID& id, U32 priority, ReadResponder* responder)
+{
+	LLMutexLock lock(&mWorkersMutex);
+	LLTextureCacheWorker* worker = new LLTextureCacheDXTWorker(this, priority, id, NULL, -1, responder);
+	handle_t handle = worker->read();
+	mReaders[handle] = worker;
+	return handle;
+}
+
+void LLTextureCache::writeDXTToCache(const LLUUID& id, U32 priority, LLImageRaw* raw, S32 discard)
+{
+	if (!mDXTCacheEnabled || mReadOnly || !raw || discard < 0)
+	{
+		return;
+	}
+	S32 width = raw->getWidth();
+	S32 height = raw->getHeight();
+	S32 components = raw->getComponents();
+	if ((components != 3 && components != 4) ||
+		width < TEXTURE_CACHE_DXT_MIN_SIZE || height < TEXTURE_CACHE_DXT_MIN_SIZE ||
+		(width & (width - 1)) || (height & (height - 1)))
+	{
+		return;
+	}
+	{
+		LLMutexLock lock(&mDXTMutex);
+		if (mDXTPendingWrites.find(id) != mDXTPendingWrites.end())
+		{
+			return;
+		}
+		dxt_entry_map_t::iterator iter = mDXTEntries.find(id);
+		if (iter != mDXTEntries.end() && iter->second.mDiscard <= discard)
+		{
+			return; // already have this or better
+		}
+		mDXTPendingWrites.insert(id);
+	}
+
+	// The caller may scale raw in place once we return, compress a copy
+	LLPointer<LLImageRaw> copy = new LLImageRaw(raw->getData(), width, height, components);
+	LLMutexLock lock(&mWorkersMutex);
+	LLTextureCacheWorker* worker = new LLTextureCacheDXTWorker(this, priority, id, copy, discard, NULL);
+	handle_t handle = worker->write();
+	mDXTWriters[handle] = worker;
+}
+
+// Called from the cache thread when a write finishes, size 0 if it failed
+void LLTextureCache::addDXTEntry(const LLUUID& id, S32 discard, S32 size)
+{
+	LLMutexLock lock(&mDXTMutex);
+	mDXTPendingWrites.erase(id);
+
+	dxt_entry_map_t::iterator iter = mDXTEntries.find(id);
+	if (iter != mDXTEntries.end())
+	{
+		mDXTSizeTotal -= iter->second.mSize;
+		mDXTEntries.erase(iter);
+	}
+	if (size <= 0)
+	{
+		LLAPRFile::remove(getDXTFileName(id), getLocalAPRFilePool());
+		return;
+	}
+
+	DXTEntry& entry = mDXTEntries[id];
+	entry.mID = id;
+	entry.mDiscard = discard;
+	entry.mSize = size;
+	entry.mTime = time(NULL);
+	mDXTSizeTotal += size;
+
+	if (mDXTSizeTotal > sCacheMaxDXTSize)
+	{
+		purgeDXTEntries();
+	}
+}
+
+void LLTextureCache::removeDXTEntry(const LLUUID& id)
+{
+	LLMutexLock lock(&mDXTMutex);
+	dxt_entry_map_t::iterator iter = mDXTEntries.find(id);
+	if (iter != mDXTEntries.end())
+	{
+		mDXTSizeTotal -= iter->second.mSize;
+		mDXTEntries.erase(iter);
+		LLAPRFile::remove(getDXTFileName(id), getLocalAPRFilePool());
+	}
+}
+
+//called after mDXTMutex is locked.
+void LLTextureCache::purgeDXTEntries()
+{
+	// Least recently used first, down to the same fraction as the bodies
+	typedef std::set<std::pair<U32, LLUUID> > time_id_set_t;
+	time_id_set_t time_ids;
+	for (dxt_entry_map_t::iterator iter = mDXTEntries.begin(); iter != mDXTEntries.end(); ++iter)
+	{
+		time_ids.insert(std::make_pair(iter->second.mTime, iter->first));
+	}
+
+	S64 purged_cache_size = (sCacheMaxDXTSize * (S64)((1.f-TEXTURE_CACHE_PURGE_AMOUNT)*100)) / 100;
+	S32 purge_count = 0;
+	for (time_id_set_t::iterator iter = time_ids.begin();
+		 iter != time_ids.end() && mDXTSizeTotal > purged_cache_size; ++iter)
+	{
+		dxt_entry_map_t::iterator entry_iter = mDXTEntries.find(iter->second);
+		mDXTSizeTotal -= entry_iter->second.mSize;
+		mDXTEntries.erase(entry_iter);
+		LLAPRFile::remove(getDXTFileName(iter->second), getLocalAPRFilePool());
+		purge_count++;
+	}
+	LL_DEBUGS("TextureCache") << "COMPRESSED CACHE: PURGED: " << purge_count
+			<< " ENTRIES: " << mDXTEntries.size()
+			<< " SIZE: " << mDXTSizeTotal / (1024*1024) << " MB" << LL_ENDL;
+}
+
+//called after mDXTMutex is locked.
+void LLTextureCache::readDXTEntries()
+{
+	mDXTEntries.clear();
+	mDXTSizeTotal = 0;
+
+	bool valid = false;
+	S32 file_size = LLAPRFile::size(mDXTEntriesFileName, getLocalAPRFilePool());
+	if (file_size >= (S32)sizeof(DXTEntriesInfo))
+	{
+		std::vector<U8> buffer(file_size);
+		if (LLAPRFile::readEx(mDXTEntriesFileName, &buffer[0], 0, file_size, getLocalAPRFilePool()) == file_size)
+		{
+			DXTEntriesInfo info;
+			memcpy(&info, &buffer[0], sizeof(DXTEntriesInfo));
+			if (info.mVersion == sDXTCacheVersion &&
+				file_size == (S32)(sizeof(DXTEntriesInfo) + info.mEntries * sizeof(DXTEntry)))
+			{
+				const U8* data = &buffer[0] + sizeof(DXTEntriesInfo);
+				for (U32 i = 0; i < info.mEntries; i++)
+				{
+					DXTEntry entry;
+					memcpy(&entry, data + i * sizeof(DXTEntry), sizeof(DXTEntry));
+					if (entry.mSize > 0 && entry.mDiscard >= 0)
+					{
+						mDXTEntries[entry.mID] = entry;
+						mDXTSizeTotal += entry.mSize;
+					}
+				}
+				valid = true;
+			}
+		}
+	}
+
+	// The entries are only written on a clean shutdown, remove them so a
+	// crash before the next one can't leave a stale index behind.
+	LLAPRFile::remove(mDXTEntriesFileName, getLocalAPRFilePool());
+	if (!valid)
+	{
+		purgeDXTTextures(false);
+		LLFile::mkdir(mDXTDirName);
+		const char* subdirs = "0123456789abcdef";
+		for (S32 i=0; i<16; i++)
+		{
+			LLFile::mkdir(mDXTDirName + gDirUtilp->getDirDelimiter() + subdirs[i]);
+		}
+	}
+	else if (mDXTSizeTotal > sCacheMaxDXTSize)
+	{
+		purgeDXTEntries();
+	}
+
+	LL_INFOS("TextureCache") << "Compressed textures: " << mDXTEntries.size()
+			<< " Size: " << mDXTSizeTotal/(1024*1024) << " MB" << LL_ENDL;
+}
+
+//called after mDXTMutex is locked.
+void LLTextureCache::writeDXTEntries()
+{
+	DXTEntriesInfo info;
+	info.mVersion = sDXTCacheVersion;
+	info.mEntries = mDXTEntries.size();
+
+	std::vector<U8> buffer(sizeof(DXTEntriesInfo) + info.mEntries * sizeof(DXTEntry));
+	memcpy(&buffer[0], &info, sizeof(DXTEntriesInfo));
+	U8* data = &buffer[0] + sizeof(DXTEntriesInfo);
+	for (dxt_entry_map_t::iterator iter = mDXTEntries.begin(); iter != mDXTEntries.end(); ++iter)
+	{
+		memcpy(data, &iter->second, sizeof(DXTEntry));
+		data += sizeof(DXTEntry);
+	}
+	LLAPRFile::remove(mDXTEntriesFileName, getLocalAPRFilePool());
+	LLAPRFile::writeEx(mDXTEntriesFileName, &buffer[0], 0, (S32)buffer.size(), getLocalAPRFilePool());
+}
+
+//called after mDXTMutex is locked.
+void LLTextureCache::purgeDXTTextures(bool purge_directories)
+{
+	if (!mReadOnly && !mDXTDirName.empty() && LLFile::isdir(mDXTDirName))
+	{
+		const char* subdirs = "0123456789abcdef";
+		std::string delem = gDirUtilp->getDirDelimiter();
+		std::string mask = delem + "*";
+		for (S32 i=0; i<16; i++)
+		{
+			std::string dirname = mDXTDirName + delem + subdirs[i];
+			gDirUtilp->deleteFilesInDir(dirname, mask);
+			if (purge_directories)
+			{
+				LLFile::rmdir(dirname);
+			}
+		}
+		gDirUtilp->deleteFilesInDir(mDXTDirName, mask);
+		if (purge_directories)
+		{
+			LLFile::rmdir(mDXTDirName);
+		}
+	}
+	mDXTEntries.clear();
+	mDXTSizeTotal = 0;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 LLTextureCache::ReadResponder::ReadResponder()
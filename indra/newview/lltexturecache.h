@@ -27,14 +27,17 @@
 #ifndef LL_LLTEXTURECACHE_
 #define LL_LLTEXTURECACHE_H
 
+#include "llapr.h"
 #include "lldir.h"
 #include "llstl.h"
 #include "llstring.h"
 #include "lluuid.h"
 
 #include "llworkerthread.h"
+#include "lltexturecachearena.h"
 
 class LLImageFormatted;
+class LLImageRaw;
 class LLTextureCacheWorker;
 
 class LLTextureCache : public LLWorkerThread
@@ -42,6 +45,7 @@ class LLTextureCache : public LLWorkerThread
 	friend class LLTextureCacheWorker;
 	friend class LLTextureCacheRemoteWorker;
 	friend class LLTextureCacheLocalFileWorker;
+	friend class LLTextureCacheDXTWorker;
 
 private:
 	// Entries
@@ -56,16 +60,34 @@ private:
         	Entry() :
 		        mBodySize(0),
 			mImageSize(0),
-			mTime(0)
+			mTime(0),
+			mBodyOffset(-1)
 		{
 		}
 		Entry(const LLUUID& id, S32 imagesize, S32 bodysize, U32 time) :
-			mID(id), mImageSize(imagesize), mBodySize(bodysize), mTime(time) {}
-		void init(const LLUUID& id, U32 time) { mID = id, mImageSize = 0; mBodySize = 0; mTime = time; }
-		Entry& operator=(const Entry& entry) {mID = entry.mID, mImageSize = entry.mImageSize; mBodySize = entry.mBodySize; mTime = entry.mTime; return *this;}
+			mID(id), mImageSize(imagesize), mBodySize(bodysize), mTime(time), mBodyOffset(-1) {}
+		void init(const LLUUID& id, U32 time) { mID = id, mImageSize = 0; mBodySize = 0; mTime = time; mBodyOffset = -1; }
+		Entry& operator=(const Entry& entry) {mID = entry.mID, mImageSize = entry.mImageSize; mBodySize = entry.mBodySize; mTime = entry.mTime; mBodyOffset = entry.mBodyOffset; return *this;}
 		LLUUID mID; // 16 bytes
 		S32 mImageSize; // total size of image if known
-		S32 mBodySize; // size of body file in body cache
+		S32 mBodySize; // size of body in the body arena
+		U32 mTime; // seconds since 1/1/1970
+		S32 mBodyOffset; // offset of the body in the body arena, -1 if none
+	};
+
+	// Compressed tier entries
+	struct DXTEntriesInfo
+	{
+		DXTEntriesInfo() : mVersion(0.f), mEntries(0) {}
+		F32 mVersion;
+		U32 mEntries;
+	};
+	struct DXTEntry
+	{
+		DXTEntry() : mDiscard(-1), mSize(0), mTime(0) {}
+		LLUUID mID;
+		S32 mDiscard; // discard level the compressed copy was made at
+		S32 mSize; // file size
 		U32 mTime; // seconds since 1/1/1970
 	};
 
@@ -98,7 +120,7 @@ public:
 		}
 	};
 	
-	LLTextureCache(bool threaded);
+	LLTextureCache(bool threaded, bool concurrent_queue = false, S32 pool_size = 1);
 	~LLTextureCache();
 
 	/*virtual*/ S32 update(U32 max_time_ms);	
@@ -120,6 +142,19 @@ public:
 
 	bool removeFromCache(const LLUUID& id);
 
+	// Compressed (BC1/BC3) tier, holding decoded textures ready for upload.
+	// Off unless enabled before initCache().
+	void setDXTCacheEnabled(BOOL enabled) { mDXTCacheEnabled = enabled; }
+	BOOL getDXTCacheEnabled() const { return mDXTCacheEnabled; }
+	// Discard level of the compressed copy of id, -1 if there is none
+	S32 getDXTDiscard(const LLUUID& id);
+	// Delivers an IMG_CODEC_DXT image, complete with readComplete()
+	handle_t readDXTFromCache(const LLUUID& id, U32 priority, ReadResponder* responder);
+	// Compresses a copy of raw on the cache thread and stores it, unless
+	// we already have a copy at the same or a better discard level.
+	// Fire and forget, the writer is cleaned up by update().
+	void writeDXTToCache(const LLUUID& id, U32 priority, LLImageRaw* raw, S32 discard);
+
 	// For LLTextureCacheWorker::Responder
 	LLTextureCacheWorker* getReader(handle_t handle);
 	LLTextureCacheWorker* getWriter(handle_t handle);
@@ -131,6 +166,8 @@ public:
 	S32 getNumWrites() { return mWriters.size(); }
 	S64 getUsage() { return mTexturesSizeTotal; }
 	S64 getMaxUsage() { return sCacheMaxTexturesSize; }
+	S64 getDXTUsage() { return mDXTSizeTotal; }
+	S64 getMaxDXTUsage() { return sCacheMaxDXTSize; }
 	U32 getEntries() { return mHeaderEntriesInfo.mEntries; }
 	U32 getMaxEntries() { return sCacheMaxEntries; };
 	BOOL isInCache(const LLUUID& id) ;
@@ -140,7 +177,10 @@ protected:
 	// Accessed by LLTextureCacheWorker
 	std::string getLocalFileName(const LLUUID& id);
 	std::string getTextureFileName(const LLUUID& id);
+	std::string getDXTFileName(const LLUUID& id);
 	void addCompleted(Responder* responder, bool success);
+	void addDXTEntry(const LLUUID& id, S32 discard, S32 size);
+	void removeDXTEntry(const LLUUID& id);
 	
 protected:
 	//void setFileAPRPool(apr_pool_t* pool) { mFileAPRPool = pool ; }
@@ -151,10 +191,13 @@ private:
 	void clearCorruptedCache();
 	void purgeAllTextures(bool purge_directories);
 	void purgeTextures(bool validate);
-	LLAPRFile* openHeaderEntriesFile(bool readonly, S32 offset);
-	void closeHeaderEntriesFile();
+	void openCacheFiles();
+	void closeCacheFiles();
+	bool migrateUnpackedCache();
 	void readEntriesHeader();
 	void writeEntriesHeader();
+	bool readEntries(U32 idx, Entry* entries, U32 count);
+	bool writeEntries(U32 idx, const Entry* entries, U32 count);
 	S32 openAndReadEntry(const LLUUID& id, Entry& entry, bool create);
 	bool updateEntry(S32& idx, Entry& entry, S32 new_image_size, S32 new_body_size);
 	void updateEntryTimeStamp(S32 idx, Entry& entry) ;
@@ -162,21 +205,31 @@ private:
 	void writeEntriesAndClose(const std::vector<Entry>& entries);
 	void readEntryFromHeaderImmediately(S32& idx, Entry& entry) ;
 	void writeEntryToHeaderImmediately(S32& idx, Entry& entry, bool write_header = false) ;
-	void removeEntry(S32 idx, Entry& entry, std::string& filename);
+	void readEntry(S32& idx, Entry& entry) ;
+	void removeEntry(S32 idx, Entry& entry);
 	void removeCachedTexture(const LLUUID& id) ;
+	S32 readHeaderData(S32 idx, U8* data, S32 offset, S32 size);
+	S32 writeHeaderData(S32 idx, U8* data, S32 size);
+	S32 readBody(const LLUUID& id, U8* data, S32 offset, S32 size);
+	bool writeBody(const LLUUID& id, U8* data, S32 size);
+	void evictBodies(const std::vector<LLUUID>& evicted);
 	S32 getHeaderCacheEntry(const LLUUID& id, Entry& entry);
 	S32 setHeaderCacheEntry(const LLUUID& id, Entry& entry, S32 imagesize, S32 datasize);
 	void writeUpdatedEntries() ;
 	void updatedHeaderEntriesFile() ;
 	void lockHeaders() { mHeaderMutex.lock(); }
 	void unlockHeaders() { mHeaderMutex.unlock(); }
+	// mDXTMutex must be locked for these
+	void readDXTEntries();
+	void writeDXTEntries();
+	void purgeDXTTextures(bool purge_directories);
+	void purgeDXTEntries();
 	
 private:
 	// Internal
 	LLMutex mWorkersMutex;
 	LLMutex mHeaderMutex;
 	LLMutex mListMutex;
-	LLAPRFile* mHeaderAPRFile;
 	
 	typedef std::map<handle_t, LLTextureCacheWorker*> handle_map_t;
 	handle_map_t mReaders;
@@ -198,9 +251,13 @@ private:
 	std::set<LLUUID> mLRU;
 	typedef std::map<LLUUID,S32> id_map_t;
 	id_map_t mHeaderIDMap;
+	LLAPRMappedFile mEntriesFile;
+	LLAPRMappedFile mHeaderDataFile;
 
 	// BODIES (TEXTURES minus headers)
 	std::string mTexturesDirName;
+	std::string mBodyArenaFileName;
+	LLTextureCacheArena mBodyArena;
 	typedef std::map<LLUUID,S32> size_map_t;
 	size_map_t mTexturesSizeMap;
 	S64 mTexturesSizeTotal;
@@ -209,10 +266,23 @@ private:
 	typedef std::map<S32, Entry> idx_entry_map_t;
 	idx_entry_map_t mUpdatedEntryMap;
 
+	// COMPRESSED TIER
+	BOOL mDXTCacheEnabled;
+	LLMutex mDXTMutex;
+	std::string mDXTDirName;
+	std::string mDXTEntriesFileName;
+	typedef std::map<LLUUID, DXTEntry> dxt_entry_map_t;
+	dxt_entry_map_t mDXTEntries;
+	std::set<LLUUID> mDXTPendingWrites;
+	S64 mDXTSizeTotal;
+	handle_map_t mDXTWriters; // protected by mWorkersMutex
+
 	// Statics
 	static F32 sHeaderCacheVersion;
 	static U32 sCacheMaxEntries;
 	static S64 sCacheMaxTexturesSize;
+	static F32 sDXTCacheVersion;
+	static S64 sCacheMaxDXTSize;
 };
 
 extern const S32 TEXTURE_CACHE_ENTRY_SIZE;
@@ -0,0 +1,249 @@
+/**
+ * @file lltexturecachearena.cpp
+ * @brief Memory mapped ring of texture bodies used by LLTextureCache.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "lltexturecachearena.h"
+
+const U32 ARENA_MAGIC = 0x4c4c5442; // "LLTB"
+const U32 ARENA_VERSION = 1;
+const U32 RECORD_MAGIC = 0x4c4c5452; // "LLTR"
+const S32 RECORD_ALIGNMENT = 16;
+const S32 STALE_FRACTION = 4; // the next 1/4th of the ring to be overwritten is stale
+
+LLTextureCacheArena::LLTextureCacheArena()
+	: mReset(false)
+{
+}
+
+LLTextureCacheArena::~LLTextureCacheArena()
+{
+	close();
+}
+
+bool LLTextureCacheArena::open(const std::string& filename, S32 size, bool readonly)
+{
+	llassert_always(!isOpen());
+	mReset = false;
+
+	S64 file_size = (S64)size + (S64)sizeof(Info);
+	file_size = (file_size + RECORD_ALIGNMENT - 1) & ~(S64)(RECORD_ALIGNMENT - 1);
+	if (size <= 0 || file_size > 0x7fffffff)
+	{
+		llwarns << "Invalid texture body arena size: " << size << llendl;
+		return false;
+	}
+
+	if (!mFile.open(filename, file_size, readonly))
+	{
+		return false;
+	}
+	if (mFile.getSize() != file_size && !readonly)
+	{
+		// made for a bigger cache, start over rather than map the excess
+		mFile.close();
+		LLAPRFile::remove(filename);
+		if (!mFile.open(filename, file_size))
+		{
+			return false;
+		}
+	}
+
+	const Info* info = getInfo();
+	const S32 start = (S32)sizeof(Info);
+	if (mFile.getSize() != file_size
+		|| info->mMagic != ARENA_MAGIC
+		|| info->mVersion != ARENA_VERSION
+		|| info->mSize != (S32)file_size
+		|| info->mHead < start || info->mHead > info->mSize
+		|| info->mEnd < start || info->mEnd > info->mSize)
+	{
+		if (readonly)
+		{
+			// can't fix it up, and don't know what it holds
+			close();
+			return false;
+		}
+		llinfos << "Starting a new texture body arena: " << filename << llendl;
+		clear();
+		mReset = true;
+	}
+	return true;
+}
+
+void LLTextureCacheArena::close()
+{
+	mFile.close();
+}
+
+void LLTextureCacheArena::clear()
+{
+	if (!isOpen() || mFile.isReadOnly())
+	{
+		return;
+	}
+	Info* info = getInfo();
+	memset(info, 0, sizeof(Info));
+	info->mMagic = ARENA_MAGIC;
+	info->mVersion = ARENA_VERSION;
+	info->mSize = (S32)mFile.getSize();
+	info->mHead = (S32)sizeof(Info);
+	info->mEnd = info->mHead;
+	info->mUsage = 0;
+}
+
+//static
+S32 LLTextureCacheArena::getAllocationSize(S32 size)
+{
+	return ((S32)sizeof(Record) + size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+S32 LLTextureCacheArena::getCapacity() const
+{
+	return isOpen() ? (S32)mFile.getSize() - (S32)sizeof(Info) : 0;
+}
+
+S32 LLTextureCacheArena::getUsage() const
+{
+	return isOpen() ? getInfo()->mUsage : 0;
+}
+
+// Drops the record at pos, returns where the next one starts
+S32 LLTextureCacheArena::evictRecord(S32 pos, S32 end, std::vector<LLUUID>& evicted)
+{
+	Record* record = getRecord(pos);
+	if (record->mMagic != RECORD_MAGIC
+		|| record->mLength < (S32)sizeof(Record)
+		|| (record->mLength & (RECORD_ALIGNMENT - 1))
+		|| pos + record->mLength > end)
+	{
+		// Shouldn't happen, failsafe only. Whoever still points past here
+		// is caught by isValid().
+		llwarns << "Corrupted texture body record at " << pos << ", dropping the rest of the lap" << llendl;
+		return end;
+	}
+	if (record->mID.notNull())
+	{
+		evicted.push_back(record->mID);
+		getInfo()->mUsage -= record->mDataSize;
+		record->mID.setNull();
+	}
+	return pos + record->mLength;
+}
+
+S32 LLTextureCacheArena::allocate(const LLUUID& id, S32 size, std::vector<LLUUID>& evicted)
+{
+	if (!isOpen() || mFile.isReadOnly() || size <= 0)
+	{
+		return -1;
+	}
+	S32 length = getAllocationSize(size);
+	if (length > getCapacity())
+	{
+		return -1;
+	}
+
+	Info* info = getInfo();
+	S32 head = info->mHead;
+	if (head + length > info->mSize)
+	{
+		// Wrap around, what is left of the previous lap goes first
+		S32 pos = head;
+		while (pos < info->mEnd)
+		{
+			pos = evictRecord(pos, info->mEnd, evicted);
+		}
+		info->mEnd = head;
+		head = (S32)sizeof(Info);
+	}
+
+	// Overwrite the oldest records until there is room. The new record takes
+	// over the slack up to the start of the first survivor.
+	S32 pos = head;
+	while (pos < head + length && pos < info->mEnd)
+	{
+		pos = evictRecord(pos, info->mEnd, evicted);
+	}
+	length = llmax(length, pos - head);
+
+	Record* record = getRecord(head);
+	record->mMagic = RECORD_MAGIC;
+	record->mLength = length;
+	record->mDataSize = size;
+	record->mPad = 0;
+	record->mID = id;
+
+	info->mHead = head + length;
+	info->mEnd = llmax(info->mEnd, info->mHead);
+	info->mUsage += size;
+
+	return head + (S32)sizeof(Record);
+}
+
+void LLTextureCacheArena::release(S32 offset, const LLUUID& id)
+{
+	if (!isOpen() || mFile.isReadOnly()
+		|| offset < (S32)(sizeof(Info) + sizeof(Record)) || offset > getInfo()->mEnd)
+	{
+		return;
+	}
+	Record* record = getRecord(offset - (S32)sizeof(Record));
+	if (isValid(offset, id, record->mDataSize))
+	{
+		record->mID.setNull();
+		getInfo()->mUsage -= record->mDataSize;
+	}
+}
+
+bool LLTextureCacheArena::isValid(S32 offset, const LLUUID& id, S32 size) const
+{
+	if (!isOpen() || id.isNull() || size < 0)
+	{
+		return false;
+	}
+	const Info* info = getInfo();
+	S32 pos = offset - (S32)sizeof(Record);
+	if (pos < (S32)sizeof(Info) || (pos & (RECORD_ALIGNMENT - 1)) || offset > info->mEnd)
+	{
+		return false;
+	}
+	const Record* record = getRecord(pos);
+	return record->mMagic == RECORD_MAGIC
+		&& record->mID == id
+		&& record->mDataSize == size
+		&& record->mLength >= (S32)sizeof(Record) + size
+		&& pos + record->mLength <= info->mEnd;
+}
+
+bool LLTextureCacheArena::isStale(S32 offset) const
+{
+	const Info* info = getInfo();
+	S32 pos = offset - (S32)sizeof(Record);
+	// bytes still to be allocated before pos is overwritten
+	S32 distance = pos >= info->mHead ? pos - info->mHead
+									  : (info->mSize - info->mHead) + (pos - (S32)sizeof(Info));
+	return distance < getCapacity() / STALE_FRACTION;
+}
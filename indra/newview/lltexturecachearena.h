@@ -0,0 +1,108 @@
+/**
+ * @file lltexturecachearena.h
+ * @brief Memory mapped ring of texture bodies used by LLTextureCache.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLTEXTURECACHEARENA_H
+#define LL_LLTEXTURECACHEARENA_H
+
+#include <vector>
+
+#include "llapr.h"
+#include "lluuid.h"
+
+// One file holding the bodies of every cached texture. Space is handed out
+// by bumping a head offset, wrapping to the start of the file when it runs
+// off the end and overwriting the oldest bodies on the way. Each body is
+// preceded by a small record naming its texture so stale offsets can be
+// detected and overwritten textures reported back to the caller.
+//
+// Not thread safe: LLTextureCache calls it with mHeaderMutex locked.
+class LLTextureCacheArena
+{
+public:
+	LLTextureCacheArena();
+	~LLTextureCacheArena();
+
+	// Maps filename with room for size bytes of bodies and record overhead.
+	// Existing contents are kept if the file was made for the same size,
+	// otherwise it starts out empty and wasReset() returns true.
+	bool open(const std::string& filename, S32 size, bool readonly = false);
+	void close();
+	bool isOpen() const { return mFile.isOpen(); }
+	bool wasReset() const { return mReset; }
+
+	// Forgets every body
+	void clear();
+
+	// Reserves size bytes for id and returns the offset of the body, -1 if it
+	// can never fit. The ids of bodies overwritten to make room are appended
+	// to evicted.
+	S32 allocate(const LLUUID& id, S32 size, std::vector<LLUUID>& evicted);
+	// Marks the body at offset free, so it is not reported when overwritten
+	void release(S32 offset, const LLUUID& id);
+	// True if offset still holds the size byte body of id
+	bool isValid(S32 offset, const LLUUID& id, S32 size) const;
+	// True if the body at offset is among the next to be overwritten.
+	// Bodies that are used again while stale should be moved to the head.
+	bool isStale(S32 offset) const;
+
+	U8* getData(S32 offset) const { return mFile.getData() + offset; }
+	S32 getCapacity() const;
+	S32 getUsage() const;
+
+	// Bytes allocate() takes for a body of size bytes
+	static S32 getAllocationSize(S32 size);
+
+private:
+	// Info and Record are 32 bytes each, keeping records and bodies aligned
+	struct Info
+	{
+		U32 mMagic;
+		U32 mVersion;
+		S32 mSize;	// file size
+		S32 mHead;	// next allocation
+		S32 mEnd;	// end of the last record written on the previous lap
+		S32 mUsage;	// body bytes in live records
+		U32 mPad[2];
+	};
+	struct Record
+	{
+		U32 mMagic;
+		S32 mLength;	// record and body, including any slack it absorbed
+		S32 mDataSize;	// body size
+		U32 mPad;
+		LLUUID mID;		// null once released
+	};
+
+	Info* getInfo() const { return (Info*)mFile.getData(); }
+	Record* getRecord(S32 pos) const { return (Record*)(mFile.getData() + pos); }
+	S32 evictRecord(S32 pos, S32 end, std::vector<LLUUID>& evicted);
+
+private:
+	LLAPRMappedFile mFile;
+	bool mReset;
+};
+
+#endif // LL_LLTEXTURECACHEARENA_H
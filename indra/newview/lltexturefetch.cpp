@@ -35,21 +35,24 @@
 #include "llcurl.h"
 #include "lldir.h"
 #include "llhttpclient.h"
+#include "llhttppipeline.h"
 #include "llhttpstatuscodes.h"
 #include "llimage.h"
+#include "llimagedxt.h"
 #include "llimagej2c.h"
 #include "llimageworker.h"
 #include "llworkerthread.h"
 #include "message.h"
 
-#include "llagent.h"
+#include "llagentdata.h"
 #include "lltexturecache.h"
 #include "llviewercontrol.h"
 #include "llviewertexturelist.h"
 #include "llviewertexture.h"
-#include "llviewerregion.h"
 #include "llviewerstats.h"
-#include "llworld.h"
+
+// Persistent connections kept to each texture server, requests beyond that are pipelined on them
+static const S32 HTTP_CONNECTIONS_PER_HOST = 4;
 
 //////////////////////////////////////////////////////////////////////////////
 class LLTextureFetchWorker : public LLWorkerClass
@@ -163,6 +166,7 @@ public:
 
 	void setCanUseHTTP(bool can_use_http) {mCanUseHTTP = can_use_http;}
 	bool getCanUseHTTP()const {return mCanUseHTTP ;}
+	void setCanUseDXT(bool can_use_dxt) {mCanUseDXT = can_use_dxt;}
 
 protected:
 	LLTextureFetchWorker(LLTextureFetch* fetcher, const std::string& url, const LLUUID& id, const LLHost& host,
@@ -224,6 +228,7 @@ private:
 	LLPointer<LLImageFormatted> mFormattedImage;
 	LLPointer<LLImageRaw> mRawImage;
 	LLPointer<LLImageRaw> mAuxImage;
+	LLPointer<LLImageDXT> mCompressedImage; // compressed tier hit, replaces mRawImage
 	LLUUID mID;
 	LLHost mHost;
 	std::string mUrl;
@@ -256,6 +261,10 @@ private:
 	BOOL mInLocalCache;
 	bool mCanUseHTTP ;
 	bool mCanUseNET ; //can get from asset server.
+	bool mCanUseDXT ; //requester can take a compressed image instead of a raw one.
+	BOOL mTriedDXT;
+	BOOL mReadingDXT;
+	S32 mCompressedDiscard;
 	S32 mHTTPFailCount;
 	S32 mRetryAttempt;
 	S32 mActiveCount;
@@ -415,6 +424,10 @@ LLTextureFetchWorker::LLTextureFetchWorker(LLTextureFetch* fetcher,
 	  mHaveAllData(FALSE),
 	  mInLocalCache(FALSE),
 	  mCanUseHTTP(true),
+	  mCanUseDXT(false),
+	  mTriedDXT(FALSE),
+	  mReadingDXT(FALSE),
+	  mCompressedDiscard(-1),
 	  mHTTPFailCount(0),
 	  mRetryAttempt(0),
 	  mActiveCount(0),
@@ -621,6 +634,7 @@ bool LLTextureFetchWorker::doWork(S32 param)
 	if (mState == INIT)
 	{		
 		mRawImage = NULL ;
+		mCompressedImage = NULL ;
 		mRequestedDiscard = -1;
 		mLoadedDiscard = -1;
 		mDecodedDiscard = -1;
@@ -647,6 +661,23 @@ bool LLTextureFetchWorker::doWork(S32 param)
 
 	if (mState == LOAD_FROM_TEXTURE_CACHE)
 	{
+		if (mCacheReadHandle == LLTextureCache::nullHandle() && mCanUseDXT && !mTriedDXT &&
+			mFormattedImage.isNull() && !mNeedsAux && mUrl.compare(0, 7, "file://") != 0)
+		{
+			// Try the compressed tier first, a hit skips the decode entirely
+			mTriedDXT = TRUE;
+			S32 dxt_discard = mFetcher->mTextureCache->getDXTDiscard(mID);
+			if (dxt_discard >= 0 && dxt_discard <= mDesiredDiscard)
+			{
+				setPriority(LLWorkerThread::PRIORITY_LOW | mWorkPriority); // Set priority first since Responder may change it
+				mFileSize = 0;
+				mLoaded = FALSE;
+				mReadingDXT = TRUE;
+				mCompressedDiscard = dxt_discard;
+				CacheReadResponder* responder = new CacheReadResponder(mFetcher, mID, NULL);
+				mCacheReadHandle = mFetcher->mTextureCache->readDXTFromCache(mID, mWorkPriority, responder);
+			}
+		}
 		if (mCacheReadHandle == LLTextureCache::nullHandle())
 		{
 			U32 cache_priority = mWorkPriority;
@@ -715,6 +746,39 @@ bool LLTextureFetchWorker::doWork(S32 param)
 		}
 	}
 
+	if (mState == CACHE_POST && mReadingDXT)
+	{
+		mReadingDXT = FALSE;
+		LLPointer<LLImageDXT> dxt = NULL;
+		if (mFormattedImage.notNull() && mFormattedImage->getCodec() == IMG_CODEC_DXT)
+		{
+			dxt = (LLImageDXT*)mFormattedImage.get();
+		}
+		mFormattedImage = NULL;
+		mFileSize = 0;
+		mHaveAllData = FALSE;
+		mInLocalCache = FALSE;
+		if (dxt.notNull() && dxt->updateData() && dxt->isCompressed() &&
+			dxt->calcDataSize(0) <= dxt->getDataSize())
+		{
+			LL_DEBUGS("Texture") << mID << ": Compressed cache hit. Discard: " << mCompressedDiscard
+								 << " Size: " << llformat("%dx%d", dxt->getWidth(), dxt->getHeight()) << LL_ENDL;
+			mCompressedImage = dxt;
+			mRawImage = NULL;
+			mAuxImage = NULL;
+			mDecodedDiscard = mCompressedDiscard;
+			mState = DONE;
+			// fall through
+		}
+		else
+		{
+			// Miss or bad file, go to the regular cache
+			mState = LOAD_FROM_TEXTURE_CACHE;
+			setPriority(LLWorkerThread::PRIORITY_HIGH | mWorkPriority);
+			return false;
+		}
+	}
+
 	if (mState == CACHE_POST)
 	{
 		mCachedSize = mFormattedImage.notNull() ? mFormattedImage->getDataSize() : 0;
@@ -755,24 +819,11 @@ bool LLTextureFetchWorker::doWork(S32 param)
 // 		if (mHost != LLHost::invalid) get_url = false;
 		if ( use_http && mCanUseHTTP && mUrl.empty())//get http url.
 		{
-			LLViewerRegion* region = NULL;
-			if (mHost == LLHost::invalid)
-				region = gAgent.getRegion();
-			else
-				region = LLWorld::getInstance()->getRegion(mHost);
-
-			if (region)
+			std::string http_url = mFetcher->mRegions->getHttpUrl(mHost);
+			if (!http_url.empty())
 			{
-				std::string http_url = region->getHttpUrl() ;
-				if (!http_url.empty())
-				{
-					mUrl = http_url + "/?texture_id=" + mID.asString().c_str();
-					mWriteToCacheState = CAN_WRITE ; //because this texture has a fixed texture id.
-				}
-				else
-				{
-					mCanUseHTTP = false ;
-				}
+				mUrl = http_url + "/?texture_id=" + mID.asString().c_str();
+				mWriteToCacheState = CAN_WRITE ; //because this texture has a fixed texture id.
 			}
 			else
 			{
@@ -848,11 +899,13 @@ bool LLTextureFetchWorker::doWork(S32 param)
 		{
 			//NOTE:
 			//control the number of the http requests issued for:
-			//1, not openning too many file descriptors at the same time;
+			//1, the pipeline sends first come first served, keep the rest here in priority order;
 			//2, control the traffic of http so udp gets bandwidth.
+			//The pipeline adapts what it can use to the bandwidth and latency of each host.
 			//
-			static const S32 MAX_NUM_OF_HTTP_REQUESTS_IN_QUEUE = 32 ;
-			if(mFetcher->getNumHTTPRequests() > MAX_NUM_OF_HTTP_REQUESTS_IN_QUEUE)
+			static LLCachedControl<U32> max_http_requests(gSavedSettings,"ImagePipelineHTTPMaxRequests");
+			S32 max_requests = llmin((S32)max_http_requests, mFetcher->mHTTPPipeline->getCapacity());
+			if(mFetcher->getNumHTTPRequests() >= max_requests)
 			{
 				return false ; //wait.
 			}
@@ -901,7 +954,7 @@ bool LLTextureFetchWorker::doWork(S32 param)
 				// Will call callbackHttpGet when curl request completes
 				std::vector<std::string> headers;
 				headers.push_back("Accept: image/x-j2c");
-				res = mFetcher->mCurlGetRequest->getByteRange(mUrl, headers, offset, mRequestedSize,
+				res = mFetcher->mHTTPPipeline->getByteRange(mUrl, headers, offset, mRequestedSize,
 															  new HTTPGetResponder(mFetcher, mID, LLTimer::getTotalTime(), mRequestedSize, offset, true));
 			}
 			if (!res)
@@ -1123,6 +1176,11 @@ bool LLTextureFetchWorker::doWork(S32 param)
 				llassert_always(mRawImage.notNull());
 				LL_DEBUGS("Texture") << mID << ": Decoded. Discard: " << mDecodedDiscard
 						<< " Raw Image: " << llformat("%dx%d",mRawImage->getWidth(),mRawImage->getHeight()) << LL_ENDL;
+				if (mCanUseDXT && !mInLocalCache && mUrl.compare(0, 7, "file://") != 0)
+				{
+					// Compressed on the cache thread, we don't wait for it
+					mFetcher->mTextureCache->writeDXTToCache(mID, mWorkPriority, mRawImage, mDecodedDiscard);
+				}
 				setPriority(LLWorkerThread::PRIORITY_HIGH | mWorkPriority);
 				mState = WRITE_TO_CACHE;
 			}
@@ -1423,7 +1481,10 @@ void LLTextureFetchWorker::callbackCacheRead(bool success, LLImageFormatted* ima
 		llassert_always(imagesize >= 0);
 		mFileSize = imagesize;
 		mFormattedImage = image;
-		mImageCodec = image->getCodec();
+		if (!mReadingDXT)
+		{
+			mImageCodec = image->getCodec();
+		}
 		mInLocalCache = islocal;
 		if (mFileSize != 0 && mFormattedImage->getDataSize() >= mFileSize)
 		{
@@ -1512,38 +1573,67 @@ bool LLTextureFetchWorker::writeToCacheComplete()
 //////////////////////////////////////////////////////////////////////////////
 // public
 
-LLTextureFetch::LLTextureFetch(LLTextureCache* cache, LLImageDecodeThread* imagedecodethread, bool threaded)
-	: LLWorkerThread("TextureFetch", threaded),
+LLTextureFetch::LLTextureFetch(LLTextureFetchRegions* regions, LLTextureCache* cache, LLImageDecodeThread* imagedecodethread,
+							   bool threaded, bool concurrent_queue)
+	: LLWorkerThread("TextureFetch", threaded, concurrent_queue),
 	  mDebugCount(0),
 	  mDebugPause(FALSE),
 	  mPacketCount(0),
 	  mBadPacketCount(0),
 	  mQueueMutex(getAPRPool()),
 	  mNetworkQueueMutex(getAPRPool()),
+	  mRegions(regions),
 	  mTextureCache(cache),
 	  mImageDecodeThread(imagedecodethread),
 	  mTextureBandwidth(0),
 	  mHTTPTextureBits(0),
-	  mCurlGetRequest(NULL)
+	  mHTTPPipeline(NULL),
+	  mTraceFile(NULL)
 {
 	mMaxBandwidth = gSavedSettings.getF32("ThrottleBandwidthKBPS");
 	mTextureInfo.setUpLogging(gSavedSettings.getBOOL("LogTextureDownloadsToViewerLog"), gSavedSettings.getBOOL("LogTextureDownloadsToSimulator"), gSavedSettings.getU32("TextureLoggingThreshold"));
+
+	std::string trace_file = gSavedSettings.getString("TextureFetchTraceFile");
+	if (!trace_file.empty())
+	{
+		startTrace(gDirUtilp->getExpandedFilename(LL_PATH_LOGS, trace_file));
+	}
 }
 
 LLTextureFetch::~LLTextureFetch()
 {
 	clearDeleteList() ;
+	delete mTraceFile;
+	delete mRegions;
 
 	// ~LLQueuedThread() called here
 }
 
 bool LLTextureFetch::createRequest(const std::string& url, const LLUUID& id, const LLHost& host, F32 priority,
-								   S32 w, S32 h, S32 c, S32 desired_discard, bool needs_aux, bool can_use_http)
+								   S32 w, S32 h, S32 c, S32 desired_discard, bool needs_aux, bool can_use_http,
+								   bool can_use_dxt)
 {
 	if (mDebugPause)
 	{
 		return false;
 	}
+	if (mTraceFile)
+	{
+		// The worker only looks the url up once it gets to the network,
+		// this is the one it would find now
+		std::string trace_url = url;
+		if (trace_url.empty() && can_use_http)
+		{
+			std::string http_url = mRegions->getHttpUrl(host);
+			if (!http_url.empty())
+			{
+				trace_url = http_url + "/?texture_id=" + id.asString();
+			}
+		}
+		trace("create", id, llformat("%g %d %d %d %d %d %d %s", priority, desired_discard, w, h, c,
+									 (S32)needs_aux, (S32)can_use_http,
+									 trace_url.empty() ? "-" : trace_url.c_str()));
+	}
 	
 	LLTextureFetchWorker* worker = getWorker(id) ;
 	if (worker)
@@ -1601,9 +1691,11 @@ bool LLTextureFetch::createRequest(const std::string& url, const LLUUID& id, con
 		worker->setImagePriority(priority);
 		worker->setDesiredDiscard(desired_discard, desired_size);
 		worker->setCanUseHTTP(can_use_http) ;
+		worker->setCanUseDXT(can_use_dxt) ;
 		if (!worker->haveWork())
 		{
 			worker->mState = LLTextureFetchWorker::INIT;
+			worker->mTriedDXT = FALSE;
 			worker->unlockWorkMutex();
 
 			worker->addWork(0, LLWorkerThread::PRIORITY_HIGH | worker->mWorkPriority);
@@ -1624,6 +1716,7 @@ bool LLTextureFetch::createRequest(const std::string& url, const LLUUID& id, con
 		worker->mActiveCount++;
 		worker->mNeedsAux = needs_aux;
 		worker->setCanUseHTTP(can_use_http) ;
+		worker->setCanUseDXT(can_use_dxt) ;
 		worker->unlockWorkMutex();
 	}
 	
@@ -1678,6 +1771,10 @@ void LLTextureFetch::removeFromHTTPQueue(const LLUUID& id, S32 received_size)
 
 void LLTextureFetch::deleteRequest(const LLUUID& id, bool cancel)
 {
+	if (mTraceFile)
+	{
+		trace("delete", id);
+	}
 	lockQueue() ;
 	LLTextureFetchWorker* worker = getWorkerAfterLock(id);
 	if (worker)
@@ -1750,7 +1847,8 @@ LLTextureFetchWorker* LLTextureFetch::getWorker(const LLUUID& id)
 
 
 bool LLTextureFetch::getRequestFinished(const LLUUID& id, S32& discard_level,
-										LLPointer<LLImageRaw>& raw, LLPointer<LLImageRaw>& aux)
+										LLPointer<LLImageRaw>& raw, LLPointer<LLImageRaw>& aux,
+										LLPointer<LLImageDXT>& compressed)
 {
 	bool res = false;
 	LLTextureFetchWorker* worker = getWorker(id);
@@ -1775,6 +1873,7 @@ bool LLTextureFetch::getRequestFinished(const LLUUID& id, S32& discard_level,
 			discard_level = worker->mDecodedDiscard;
 			raw = worker->mRawImage;
 			aux = worker->mAuxImage;
+			compressed = worker->mCompressedImage;
 			res = true;
 			LL_DEBUGS("Texture") << id << ": Request Finished. State: " << worker->mState << " Discard: " << discard_level << LL_ENDL;
 			worker->unlockWorkMutex();
@@ -1790,6 +1889,7 @@ bool LLTextureFetch::getRequestFinished(const LLUUID& id, S32& discard_level,
 				discard_level = worker->mDecodedDiscard;
 				raw = worker->mRawImage;
 				aux = worker->mAuxImage;
+				compressed = worker->mCompressedImage;
 			}
 			worker->unlockWorkMutex();
 		}
@@ -1803,6 +1903,10 @@ bool LLTextureFetch::getRequestFinished(const LLUUID& id, S32& discard_level,
 
 bool LLTextureFetch::updateRequestPriority(const LLUUID& id, F32 priority)
 {
+	if (mTraceFile)
+	{
+		trace("priority", id, llformat("%g", priority));
+	}
 	bool res = false;
 	LLTextureFetchWorker* worker = getWorker(id);
 	if (worker)
@@ -1815,6 +1919,45 @@ bool LLTextureFetch::updateRequestPriority(const LLUUID& id, F32 priority)
 	return res;
 }
 
+void LLTextureFetch::updateRequestPriorities(const request_priority_list_t& priorities)
+{
+	if (priorities.empty())
+	{
+		return;
+	}
+	if (mTraceFile)
+	{
+		for (request_priority_list_t::const_iterator iter = priorities.begin();
+			 iter != priorities.end(); ++iter)
+		{
+			trace("priority", iter->first, llformat("%g", iter->second));
+		}
+	}
+	std::vector<std::pair<LLTextureFetchWorker*, F32> > workers;
+	workers.reserve(priorities.size());
+	lockQueue() ;
+	for (request_priority_list_t::const_iterator iter = priorities.begin();
+		 iter != priorities.end(); ++iter)
+	{
+		LLTextureFetchWorker* worker = getWorkerAfterLock(iter->first);
+		if (worker)
+		{
+			workers.push_back(std::make_pair(worker, iter->second));
+		}
+	}
+	unlockQueue() ;
+
+	// Not under the queue lock, doWork() takes the work mutex before the queue lock
+	for (std::vector<std::pair<LLTextureFetchWorker*, F32> >::iterator iter = workers.begin();
+		 iter != workers.end(); ++iter)
+	{
+		LLTextureFetchWorker* worker = iter->first;
+		worker->lockWorkMutex();
+		worker->setImagePriority(iter->second);
+		worker->unlockWorkMutex();
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 // MAIN THREAD
@@ -1827,7 +1970,7 @@ S32 LLTextureFetch::update(U32 max_time_ms)
 		mNetworkQueueMutex.lock() ;
 		mMaxBandwidth = band_width ;
 
-		gTextureList.sTextureBits += mHTTPTextureBits ;
+		LLViewerTextureList::sTextureBits += mHTTPTextureBits ;
 		mHTTPTextureBits = 0 ;
 
 		mNetworkQueueMutex.unlock() ;
@@ -1842,8 +1985,8 @@ S32 LLTextureFetch::update(U32 max_time_ms)
 
 	if (!mThreaded)
 	{
-		// Update Curl on same thread as mCurlGetRequest was constructed
-		S32 processed = mCurlGetRequest->process();
+		// Update Curl on same thread as mHTTPPipeline was constructed
+		S32 processed = mHTTPPipeline->process();
 		if (processed > 0)
 		{
 			lldebugs << "processed: " << processed << " messages." << llendl;
@@ -1876,22 +2019,23 @@ void LLTextureFetch::shutDownImageDecodeThread()
 // WORKER THREAD
 void LLTextureFetch::startThread()
 {
-	// Construct mCurlGetRequest from Worker Thread
-	mCurlGetRequest = new LLCurlRequest();
+	// Construct mHTTPPipeline from Worker Thread
+	S32 max_window = llmax((S32)gSavedSettings.getU32("ImagePipelineHTTPMaxRequests"), 1);
+	mHTTPPipeline = new LLHTTPPipeline(HTTP_CONNECTIONS_PER_HOST, llmin(2, max_window), max_window);
 }
 
 // WORKER THREAD
 void LLTextureFetch::endThread()
 {
-	// Destroy mCurlGetRequest from Worker Thread
-	delete mCurlGetRequest;
-	mCurlGetRequest = NULL;
+	// Destroy mHTTPPipeline from Worker Thread
+	delete mHTTPPipeline;
+	mHTTPPipeline = NULL;
 }
 
 // WORKER THREAD
 void LLTextureFetch::threadedUpdate()
 {
-	llassert_always(mCurlGetRequest);
+	llassert_always(mHTTPPipeline);
 	
 	// Limit update frequency
 	const F32 PROCESS_TIME = 0.05f; 
@@ -1902,8 +2046,8 @@ void LLTextureFetch::threadedUpdate()
 	}
 	process_timer.reset();
 	
-	// Update Curl on same thread as mCurlGetRequest was constructed
-	S32 processed = mCurlGetRequest->process();
+	// Update Curl on same thread as mHTTPPipeline was constructed
+	S32 processed = mHTTPPipeline->process();
 	if (processed > 0)
 	{
 		lldebugs << "processed: " << processed << " messages." << llendl;
@@ -1914,7 +2058,7 @@ void LLTextureFetch::threadedUpdate()
 	static LLFrameTimer info_timer;
 	if (info_timer.getElapsedTimeF32() >= INFO_TIME)
 	{
-		S32 q = mCurlGetRequest->getQueued();
+		S32 q = mHTTPPipeline->getQueued();
 		if (q > 0)
 		{
 			llinfos << "Queued gets: " << q << llendl;
@@ -2002,7 +2146,7 @@ void LLTextureFetch::sendRequestListToSimulators()
 		// invalid host = use agent host
 		if (host == LLHost::invalid)
 		{
-			host = gAgent.getRegionHost();
+			host = mRegions->getAgentRegionHost();
 		}
 
 		S32 sim_request_count = 0;
@@ -2024,8 +2168,8 @@ void LLTextureFetch::sendRequestListToSimulators()
 				{
 					gMessageSystem->newMessageFast(_PREHASH_RequestImage);
 					gMessageSystem->nextBlockFast(_PREHASH_AgentData);
-					gMessageSystem->addUUIDFast(_PREHASH_AgentID, gAgent.getID());
-					gMessageSystem->addUUIDFast(_PREHASH_SessionID, gAgent.getSessionID());
+					gMessageSystem->addUUIDFast(_PREHASH_AgentID, gAgentID);
+					gMessageSystem->addUUIDFast(_PREHASH_SessionID, gAgentSessionID);
 				}
 				S32 packet = req->mLastPacket + 1;
 				gMessageSystem->nextBlockFast(_PREHASH_RequestImage);
@@ -2082,7 +2226,7 @@ void LLTextureFetch::sendRequestListToSimulators()
 			LLHost host = iter1->first;
 			if (host == LLHost::invalid)
 			{
-				host = gAgent.getRegionHost();
+				host = mRegions->getAgentRegionHost();
 			}
 			S32 request_count = 0;
 			for (queue_t::iterator iter2 = iter1->second.begin();
@@ -2092,8 +2236,8 @@ void LLTextureFetch::sendRequestListToSimulators()
 				{
 					gMessageSystem->newMessageFast(_PREHASH_RequestImage);
 					gMessageSystem->nextBlockFast(_PREHASH_AgentData);
-					gMessageSystem->addUUIDFast(_PREHASH_AgentID, gAgent.getID());
-					gMessageSystem->addUUIDFast(_PREHASH_SessionID, gAgent.getSessionID());
+					gMessageSystem->addUUIDFast(_PREHASH_AgentID, gAgentID);
+					gMessageSystem->addUUIDFast(_PREHASH_SessionID, gAgentSessionID);
 				}
 				gMessageSystem->nextBlockFast(_PREHASH_RequestImage);
 				gMessageSystem->addUUIDFast(_PREHASH_Image, *iter2);
@@ -2275,6 +2419,33 @@ bool LLTextureFetch::receiveImagePacket(const LLHost& host, const LLUUID& id, U1
 	return res;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+
+void LLTextureFetch::startTrace(const std::string& filename)
+{
+	delete mTraceFile;
+	mTraceFile = new llofstream(filename.c_str());
+	if (!mTraceFile->is_open())
+	{
+		llwarns << "Can't open texture fetch trace " << filename << llendl;
+		delete mTraceFile;
+		mTraceFile = NULL;
+		return;
+	}
+	llinfos << "Tracing texture fetch requests to " << filename << llendl;
+	mTraceTimer.reset();
+}
+
+void LLTextureFetch::trace(const char* event, const LLUUID& id, const std::string& args)
+{
+	*mTraceFile << llformat("%.4f ", mTraceTimer.getElapsedTimeF64()) << event << " " << id;
+	if (!args.empty())
+	{
+		*mTraceFile << " " << args;
+	}
+	*mTraceFile << "\n";
+}
+
 //////////////////////////////////////////////////////////////////////////////
 BOOL LLTextureFetch::isFromLocalCache(const LLUUID& id)
 {
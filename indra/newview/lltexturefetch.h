@@ -39,7 +39,23 @@ class LLTextureFetchWorker;
 class HTTPGetResponder;
 class LLTextureCache;
 class LLImageDecodeThread;
+class LLImageDXT;
 class LLHost;
+class LLHTTPPipeline;
+
+// Where LLTextureFetch finds the simulators it fetches from.  The viewer's
+// asks LLAgent and LLWorld, tools that run the fetch outside the viewer
+// (test_apps/lltexturefetchreplay) supply their own.
+class LLTextureFetchRegions
+{
+public:
+	virtual ~LLTextureFetchRegions() {}
+	// HTTP texture url of the region at host, of the agent's region if
+	// host is invalid.  Empty if there is no such region or it has none.
+	virtual std::string getHttpUrl(const LLHost& host) = 0;
+	// Where UDP requests with an invalid host go
+	virtual LLHost getAgentRegionHost() = 0;
+};
 
 // Interface class
 class LLTextureFetch : public LLWorkerThread
@@ -48,7 +64,9 @@ class LLTextureFetch : public LLWorkerThread
 	friend class HTTPGetResponder;
 	
 public:
-	LLTextureFetch(LLTextureCache* cache, LLImageDecodeThread* imagedecodethread, bool threaded);
+	// Takes ownership of regions
+	LLTextureFetch(LLTextureFetchRegions* regions, LLTextureCache* cache, LLImageDecodeThread* imagedecodethread,
+				   bool threaded, bool concurrent_queue = false);
 	~LLTextureFetch();
 
 	/*virtual*/ S32 update(U32 max_time_ms);	
@@ -56,11 +74,18 @@ public:
 	void shutDownImageDecodeThread() ;  //called in the main thread after the ImageDecodeThread shuts down.
 
 	bool createRequest(const std::string& url, const LLUUID& id, const LLHost& host, F32 priority,
-					   S32 w, S32 h, S32 c, S32 discard, bool needs_aux, bool can_use_http);
+					   S32 w, S32 h, S32 c, S32 discard, bool needs_aux, bool can_use_http,
+					   bool can_use_dxt = false);
 	void deleteRequest(const LLUUID& id, bool cancel);
+	// compressed is set instead of raw when the request was served from the
+	// compressed tier of the texture cache
 	bool getRequestFinished(const LLUUID& id, S32& discard_level,
-							LLPointer<LLImageRaw>& raw, LLPointer<LLImageRaw>& aux);
+							LLPointer<LLImageRaw>& raw, LLPointer<LLImageRaw>& aux,
+							LLPointer<LLImageDXT>& compressed);
 	bool updateRequestPriority(const LLUUID& id, F32 priority);
+	typedef std::vector<std::pair<LLUUID, F32> > request_priority_list_t;
+	// Same as updateRequestPriority() for each, looking them all up in one go
+	void updateRequestPriorities(const request_priority_list_t& priorities);
 
 	bool receiveImageHeader(const LLHost& host, const LLUUID& id, U8 codec, U16 packets, U32 totalbytes, U16 data_size, U8* data);
 	bool receiveImagePacket(const LLHost& host, const LLUUID& id, U16 packet_num, U16 data_size, U8* data);
@@ -83,6 +108,15 @@ public:
 	LLTextureFetchWorker* getWorkerAfterLock(const LLUUID& id);
 
 	LLTextureInfo* getTextureInfo() { return &mTextureInfo; }
+
+	// Appends every createRequest(), updateRequestPriority() and deleteRequest()
+	// to filename, one per line, for test_apps/lltexturefetchreplay:
+	//   <seconds> create <id> <priority> <discard> <w> <h> <c> <needs_aux> <can_use_http> <url>
+	//   <seconds> priority <id> <priority>
+	//   <seconds> delete <id>
+	// Seconds count from the call to startTrace().  <url> is where an HTTP
+	// fetch would go when the request is made, "-" if there is none.
+	void startTrace(const std::string& filename);
 	
 protected:
 	void addToNetworkQueue(LLTextureFetchWorker* worker);
@@ -94,6 +128,7 @@ protected:
 	void processCurlRequests();	
 
 private:
+	void trace(const char* event, const LLUUID& id, const std::string& args = LLStringUtil::null);
 	void sendRequestListToSimulators();
 	/*virtual*/ void startThread(void);
 	/*virtual*/ void endThread(void);
@@ -110,9 +145,10 @@ private:
 	LLMutex mQueueMutex;        //to protect mRequestMap only
 	LLMutex mNetworkQueueMutex; //to protect mNetworkQueue, mHTTPTextureQueue and mCancelQueue.
 
+	LLTextureFetchRegions* mRegions;
 	LLTextureCache* mTextureCache;
 	LLImageDecodeThread* mImageDecodeThread;
-	LLCurlRequest* mCurlGetRequest;
+	LLHTTPPipeline* mHTTPPipeline;
 	
 	// Map of all requests by UUID
 	typedef std::map<LLUUID,LLTextureFetchWorker*> map_t;
@@ -129,6 +165,9 @@ private:
 	LLTextureInfo mTextureInfo;
 
 	U32 mHTTPTextureBits;
+
+	llofstream* mTraceFile;
+	LLTimer mTraceTimer;
 };
 
 #endif // LL_LLTEXTUREFETCH_H
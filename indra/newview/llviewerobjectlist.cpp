@@ -88,8 +88,8 @@ extern LLPipeline	gPipeline;
 
 // Statics for object lookup tables.
 U32						LLViewerObjectList::sSimulatorMachineIndex = 1; // Not zero deliberately, to speed up index check.
-std::map<U64, U32>			LLViewerObjectList::sIPAndPortToIndex;
-std::map<U64, LLUUID>	LLViewerObjectList::sIndexAndLocalIDToUUID;
+LLFlatHashMap<U64, U32>		LLViewerObjectList::sIPAndPortToIndex;
+LLFlatHashMap<U64, LLUUID>	LLViewerObjectList::sIndexAndLocalIDToUUID;
 
 LLViewerObjectList::LLViewerObjectList()
 {
@@ -140,7 +140,15 @@ void LLViewerObjectList::getUUIDFromLocal(LLUUID &id,
 
 	U64	indexid = (((U64)index) << 32) | (U64)local_id;
 
-	id = get_if_there(sIndexAndLocalIDToUUID, indexid, LLUUID::null);
+	LLFlatHashMap<U64, LLUUID>::iterator iter = sIndexAndLocalIDToUUID.find(indexid);
+	if (iter != sIndexAndLocalIDToUUID.end())
+	{
+		id = iter->second;
+	}
+	else
+	{
+		id.setNull();
+	}
 }
 
 U64 LLViewerObjectList::getIndex(const U32 local_id,
@@ -174,7 +182,7 @@ BOOL LLViewerObjectList::removeFromLocalIDTable(const LLViewerObject &object)
 		
 		U64	indexid = (((U64)index) << 32) | (U64)local_id;
 		
-		std::map<U64, LLUUID>::iterator iter = sIndexAndLocalIDToUUID.find(indexid);
+		LLFlatHashMap<U64, LLUUID>::iterator iter = sIndexAndLocalIDToUUID.find(indexid);
 		if (iter == sIndexAndLocalIDToUUID.end())
 		{
 			return FALSE;
@@ -337,8 +345,8 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 		return;
 	}
 
-	U8 compressed_dpbuffer[2048];
-	LLDataPackerBinaryBuffer compressed_dp(compressed_dpbuffer, 2048);
+	U8 compressed_dpbuffer[MAX_OBJECT_UPDATE_DATA];
+	LLDataPackerBinaryBuffer compressed_dp(compressed_dpbuffer, MAX_OBJECT_UPDATE_DATA);
 	LLDataPacker *cached_dpp = NULL;
 	
 	for (i = 0; i < num_objects; i++)
@@ -369,8 +377,8 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 		}
 		else if (compressed)
 		{
-			U8							compbuffer[2048];
-			S32							uncompressed_length = 2048;
+			U8							compbuffer[MAX_OBJECT_UPDATE_DATA];
+			uLongf						uncompressed_length = MAX_OBJECT_UPDATE_DATA;
 			S32							compressed_length;
 			compressed_dp.reset();
 
@@ -380,20 +388,25 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 				mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_UpdateFlags, flags, i);
 			}
 			
+			// Never read more than the buffers hold, whatever the block says
 			if (flags & FLAGS_ZLIB_COMPRESSED)
 			{
-				compressed_length = mesgsys->getSizeFast(_PREHASH_ObjectData, i, _PREHASH_Data);
-				mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_Data, compbuffer, 0, i);
-				uncompressed_length = 2048;
-				uncompress(compressed_dpbuffer, (unsigned long *)&uncompressed_length,
-						   compbuffer, compressed_length);
-				compressed_dp.assignBuffer(compressed_dpbuffer, uncompressed_length);
+				compressed_length = llclamp(mesgsys->getSizeFast(_PREHASH_ObjectData, i, _PREHASH_Data), 0, MAX_OBJECT_UPDATE_DATA);
+				mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_Data, compbuffer, 0, i, MAX_OBJECT_UPDATE_DATA);
+				uncompressed_length = MAX_OBJECT_UPDATE_DATA;
+				if (uncompress(compressed_dpbuffer, &uncompressed_length,
+							   compbuffer, compressed_length) != Z_OK)
+				{
+					llwarns << "Failed to inflate object update block " << i << " from " << mesgsys->getSender() << llendl;
+					continue;
+				}
+				compressed_dp.assignBuffer(compressed_dpbuffer, (S32)uncompressed_length);
 			}
 			else
 			{
-				uncompressed_length = mesgsys->getSizeFast(_PREHASH_ObjectData, i, _PREHASH_Data);
-				mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_Data, compressed_dpbuffer, 0, i);
-				compressed_dp.assignBuffer(compressed_dpbuffer, uncompressed_length);
+				uncompressed_length = llclamp(mesgsys->getSizeFast(_PREHASH_ObjectData, i, _PREHASH_Data), 0, MAX_OBJECT_UPDATE_DATA);
+				mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_Data, compressed_dpbuffer, 0, i, MAX_OBJECT_UPDATE_DATA);
+				compressed_dp.assignBuffer(compressed_dpbuffer, (S32)uncompressed_length);
 			}
 
 
@@ -33,6 +33,7 @@
 // common includes
 #include "llstat.h"
 #include "llstring.h"
+#include "llflathashmap.h"
 
 // project includes
 #include "llviewerobject.h"
@@ -44,6 +45,9 @@ class LLDebugBeacon;
 const U32 CLOSE_BIN_SIZE = 10;
 const U32 NUM_BINS = 128;
 
+// Largest ObjectData/Data of a compressed update, before and after inflating
+const S32 MAX_OBJECT_UPDATE_DATA = 2048;
+
 // GL name = position in object list + GL_NAME_INDEX_OFFSET so that
 // we can have special numbers like zero.
 const U32 GL_NAME_LAND = 0;
@@ -184,19 +188,22 @@ protected:
 	typedef std::map<LLUUID, LLPointer<LLViewerObject> > vo_map;
 	vo_map mDeadObjects;	// Need to keep multiple entries per UUID
 
-	std::map<LLUUID, LLPointer<LLViewerObject> > mUUIDObjectMap;
+	typedef LLFlatHashMap<LLUUID, LLPointer<LLViewerObject> > uuid_object_map_t;
+	uuid_object_map_t mUUIDObjectMap;
 
 	std::vector<LLDebugBeacon> mDebugBeacons;
 
 	S32 mCurLazyUpdateIndex;
 
 	static U32 sSimulatorMachineIndex;
-	static std::map<U64, U32> sIPAndPortToIndex;
+	static LLFlatHashMap<U64, U32> sIPAndPortToIndex;
 
-	static std::map<U64, LLUUID> sIndexAndLocalIDToUUID;
+	// (host index << 32) | local id
+	static LLFlatHashMap<U64, LLUUID> sIndexAndLocalIDToUUID;
 
 	std::set<LLViewerObject *> mSelectPickList;
 
+
 	friend class LLViewerObject;
 };
 
@@ -232,7 +239,7 @@ extern LLViewerObjectList gObjectList;
  */
 inline LLViewerObject *LLViewerObjectList::findObject(const LLUUID &id)
 {
-	std::map<LLUUID, LLPointer<LLViewerObject> >::iterator iter = mUUIDObjectMap.find(id);
+	uuid_object_map_t::iterator iter = mUUIDObjectMap.find(id);
 	if(iter != mUUIDObjectMap.end())
 	{
 		return iter->second;
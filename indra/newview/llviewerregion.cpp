@@ -327,7 +327,7 @@ void LLViewerRegion::loadObjectCache()
 
 	if(LLVOCache::hasInstance())
 	{
-		LLVOCache::getInstance()->readFromCache(mHandle, mCacheID, mCacheMap) ;
+		LLVOCache::getInstance()->readFromCache(mHandle, mCacheID, mCacheFile) ;
 	}
 }
 
@@ -339,16 +339,17 @@ void LLViewerRegion::saveObjectCache()
 		return;
 	}
 
-	if (mCacheMap.empty())
+	if (mCacheMap.empty() && !mCacheFile.isOpen())
 	{
 		return;
 	}
 
 	if(LLVOCache::hasInstance())
 	{
-		LLVOCache::getInstance()->writeToCache(mHandle, mCacheID, mCacheMap, mCacheDirty) ;
+		LLVOCache::getInstance()->writeToCache(mHandle, mCacheID, mCacheMap, mCacheFile, mCacheDirty) ;
 		mCacheDirty = FALSE;
 	}
+	mCacheFile.close();
 
 	for(LLVOCacheEntry::vocache_entry_map_t::iterator iter = mCacheMap.begin(); iter != mCacheMap.end(); ++iter)
 	{
@@ -1032,18 +1033,24 @@ void LLViewerRegion::cacheFullUpdate(LLViewerObject* objectp, LLDataPackerBinary
 	U32 crc = objectp->getCRC();
 
 	LLVOCacheEntry* entry = get_if_there(mCacheMap, local_id, (LLVOCacheEntry*)NULL);
+	const LLVOCacheIndexEntry* cached = entry ? NULL : mCacheFile.find(local_id);
 
-	if (entry)
+	if (entry || cached)
 	{
 		// we've seen this object before
-		if (entry->getCRC() == crc)
+		if ((entry ? entry->getCRC() : cached->mCRC) == crc)
 		{
 			// Record a hit
+			if (!entry)
+			{
+				entry = mCacheFile.createEntry(*cached);
+				mCacheMap[local_id] = entry;
+			}
 			entry->recordDupe();
 		}
 		else
 		{
-			// Update the cache entry
+			// Update the cache entry, it hides the one in the file
 			mCacheMap.erase(local_id);
 			delete entry;
 			entry = new LLVOCacheEntry(local_id, crc, dp);
@@ -1054,9 +1061,14 @@ void LLViewerRegion::cacheFullUpdate(LLViewerObject* objectp, LLDataPackerBinary
 	{
 		// we haven't seen this object before
 
-		// Create new entry and add to map
-		if (mCacheMap.size() > MAX_OBJECT_CACHE_ENTRIES)
+		// Create new entry and add to map.  When full, make room from the
+		// file first: what is left there hasn't been seen this session,
+		// unlike everything in mCacheMap.
+		if (mCacheMap.size() + mCacheFile.getNumLiveEntries() > MAX_OBJECT_CACHE_ENTRIES
+			&& !mCacheFile.evictEntry()
+			&& !mCacheMap.empty())
 		{
+			delete mCacheMap.begin()->second;
 			mCacheMap.erase(mCacheMap.begin());
 		}
 		entry = new LLVOCacheEntry(local_id, crc, dp);
@@ -1073,12 +1085,19 @@ LLDataPacker *LLViewerRegion::getDP(U32 local_id, U32 crc)
 	llassert(mCacheLoaded);
 
 	LLVOCacheEntry* entry = get_if_there(mCacheMap, local_id, (LLVOCacheEntry*)NULL);
+	const LLVOCacheIndexEntry* cached = entry ? NULL : mCacheFile.find(local_id);
 
-	if (entry)
+	if (entry || cached)
 	{
 		// we've seen this object before
-		if (entry->getCRC() == crc)
+		if ((entry ? entry->getCRC() : cached->mCRC) == crc)
 		{
+			// Only hits are copied out of the cache file
+			if (!entry)
+			{
+				entry = mCacheFile.createEntry(*cached);
+				mCacheMap[local_id] = entry;
+			}
 			// Record a hit
 			entry->recordHit();
 			return entry->getDP(crc);
@@ -1193,6 +1212,7 @@ void LLViewerRegion::dumpCache()
 		change_bin[i] = 0;
 	}
 
+	S32 count = 0;
 	LLVOCacheEntry *entry;
 	for(LLVOCacheEntry::vocache_entry_map_t::iterator iter = mCacheMap.begin(); iter != mCacheMap.end(); ++iter)
 	{
@@ -1206,9 +1226,25 @@ void LLViewerRegion::dumpCache()
 
 		hit_bin[hits]++;
 		change_bin[changes]++;
+		count++;
+	}
+	for (i = 0; i < mCacheFile.getNumEntries(); i++)
+	{
+		const LLVOCacheIndexEntry& cached = mCacheFile.getIndexEntry(i);
+		if (mCacheFile.isEvicted(i) || mCacheMap.count(cached.mLocalID))
+		{
+			continue;
+		}
+
+		S32 hits = llclamp(cached.mHitCount, 0, BINS-1);
+		S32 changes = llclamp(cached.mCRCChangeCount, 0, BINS-1);
+
+		hit_bin[hits]++;
+		change_bin[changes]++;
+		count++;
 	}
 
-	llinfos << "Count " << mCacheMap.size() << llendl;
+	llinfos << "Count " << count << llendl;
 	for (i = 0; i < BINS; i++)
 	{
 		llinfos << "Hits " << i << " " << hit_bin[i] << llendl;
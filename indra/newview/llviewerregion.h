@@ -385,7 +385,9 @@ private:
 	// a structure of size 2^14 = 16,000
 	BOOL									mCacheLoaded;
 	BOOL                                    mCacheDirty;
+	// New, changed and hit entries; the rest stay in mCacheFile
 	LLVOCacheEntry::vocache_entry_map_t		mCacheMap;
+	LLVOCacheRegionFile						mCacheFile;
 	LLDynamicArray<U32>						mCacheMissFull;
 	LLDynamicArray<U32>						mCacheMissCRC;
 	// time?
@@ -37,6 +37,7 @@
 #include "llhost.h"
 #include "llimage.h"
 #include "llimagebmp.h"
+#include "llimagedxt.h"
 #include "llimagej2c.h"
 #include "llimagetga.h"
 #include "llmemtype.h"
@@ -49,6 +50,7 @@
 // viewer includes
 #include "llimagegl.h"
 #include "lldrawpool.h"
+#include "lltexturecache.h"
 #include "lltexturefetch.h"
 #include "llviewertexturelist.h"
 #include "llviewercontrol.h"
@@ -527,6 +529,7 @@ void LLViewerTexture::init(bool firstinit)
 	mMaxVirtualSizeResetInterval = 1;
 	mMaxVirtualSizeResetCounter = mMaxVirtualSizeResetInterval ;
 	mAdditionalDecodePriority = 0.f ;	
+	mPrioritizedVirtualSize = 0.f ;
 	mParcelMedia = NULL ;
 	mNumFaces = 0 ;
 	mNumVolumes = 0;
@@ -568,6 +571,7 @@ void LLViewerTexture::setBoostLevel(S32 level)
 	if(mBoostLevel != level)
 	{
 		mBoostLevel = level ;
+		dirtyDecodePriority() ;
 		if(mBoostLevel != LLViewerTexture::BOOST_NONE)
 		{
 			setNoDelete() ;		
@@ -640,6 +644,13 @@ void LLViewerTexture::addTextureStats(F32 virtual_size, BOOL needs_gltexture) co
 	{
 		mMaxVirtualSize = virtual_size;
 	}	
+
+	// Shrinking is noticed by LLFace::setVirtualSize(), or later by the sweep in
+	// LLViewerTextureList::updateImagesDecodePriorities()
+	if (mMaxVirtualSize > mPrioritizedVirtualSize * 1.25f)
+	{
+		dirtyDecodePriority() ;
+	}
 }
 
 void LLViewerTexture::resetTextureStats()
@@ -672,6 +683,7 @@ void LLViewerTexture::addFace(LLFace* facep)
 	facep->setIndexInTex(mNumFaces) ;
 	mNumFaces++ ;
 	mLastFaceListUpdateTimer.reset() ;
+	dirtyDecodePriority() ;
 }
 
 //virtual
@@ -689,6 +701,7 @@ void LLViewerTexture::removeFace(LLFace* facep)
 		mNumFaces = 0 ;
 	}
 	mLastFaceListUpdateTimer.reset() ;
+	dirtyDecodePriority() ;
 }
 
 S32 LLViewerTexture::getNumFaces() const
@@ -1123,7 +1136,8 @@ void LLViewerFetchedTexture::init(bool firstinit)
 	if (firstinit)
 	{
 		mDecodePriority = 0.f;
-		mInImageList = 0;
+		mImageListIndex = -1;
+		mDecodePriorityDirty = FALSE;
 	}
 
 	// Only set mIsMissingAsset true when we know for certain that the database
@@ -1465,6 +1479,61 @@ BOOL LLViewerFetchedTexture::createTexture(S32 usename/*= 0*/)
 	return res;
 }
 
+// Compressed copies can only stand in for textures nobody reads back
+bool LLViewerFetchedTexture::canUseCompressedCache() const
+{
+	return LLAppViewer::getTextureCache()->getDXTCacheEnabled() &&
+		gGLManager.mHasCompressedTextures &&
+		!gNoRender &&
+		!mNeedsAux &&
+		!mForceToSaveRawImage &&
+		mLoadedCallbackList.empty() &&
+		!isForSculptOnly() &&
+		mUrl.compare(0, 7, "file://") != 0 &&
+		mGLTexturep.notNull() && !mGLTexturep->getHasExplicitFormat();
+}
+
+BOOL LLViewerFetchedTexture::createCompressedTexture(S32 discard_level, LLImageDXT* imagedxt)
+{
+	S32 full_width = imagedxt->getWidth() << discard_level;
+	S32 full_height = imagedxt->getHeight() << discard_level;
+	if (full_width > MAX_IMAGE_SIZE || full_height > MAX_IMAGE_SIZE ||
+		!LLImageGL::checkSize(imagedxt->getWidth(), imagedxt->getHeight()))
+	{
+		return FALSE;
+	}
+
+	if (getComponents() != imagedxt->getComponents())
+	{
+		// Same as addToCreateTexture(), faces may need another pool
+		mComponents = imagedxt->getComponents();
+		mGLTexturep->setComponents(mComponents) ;
+		for(U32 i = 0 ; i < mNumFaces ; i++)
+		{
+			mFaceList[i]->dirtyTexture() ;
+		}
+		mCachedRawImageReady = FALSE ;
+		mCachedRawDiscardLevel = -1 ;
+		mCachedRawImage = NULL ;
+		mSavedRawDiscardLevel = -1 ;
+		mSavedRawImage = NULL ;
+	}
+
+	if (!mGLTexturep->createGLTexture(discard_level, imagedxt, 0, mBoostLevel))
+	{
+		return FALSE;
+	}
+
+	mFullWidth = full_width;
+	mFullHeight = full_height;
+	mOrigWidth = mFullWidth;
+	mOrigHeight = mFullHeight;
+	setTexelsPerImage();
+	resetFaceAtlas() ;
+	setActive() ;
+	return TRUE;
+}
+
 // Call with 0,0 to turn this feature off.
 //virtual
 void LLViewerFetchedTexture::setKnownDrawSize(S32 width, S32 height)
@@ -1719,8 +1788,6 @@ F32 LLViewerFetchedTexture::maxDecodePriority()
 
 void LLViewerFetchedTexture::setDecodePriority(F32 priority)
 {
-	llassert(!mInImageList); 
-    
 	mDecodePriority = priority;
 
 	if(mDecodePriority < F_ALMOST_ZERO)
@@ -1729,6 +1796,22 @@ void LLViewerFetchedTexture::setDecodePriority(F32 priority)
 	}
 }
 
+//virtual
+void LLViewerFetchedTexture::dirtyDecodePriority() const
+{
+	if(!mDecodePriorityDirty && isInImageList())
+	{
+		mDecodePriorityDirty = TRUE ;
+		gTextureList.dirtyImagePriority(const_cast<LLViewerFetchedTexture*>(this)) ;
+	}
+}
+
+void LLViewerFetchedTexture::clearDecodePriorityDirty()
+{
+	mDecodePriorityDirty = FALSE ;
+	mPrioritizedVirtualSize = mMaxVirtualSize ;
+}
+
 void LLViewerFetchedTexture::setAdditionalDecodePriority(F32 priority)
 {
 	priority = llclamp(priority, 0.f, 1.f);
@@ -1827,9 +1910,10 @@ bool LLViewerFetchedTexture::updateFetch()
 		// Sets mRawDiscardLevel, mRawImage, mAuxRawImage
 		S32 fetch_discard = current_discard;
 		
+		LLPointer<LLImageDXT> compressed;
 		if (mRawImage.notNull()) sRawCount--;
 		if (mAuxRawImage.notNull()) sAuxCount--;
-		bool finished = LLAppViewer::getTextureFetch()->getRequestFinished(getID(), fetch_discard, mRawImage, mAuxRawImage);
+		bool finished = LLAppViewer::getTextureFetch()->getRequestFinished(getID(), fetch_discard, mRawImage, mAuxRawImage, compressed);
 		if (mRawImage.notNull()) sRawCount++;
 		if (mAuxRawImage.notNull()) sAuxCount++;
 		if (finished)
@@ -1843,6 +1927,17 @@ bool LLViewerFetchedTexture::updateFetch()
 																		mFetchPriority, mFetchDeltaTime, mRequestDeltaTime, mCanUseHTTP);
 		}
 		
+		if (compressed.notNull() && mRawImage.isNull())
+		{
+			// Served from the compressed cache tier, upload it as is
+			if (fetch_discard >= 0 && (current_discard < 0 || fetch_discard < current_discard) &&
+				createCompressedTexture(fetch_discard, compressed))
+			{
+				return TRUE ;
+			}
+			return false;
+		}
+
 		// We may have data ready regardless of whether or not we are finished (e.g. waiting on write)
 		if (mRawImage.notNull())
 		{
@@ -1922,7 +2017,7 @@ bool LLViewerFetchedTexture::updateFetch()
 			if(decode_priority > 0.0f || mStopFetchingTimer.getElapsedTimeF32() > MAX_HOLD_TIME)
 			{
 				mStopFetchingTimer.reset() ;
-				LLAppViewer::getTextureFetch()->updateRequestPriority(mID, decode_priority);
+				gTextureList.queueRequestPriority(mID, decode_priority);
 			}
 		}
 	}
@@ -1993,7 +2088,8 @@ bool LLViewerFetchedTexture::updateFetch()
 		// bypass texturefetch directly by pulling from LLTextureCache
 		bool fetch_request_created = false;
 		fetch_request_created = LLAppViewer::getTextureFetch()->createRequest(mUrl, getID(),getTargetHost(), decode_priority,
-																			  w, h, c, desired_discard, needsAux(), mCanUseHTTP);
+																			  w, h, c, desired_discard, needsAux(), mCanUseHTTP,
+																			  canUseCompressedCache());
 		
 		if (fetch_request_created)
 		{
@@ -2454,7 +2550,7 @@ void LLViewerFetchedTexture::forceImmediateUpdate()
 		return ;
 	}
 	//if already called forceImmediateUpdate()
-	if(mInImageList && mDecodePriority == LLViewerFetchedTexture::maxDecodePriority())
+	if(isInImageList() && mDecodePriority == LLViewerFetchedTexture::maxDecodePriority())
 	{
 		return ;
 	}
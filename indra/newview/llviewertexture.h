@@ -44,6 +44,7 @@
 class LLFace;
 class LLImageGL ;
 class LLImageRaw;
+class LLImageDXT;
 class LLViewerObject;
 class LLViewerTexture;
 class LLViewerFetchedTexture ;
@@ -179,6 +180,10 @@ public:
 
 	virtual F32  getMaxVirtualSize() ;
 
+	// Something the decode priority depends on changed: a face came or went,
+	// was resized, or the boost level moved.
+	virtual void dirtyDecodePriority() const {}
+
 	LLFrameTimer* getLastReferencedTimer() {return &mLastReferencedTimer ;}
 	
 	S32 getFullWidth() const { return mFullWidth; }
@@ -280,6 +285,7 @@ protected:
 	mutable S32  mMaxVirtualSizeResetCounter ;
 	mutable S32  mMaxVirtualSizeResetInterval;
 	mutable F32 mAdditionalDecodePriority;  // priority add to mDecodePriority.
+	mutable F32 mPrioritizedVirtualSize;	// mMaxVirtualSize when the decode priority was last calculated
 	LLFrameTimer mLastReferencedTimer;	
 
 	//GL texture
@@ -353,24 +359,6 @@ public:
 public:
 	static F32 maxDecodePriority();
 	
-	struct Compare
-	{
-		// lhs < rhs
-		bool operator()(const LLPointer<LLViewerFetchedTexture> &lhs, const LLPointer<LLViewerFetchedTexture> &rhs) const
-		{
-			const LLViewerFetchedTexture* lhsp = (const LLViewerFetchedTexture*)lhs;
-			const LLViewerFetchedTexture* rhsp = (const LLViewerFetchedTexture*)rhs;
-			// greater priority is "less"
-			const F32 lpriority = lhsp->getDecodePriority();
-			const F32 rpriority = rhsp->getDecodePriority();
-			if (lpriority > rpriority) // higher priority
-				return true;
-			if (lpriority < rpriority)
-				return false;
-			return lhsp < rhsp;
-		}
-	};
-
 public:
 	/*virtual*/ S8 getType() const ;
 	/*virtual*/ void forceImmediateUpdate() ;
@@ -409,6 +397,11 @@ public:
 	void setDecodePriority(F32 priority = -1.0f);
 	F32 getDecodePriority() const { return mDecodePriority; };
 
+	/*virtual*/ void dirtyDecodePriority() const;
+	BOOL isDecodePriorityDirty() const { return mDecodePriorityDirty; }
+	// ONLY call from LLViewerTextureList, once the priority is recalculated
+	void clearDecodePriorityDirty();
+
 	void setAdditionalDecodePriority(F32 priority) ;
 	
 	void updateVirtualSize() ;
@@ -431,8 +424,11 @@ public:
 	S32 getOriginalWidth() { return mOrigWidth; }
 	S32 getOriginalHeight() { return mOrigHeight; }
 
-	BOOL isInImageList() const {return mInImageList ;}
-	void setInImageList(BOOL flag) {mInImageList = flag ;}
+	BOOL isInImageList() const {return mImageListIndex >= 0 ;}
+	// Position in the priority heap of LLViewerTextureList, -1 if not in it.
+	// ONLY call from LLTexturePriorityHeap
+	S32 getImageListIndex() const {return mImageListIndex ;}
+	void setImageListIndex(S32 index) {mImageListIndex = index ;}
 
 	LLFrameTimer* getLastPacketTimer() {return &mLastPacketTimer;}
 
@@ -486,6 +482,10 @@ private:
 	void saveRawImage() ;
 	void setCachedRawImage() ;
 
+	// compressed texture cache tier
+	bool canUseCompressedCache() const ;
+	BOOL createCompressedTexture(S32 discard_level, LLImageDXT* imagedxt) ;
+
 	//for atlas
 	void resetFaceAtlas() ;
 	void invalidateAtlas(BOOL rebuild_geom) ;
@@ -559,7 +559,8 @@ protected:
 	LLFrameTimer mLastPacketTimer;		// Time since last packet.
 	LLFrameTimer mStopFetchingTimer;	// Time since mDecodePriority == 0.f.
 
-	BOOL  mInImageList;				// TRUE if image is in list (in which case don't reset priority!)
+	S32   mImageListIndex;			// >= 0 if image is in list (in which case don't reset priority!)
+	mutable BOOL mDecodePriorityDirty;	// waiting in LLViewerTextureList for its priority to be recalculated
 	BOOL  mNeedsCreateTexture;	
 
 	BOOL   mForSculpt ; //a flag if the texture is used as sculpt data.
@@ -27,6 +27,7 @@
 #include "llviewerprecompiledheaders.h"
 
 #include <sys/stat.h>
+#include <algorithm>
 
 #include "llviewertexturelist.h"
 
@@ -78,11 +79,153 @@ static LLFastTimer::DeclareTimer FTM_PROCESS_IMAGES("Process Images");
 
 ///////////////////////////////////////////////////////////////////////////////
 
+bool LLTexturePriorityHeap::insert(LLViewerFetchedTexture* image)
+{
+	if (image->getImageListIndex() >= 0)
+	{
+		return false;
+	}
+	S32 index = (S32)mHeap.size();
+	mHeap.push_back(image);
+	image->setImageListIndex(index);
+	siftUp(index);
+	return true;
+}
+
+bool LLTexturePriorityHeap::erase(LLViewerFetchedTexture* image)
+{
+	S32 index = image->getImageListIndex();
+	if (index < 0 || index >= (S32)mHeap.size() || mHeap[index] != image)
+	{
+		return false;
+	}
+	S32 last = (S32)mHeap.size() - 1;
+	if (index != last)
+	{
+		swap(index, last);
+	}
+	image->setImageListIndex(-1);
+	mHeap.pop_back();
+	if (index != last)
+	{
+		siftUp(index);
+		siftDown(index);
+	}
+	return true;
+}
+
+void LLTexturePriorityHeap::update(LLViewerFetchedTexture* image)
+{
+	S32 index = image->getImageListIndex();
+	llassert(index >= 0 && index < (S32)mHeap.size() && mHeap[index] == image);
+	siftUp(index);
+	siftDown(image->getImageListIndex());
+}
+
+void LLTexturePriorityHeap::clear()
+{
+	for (heap_t::iterator iter = mHeap.begin(); iter != mHeap.end(); ++iter)
+	{
+		(*iter)->setImageListIndex(-1);
+	}
+	mHeap.clear();
+}
+
+namespace
+{
+	// Orders heap positions by priority for std::push_heap()/pop_heap()
+	struct LLHeapIndexLower
+	{
+		LLHeapIndexLower(const LLTexturePriorityHeap::heap_t& heap) : mHeap(heap) {}
+		bool operator()(S32 a, S32 b) const
+		{
+			return mHeap[a]->getDecodePriority() < mHeap[b]->getDecodePriority();
+		}
+		const LLTexturePriorityHeap::heap_t& mHeap;
+	};
+}
+
+void LLTexturePriorityHeap::getTop(S32 count, std::vector<LLViewerFetchedTexture*>& top) const
+{
+	// The next highest is always a child of one already taken, so only the
+	// children of those need looking at
+	std::vector<S32> candidates;
+	LLHeapIndexLower lower(mHeap);
+	if (!mHeap.empty())
+	{
+		candidates.push_back(0);
+	}
+	while (count > 0 && !candidates.empty())
+	{
+		std::pop_heap(candidates.begin(), candidates.end(), lower);
+		S32 index = candidates.back();
+		candidates.pop_back();
+		top.push_back(mHeap[index]);
+		count--;
+
+		for (S32 child = index * 2 + 1; child <= index * 2 + 2 && child < (S32)mHeap.size(); child++)
+		{
+			candidates.push_back(child);
+			std::push_heap(candidates.begin(), candidates.end(), lower);
+		}
+	}
+}
+
+void LLTexturePriorityHeap::swap(S32 a, S32 b)
+{
+	LLPointer<LLViewerFetchedTexture>::swap(mHeap[a], mHeap[b]);
+	mHeap[a]->setImageListIndex(a);
+	mHeap[b]->setImageListIndex(b);
+}
+
+void LLTexturePriorityHeap::siftUp(S32 index)
+{
+	while (index > 0)
+	{
+		S32 parent = (index - 1) / 2;
+		if (!higher(index, parent))
+		{
+			break;
+		}
+		swap(index, parent);
+		index = parent;
+	}
+}
+
+void LLTexturePriorityHeap::siftDown(S32 index)
+{
+	const S32 size = (S32)mHeap.size();
+	while (true)
+	{
+		S32 highest = index;
+		S32 child = index * 2 + 1;
+		if (child < size && higher(child, highest))
+		{
+			highest = child;
+		}
+		child++;
+		if (child < size && higher(child, highest))
+		{
+			highest = child;
+		}
+		if (highest == index)
+		{
+			break;
+		}
+		swap(index, highest);
+		index = highest;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 LLViewerTextureList::LLViewerTextureList() 
 	: mForceResetTextureStats(FALSE),
 	mUpdateStats(FALSE),
 	mMaxResidentTexMemInMegaBytes(0),
-	mMaxTotalTextureMemInMegaBytes(0)
+	mMaxTotalTextureMemInMegaBytes(0),
+	mLastUpdateSlot(0),
+	mLastFetchSlot(0)
 {
 }
 
@@ -277,6 +420,8 @@ void LLViewerTextureList::shutdown()
 	mCreateTextureList.clear();
 	
 	mUUIDMap.clear();
+	mDirtyPriorityList.clear();
+	mRequestPriorities.clear();
 	
 	mImageList.clear();
 }
@@ -496,12 +641,10 @@ void LLViewerTextureList::addImageToList(LLViewerFetchedTexture *image)
 	{
 		llerrs << "LLViewerTextureList::addImageToList - Image already in list" << llendl;
 	}
-	if((mImageList.insert(image)).second != true) 
+	if(!mImageList.insert(image)) 
 	{
 		llerrs << "Error happens when insert image to mImageList!" << llendl ;
 	}
-	
-	image->setInImageList(TRUE) ;
 }
 
 void LLViewerTextureList::removeImageFromList(LLViewerFetchedTexture *image)
@@ -517,12 +660,13 @@ void LLViewerTextureList::removeImageFromList(LLViewerFetchedTexture *image)
 		}
 		llerrs << "LLViewerTextureList::removeImageFromList - Image not in list" << llendl;
 	}
-	if(mImageList.erase(image) != 1) 
+	if(!mImageList.erase(image)) 
 	{
 		llerrs << "Error happens when remove image from mImageList!" << llendl ;
 	}
-      
-	image->setInImageList(FALSE) ;
+	mDirtyPriorityList.erase(std::remove(mDirtyPriorityList.begin(), mDirtyPriorityList.end(), image),
+							 mDirtyPriorityList.end());
+	image->clearDecodePriorityDirty();
 }
 
 void LLViewerTextureList::addImage(LLViewerFetchedTexture *new_image)
@@ -571,8 +715,14 @@ void LLViewerTextureList::dirtyImage(LLViewerFetchedTexture *image)
 	mDirtyTextureList.insert(image);
 }
 
+void LLViewerTextureList::dirtyImagePriority(LLViewerFetchedTexture *image)
+{
+	mDirtyPriorityList.push_back(image);
+}
+
 ////////////////////////////////////////////////////////////////////////////
 static LLFastTimer::DeclareTimer FTM_IMAGE_MARK_DIRTY("Dirty Images");
+static LLFastTimer::DeclareTimer FTM_IMAGE_PRIORITIES("Image Priorities");
 
 void LLViewerTextureList::updateImages(F32 max_time)
 {
@@ -585,7 +735,10 @@ void LLViewerTextureList::updateImages(F32 max_time)
 	LLViewerStats::getInstance()->mRawMemStat.addValue((F32)BYTES_TO_MEGA_BYTES(LLImageRaw::sGlobalRawMemory));
 	LLViewerStats::getInstance()->mFormattedMemStat.addValue((F32)BYTES_TO_MEGA_BYTES(LLImageFormatted::sGlobalFormattedMemory));
 	
-	updateImagesDecodePriorities();
+	{
+		LLFastTimer t(FTM_IMAGE_PRIORITIES);
+		updateImagesDecodePriorities();
+	}
 
 	F32 total_max_time = max_time;
 	max_time -= updateImagesFetchTextures(max_time);
@@ -621,20 +774,44 @@ void LLViewerTextureList::updateImages(F32 max_time)
 
 void LLViewerTextureList::updateImagesDecodePriorities()
 {
-	// Update the decode priority for N images each frame
+	// Recalculate the priority of textures dirtied since last frame, oldest
+	// first and no more than MAX_DIRTY_UPDATES, the rest wait for next frame
+	{
+		const S32 MAX_DIRTY_UPDATES = 256;
+		S32 update_counter = MAX_DIRTY_UPDATES;
+		while(update_counter > 0 && !mDirtyPriorityList.empty())
+		{
+			LLViewerFetchedTexture* imagep = mDirtyPriorityList.front();
+			mDirtyPriorityList.pop_front();
+			if (!imagep->isDecodePriorityDirty())
+			{
+				continue; // the sweep got to it first, or it was queued twice
+			}
+			if (imagep->isDeleted())
+			{
+				imagep->clearDecodePriorityDirty();
+				continue;
+			}
+			updateImageDecodePriority(imagep);
+			update_counter--;
+		}
+	}
+
+	// Sweep through N images each frame for what nobody dirties: flushing
+	// unused images, and virtual sizes decaying after faces are no longer drawn
 	{
 		const size_t max_update_count = llmin((S32) (1024*gFrameIntervalSeconds) + 1, 32); //target 1024 textures per second
 		S32 update_counter = llmin(max_update_count, mUUIDMap.size()/10);
-		uuid_map_t::iterator iter = mUUIDMap.upper_bound(mLastUpdateUUID);
 		while(update_counter > 0 && !mUUIDMap.empty())
 		{
+			// Found again each time round, in case the map was rehashed
+			uuid_map_t::iterator iter = mUUIDMap.fromSlot(mLastUpdateSlot);
 			if (iter == mUUIDMap.end())
 			{
 				iter = mUUIDMap.begin();
 			}
-			mLastUpdateUUID = iter->first;
+			mLastUpdateSlot = iter.getSlot() + 1;
 			LLPointer<LLViewerFetchedTexture> imagep = iter->second;
-			++iter; // safe to incrament now
 
 			//
 			// Flush formatted images using a lazy flush
@@ -693,24 +870,35 @@ void LLViewerTextureList::updateImagesDecodePriorities()
 				}
 			}
 			
-			imagep->processTextureStats();
-			F32 old_priority = imagep->getDecodePriority();
-			F32 old_priority_test = llmax(old_priority, 0.0f);
-			F32 decode_priority = imagep->calcDecodePriority();
-			F32 decode_priority_test = llmax(decode_priority, 0.0f);
-			// Ignore < 20% difference
-			if ((decode_priority_test < old_priority_test * .8f) ||
-				(decode_priority_test > old_priority_test * 1.25f))
-			{
-				removeImageFromList(imagep);
-				imagep->setDecodePriority(decode_priority);
-				addImageToList(imagep);
-			}
+			updateImageDecodePriority(imagep);
 			update_counter--;
 		}
 	}
 }
 
+void LLViewerTextureList::updateImageDecodePriority(LLViewerFetchedTexture* imagep)
+{
+	imagep->processTextureStats();
+	F32 old_priority = imagep->getDecodePriority();
+	F32 old_priority_test = llmax(old_priority, 0.0f);
+	F32 decode_priority = imagep->calcDecodePriority();
+	F32 decode_priority_test = llmax(decode_priority, 0.0f);
+	imagep->clearDecodePriorityDirty();
+	// Ignore < 20% difference
+	if ((decode_priority_test < old_priority_test * .8f) ||
+		(decode_priority_test > old_priority_test * 1.25f))
+	{
+		imagep->setDecodePriority(decode_priority);
+		mImageList.update(imagep);
+	}
+}
+
+void LLViewerTextureList::flushRequestPriorities()
+{
+	LLAppViewer::getTextureFetch()->updateRequestPriorities(mRequestPriorities);
+	mRequestPriorities.clear();
+}
+
 /*
  static U8 get_image_type(LLViewerFetchedTexture* imagep, LLHost target_host)
  {
@@ -773,16 +961,17 @@ void LLViewerTextureList::forceImmediateUpdate(LLViewerFetchedTexture* imagep)
 	{
 		return ;
 	}
-	if(imagep->isInImageList())
-	{
-		removeImageFromList(imagep);
-	}
-
 	imagep->processTextureStats();
 	F32 decode_priority = LLViewerFetchedTexture::maxDecodePriority() ;
 	imagep->setDecodePriority(decode_priority);
-	mImageList.insert(imagep);
-	imagep->setInImageList(TRUE) ;
+	if(imagep->isInImageList())
+	{
+		mImageList.update(imagep);
+	}
+	else
+	{
+		mImageList.insert(imagep);
+	}
 
 	return ;
 }
@@ -799,22 +988,13 @@ F32 LLViewerTextureList::updateImagesFetchTextures(F32 max_time)
 	// 32 high priority entries
 	typedef std::vector<LLViewerFetchedTexture*> entries_list_t;
 	entries_list_t entries;
-	size_t update_counter = llmin(max_priority_count, mImageList.size());
-	image_priority_list_t::iterator iter1 = mImageList.begin();
-	while(update_counter > 0)
-	{
-		entries.push_back(*iter1);
-		
-		++iter1;
-		update_counter--;
-	}
+	mImageList.getTop(max_priority_count, entries);
 	
 	// 256 cycled entries
-	update_counter = llmin(max_update_count, mUUIDMap.size());	
+	size_t update_counter = llmin(max_update_count, mUUIDMap.size());	
 	if(update_counter > 0)
 	{
-		uuid_map_t::iterator iter2 = mUUIDMap.upper_bound(mLastFetchUUID);
-		uuid_map_t::iterator iter2p = iter2;
+		uuid_map_t::iterator iter2 = mUUIDMap.fromSlot(mLastFetchSlot);
 		while(update_counter > 0)
 		{
 			if (iter2 == mUUIDMap.end())
@@ -822,11 +1002,10 @@ F32 LLViewerTextureList::updateImagesFetchTextures(F32 max_time)
 				iter2 = mUUIDMap.begin();
 			}
 			entries.push_back(iter2->second);
-			iter2p = iter2++;
+			mLastFetchSlot = iter2.getSlot() + 1;
+			++iter2;
 			update_counter--;
 		}
-
-		mLastFetchUUID = iter2p->first;
 	}
 	
 	S32 fetch_count = 0;
@@ -847,6 +1026,7 @@ F32 LLViewerTextureList::updateImagesFetchTextures(F32 max_time)
 		}
 		min_count--;
 	}
+	flushRequestPriorities();
 	//if (fetch_count == 0)
 	//{
 	//	gDebugTimers[0].pause();
@@ -878,35 +1058,25 @@ void LLViewerTextureList::decodeAllImages(F32 max_time)
 	LLTimer timer;
 	if(gNoRender) return;
 	
-	// Update texture stats and priorities
-	std::vector<LLPointer<LLViewerFetchedTexture> > image_list;
-	for (image_priority_list_t::iterator iter = mImageList.begin();
-		 iter != mImageList.end(); )
-	{
-		LLViewerFetchedTexture* imagep = *iter++;
-		image_list.push_back(imagep);
-		imagep->setInImageList(FALSE) ;
-	}
-	mImageList.clear();
-	for (std::vector<LLPointer<LLViewerFetchedTexture> >::iterator iter = image_list.begin();
-		 iter != image_list.end(); ++iter)
+	// Update texture stats and priorities. Work on a copy, the heap reorders as we go
+	typedef std::vector<LLPointer<LLViewerFetchedTexture> > image_vec_t;
+	image_vec_t image_list(mImageList.begin(), mImageList.end());
+	for (image_vec_t::iterator iter = image_list.begin(); iter != image_list.end(); ++iter)
 	{
 		LLViewerFetchedTexture* imagep = *iter;
 		imagep->processTextureStats();
 		F32 decode_priority = imagep->calcDecodePriority();
 		imagep->setDecodePriority(decode_priority);
-		mImageList.insert(imagep);
-		imagep->setInImageList(TRUE) ;
+		imagep->clearDecodePriorityDirty();
+		mImageList.update(imagep);
 	}
-	image_list.clear();
 	
 	// Update fetch (decode)
-	for (image_priority_list_t::iterator iter = mImageList.begin();
-		 iter != mImageList.end(); )
+	for (image_vec_t::iterator iter = image_list.begin(); iter != image_list.end(); ++iter)
 	{
-		LLViewerFetchedTexture* imagep = *iter++;
-		imagep->updateFetch();
+		(*iter)->updateFetch();
 	}
+	flushRequestPriorities();
 	// Run threads
 	S32 fetch_pending = 0;
 	while (1)
@@ -920,12 +1090,12 @@ void LLViewerTextureList::decodeAllImages(F32 max_time)
 		}
 	}
 	// Update fetch again
-	for (image_priority_list_t::iterator iter = mImageList.begin();
-		 iter != mImageList.end(); )
+	for (image_vec_t::iterator iter = image_list.begin(); iter != image_list.end(); ++iter)
 	{
-		LLViewerFetchedTexture* imagep = *iter++;
-		imagep->updateFetch();
+		(*iter)->updateFetch();
 	}
+	flushRequestPriorities();
+	image_list.clear();
 	max_time -= timer.getElapsedTimeF32();
 	max_time = llmax(max_time, .001f);
 	F32 create_time = updateImagesCreateTextures(max_time);
@@ -28,13 +28,16 @@
 #define LL_LLVIEWERTEXTURELIST_H
 
 #include "lluuid.h"
+#include "llflathashmap.h"
 //#include "message.h"
 #include "llgl.h"
 #include "llstat.h"
 #include "llviewertexture.h"
 #include "llui.h"
+#include <deque>
 #include <list>
 #include <set>
+#include <vector>
 
 const U32 LL_IMAGE_REZ_LOSSLESS_CUTOFF = 128;
 
@@ -51,6 +54,42 @@ class LLImageJ2C;
 class LLMessageSystem;
 class LLTextureView;
 
+// Fetched textures by decode priority, highest first. A binary heap which
+// keeps the position of each texture in the texture, so one whose priority
+// changed is moved in O(log n) without looking for it.
+class LLTexturePriorityHeap
+{
+public:
+	typedef std::vector<LLPointer<LLViewerFetchedTexture> > heap_t;
+	// In heap order, not priority order
+	typedef heap_t::const_iterator iterator;
+
+	bool insert(LLViewerFetchedTexture* image);
+	bool erase(LLViewerFetchedTexture* image);
+	// Put image back in place after its decode priority changed
+	void update(LLViewerFetchedTexture* image);
+	void clear();
+
+	// Appends the count textures of highest priority to top, highest first
+	void getTop(S32 count, std::vector<LLViewerFetchedTexture*>& top) const;
+
+	iterator begin() const { return mHeap.begin(); }
+	iterator end() const { return mHeap.end(); }
+	size_t size() const { return mHeap.size(); }
+	bool empty() const { return mHeap.empty(); }
+
+private:
+	bool higher(S32 a, S32 b) const
+	{
+		return mHeap[a]->getDecodePriority() > mHeap[b]->getDecodePriority();
+	}
+	void swap(S32 a, S32 b);
+	void siftUp(S32 index);
+	void siftDown(S32 index);
+
+	heap_t mHeap;
+};
+
 typedef	void (*LLImageCallback)(BOOL success,
 								LLViewerFetchedTexture *src_vi,
 								LLImageRaw* src,
@@ -87,6 +126,10 @@ public:
 	LLViewerFetchedTexture *findImage(const LLUUID &image_id);
 
 	void dirtyImage(LLViewerFetchedTexture *image);
+	// Recalculate the decode priority of image soon, see LLViewerFetchedTexture::dirtyDecodePriority()
+	void dirtyImagePriority(LLViewerFetchedTexture *image);
+	// Passed on to LLTextureFetch::updateRequestPriorities() after updateFetch() of this frame's textures
+	void queueRequestPriority(const LLUUID& id, F32 priority) { mRequestPriorities.push_back(std::make_pair(id, priority)); }
 	
 	// Using image stats, determine what images are necessary, and perform image updates.
 	void updateImages(F32 max_time);
@@ -113,6 +156,8 @@ public:
 	
 private:
 	void updateImagesDecodePriorities();
+	void updateImageDecodePriority(LLViewerFetchedTexture* imagep);
+	void flushRequestPriorities();
 	F32  updateImagesCreateTextures(F32 max_time);
 	F32  updateImagesFetchTextures(F32 max_time);
 	void updateImagesUpdateStats();
@@ -176,13 +221,20 @@ public:
 	BOOL mForceResetTextureStats;
     
 private:
-	typedef std::map< LLUUID, LLPointer<LLViewerFetchedTexture> > uuid_map_t;
+	typedef LLFlatHashMap< LLUUID, LLPointer<LLViewerFetchedTexture> > uuid_map_t;
 	uuid_map_t mUUIDMap;
-	LLUUID mLastUpdateUUID;
-	LLUUID mLastFetchUUID;
+	// Where the sweeps through mUUIDMap go on from next frame
+	U32 mLastUpdateSlot;
+	U32 mLastFetchSlot;
 	
-	typedef std::set<LLPointer<LLViewerFetchedTexture>, LLViewerFetchedTexture::Compare> image_priority_list_t;	
+	typedef LLTexturePriorityHeap image_priority_list_t;
 	image_priority_list_t mImageList;
+	// Textures waiting for dirtyImagePriority(), in the order they were
+	// dirtied.  Not references, so the lazy flush's reference count stays
+	// right: removeImageFromList() takes a texture out.  Entries whose dirty
+	// flag is clear were updated by the sweep already and are skipped.
+	std::deque<LLViewerFetchedTexture*> mDirtyPriorityList;
+	std::vector<std::pair<LLUUID, F32> > mRequestPriorities;
 
 	// simply holds on to LLViewerFetchedTexture references to stop them from being purged too soon
 	std::set<LLPointer<LLViewerFetchedTexture> > mImagePreloads;
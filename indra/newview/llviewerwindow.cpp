@@ -487,6 +487,9 @@ public:
 			LLRender::sUICalls = LLRender::sUIVerts = 0;
 			ypos += y_inc;
 
+			addText(xpos, ypos, llformat("Immediate Verts/Calls: %d/%d", LLRender::sFrameVerts, LLRender::sFrameCalls));
+			ypos += y_inc;
+
 			addText(xpos,ypos, llformat("%d/%d Nodes visible", gPipeline.mNumVisibleNodes, LLSpatialGroup::sNodeCount));
 			
 			ypos += y_inc;
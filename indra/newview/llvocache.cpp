@@ -66,67 +66,16 @@ LLVOCacheEntry::LLVOCacheEntry()
 	mDP.assignBuffer(mBuffer, 0);
 }
 
-LLVOCacheEntry::LLVOCacheEntry(LLAPRFile* apr_file)
+LLVOCacheEntry::LLVOCacheEntry(const LLVOCacheIndexEntry& index, const U8* data)
 {
-	S32 size = -1;
-	BOOL success;
-
-	success = check_read(apr_file, &mLocalID, sizeof(U32));
-	if(success)
-{
-		success = check_read(apr_file, &mCRC, sizeof(U32));
-	}
-	if(success)
-	{
-		success = check_read(apr_file, &mHitCount, sizeof(S32));
-	}
-	if(success)
-	{
-		success = check_read(apr_file, &mDupeCount, sizeof(S32));
-}
-	if(success)
-{
-		success = check_read(apr_file, &mCRCChangeCount, sizeof(S32));
-	}
-	if(success)
-	{
-		success = check_read(apr_file, &size, sizeof(S32));
-
-	// Corruption in the cache entries
-	if ((size > 10000) || (size < 1))
-	{
-		// We've got a bogus size, skip reading it.
-		// We won't bother seeking, because the rest of this file
-		// is likely bogus, and will be tossed anyway.
-		llwarns << "Bogus cache entry, size " << size << ", aborting!" << llendl;
-		mLocalID = 0;
-		mCRC = 0;
-		mBuffer = NULL;
-		return;
-	}
-	}
-	if(success && size > 0)
-	{
-		mBuffer = new U8[size];
-		success = check_read(apr_file, mBuffer, size);
-
-		if(success)
-		{
-	mDP.assignBuffer(mBuffer, size);
-}
-		else
-		{
-			delete[] mBuffer ;
-			mBuffer = NULL ;
-		}
-	}
-
-	if(!success)
-	{
-		mLocalID = 0;
-		mCRC = 0;
-		mBuffer = NULL;
-	}
+	mLocalID = index.mLocalID;
+	mCRC = index.mCRC;
+	mHitCount = index.mHitCount;
+	mDupeCount = index.mDupeCount;
+	mCRCChangeCount = index.mCRCChangeCount;
+	mBuffer = new U8[index.mSize];
+	memcpy(mBuffer, data, index.mSize);
+	mDP.assignBuffer(mBuffer, index.mSize);
 }
 
 LLVOCacheEntry::~LLVOCacheEntry()
@@ -181,40 +130,226 @@ void LLVOCacheEntry::dump() const
 		<< llendl;
 }
 
-BOOL LLVOCacheEntry::writeToFile(LLAPRFile* apr_file) const
+void LLVOCacheEntry::fillIndexEntry(LLVOCacheIndexEntry& index) const
+{
+	index.mLocalID = mLocalID;
+	index.mCRC = mCRC;
+	index.mHitCount = mHitCount;
+	index.mDupeCount = mDupeCount;
+	index.mCRCChangeCount = mCRCChangeCount;
+	index.mSize = mDP.getBufferSize();
+}
+
+//-------------------------------------------------------------------
+//LLVOCacheRegionFile
+//-------------------------------------------------------------------
+const S32 MAX_OBJECT_DATA_SIZE = 10000;
+
+LLVOCacheRegionFile::LLVOCacheRegionFile()
+:	mIndex(NULL),
+	mNumEntries(0),
+	mNumEvicted(0)
+{
+}
+
+bool LLVOCacheRegionFile::open(const std::string& filename, const LLUUID& id)
 {
-	BOOL success;
-	success = check_write(apr_file, (void*)&mLocalID, sizeof(U32));
-	if(success)
+	close();
+	if (!mFile.open(filename, 0, true))
 	{
-		success = check_write(apr_file, (void*)&mCRC, sizeof(U32));
+		return false;
 	}
-	if(success)
+
+	S64 file_size = mFile.getSize();
+	const LLVOCacheFileHeader* header = (const LLVOCacheFileHeader*)mFile.getData();
+	if (file_size < (S64)sizeof(LLVOCacheFileHeader))
 	{
-		success = check_write(apr_file, (void*)&mHitCount, sizeof(S32));
+		llwarns << "Truncated object cache file " << filename << llendl;
+		close();
+		return false;
 	}
-	if(success)
+
+	LLUUID cache_id;
+	memcpy(cache_id.mData, header->mRegionID, UUID_BYTES);
+	if (cache_id != id)
 	{
-		success = check_write(apr_file, (void*)&mDupeCount, sizeof(S32));
+		llinfos << "Cache ID doesn't match for this region, discarding" << llendl;
+		close();
+		return false;
 	}
-	if(success)
+
+	S32 num_entries = header->mNumEntries;
+	S64 data_start = (S64)sizeof(LLVOCacheFileHeader) + (S64)num_entries * sizeof(LLVOCacheIndexEntry);
+	if (num_entries < 0 || data_start > file_size)
 	{
-		success = check_write(apr_file, (void*)&mCRCChangeCount, sizeof(S32));
+		llwarns << "Bogus entry count " << num_entries << " in " << filename << ", discarding" << llendl;
+		close();
+		return false;
 	}
-	if(success)
+
+	// Only the index is checked here, the object data isn't touched until
+	// there's a cache hit on it
+	const LLVOCacheIndexEntry* index = (const LLVOCacheIndexEntry*)(mFile.getData() + sizeof(LLVOCacheFileHeader));
+	for (S32 i = 0; i < num_entries; i++)
 	{
-		S32 size = mDP.getBufferSize();
-		success = check_write(apr_file, (void*)&size, sizeof(S32));
-	
-		if(success)
+		if (!index[i].mLocalID
+			|| (i > 0 && index[i].mLocalID <= index[i - 1].mLocalID)
+			|| index[i].mSize < 1 || index[i].mSize > MAX_OBJECT_DATA_SIZE
+			|| (S64)index[i].mOffset < data_start
+			|| (S64)index[i].mOffset + index[i].mSize > file_size)
 		{
-			success = check_write(apr_file, (void*)mBuffer, size);
+			llwarns << "Aborting cache file load for " << filename << ", cache file corruption!" << llendl;
+			close();
+			return false;
+		}
 	}
+
+	mIndex = index;
+	mNumEntries = num_entries;
+	return true;
+}
+
+void LLVOCacheRegionFile::close()
+{
+	mFile.close();
+	mIndex = NULL;
+	mNumEntries = 0;
+	mEvicted.clear();
+	mEvictOrder.clear();
+	mNumEvicted = 0;
 }
 
-	return success ;
+const LLVOCacheIndexEntry* LLVOCacheRegionFile::find(U32 local_id) const
+{
+	S32 low = 0;
+	S32 high = mNumEntries - 1;
+	while (low <= high)
+	{
+		S32 mid = (low + high) / 2;
+		U32 mid_id = mIndex[mid].mLocalID;
+		if (mid_id < local_id)
+		{
+			low = mid + 1;
+		}
+		else if (mid_id > local_id)
+		{
+			high = mid - 1;
+		}
+		else
+		{
+			return isEvicted(mid) ? NULL : &mIndex[mid];
+		}
+	}
+	return NULL;
 }
 
+namespace
+{
+	struct LLVOCacheFewerHits
+	{
+		LLVOCacheFewerHits(const LLVOCacheIndexEntry* index) : mIndex(index) {}
+		bool operator()(S32 lhs, S32 rhs) const
+		{
+			return mIndex[lhs].mHitCount < mIndex[rhs].mHitCount;
+		}
+		const LLVOCacheIndexEntry* mIndex;
+	};
+}
+
+bool LLVOCacheRegionFile::evictEntry()
+{
+	if (mNumEvicted >= mNumEntries)
+	{
+		return false;
+	}
+	if (mEvicted.empty())
+	{
+		mEvicted.resize(mNumEntries, false);
+		mEvictOrder.resize(mNumEntries);
+		for (S32 i = 0; i < mNumEntries; i++)
+		{
+			mEvictOrder[i] = i;
+		}
+		std::stable_sort(mEvictOrder.begin(), mEvictOrder.end(), LLVOCacheFewerHits(mIndex));
+	}
+	mEvicted[mEvictOrder[mNumEvicted++]] = true;
+	return true;
+}
+
+LLVOCacheEntry* LLVOCacheRegionFile::createEntry(const LLVOCacheIndexEntry& index) const
+{
+	return new LLVOCacheEntry(index, getData(index));
+}
+
+//-------------------------------------------------------------------
+//LLVOCacheWriter
+//-------------------------------------------------------------------
+// Writes region cache files off the main thread.  Requests are handled one
+// at a time in the order they were posted.
+class LLVOCacheWriter : public LLQueuedThread
+{
+public:
+	class WriteRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		/*virtual*/ ~WriteRequest() {}
+
+	public:
+		WriteRequest(handle_t handle, LLVOCacheWriter* writer, const std::string& filename, std::vector<U8>& buffer)
+			: LLQueuedThread::QueuedRequest(handle, PRIORITY_NORMAL, FLAG_AUTO_COMPLETE),
+			  mWriter(writer),
+			  mFilename(filename)
+		{
+			mBuffer.swap(buffer);
+		}
+
+		/*virtual*/ bool processRequest()
+		{
+			// Written beside the old file and renamed over it, so a region
+			// never maps a half written file
+			LLVolatileAPRPool* pool = mWriter->getLocalAPRFilePool();
+			std::string temp_filename = mFilename + ".tmp";
+			LLAPRFile::remove(temp_filename, pool);
+			S32 size = (S32)mBuffer.size();
+			if (LLAPRFile::writeEx(temp_filename, &mBuffer[0], 0, size, pool) != size)
+			{
+				llwarns << "Failed to write object cache file " << mFilename << llendl;
+				LLAPRFile::remove(temp_filename, pool);
+				LLAPRFile::remove(mFilename, pool);
+				return true;
+			}
+			if (LLFile::rename(temp_filename, mFilename) != 0)
+			{
+				// Windows won't rename over an existing file
+				LLFile::remove(mFilename);
+			}
+			if (LLFile::rename(temp_filename, mFilename) != 0)
+			{
+				llwarns << "Failed to rename " << temp_filename << " to " << mFilename << llendl;
+				LLAPRFile::remove(temp_filename, pool);
+			}
+			return true;
+		}
+
+	private:
+		LLVOCacheWriter* mWriter;
+		std::string mFilename;
+		std::vector<U8> mBuffer;
+	};
+
+	LLVOCacheWriter()
+		: LLQueuedThread("VOCache Writer")
+	{
+	}
+
+	handle_t write(const std::string& filename, std::vector<U8>& buffer)
+	{
+		handle_t handle = generateHandle();
+		addRequest(new WriteRequest(handle, this, filename, buffer));
+		return handle;
+	}
+};
+
 //-------------------------------------------------------------------
 //LLVOCache
 //-------------------------------------------------------------------
@@ -260,10 +395,14 @@ LLVOCache::LLVOCache():
 	mNumEntries(0)
 {
 	mLocalAPRFilePoolp = new LLVolatileAPRPool() ;
+	mWriter = new LLVOCacheWriter() ;
 }
 
 LLVOCache::~LLVOCache()
 {
+	mWriter->waitOnPending() ;
+	mWriter->shutdown() ;
+	delete mWriter ;
 	writeCacheHeader();
 	clearCacheInMemory();
 	delete mLocalAPRFilePoolp;
@@ -317,6 +456,9 @@ void LLVOCache::removeCache(ELLPath location)
 		return ;
 	}
 
+	mWriter->waitOnPending() ;
+	mPendingWrites.clear() ;
+
 	std::string delem = gDirUtilp->getDirDelimiter();
 	std::string mask = delem + "*";
 	std::string cache_dir = gDirUtilp->getExpandedFilename(location, object_cache_dirname);
@@ -335,6 +477,9 @@ void LLVOCache::removeCache()
 		return ;
 	}
 
+	mWriter->waitOnPending() ;
+	mPendingWrites.clear() ;
+
 	std::string delem = gDirUtilp->getDirDelimiter();
 	std::string mask = delem + "*";
 	gDirUtilp->deleteFilesInDir(mObjectCacheDirName, mask); 
@@ -375,11 +520,23 @@ void LLVOCache::removeFromCache(U64 handle)
 		return ;
 	}
 
+	waitForWrite(handle) ;
+
 	std::string filename;
 	getObjectCacheFilename(handle, filename);
 	LLAPRFile::remove(filename, mLocalAPRFilePoolp);	
 }
 
+void LLVOCache::waitForWrite(U64 handle)
+{
+	std::map<U64, LLQueuedThread::handle_t>::iterator iter = mPendingWrites.find(handle) ;
+	if (iter != mPendingWrites.end())
+	{
+		mWriter->waitForResult(iter->second) ;
+		mPendingWrites.erase(iter) ;
+	}
+}
+
 BOOL LLVOCache::checkRead(LLAPRFile* apr_file, void* src, S32 n_bytes) 
 {
 	if(!check_read(apr_file, src, n_bytes))
@@ -499,7 +656,7 @@ BOOL LLVOCache::updateEntry(const HeaderEntryInfo* entry)
 	return checkWrite(apr_file, (void*)entry, sizeof(HeaderEntryInfo)) ;
 }
 
-void LLVOCache::readFromCache(U64 handle, const LLUUID& id, LLVOCacheEntry::vocache_entry_map_t& cache_entry_map) 
+void LLVOCache::readFromCache(U64 handle, const LLUUID& id, LLVOCacheRegionFile& cache_file) 
 {
 	llassert_always(mInitialized);
 
@@ -509,44 +666,12 @@ void LLVOCache::readFromCache(U64 handle, const LLUUID& id, LLVOCacheEntry::voca
 		return ;
 	}
 
+	// The region may be coming back before its last visit was written
+	waitForWrite(handle) ;
+
 	std::string filename;
 	getObjectCacheFilename(handle, filename);
-	LLAPRFile* apr_file = new LLAPRFile(filename, APR_READ|APR_BINARY, mLocalAPRFilePoolp);
-
-	LLUUID cache_id ;
-	if(!checkRead(apr_file, cache_id.mData, UUID_BYTES))
-	{
-		return ;
-	}
-	if(cache_id != id)
-	{
-		llinfos << "Cache ID doesn't match for this region, discarding"<< llendl;
-
-		delete apr_file ;
-		return ;
-	}
-
-	S32 num_entries;
-	if(!checkRead(apr_file, &num_entries, sizeof(S32)))
-	{
-		return ;
-	}
-	
-	for (S32 i = 0; i < num_entries; i++)
-	{
-		LLVOCacheEntry* entry = new LLVOCacheEntry(apr_file);
-		if (!entry->getLocalID())
-		{
-			llwarns << "Aborting cache file load for " << filename << ", cache file corruption!" << llendl;
-			delete entry ;
-			break;
-		}
-		cache_entry_map[entry->getLocalID()] = entry;
-	}
-	num_entries = cache_entry_map.size() ;
-
-	delete apr_file ;
-	return ;
+	cache_file.open(filename, id) ;
 }
 	
 void LLVOCache::purgeEntries()
@@ -568,7 +693,8 @@ void LLVOCache::purgeEntries()
 	mNumEntries = mHandleEntryMap.size() ;
 }
 
-void LLVOCache::writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map, BOOL dirty_cache) 
+void LLVOCache::writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map,
+							 LLVOCacheRegionFile& cache_file, BOOL dirty_cache) 
 {
 	llassert_always(mInitialized);
 
@@ -614,34 +740,78 @@ void LLVOCache::writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry:
 		return ; //nothing changed, no need to update.
 	}
 
-	//write to cache file
+	//pack the cache file here, the writer thread only writes it
+	std::vector<U8> buffer ;
+	packCacheFile(id, cache_entry_map, cache_file, buffer) ;
+	cache_file.close() ;
+
 	std::string filename;
 	getObjectCacheFilename(handle, filename);
-	LLAPRFile* apr_file = new LLAPRFile(filename, APR_CREATE|APR_WRITE|APR_BINARY, mLocalAPRFilePoolp);
-	
-	if(!checkWrite(apr_file, (void*)id.mData, UUID_BYTES))
+	mPendingWrites[handle] = mWriter->write(filename, buffer) ;
+}
+
+void LLVOCache::packCacheFile(const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map,
+							  const LLVOCacheRegionFile& cache_file, std::vector<U8>& buffer)
+{
+	// Merge the two by local id, an entry in the map replaces the one in the file
+	std::vector<LLVOCacheIndexEntry> index ;
+	std::vector<const U8*> data ;
+	index.reserve(cache_entry_map.size() + cache_file.getNumLiveEntries()) ;
+	data.reserve(index.capacity()) ;
+
+	LLVOCacheEntry::vocache_entry_map_t::const_iterator map_iter = cache_entry_map.begin() ;
+	S32 i = 0 ;
+	while (map_iter != cache_entry_map.end() || i < cache_file.getNumEntries())
 	{
-		return ;
+		LLVOCacheIndexEntry entry ;
+		if (i < cache_file.getNumEntries()
+			&& (map_iter == cache_entry_map.end() || cache_file.getIndexEntry(i).mLocalID < map_iter->first))
+		{
+			if (cache_file.isEvicted(i))
+			{
+				i++ ;
+				continue ;
+			}
+			entry = cache_file.getIndexEntry(i) ;
+			data.push_back(cache_file.getData(entry)) ;
+			i++ ;
+		}
+		else
+		{
+			if (i < cache_file.getNumEntries() && cache_file.getIndexEntry(i).mLocalID == map_iter->first)
+			{
+				i++ ;
+			}
+			map_iter->second->fillIndexEntry(entry) ;
+			data.push_back(map_iter->second->getData()) ;
+			++map_iter ;
+		}
+		if (entry.mSize < 1 || entry.mSize > MAX_OBJECT_DATA_SIZE)
+		{
+			data.pop_back() ;
+			continue ;
+		}
+		index.push_back(entry) ;
 	}
 
-	S32 num_entries = cache_entry_map.size() ;
-	if(!checkWrite(apr_file, &num_entries, sizeof(S32)))
+	U32 offset = sizeof(LLVOCacheFileHeader) + index.size() * sizeof(LLVOCacheIndexEntry) ;
+	for (U32 j = 0 ; j < index.size() ; j++)
 	{
-		return ;
+		index[j].mOffset = offset ;
+		offset += index[j].mSize ;
 	}
 
-	for (LLVOCacheEntry::vocache_entry_map_t::const_iterator iter = cache_entry_map.begin(); iter != cache_entry_map.end(); ++iter)
+	buffer.resize(offset) ;
+	LLVOCacheFileHeader* header = (LLVOCacheFileHeader*)&buffer[0] ;
+	memcpy(header->mRegionID, id.mData, UUID_BYTES) ;
+	header->mNumEntries = index.size() ;
+	if (!index.empty())
 	{
-		if(!iter->second->writeToFile(apr_file))
-		{
-			//failed
-			delete apr_file ;
-			removeCache() ;
-			return ;
-		}
+		memcpy(&buffer[sizeof(LLVOCacheFileHeader)], &index[0], index.size() * sizeof(LLVOCacheIndexEntry)) ;
+	}
+	for (U32 j = 0 ; j < index.size() ; j++)
+	{
+		memcpy(&buffer[index[j].mOffset], data[j], index[j].mSize) ;
 	}
-
-	delete apr_file ;
-	return ;
 }
 
@@ -30,8 +30,31 @@
 #include "lluuid.h"
 #include "lldatapacker.h"
 #include "lldlinked.h"
+#include "llapr.h"
+#include "llqueuedthread.h"
 
 
+//---------------------------------------------------------------------------
+// Region cache files: an LLVOCacheFileHeader, then mNumEntries
+// LLVOCacheIndexEntry records sorted by local id, then the packed object
+// data they point at.
+struct LLVOCacheFileHeader
+{
+	U8  mRegionID[UUID_BYTES];
+	S32 mNumEntries;
+};
+
+struct LLVOCacheIndexEntry
+{
+	U32 mLocalID;
+	U32 mCRC;
+	S32 mHitCount;
+	S32 mDupeCount;
+	S32 mCRCChangeCount;
+	U32 mOffset;	// of the object data, from the start of the file
+	S32 mSize;
+};
+
 //---------------------------------------------------------------------------
 // Cache entries
 class LLVOCacheEntry;
@@ -40,7 +63,7 @@ class LLVOCacheEntry
 {
 public:
 	LLVOCacheEntry(U32 local_id, U32 crc, LLDataPackerBinaryBuffer &dp);
-	LLVOCacheEntry(LLAPRFile* apr_file);
+	LLVOCacheEntry(const LLVOCacheIndexEntry& index, const U8* data);
 	LLVOCacheEntry();
 	~LLVOCacheEntry();
 
@@ -50,7 +73,9 @@ public:
 	S32 getCRCChangeCount() const	{ return mCRCChangeCount; }
 
 	void dump() const;
-	BOOL writeToFile(LLAPRFile* apr_file) const;
+	// All but mOffset
+	void fillIndexEntry(LLVOCacheIndexEntry& index) const;
+	const U8* getData() const		{ return mBuffer; }
 	void assignCRC(U32 crc, LLDataPackerBinaryBuffer &dp);
 	LLDataPackerBinaryBuffer *getDP(U32 crc);
 	void recordHit();
@@ -69,6 +94,46 @@ protected:
 	U8							*mBuffer;
 };
 
+//
+// A region's cache file, mapped read only.  Entries are looked up in the
+// mapping and only copied into an LLVOCacheEntry when they are needed.
+//
+class LLVOCacheRegionFile
+{
+public:
+	LLVOCacheRegionFile();
+
+	// Maps filename if it is a valid cache file for region id
+	bool open(const std::string& filename, const LLUUID& id);
+	void close();
+	bool isOpen() const		{ return mFile.isOpen(); }
+
+	S32 getNumEntries() const	{ return mNumEntries; }
+	// Entries not evicted
+	S32 getNumLiveEntries() const	{ return mNumEntries - mNumEvicted; }
+	const LLVOCacheIndexEntry& getIndexEntry(S32 i) const	{ return mIndex[i]; }
+	bool isEvicted(S32 i) const	{ return !mEvicted.empty() && mEvicted[i]; }
+	const U8* getData(const LLVOCacheIndexEntry& index) const	{ return mFile.getData() + index.mOffset; }
+
+	// NULL if local_id isn't in the file, or was evicted
+	const LLVOCacheIndexEntry* find(U32 local_id) const;
+	// Drops the entry with the fewest hits left, as if it had never been
+	// in the file.  false once all are gone.
+	bool evictEntry();
+	// Copies the entry out of the mapping
+	LLVOCacheEntry* createEntry(const LLVOCacheIndexEntry& index) const;
+
+private:
+	LLAPRMappedFile				mFile;
+	const LLVOCacheIndexEntry*	mIndex;
+	S32							mNumEntries;
+	std::vector<bool>			mEvicted;		// empty until the first eviction
+	std::vector<S32>			mEvictOrder;	// entries by hit count, fewest first
+	S32							mNumEvicted;
+};
+
+class LLVOCacheWriter;
+
 //
 //Note: LLVOCache is not thread-safe
 //
@@ -108,8 +173,12 @@ public:
 	void initCache(ELLPath location, U32 size, U32 cache_version) ;
 	void removeCache(ELLPath location) ;
 
-	void readFromCache(U64 handle, const LLUUID& id, LLVOCacheEntry::vocache_entry_map_t& cache_entry_map) ;
-	void writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map, BOOL dirty_cache) ;
+	void readFromCache(U64 handle, const LLUUID& id, LLVOCacheRegionFile& cache_file) ;
+	// Entries in cache_entry_map replace those in cache_file.  The new file
+	// is packed here, then cache_file is closed and the writer thread
+	// writes the new one.
+	void writeToCache(U64 handle, const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map,
+					  LLVOCacheRegionFile& cache_file, BOOL dirty_cache) ;
 
 	void setReadOnly(BOOL read_only) {mReadOnly = read_only;} 
 
@@ -126,6 +195,10 @@ private:
 	BOOL updateEntry(const HeaderEntryInfo* entry);
 	BOOL checkRead(LLAPRFile* apr_file, void* src, S32 n_bytes) ;
 	BOOL checkWrite(LLAPRFile* apr_file, void* src, S32 n_bytes) ;
+	void packCacheFile(const LLUUID& id, const LLVOCacheEntry::vocache_entry_map_t& cache_entry_map,
+					   const LLVOCacheRegionFile& cache_file, std::vector<U8>& buffer) ;
+	// Blocks until the region's file is no longer being written
+	void waitForWrite(U64 handle) ;
 	
 private:
 	BOOL                 mInitialized ;
@@ -138,6 +211,8 @@ private:
 	LLVolatileAPRPool*   mLocalAPRFilePoolp ; 	
 	header_entry_queue_t mHeaderEntryQueue;
 	handle_entry_map_t   mHandleEntryMap;	
+	LLVOCacheWriter*     mWriter ;
+	std::map<U64, LLQueuedThread::handle_t> mPendingWrites ;
 
 	static LLVOCache* sInstance ;
 public:
@@ -62,12 +62,15 @@
 #include "llmediaentry.h"
 #include "llmediadataclient.h"
 #include "llagent.h"
+#include "llappviewer.h"
 #include "llviewermediafocus.h"
 
 const S32 MIN_QUIET_FRAMES_COALESCE = 30;
 const F32 FORCE_SIMPLE_RENDER_AREA = 512.f;
 const F32 FORCE_CULL_AREA = 8.f;
 const F32 MAX_LOD_DISTANCE = 24.f;
+// LODs the object would switch to this much nearer or farther are built ahead
+const F32 LOD_PREFETCH_MARGIN = 0.2f;
 
 
 BOOL gAnimateTextures = TRUE;
@@ -77,6 +80,7 @@ F32 LLVOVolume::sLODFactor = 1.f;
 F32	LLVOVolume::sLODSlopDistanceFactor = 0.5f; //Changing this to zero, effectively disables the LOD transition slop 
 F32 LLVOVolume::sDistanceFactor = 1.0f;
 S32 LLVOVolume::sNumLODChanges = 0;
+std::vector<LLVOVolume*> LLVOVolume::sLODPending;
 LLPointer<LLObjectMediaDataClient> LLVOVolume::sObjectMediaClient = NULL;
 LLPointer<LLObjectMediaNavigateClient> LLVOVolume::sObjectMediaNavigateClient = NULL;
 
@@ -199,6 +203,7 @@ LLVOVolume::LLVOVolume(const LLUUID &id, const LLPCode pcode, LLViewerRegion *re
 	mVObjRadius = LLVector3(1,1,0.5f).length();
 	mNumFaces = 0;
 	mLODChanged = FALSE;
+	mLODPending = FALSE;
 	mSculptChanged = FALSE;
 	mSpotLightPriority = 0.f;
 
@@ -215,6 +220,11 @@ LLVOVolume::~LLVOVolume()
 	delete mVolumeImpl;
 	mVolumeImpl = NULL;
 
+	if (mLODPending)
+	{
+		sLODPending.erase(std::find(sLODPending.begin(), sLODPending.end(), this));
+	}
+
 	if(!mMediaImplList.empty())
 	{
 		for(U32 i = 0 ; i < mMediaImplList.size() ; i++)
@@ -945,6 +955,15 @@ BOOL LLVOVolume::setVolume(const LLVolumeParams &volume_params, const S32 detail
 		}
 	}
 	
+	// New params are built here, on this thread, not on the volume build
+	// thread like LOD changes.  Callers rely on the new volume being in
+	// place when this returns: processUpdateMessage() unpacks the texture
+	// entries right after, and their count comes from the new volume's
+	// faces.  Keeping the old volume until a build finished would drop
+	// the entries of faces the old shape doesn't have.  The first volume
+	// of a new object and edits made in the build tools are needed at once
+	// as well.  Objects with the same params still share one build through
+	// their LOD group.
 	if ((LLPrimitive::setVolume(volume_params, mLOD, (mVolumeImpl && mVolumeImpl->isVolumeUnique()))) || mSculptChanged)
 	{
 		mFaceMappingChanged = TRUE;
@@ -1128,16 +1147,78 @@ BOOL LLVOVolume::calcLOD()
 
 	if (cur_detail != mLOD)
 	{
+		// Keep the current LOD until the new one is built
+		if (!requestLOD(cur_detail, FALSE))
+		{
+			return FALSE;
+		}
 		mAppAngle = llround((F32) atan2( mDrawable->getRadius(), mDrawable->mDistanceWRTCamera) * RAD_TO_DEG, 0.01f);
 		mLOD = cur_detail;		
 		return TRUE;
 	}
 	else
 	{
+		// Build the LODs it's about to switch to ahead of time
+		S32 nearer_detail = computeLODDetail(llround(distance * (1.f - LOD_PREFETCH_MARGIN), 0.01f),
+											 llround(radius, 0.01f));
+		S32 farther_detail = computeLODDetail(llround(distance * (1.f + LOD_PREFETCH_MARGIN), 0.01f),
+											  llround(radius, 0.01f));
+		if (nearer_detail != mLOD)
+		{
+			requestLOD(nearer_detail, TRUE);
+		}
+		if (farther_detail != mLOD)
+		{
+			requestLOD(farther_detail, TRUE);
+		}
 		return FALSE;
 	}
 }
 
+BOOL LLVOVolume::requestLOD(S32 detail, BOOL prefetch)
+{
+	// Sculpts and flexis still build in place
+	LLVolume* volumep = getVolume();
+	if (!volumep || volumep->isUnique() || isSculpted() || mVolumeImpl)
+	{
+		return TRUE;
+	}
+	if (getVolumeManager()->requestLOD(volumep->getParams(), detail, prefetch))
+	{
+		return TRUE;
+	}
+	if (!prefetch && !mLODPending)
+	{
+		mLODPending = TRUE;
+		sLODPending.push_back(this);
+	}
+	return FALSE;
+}
+
+//static
+void LLVOVolume::updateVolumeBuilds()
+{
+	LLVolumeMgr* volume_manager = getVolumeManager();
+	if (!volume_manager)
+	{
+		return;
+	}
+	volume_manager->updateBuilds();
+
+	// Their LOD may be built now, or not wanted any more
+	std::vector<LLVOVolume*> pending;
+	pending.swap(sLODPending);
+	for (std::vector<LLVOVolume*>::iterator iter = pending.begin(); iter != pending.end(); ++iter)
+	{
+		LLVOVolume* volumep = *iter;
+		volumep->mLODPending = FALSE;
+		if (!volumep->isDead())
+		{
+			volumep->updateLOD();
+		}
+	}
+}
+
 BOOL LLVOVolume::updateLOD()
 {
 	if (mDrawable.isNull())
@@ -3327,6 +3408,8 @@ void LLVolumeGeometryManager::getGeometry(LLSpatialGroup* group)
 
 }
 
+LLFaceGeomBatch LLVolumeGeometryManager::sGeomBatch;
+
 static LLFastTimer::DeclareTimer FTM_REBUILD_VOLUME_VB("Volume");
 static LLFastTimer::DeclareTimer FTM_REBUILD_VBO("VBO Rebuilt");
 
@@ -3535,6 +3618,8 @@ void LLVolumeGeometryManager::rebuildGeom(LLSpatialGroup* group)
 	genDrawInfo(group, fullbright_mask, fullbright_faces);
 	genDrawInfo(group, alpha_mask, alpha_faces, TRUE);
 
+	sGeomBatch.build(LLAppViewer::getJobPool());
+
 	if (!LLPipeline::sDelayVBUpdate)
 	{
 		//drawables have been rebuilt, clear rebuild status
@@ -3590,7 +3675,7 @@ void LLVolumeGeometryManager::rebuildMesh(LLSpatialGroup* group)
 					LLFace* face = drawablep->getFace(i);
 					if (face && face->mVertexBuffer.notNull())
 					{
-						face->getGeometryVolume(*volume, face->getTEOffset(), 
+						sGeomBatch.add(face, *volume, face->getTEOffset(), 
 							vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), face->getGeomIndex());
 					}
 				}
@@ -3598,6 +3683,8 @@ void LLVolumeGeometryManager::rebuildMesh(LLSpatialGroup* group)
 				drawablep->clearState(LLDrawable::REBUILD_ALL);
 			}
 		}
+
+		sGeomBatch.build(LLAppViewer::getJobPool());
 		
 		//unmap all the buffers
 		for (LLSpatialGroup::buffer_map_t::iterator i = group->mBufferMap.begin(); i != group->mBufferMap.end(); ++i)
@@ -3779,12 +3866,9 @@ void LLVolumeGeometryManager::genDrawInfo(LLSpatialGroup* group, U32 mask, std::
 
 					U32 te_idx = facep->getTEOffset();
 
-					if (facep->getGeometryVolume(*volume, te_idx, 
-						vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), index_offset))
-					{
-						buffer->markDirty(facep->getGeomIndex(), facep->getGeomCount(), 
-							facep->getIndicesStart(), facep->getIndicesCount());
-					}
+					//filled and marked dirty by sGeomBatch.build() in rebuildGeom()
+					sGeomBatch.add(facep, *volume, te_idx, 
+						vobj->getRelativeXform(), vobj->getRelativeXformInvTrans(), index_offset);
 				}
 			}
 
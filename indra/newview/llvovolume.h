@@ -273,9 +273,16 @@ public:
 	void removeMDCImpl() { --mMDCImplCount; }
 	S32 getMDCImplCount() { return mMDCImplCount; }
 	
+	// Hands finished volume builds over, and switches the objects that
+	// were waiting on them to their new LOD
+	static void updateVolumeBuilds();
+
 protected:
 	S32	computeLODDetail(F32	distance, F32 radius);
 	BOOL calcLOD();
+	// FALSE while detail is built on the volume build thread.  Only used
+	// for LOD changes, see setVolume() for param changes.
+	BOOL requestLOD(S32 detail, BOOL prefetch);
 	LLFace* addFace(S32 face_index);
 	void updateTEData();
 
@@ -293,6 +300,7 @@ private:
 	LLFrameTimer mTextureUpdateTimer;
 	S32			mLOD;
 	BOOL		mLODChanged;
+	BOOL		mLODPending;	// in sLODPending
 	BOOL		mSculptChanged;
 	F32			mSpotLightPriority;
 	LLMatrix4	mRelativeXform;
@@ -319,6 +327,8 @@ public:
 
 protected:
 	static S32 sNumLODChanges;
+	// Waiting on a LOD from the volume build thread
+	static std::vector<LLVOVolume*> sLODPending;
 	
 	friend class LLVolumeImplFlexible;
 };
@@ -1479,8 +1479,11 @@ void LLPipeline::updateMove()
 F32 LLPipeline::calcPixelArea(LLVector3 center, LLVector3 size, LLCamera &camera)
 {
 	LLVector3 lookAt = center - camera.getOrigin();
-	F32 dist = lookAt.length();
+	return calcPixelArea(lookAt.length(), size);
+}
 
+F32 LLPipeline::calcPixelArea(F32 dist, const LLVector3& size)
+{
 	//ramp down distance for nearby objects
 	//shrink dist by dist/16.
 	if (dist < 16.f)
@@ -1629,7 +1632,7 @@ void LLPipeline::updateCull(LLCamera& camera, LLCullResult& result, S32 water_cl
 			{
 				if (hasRenderType(part->mDrawableType))
 				{
-					part->cull(camera);
+					mCullBatch.add(part, camera);
 				}
 			}
 		}
@@ -1637,6 +1640,8 @@ void LLPipeline::updateCull(LLCamera& camera, LLCullResult& result, S32 water_cl
 
 	camera.disableUserClipPlane();
 
+	mCullBatch.cull();
+
 	if (gSky.mVOSkyp.notNull() && gSky.mVOSkyp->mDrawable.notNull())
 	{
 		// Hack for sky - always visible.
@@ -1822,13 +1827,21 @@ void LLPipeline::rebuildPriorityGroups()
 	mGroupQ1.clear();
 }
 		
+static LLFastTimer::DeclareTimer FTM_REBUILD_GROUPS("Rebuild Groups");
+
 void LLPipeline::rebuildGroups()
 {
+	LLFastTimer t(FTM_REBUILD_GROUPS);
+
 	// Iterate through some drawables on the non-priority build queue
 	S32 size = (S32) mGroupQ2.size();
 	S32 min_count = llclamp((S32) ((F32) (size * size)/4096*0.25f), 1, size);
 			
 	S32 count = 0;
+
+	// Whatever min_count says, stop once this frame's budget is spent
+	F32 max_time = gSavedSettings.getF32("RenderRebuildGroupTime") * 0.001f;
+	LLTimer rebuild_timer;
 	
 	std::sort(mGroupQ2.begin(), mGroupQ2.end(), LLSpatialGroup::CompareUpdateUrgency());
 
@@ -1852,7 +1865,8 @@ void LLPipeline::rebuildGroups()
 			
 		group->clearState(LLSpatialGroup::IN_BUILD_Q2);
 
-		if (count > min_count)
+		if (count > min_count ||
+			(max_time > 0.f && rebuild_timer.getElapsedTimeF32() > max_time))
 		{
 			++iter;
 			break;
@@ -5441,6 +5455,8 @@ void LLPipeline::resetVertexBuffers()
 
 	gSky.resetVertexBuffers();
 
+	gGL.resetVertexBuffers();
+
 	if (LLVertexBuffer::sGLCount > 0)
 	{
 		LLVertexBuffer::cleanupClass();
@@ -210,6 +210,7 @@ public:
 
 	//calculate pixel area of given box from vantage point of given camera
 	static F32 calcPixelArea(LLVector3 center, LLVector3 size, LLCamera& camera);
+	static F32 calcPixelArea(F32 dist, const LLVector3& size); // of a box of radius size at dist
 
 	void stateSort(LLCamera& camera, LLCullResult& result);
 	void stateSort(LLSpatialGroup* group, LLCamera& camera);
@@ -562,6 +563,8 @@ protected:
 	LLDrawable::drawable_vector_t mMovedBridge;
 	LLDrawable::drawable_vector_t	mShiftList;
 
+	LLSpatialCullBatch				mCullBatch;		// reused by updateCull()
+
 	/////////////////////////////////////////////
 	//
 	//
@@ -0,0 +1,302 @@
+/**
+ * @file lltexturecachearena_test.cpp
+ * @brief Tests and cache hit benchmark for LLTextureCacheArena
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+// Precompiled header: almost always required for newview cpp files
+#include "../llviewerprecompiledheaders.h"
+// Class to test
+#include "../lltexturecachearena.h"
+// Dependencies
+#include "llfile.h"
+#include "lltimer.h"
+
+#include <iostream>
+
+// Tut header
+#include "../test/lltut.h"
+
+namespace
+{
+	const char* ARENA_FILENAME = "lltexturecachearena_test.bodies";
+	const char* BENCH_DIRNAME = "lltexturecachearena_test_bodies";
+
+	LLUUID make_id(U32 n)
+	{
+		LLUUID id;
+		id.mData[0] = (U8)(n >> 24);
+		id.mData[1] = (U8)(n >> 16);
+		id.mData[2] = (U8)(n >> 8);
+		id.mData[3] = (U8)n;
+		id.mData[15] = 1; // never null
+		return id;
+	}
+
+	void fill_body(U8* data, S32 size, U32 n)
+	{
+		for (S32 i = 0; i < size; i++)
+		{
+			data[i] = (U8)(n * 31 + i);
+		}
+	}
+
+	bool check_body(const U8* data, S32 size, U32 n)
+	{
+		for (S32 i = 0; i < size; i++)
+		{
+			if (data[i] != (U8)(n * 31 + i))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	struct LLLiveBody
+	{
+		S32 mOffset;
+		S32 mSize;
+		U32 mN;
+	};
+}
+
+namespace tut
+{
+	struct texturecachearena_test
+	{
+		texturecachearena_test()
+		{
+			static bool init = false;
+			if (!init)
+			{
+				ll_init_apr();
+				init = true;
+			}
+			LLFile::remove(ARENA_FILENAME);
+		}
+		~texturecachearena_test()
+		{
+			LLFile::remove(ARENA_FILENAME);
+		}
+	};
+	typedef test_group<texturecachearena_test> texturecachearena_group_t;
+	typedef texturecachearena_group_t::object texturecachearena_object_t;
+	tut::texturecachearena_group_t texturecachearena_instance("LLTextureCacheArena");
+
+	template<> template<>
+	void texturecachearena_object_t::test<1>()
+		// wrapping evicts the oldest bodies, and only those
+	{
+		const S32 ARENA_SIZE = 256 * 1024;
+		LLTextureCacheArena arena;
+		ensure("open", arena.open(ARENA_FILENAME, ARENA_SIZE));
+		ensure("new arena", arena.wasReset());
+		ensure("capacity", arena.getCapacity() >= ARENA_SIZE);
+
+		std::map<LLUUID, LLLiveBody> live;
+		U32 r = 12345;
+		S32 evictions = 0;
+		for (U32 n = 0; n < 2000; n++)
+		{
+			r = r * 1103515245 + 12345;
+			S32 size = 1 + (S32)((r >> 8) % 20000);
+			LLUUID id = make_id(n);
+
+			std::vector<LLUUID> evicted;
+			S32 offset = arena.allocate(id, size, evicted);
+			ensure("allocated", offset >= 0);
+			fill_body(arena.getData(offset), size, n);
+
+			for (std::vector<LLUUID>::iterator iter = evicted.begin(); iter != evicted.end(); ++iter)
+			{
+				ensure("evicted a live body", live.erase(*iter) == 1);
+				evictions++;
+			}
+			LLLiveBody body = { offset, size, n };
+			live[id] = body;
+
+			if (n % 3 == 0 && live.size() > 4)
+			{
+				// release a body now and then, it must not come back as evicted
+				LLUUID victim = live.begin()->first;
+				arena.release(live.begin()->second.mOffset, victim);
+				ensure("released body invalid", !arena.isValid(live.begin()->second.mOffset, victim, live.begin()->second.mSize));
+				live.erase(live.begin());
+			}
+		}
+		ensure("wrapped", evictions > 0);
+
+		S32 usage = 0;
+		for (std::map<LLUUID, LLLiveBody>::iterator iter = live.begin(); iter != live.end(); ++iter)
+		{
+			const LLLiveBody& body = iter->second;
+			ensure("live body valid", arena.isValid(body.mOffset, iter->first, body.mSize));
+			ensure("live body intact", check_body(arena.getData(body.mOffset), body.mSize, body.mN));
+			ensure("wrong size invalid", !arena.isValid(body.mOffset, iter->first, body.mSize + 1));
+			usage += body.mSize;
+		}
+		ensure_equals("usage", arena.getUsage(), usage);
+		std::vector<LLUUID> evicted;
+		ensure("bigger than the arena", arena.allocate(make_id(99999), ARENA_SIZE + 1, evicted) < 0);
+	}
+
+	template<> template<>
+	void texturecachearena_object_t::test<2>()
+		// bodies survive a reopen at the same size, not at another one
+	{
+		const S32 ARENA_SIZE = 64 * 1024;
+		std::vector<LLUUID> evicted;
+		S32 offset;
+		{
+			LLTextureCacheArena arena;
+			ensure("open", arena.open(ARENA_FILENAME, ARENA_SIZE));
+			offset = arena.allocate(make_id(1), 1000, evicted);
+			fill_body(arena.getData(offset), 1000, 1);
+		}
+		{
+			LLTextureCacheArena arena;
+			ensure("reopen", arena.open(ARENA_FILENAME, ARENA_SIZE));
+			ensure("kept", !arena.wasReset());
+			ensure("valid", arena.isValid(offset, make_id(1), 1000));
+			ensure("intact", check_body(arena.getData(offset), 1000, 1));
+			ensure("stale offset", !arena.isValid(offset + 16, make_id(1), 1000));
+			ensure("other id", !arena.isValid(offset, make_id(2), 1000));
+		}
+		{
+			LLTextureCacheArena arena;
+			ensure("resize", arena.open(ARENA_FILENAME, ARENA_SIZE * 2));
+			ensure("reset", arena.wasReset());
+			ensure("gone", !arena.isValid(offset, make_id(1), 1000));
+			ensure_equals("empty", arena.getUsage(), 0);
+		}
+	}
+
+	template<> template<>
+	void texturecachearena_object_t::test<3>()
+		// the bodies next in line to be overwritten are stale
+	{
+		const S32 BODY_SIZE = 1000;
+		const S32 COUNT = 64;
+		LLTextureCacheArena arena;
+		ensure("open", arena.open(ARENA_FILENAME, COUNT * LLTextureCacheArena::getAllocationSize(BODY_SIZE)));
+
+		std::vector<S32> offsets;
+		std::vector<LLUUID> evicted;
+		for (S32 n = 0; n < COUNT; n++)
+		{
+			offsets.push_back(arena.allocate(make_id(n), BODY_SIZE, evicted));
+		}
+		ensure("no evictions yet", evicted.empty());
+		ensure("oldest stale", arena.isStale(offsets[0]));
+		ensure("newest fresh", !arena.isStale(offsets[COUNT - 1]));
+
+		arena.allocate(make_id(COUNT), BODY_SIZE, evicted);
+		ensure_equals("one eviction", (S32)evicted.size(), 1);
+		ensure("oldest evicted", evicted[0] == make_id(0));
+		ensure("second oldest stale", arena.isStale(offsets[1]));
+		ensure("wrapped body fresh", !arena.isStale(offsets[0]));
+	}
+
+	template<> template<>
+	void texturecachearena_object_t::test<4>()
+		// cache hit benchmark: a file per body against the mapped arena,
+		// with LL_BENCHMARKS only
+	{
+		if (!run_benchmarks())
+		{
+			return;
+		}
+		const S32 COUNT = 500;
+		const S32 BODY_SIZE = 32 * 1024;
+		const S32 HEADER_SIZE = 600;
+		const S32 PASSES = 4;
+
+		LLFile::mkdir(BENCH_DIRNAME);
+		std::string header_filename = std::string(BENCH_DIRNAME) + "/texture.cache";
+		std::vector<std::string> filenames;
+		std::vector<U8> body(BODY_SIZE);
+		std::vector<U8> header(HEADER_SIZE * COUNT);
+		LLAPRFile::writeEx(header_filename, &header[0], 0, (S32)header.size());
+
+		LLTextureCacheArena arena;
+		ensure("open", arena.open(ARENA_FILENAME, COUNT * LLTextureCacheArena::getAllocationSize(BODY_SIZE)));
+		std::vector<S32> offsets;
+		std::vector<LLUUID> evicted;
+		for (S32 n = 0; n < COUNT; n++)
+		{
+			fill_body(&body[0], BODY_SIZE, n);
+			filenames.push_back(llformat("%s/%d.texture", BENCH_DIRNAME, n));
+			LLAPRFile::writeEx(filenames.back(), &body[0], 0, BODY_SIZE);
+			S32 offset = arena.allocate(make_id(n), BODY_SIZE, evicted);
+			memcpy(arena.getData(offset), &body[0], BODY_SIZE);
+			offsets.push_back(offset);
+		}
+		ensure("all fit", evicted.empty());
+
+		// What LLTextureCacheRemoteWorker::doRead() does for a hit: the header
+		// record, then the size and contents of the body.
+		std::vector<U8> data(HEADER_SIZE + BODY_SIZE);
+		LLTimer timer;
+		for (S32 pass = 0; pass < PASSES; pass++)
+		{
+			for (S32 n = 0; n < COUNT; n++)
+			{
+				LLAPRFile::readEx(header_filename, &data[0], n * HEADER_SIZE, HEADER_SIZE);
+				S32 size = LLAPRFile::size(filenames[n]);
+				LLAPRFile::readEx(filenames[n], &data[HEADER_SIZE], 0, size);
+			}
+		}
+		F64 files_time = timer.getElapsedTimeF64();
+		ensure("files intact", check_body(&data[HEADER_SIZE], BODY_SIZE, COUNT - 1));
+
+		timer.reset();
+		for (S32 pass = 0; pass < PASSES; pass++)
+		{
+			for (S32 n = 0; n < COUNT; n++)
+			{
+				memcpy(&data[0], &header[n * HEADER_SIZE], HEADER_SIZE);
+				if (arena.isValid(offsets[n], make_id(n), BODY_SIZE))
+				{
+					memcpy(&data[HEADER_SIZE], arena.getData(offsets[n]), BODY_SIZE);
+				}
+			}
+		}
+		F64 arena_time = timer.getElapsedTimeF64();
+		ensure("arena intact", check_body(&data[HEADER_SIZE], BODY_SIZE, COUNT - 1));
+
+		const S32 hits = COUNT * PASSES;
+		std::cout << "\n" << hits << " warm cache hits of " << BODY_SIZE / 1024 << " KB:"
+				  << llformat("\nfile per body: %.2f us per hit", files_time * 1000000.0 / hits)
+				  << llformat("\nmapped arena:  %.2f us per hit, %.1fx", arena_time * 1000000.0 / hits,
+							  arena_time > 0.0 ? files_time / arena_time : 0.0)
+				  << std::endl;
+
+		for (S32 n = 0; n < COUNT; n++)
+		{
+			LLFile::remove(filenames[n]);
+		}
+		LLFile::remove(header_filename);
+		LLFile::rmdir(BENCH_DIRNAME);
+	}
+}
@@ -966,5 +966,108 @@ namespace tut
 		ensure_equals("Ensure unchanged buffer ", strlen(outBuffer), 0);
 		delete reader;
 	}
-}
 
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<46>()
+		// repeats with variable length members, read in any order
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		LLMessageBlock* block = new LLMessageBlock(_PREHASH_Test0, MBT_VARIABLE);
+		block->addVariable(_PREHASH_Test0, MVT_U32, 4);
+		block->addVariable(_PREHASH_Test1, MVT_VARIABLE, 1);
+		block->addVariable(_PREHASH_Test2, MVT_U16, 2);
+		messageTemplate.addBlock(block);
+		messageTemplate.addBlock(createBlock(_PREHASH_Test1, MVT_U32, 4, MBT_SINGLE));
+
+		const S32 REPEATS = 3;
+		const char* names[REPEATS] = { "a", "", "a longer one" };
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+		for (S32 i = 0; i < REPEATS; i++)
+		{
+			if (i)
+			{
+				builder->nextBlock(_PREHASH_Test0);
+			}
+			builder->addU32(_PREHASH_Test0, 1000 + i);
+			builder->addString(_PREHASH_Test1, names[i]);
+			builder->addU16(_PREHASH_Test2, 2000 + i);
+		}
+		builder->nextBlock(_PREHASH_Test1);
+		builder->addU32(_PREHASH_Test0, 0xbbbbbbbb);
+		LLTemplateMessageReader* reader = setReader(messageTemplate, builder);
+
+		ensure_equals("repeats", reader->getNumberOfBlocks(_PREHASH_Test0), REPEATS);
+		U32 tail;
+		reader->getU32(_PREHASH_Test1, _PREHASH_Test0, tail);
+		ensure_equals("block after the repeats", tail, 0xbbbbbbbb);
+		for (S32 i = REPEATS - 1; i >= 0; i--)
+		{
+			U16 u16;
+			U32 u32;
+			std::string name;
+			reader->getU16(_PREHASH_Test0, _PREHASH_Test2, u16, i);
+			reader->getString(_PREHASH_Test0, _PREHASH_Test1, name, i);
+			reader->getU32(_PREHASH_Test0, _PREHASH_Test0, u32, i);
+			ensure_equals("U16", u16, (U16)(2000 + i));
+			ensure_equals("string", name, std::string(names[i]));
+			ensure_equals("U32", u32, (U32)(1000 + i));
+			ensure_equals("string size", reader->getSize(_PREHASH_Test0, i, _PREHASH_Test1),
+						  (S32)strlen(names[i]) + 1);
+		}
+		ensure_equals("missing repeat", reader->getSize(_PREHASH_Test0, REPEATS, _PREHASH_Test1),
+					  LL_BLOCK_NOT_IN_MESSAGE);
+		ensure_equals("missing variable", reader->getSize(_PREHASH_Test1, _PREHASH_Test1),
+					  LL_VARIABLE_NOT_IN_BLOCK);
+		delete reader;
+	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<47>()
+		// zero coding expands back to the built message
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		messageTemplate.setEncoding(ME_ZEROCODED);
+		messageTemplate.addBlock(defaultBlock(MVT_U32, 4));
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+		// a long run of zeroes, then short ones between values
+		const S32 REPEATS = 120;
+		for (S32 i = 0; i < REPEATS; i++)
+		{
+			if (i)
+			{
+				builder->nextBlock(_PREHASH_Test0);
+			}
+			builder->addU32(_PREHASH_Test0, (i < 80 || i % 3) ? 0 : 0x01020300 + i);
+		}
+		const U32 bufferSize = 1024;
+		U8 buffer[bufferSize];
+		memset(buffer, 0, LL_PACKET_ID_SIZE);
+		U32 builtSize = builder->buildMessage(buffer, bufferSize, 0);
+		U8 original[bufferSize];
+		memcpy(original, buffer, builtSize);
+
+		U8* compressed = buffer;
+		U32 compressedSize = builtSize;
+		builder->compressMessage(compressed, compressedSize);
+		delete builder;
+		ensure("zero coded", (compressed[0] & LL_ZERO_CODE_FLAG) != 0);
+		ensure("smaller", compressedSize < builtSize);
+
+		U8 expanded[MAX_BUFFER_SIZE];
+		S32 expandedSize = zero_code_expand(compressed, compressedSize, expanded);
+		ensure_equals("expanded size", expandedSize, (S32)builtSize);
+		ensure("flag cleared", (expanded[0] & LL_ZERO_CODE_FLAG) == 0);
+		ensure("expanded data", memcmp(expanded, original, builtSize) == 0);
+
+		// runs of 255 zeroes that add up to more than a packet holds
+		U8 bomb[LL_PACKET_ID_SIZE + 80];
+		memset(bomb, 0, LL_PACKET_ID_SIZE);
+		bomb[0] = LL_ZERO_CODE_FLAG;
+		for (S32 i = LL_PACKET_ID_SIZE; i < (S32)sizeof(bomb); i += 2)
+		{
+			bomb[i] = 0;
+			bomb[i + 1] = 255;
+		}
+		ensure_equals("overflow", zero_code_expand(bomb, sizeof(bomb), expanded), -1);
+	}
+}
@@ -32,6 +32,7 @@
 #include "is_approx_equal_fraction.h" // instead of llmath.h
 
 #include <tut/tut.hpp>
+#include <cstdlib>
 #include <cstring>
 
 class LLDate;
@@ -130,6 +131,13 @@ namespace tut
 
 	void ensure_does_not_contain(const std::string& msg,
 		const std::string& actual, const std::string& expectedSubString);
+
+	// Timings differ from machine to machine and run to run, so tests only
+	// measure and print them when LL_BENCHMARKS is set in the environment
+	inline bool run_benchmarks()
+	{
+		return getenv("LL_BENCHMARKS") != NULL;
+	}
 }
 
 
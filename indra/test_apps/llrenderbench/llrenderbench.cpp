@@ -0,0 +1,295 @@
+/**
+ * @file llrenderbench.cpp
+ * @brief Times immediate mode UI drawing through LLRender, in a window of
+ *        the viewer's kind or on an offscreen Mesa context, and can save
+ *        the last frame for comparing output between builds.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <iostream>
+
+#include "llapr.h"
+#include "llgl.h"
+#include "llimage.h"
+#include "llimagetga.h"
+#include "llrender.h"
+#include "lltimer.h"
+#include "llvertexbuffer.h"
+#include "llwindow.h"
+#include "llwindowcallbacks.h"
+#if LL_MESA_HEADLESS
+#include "llwindowmesaheadless.h"
+#endif
+
+namespace
+{
+	const S32 NUM_TEXTURES = 8;
+	const S32 TEXTURE_SIZE = 64;
+	const S32 WIDGETS_PER_TEXTURE = 16;	// a floater's worth of icons
+	const S32 GLYPHS_PER_LABEL = 12;
+	const S32 WARMUP_FRAMES = 10;
+
+	void usage(const char* name)
+	{
+		std::cerr << "usage: " << name << " [options]\n"
+				  << "  --frames <n>       frames to time (default 500)\n"
+				  << "  --size <w> <h>     frame size (default 1024 768)\n"
+				  << "  --widgets <n>      widgets drawn per frame (default 2000)\n"
+				  << "  --no-vbo           draw from client arrays, as without RenderVBOEnable\n"
+				  << "  --capture <file>   save the last frame as a TGA\n";
+	}
+
+	void make_textures(std::vector<U32>& textures)
+	{
+		textures.resize(NUM_TEXTURES);
+		glGenTextures(NUM_TEXTURES, &textures[0]);
+
+		std::vector<U8> pixels(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+		for (S32 t = 0; t < NUM_TEXTURES; t++)
+		{
+			// A checker in a colour of its own, so a wrong bind shows in
+			// the capture
+			for (S32 y = 0; y < TEXTURE_SIZE; y++)
+			{
+				for (S32 x = 0; x < TEXTURE_SIZE; x++)
+				{
+					U8* p = &pixels[(y * TEXTURE_SIZE + x) * 4];
+					bool on = ((x / 8) + (y / 8)) & 1;
+					p[0] = on ? (U8)(t * 32) : 255;
+					p[1] = on ? (U8)(255 - t * 32) : 255;
+					p[2] = on ? (U8)((t & 1) * 255) : 255;
+					p[3] = 255;
+				}
+			}
+			gGL.getTexUnit(0)->bindManual(LLTexUnit::TT_TEXTURE, textures[t]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TEXTURE_SIZE, TEXTURE_SIZE, 0,
+						 GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+		}
+		gGL.getTexUnit(0)->unbind(LLTexUnit::TT_TEXTURE);
+	}
+
+	// Roughly what a busy UI frame sends through LLRender: runs of widgets
+	// sharing a texture, each a background quad and a label of one quad
+	// per glyph, placed with the UI matrix, with the redundant state sets
+	// that LLUI draws make around them.
+	void draw_frame(S32 width, S32 height, S32 widgets, const std::vector<U32>& textures, S32 frame)
+	{
+		glClear(GL_COLOR_BUFFER_BIT);
+		LLTexUnit* unit = gGL.getTexUnit(0);
+		for (S32 i = 0; i < widgets; i++)
+		{
+			unit->bindManual(LLTexUnit::TT_TEXTURE, textures[(i / WIDGETS_PER_TEXTURE) % NUM_TEXTURES]);
+			gGL.setColorMask(true, true);
+			gGL.setAlphaRejectSettings(LLRender::CF_DEFAULT);
+
+			gGL.pushUIMatrix();
+			gGL.translateUI((F32)((i * 37 + frame) % width), (F32)((i * 53) % height), 0.f);
+
+			gGL.color4ub(255, 255, 255, 200);
+			gGL.begin(LLRender::QUADS);
+			{
+				gGL.texCoord2f(0.f, 1.f);
+				gGL.vertex2i(0, 16);
+				gGL.texCoord2f(0.f, 0.f);
+				gGL.vertex2i(0, 0);
+				gGL.texCoord2f(1.f, 0.f);
+				gGL.vertex2i(96, 0);
+				gGL.texCoord2f(1.f, 1.f);
+				gGL.vertex2i(96, 16);
+			}
+			gGL.end();
+
+			gGL.color4ub(0, 0, 0, 255);
+			gGL.begin(LLRender::QUADS);
+			for (S32 g = 0; g < GLYPHS_PER_LABEL; g++)
+			{
+				const F32 u = (F32)(g % 8) / 8.f;
+				const S32 x = 4 + g * 7;
+				gGL.texCoord2f(u, 1.f);
+				gGL.vertex2i(x, 13);
+				gGL.texCoord2f(u, 0.f);
+				gGL.vertex2i(x, 3);
+				gGL.texCoord2f(u + 0.125f, 0.f);
+				gGL.vertex2i(x + 6, 3);
+				gGL.texCoord2f(u + 0.125f, 1.f);
+				gGL.vertex2i(x + 6, 13);
+			}
+			gGL.end();
+
+			gGL.popUIMatrix();
+		}
+		gGL.flush();
+	}
+
+	bool save_frame(S32 width, S32 height, const std::string& filename)
+	{
+		LLPointer<LLImageRaw> raw = new LLImageRaw(width, height, 4);
+#if !LL_MESA_HEADLESS
+		// The frame has been swapped to the front
+		glReadBuffer(GL_FRONT);
+#endif
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, raw->getData());
+		LLPointer<LLImageTGA> tga = new LLImageTGA;
+		return tga->encode(raw) && tga->save(filename);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	S32 frames = 500;
+	S32 width = 1024;
+	S32 height = 768;
+	S32 widgets = 2000;
+	bool use_vbo = true;
+	std::string capture_file;
+	for (S32 i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc)
+		{
+			frames = atoi(argv[++i]);
+		}
+		else if (arg == "--size" && i + 2 < argc)
+		{
+			width = atoi(argv[++i]);
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--widgets" && i + 1 < argc)
+		{
+			widgets = atoi(argv[++i]);
+		}
+		else if (arg == "--no-vbo")
+		{
+			use_vbo = false;
+		}
+		else if (arg == "--capture" && i + 1 < argc)
+		{
+			capture_file = argv[++i];
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (frames <= 0 || width <= 0 || height <= 0 || widgets < 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	ll_init_apr();
+	LLImage::initClass();
+
+	// Makes the GL context current and runs gGLManager.initGL()
+	LLWindowCallbacks callbacks;
+#if LL_MESA_HEADLESS
+	LLWindowMesaHeadless* window = new LLWindowMesaHeadless(&callbacks, "llrenderbench", "llrenderbench",
+															0, 0, width, height, 0, FALSE, FALSE,
+															TRUE, TRUE, FALSE);
+#else
+	// vsync off, so swapping does not hold frames to the refresh rate
+	LLWindow* window = LLWindowManager::createWindow(&callbacks, "llrenderbench", "llrenderbench",
+													 0, 0, width, height, 0, FALSE, FALSE,
+													 TRUE, TRUE, FALSE);
+	if (!window)
+	{
+		std::cerr << "Can't open a " << width << "x" << height << " GL window" << std::endl;
+		return 1;
+	}
+#endif
+	use_vbo = use_vbo && gGLManager.mHasVertexBufferObject;
+	LLVertexBuffer::initClass(use_vbo);
+	gGL.refreshState();
+
+	glViewport(0, 0, width, height);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0, width, 0.0, height, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glClearColor(0.2f, 0.2f, 0.3f, 1.f);
+
+	std::vector<U32> textures;
+	make_textures(textures);
+
+	F64 total = 0.0;
+	F64 fastest = 0.0;
+	F64 slowest = 0.0;
+	{
+		LLGLEnable blend(GL_BLEND);
+		gGL.setSceneBlendType(LLRender::BT_ALPHA);
+
+		LLTimer timer;
+		for (S32 frame = -WARMUP_FRAMES; frame < frames; frame++)
+		{
+			if (frame == 0)
+			{
+				LLRender::sCalls = LLRender::sVerts = 0;
+			}
+			timer.reset();
+			draw_frame(width, height, widgets, textures, frame);
+			window->swapBuffers();
+			glFinish();
+			F64 elapsed = timer.getElapsedTimeF64();
+			if (frame >= 0)
+			{
+				total += elapsed;
+				fastest = (frame == 0) ? elapsed : llmin(fastest, elapsed);
+				slowest = llmax(slowest, elapsed);
+			}
+		}
+	}
+
+	std::cout << "frames " << frames << " at " << width << "x" << height
+			  << ", " << widgets << " widgets, " << (use_vbo ? "stream VBO" : "client arrays") << "\n"
+			  << "ms per frame: avg " << total * 1000.0 / frames
+			  << " min " << fastest * 1000.0 << " max " << slowest * 1000.0 << "\n"
+			  << "per frame: " << LLRender::sCalls / frames << " draw calls, "
+			  << LLRender::sVerts / frames << " verts" << std::endl;
+
+	S32 result = 0;
+	if (!capture_file.empty() && !save_frame(width, height, capture_file))
+	{
+		std::cerr << "Can't save the frame to " << capture_file << std::endl;
+		result = 1;
+	}
+
+	gGL.getTexUnit(0)->unbind(LLTexUnit::TT_TEXTURE);
+	glDeleteTextures(NUM_TEXTURES, &textures[0]);
+	gGL.resetVertexBuffers();
+	LLVertexBuffer::cleanupClass();
+	gGL.shutdown();
+#if LL_MESA_HEADLESS
+	delete window;
+#else
+	LLWindowManager::destroyWindow(window);
+#endif
+
+	LLImage::cleanupClass();
+	return result;
+}
@@ -0,0 +1,533 @@
+/**
+ * @file lltexturefetchreplay.cpp
+ * @brief Replays a texture fetch trace recorded by the viewer (see the
+ *        TextureFetchTraceFile setting) against the real LLTextureFetch,
+ *        LLTextureCache and LLImageDecodeThread, and reports how long
+ *        textures took to reach full resolution.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "llapr.h"
+#include "llcontrol.h"
+#include "llcurl.h"
+#include "lldir.h"
+#include "llimage.h"
+#include "llimagedxt.h"
+#include "llimagej2c.h"
+#include "llimageworker.h"
+#include "lllfsthread.h"
+#include "llvfsthread.h"
+
+#include "lltexturecache.h"
+#include "lltexturefetch.h"
+#include "llviewercontrol.h"
+#include "llviewertexturelist.h"
+
+namespace
+{
+	const F32 FRAME_TIME = 1.f / 60.f;
+
+	struct LLReplayEvent
+	{
+		enum EType { CREATE, PRIORITY, DELETE };
+
+		F64 mTime;
+		EType mType;
+		LLUUID mID;
+		F32 mPriority;
+		S32 mDiscard;
+		S32 mWidth;
+		S32 mHeight;
+		S32 mComponents;
+		bool mNeedsAux;
+		bool mCanUseHTTP;
+		std::string mURL;	// recorded with the create, may be empty
+	};
+
+	struct LLReplayTexture
+	{
+		LLReplayTexture()
+			: mFetching(false), mHasPending(false), mFullDiscard(MAX_DISCARD_LEVEL + 1), mDiscard(-1),
+			  mStartTime(-1.0), mFullTime(-1.0), mRequests(0), mCacheHits(0)
+		{
+		}
+
+		bool mFetching;
+		// The create that came in while the one before it was in flight,
+		// issued once that one finishes. Only the latest one is kept.
+		bool mHasPending;
+		LLReplayEvent mPending;
+		S32 mFullDiscard;	// lowest discard the trace ever asks for
+		S32 mDiscard;		// best discard received, -1 for none yet
+		F64 mStartTime;		// when the first create was issued
+		F64 mFullTime;		// when mFullDiscard was reached
+		S32 mRequests;
+		S32 mCacheHits;
+	};
+
+	typedef std::map<LLUUID, LLReplayTexture> texture_map_t;
+
+	void usage(const char* name)
+	{
+		std::cerr << "usage: " << name << " --trace <file> [options]\n"
+				  << "  --trace <file>     trace recorded with the TextureFetchTraceFile setting\n"
+				  << "  --url <base url>   fetch from <base url><uuid>.j2c instead of the urls in\n"
+				  << "                     the trace, needed for traces without urls\n"
+				  << "  --cache <dir>      texture cache directory (default lltexturefetchreplay_cache)\n"
+				  << "  --cache-size <MB>  texture cache size (default 512)\n"
+				  << "  --purge            start from an empty cache\n"
+				  << "  --speed <factor>   replay the trace this many times faster (default 1)\n"
+				  << "  --timeout <secs>   give up on what is still loading after this long (default 120)\n"
+				  << "  --settings <file>  settings.xml to read the viewer settings from\n";
+	}
+
+	bool read_trace(const std::string& filename, std::vector<LLReplayEvent>& events)
+	{
+		llifstream file(filename.c_str());
+		if (!file.is_open())
+		{
+			std::cerr << "Can't open trace " << filename << std::endl;
+			return false;
+		}
+		std::string line;
+		S32 line_num = 0;
+		while (std::getline(file, line))
+		{
+			line_num++;
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+			std::istringstream fields(line);
+			std::string type;
+			std::string id;
+			LLReplayEvent event;
+			fields >> event.mTime >> type >> id;
+			event.mID.set(id);
+			event.mPriority = 0.f;
+			event.mDiscard = 0;
+			event.mWidth = event.mHeight = event.mComponents = 0;
+			event.mNeedsAux = false;
+			event.mCanUseHTTP = true;
+			if (type == "create")
+			{
+				S32 needs_aux = 0;
+				S32 can_use_http = 1;
+				event.mType = LLReplayEvent::CREATE;
+				fields >> event.mPriority >> event.mDiscard >> event.mWidth >> event.mHeight
+					   >> event.mComponents >> needs_aux >> can_use_http;
+				event.mNeedsAux = needs_aux != 0;
+				event.mCanUseHTTP = can_use_http != 0;
+				// Older traces end before the url
+				std::string url;
+				if (!fields.fail() && !(fields >> url))
+				{
+					fields.clear();
+				}
+				if (!url.empty() && url != "-")
+				{
+					event.mURL = url;
+				}
+			}
+			else if (type == "priority")
+			{
+				event.mType = LLReplayEvent::PRIORITY;
+				fields >> event.mPriority;
+			}
+			else if (type == "delete")
+			{
+				event.mType = LLReplayEvent::DELETE;
+			}
+			else
+			{
+				fields.setstate(std::ios::failbit);
+			}
+			if (fields.fail() || event.mID.isNull())
+			{
+				std::cerr << filename << ":" << line_num << ": bad trace line" << std::endl;
+				return false;
+			}
+			events.push_back(event);
+		}
+		return true;
+	}
+
+	F64 percentile(const std::vector<F64>& sorted, F64 fraction)
+	{
+		if (sorted.empty())
+		{
+			return 0.0;
+		}
+		return sorted[(size_t)((sorted.size() - 1) * fraction + 0.5)];
+	}
+}
+
+// Nobody is logged in: there are no regions, every request carries its url
+class LLReplayTextureFetchRegions : public LLTextureFetchRegions
+{
+public:
+	/*virtual*/ std::string getHttpUrl(const LLHost& host)
+	{
+		return LLStringUtil::null;
+	}
+
+	/*virtual*/ LLHost getAgentRegionHost()
+	{
+		return LLHost::invalid;
+	}
+};
+
+class LLTextureFetchReplay
+{
+public:
+	LLTextureFetchReplay(LLTextureFetch* fetch, const std::string& url, F64 speed)
+		: mFetch(fetch), mURL(url), mSpeed(speed), mActive(0), mTextureBytes(0)
+	{
+	}
+
+	// Replays events until they are all issued and nothing is loading any
+	// more, or until timeout seconds have passed after the last one. Times
+	// here and in the report are wall clock, the trace is sped up instead.
+	// Returns the time spent.
+	F64 run(const std::vector<LLReplayEvent>& events, F64 timeout,
+			LLTextureCache* cache, LLImageDecodeThread* decode)
+	{
+		for (std::vector<LLReplayEvent>::const_iterator iter = events.begin(); iter != events.end(); ++iter)
+		{
+			if (iter->mType == LLReplayEvent::CREATE)
+			{
+				LLReplayTexture& texture = mTextures[iter->mID];
+				texture.mFullDiscard = llmin(texture.mFullDiscard, iter->mDiscard);
+			}
+		}
+
+		LLTimer timer;
+		F64 now = 0.0;
+		F64 end_time = events.empty() ? 0.0 : events.back().mTime / mSpeed + timeout;
+		size_t next = 0;
+		LLTextureFetch::request_priority_list_t priorities;
+		while (next < events.size() || mActive > 0)
+		{
+			now = timer.getElapsedTimeF64();
+			if (now > end_time)
+			{
+				break;
+			}
+
+			// Events due this frame, in the order the viewer made them
+			while (next < events.size() && events[next].mTime / mSpeed <= now)
+			{
+				const LLReplayEvent& event = events[next++];
+				LLReplayTexture& texture = mTextures[event.mID];
+				switch (event.mType)
+				{
+				case LLReplayEvent::CREATE:
+					if (texture.mFetching)
+					{
+						// Closed loop: wait for the request in flight
+						texture.mPending = event;
+						texture.mHasPending = true;
+					}
+					else
+					{
+						create(texture, event, now);
+					}
+					break;
+				case LLReplayEvent::PRIORITY:
+					if (texture.mFetching)
+					{
+						priorities.push_back(std::make_pair(event.mID, event.mPriority));
+					}
+					break;
+				case LLReplayEvent::DELETE:
+					mFetch->deleteRequest(event.mID, true);
+					if (texture.mFetching)
+					{
+						texture.mFetching = false;
+						mActive--;
+					}
+					texture.mHasPending = false;
+					break;
+				}
+			}
+			if (!priorities.empty())
+			{
+				mFetch->updateRequestPriorities(priorities);
+				priorities.clear();
+			}
+
+			// What LLAppViewer::updateTextureThreads() does each frame
+			cache->update(1);
+			decode->update(1);
+			mFetch->update(1);
+			mTextureBytes += LLViewerTextureList::sTextureBits / 8;
+			LLViewerTextureList::sTextureBits = 0;
+
+			for (texture_map_t::iterator iter = mTextures.begin(); iter != mTextures.end(); ++iter)
+			{
+				LLReplayTexture& texture = iter->second;
+				if (texture.mFetching)
+				{
+					checkFinished(iter->first, texture, now);
+				}
+				if (!texture.mFetching && texture.mHasPending)
+				{
+					texture.mHasPending = false;
+					create(texture, texture.mPending, now);
+				}
+			}
+
+			ms_sleep((U32)(FRAME_TIME * 1000.f));
+		}
+		return now;
+	}
+
+	void report(F64 elapsed, std::ostream& out) const
+	{
+		std::vector<F64> times;
+		S32 requested = 0;
+		S32 requests = 0;
+		S32 cache_hits = 0;
+		for (texture_map_t::const_iterator iter = mTextures.begin(); iter != mTextures.end(); ++iter)
+		{
+			const LLReplayTexture& texture = iter->second;
+			if (texture.mStartTime < 0.0)
+			{
+				continue;
+			}
+			requested++;
+			requests += texture.mRequests;
+			cache_hits += texture.mCacheHits;
+			if (texture.mFullTime >= 0.0)
+			{
+				times.push_back(texture.mFullTime - texture.mStartTime);
+			}
+		}
+		std::sort(times.begin(), times.end());
+
+		F64 decode_secs = LLImageDecodeThread::getDecodeMicroseconds() / 1000000.0;
+		U32 decodes = LLImageDecodeThread::getDecodeCount();
+
+		out << llformat("Replayed %d textures, %d requests in %.1f s\n", requested, requests, elapsed)
+			<< llformat("Time to full resolution (%d of %d reached it): p50 %.3f s, p90 %.3f s, p99 %.3f s, max %.3f s\n",
+						(S32)times.size(), requested, percentile(times, 0.5), percentile(times, 0.9),
+						percentile(times, 0.99), times.empty() ? 0.0 : times.back())
+			<< llformat("Fetched: %.1f KB over HTTP\n", mTextureBytes / 1024.0)
+			<< llformat("Cache hits: %d of %d requests (%.1f%%)\n", cache_hits, requests,
+						requests ? 100.0 * cache_hits / requests : 0.0)
+			<< llformat("Decode: %.3f s of CPU for %u images (%.2f ms each)\n", decode_secs, decodes,
+						decodes ? decode_secs * 1000.0 / decodes : 0.0);
+	}
+
+private:
+	void create(LLReplayTexture& texture, const LLReplayEvent& event, F64 now)
+	{
+		std::string url = mURL.empty() ? event.mURL : mURL + event.mID.asString() + ".j2c";
+		if (!mFetch->createRequest(url, event.mID, LLHost::invalid, event.mPriority,
+								   event.mWidth, event.mHeight, event.mComponents, event.mDiscard,
+								   event.mNeedsAux, event.mCanUseHTTP))
+		{
+			// An aborted request is still winding down, try again next frame
+			texture.mPending = event;
+			texture.mHasPending = true;
+			return;
+		}
+		if (texture.mStartTime < 0.0)
+		{
+			texture.mStartTime = now;
+		}
+		texture.mFetching = true;
+		texture.mRequests++;
+		mActive++;
+	}
+
+	void checkFinished(const LLUUID& id, LLReplayTexture& texture, F64 now)
+	{
+		S32 discard = -1;
+		LLPointer<LLImageRaw> raw;
+		LLPointer<LLImageRaw> aux;
+		LLPointer<LLImageDXT> compressed;
+		if (!mFetch->getRequestFinished(id, discard, raw, aux, compressed))
+		{
+			return;
+		}
+		texture.mFetching = false;
+		mActive--;
+		if (mFetch->isFromLocalCache(id))
+		{
+			texture.mCacheHits++;
+		}
+		if ((raw.notNull() || compressed.notNull()) && discard >= 0 &&
+			(texture.mDiscard < 0 || discard < texture.mDiscard))
+		{
+			texture.mDiscard = discard;
+			if (discard <= texture.mFullDiscard && texture.mFullTime < 0.0)
+			{
+				texture.mFullTime = now;
+			}
+		}
+	}
+
+private:
+	LLTextureFetch* mFetch;
+	std::string mURL;
+	F64 mSpeed;
+	texture_map_t mTextures;
+	S32 mActive;
+	U64 mTextureBytes;
+};
+
+int main(int argc, char** argv)
+{
+	std::string trace_file;
+	std::string url;
+	std::string cache_dir = "lltexturefetchreplay_cache";
+	std::string settings_file = LL_REPLAY_SETTINGS_FILE;
+	S64 cache_size = 512;
+	bool purge = false;
+	F64 speed = 1.0;
+	F64 timeout = 120.0;
+	for (S32 i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--purge")
+		{
+			purge = true;
+		}
+		else if (arg == "--trace" && has_value)
+		{
+			trace_file = argv[++i];
+		}
+		else if (arg == "--url" && has_value)
+		{
+			url = argv[++i];
+		}
+		else if (arg == "--cache" && has_value)
+		{
+			cache_dir = argv[++i];
+		}
+		else if (arg == "--cache-size" && has_value)
+		{
+			cache_size = atoi(argv[++i]);
+		}
+		else if (arg == "--speed" && has_value)
+		{
+			speed = atof(argv[++i]);
+		}
+		else if (arg == "--timeout" && has_value)
+		{
+			timeout = atof(argv[++i]);
+		}
+		else if (arg == "--settings" && has_value)
+		{
+			settings_file = argv[++i];
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (trace_file.empty() || speed <= 0.0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (!url.empty() && url[url.size() - 1] != '/')
+	{
+		url += '/';
+	}
+
+	std::vector<LLReplayEvent> events;
+	if (!read_trace(trace_file, events))
+	{
+		return 1;
+	}
+	if (url.empty())
+	{
+		for (std::vector<LLReplayEvent>::iterator iter = events.begin(); iter != events.end(); ++iter)
+		{
+			if (iter->mType == LLReplayEvent::CREATE && iter->mURL.empty())
+			{
+				std::cerr << "Trace has requests without a url, give --url" << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	ll_init_apr();
+	LLCurl::initClass();
+	gDirUtilp->initAppDirs("SecondLife");
+	gDirUtilp->setCacheDir(cache_dir);
+	if (!gSavedSettings.loadFromFile(settings_file))
+	{
+		std::cerr << "Can't read settings from " << settings_file << std::endl;
+		return 1;
+	}
+
+	// Same threads as LLAppViewer::initThreads()
+	LLVFSThread::initClass(false);
+	LLLFSThread::initClass(false);
+	const bool concurrent_queues = gSavedSettings.getBOOL("ThreadConcurrentQueues");
+	LLImageDecodeThread* decode = new LLImageDecodeThread(true, concurrent_queues,
+														  gSavedSettings.getS32("ThreadPoolImageDecode"));
+	LLTextureCache* cache = new LLTextureCache(true, concurrent_queues,
+											   gSavedSettings.getS32("ThreadPoolTextureCache"));
+	LLTextureFetch* fetch = new LLTextureFetch(new LLReplayTextureFetchRegions, cache, decode, true, concurrent_queues);
+	LLImage::initClass();
+
+	if (purge)
+	{
+		cache->purgeCache(LL_PATH_CACHE);
+	}
+	cache->initCache(LL_PATH_CACHE, cache_size * 1024 * 1024, FALSE);
+
+	F64 elapsed;
+	{
+		LLTextureFetchReplay replay(fetch, url, speed);
+		elapsed = replay.run(events, timeout, cache, decode);
+		replay.report(elapsed, std::cout);
+	}
+
+	// Same order as LLAppViewer::cleanup()
+	cache->shutdown();
+	fetch->shutdown();
+	decode->shutdown();
+	fetch->shutDownTextureCacheThread();
+	fetch->shutDownImageDecodeThread();
+	delete cache;
+	delete fetch;
+	delete decode;
+	LLImage::cleanupClass();
+	LLVFSThread::cleanupClass();
+	LLLFSThread::cleanupClass();
+	LLCurl::cleanupClass();
+	return 0;
+}
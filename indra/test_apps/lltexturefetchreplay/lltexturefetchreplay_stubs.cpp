@@ -0,0 +1,65 @@
+/**
+ * @file lltexturefetchreplay_stubs.cpp
+ * @brief Stand-ins for the viewer globals that LLTextureFetch and
+ *        LLTextureCache reach for, so they can run outside the viewer.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llagentdata.h"
+#include "llappviewer.h"
+#include "llcontrol.h"
+#include "lltexturestats.h"
+#include "llviewertexturelist.h"
+
+// Only the members the fetch pipeline calls are defined here, against the
+// viewer's own headers, for classes whose sources aren't built in.  The
+// agent and the world are reached through LLTextureFetchRegions instead,
+// see lltexturefetchreplay.cpp.
+
+// Settings come from newview/app_settings/settings.xml, see main()
+LLControlGroup gSavedSettings("Global");
+
+// Nobody is logged in, so no UDP fetches go out with these
+LLUUID gAgentID;
+LLUUID gAgentSessionID;
+
+// LLTextureCache::purgeTextures() checks for NULL
+LLAppViewer* LLAppViewer::sInstance = NULL;
+
+void LLAppViewer::pauseMainloopTimeout()
+{
+}
+
+void LLAppViewer::resumeMainloopTimeout(const std::string& state, F32 secs)
+{
+}
+
+// LLTextureFetch adds the bits it receives over HTTP here, the replay reads
+// them back each frame
+U32 LLViewerTextureList::sTextureBits = 0;
+
+void send_texture_stats_to_sim(const LLSD& texture_stats)
+{
+}
@@ -0,0 +1,188 @@
+#!/usr/bin/python
+"""\
+@file   texture_server.py
+@brief  Serves <dir>/<uuid>.j2c over HTTP/1.1 with Range support, as a
+        stand-in for the texture capability when running
+        lltexturefetchreplay. Optionally holds every response back one
+        round trip time and shares one link of limited bandwidth between
+        all of them, like test_llhttppipeline_peer.py does.
+
+        texture_server.py [--port N] [--rtt SECONDS] [--bandwidth BYTES_PER_SEC] DIR
+
+$LicenseInfo:firstyear=2010&license=viewerlgpl$
+Second Life Viewer Source Code
+Copyright (C) 2010, Linden Research, Inc.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation;
+version 2.1 of the License only.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+$/LicenseInfo$
+"""
+
+import optparse
+import os
+import re
+import socket
+import sys
+import time
+from threading import Thread, Lock, Condition
+
+class Link(object):
+    """The shared bottleneck: responses go out one after the other."""
+    def __init__(self, bandwidth):
+        self.lock = Lock()
+        self.free_at = 0.0
+        self.bandwidth = bandwidth
+
+    def reserve(self, due, size):
+        if not self.bandwidth:
+            return due
+        self.lock.acquire()
+        try:
+            start = max(due, self.free_at)
+            self.free_at = start + float(size) / self.bandwidth
+            return self.free_at
+        finally:
+            self.lock.release()
+
+class Connection(object):
+    def __init__(self, sock, options, link):
+        self.sock = sock
+        self.rfile = sock.makefile('rb')
+        self.options = options
+        self.link = link
+        self.pending = []
+        self.cond = Condition()
+        self.closed = False
+
+    def start(self):
+        reader = Thread(target=self.read_requests)
+        writer = Thread(target=self.write_responses)
+        reader.setDaemon(True)
+        writer.setDaemon(True)
+        reader.start()
+        writer.start()
+
+    def read_requests(self):
+        # a new connection costs a round trip before the first request arrives
+        time.sleep(self.options.rtt)
+        try:
+            while True:
+                line = self.rfile.readline()
+                if not line:
+                    break
+                request = line.decode('latin-1').split()
+                headers = {}
+                while True:
+                    line = self.rfile.readline().decode('latin-1').strip()
+                    if not line:
+                        break
+                    name, _, value = line.partition(':')
+                    headers[name.strip().lower()] = value.strip()
+                self.cond.acquire()
+                self.pending.append((time.time() + self.options.rtt, request, headers))
+                self.cond.notify()
+                self.cond.release()
+        except socket.error:
+            pass
+        self.cond.acquire()
+        self.closed = True
+        self.cond.notify()
+        self.cond.release()
+
+    def write_responses(self):
+        while True:
+            self.cond.acquire()
+            while not self.pending and not self.closed:
+                self.cond.wait()
+            if not self.pending:
+                self.cond.release()
+                break
+            due, request, headers = self.pending.pop(0)
+            self.cond.release()
+            response = self.answer(request, headers)
+            done = self.link.reserve(due, len(response))
+            delay = done - time.time()
+            if delay > 0:
+                time.sleep(delay)
+            try:
+                self.sock.sendall(response)
+            except socket.error:
+                break
+        try:
+            self.sock.close()
+        except socket.error:
+            pass
+
+    def answer(self, request, headers):
+        match = None
+        if len(request) >= 2 and request[0] == "GET":
+            match = re.match(r"/([0-9a-fA-F-]{36})\.j2c$", request[1])
+        path = match and os.path.join(self.options.dir, match.group(1).lower() + ".j2c")
+        if not path or not os.path.isfile(path):
+            return ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n").encode('latin-1')
+        f = open(path, 'rb')
+        try:
+            data = f.read()
+        finally:
+            f.close()
+        size = len(data)
+        start, end = 0, size
+        status = "200 OK"
+        extra = ""
+        match = re.match(r"bytes=(\d+)-(\d*)$", headers.get("range", ""))
+        if match:
+            start = int(match.group(1))
+            if match.group(2):
+                end = min(size, int(match.group(2)) + 1)
+            if start >= size:
+                return ("HTTP/1.1 416 Requested Range Not Satisfiable\r\n"
+                        "Content-Range: bytes */%d\r\nContent-Length: 0\r\n\r\n" % size).encode('latin-1')
+            status = "206 Partial Content"
+            extra = "Content-Range: bytes %d-%d/%d\r\n" % (start, end - 1, size)
+        head = ("HTTP/1.1 %s\r\nContent-Type: image/x-j2c\r\n%sContent-Length: %d\r\n\r\n"
+                % (status, extra, end - start))
+        return head.encode('latin-1') + data[start:end]
+
+def main():
+    parser = optparse.OptionParser(usage="%prog [options] DIR")
+    parser.add_option("--port", type="int", default=12046,
+                      help="port to listen on, 127.0.0.1 only (default %default)")
+    parser.add_option("--rtt", type="float", default=0.0,
+                      help="seconds every response is held back (default %default)")
+    parser.add_option("--bandwidth", type="float", default=0.0,
+                      help="bytes per second shared by all responses, 0 for no limit (default %default)")
+    options, args = parser.parse_args()
+    if len(args) != 1 or not os.path.isdir(args[0]):
+        parser.error("need the directory the textures are in")
+    options.dir = args[0]
+
+    link = Link(options.bandwidth)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('127.0.0.1', options.port))
+    sock.listen(128)
+    sys.stderr.write("Serving %s as http://127.0.0.1:%d/\n" % (options.dir, options.port))
+    try:
+        while True:
+            conn, addr = sock.accept()
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            Connection(conn, options, link).start()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())